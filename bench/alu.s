@@ -0,0 +1,18 @@
+# Tight ALU loop: register-only arithmetic, logic and shifts, 3M iterations of 10 instructions
+    li t0, 3000000
+    li a0, 1
+    li a1, 0x9E3779B9
+    li a2, 0
+loop:
+    add a2, a2, a0
+    xor a0, a0, a1
+    slli a3, a0, 3
+    srli a4, a0, 7
+    or a3, a3, a4
+    sub a0, a3, a2
+    andi a5, a0, 0xFF
+    add a1, a1, a5
+    addi t0, t0, -1
+    bnez t0, loop
+    li a7, 10
+    ecall
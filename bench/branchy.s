@@ -0,0 +1,29 @@
+# Branch-heavy code: data-dependent branches on the bits of an xorshift generator
+    li t0, 1500000
+    li a0, 0x12345678       # Generator state
+    li a1, 0                # Taken-path counters
+    li a2, 0
+    li a3, 0
+loop:
+    slli t1, a0, 13
+    xor a0, a0, t1
+    srli t1, a0, 17
+    xor a0, a0, t1
+    slli t1, a0, 5
+    xor a0, a0, t1
+    andi t2, a0, 1
+    beqz t2, even
+    addi a1, a1, 1
+    j second
+even:
+    addi a2, a2, 1
+second:
+    andi t2, a0, 6
+    li t3, 4
+    blt t2, t3, low
+    addi a3, a3, 1
+low:
+    addi t0, t0, -1
+    bnez t0, loop
+    li a7, 10
+    ecall
@@ -0,0 +1,25 @@
+# Load/store streaming: fills a 256 KiB buffer, then sums it back, 40 passes
+    li s0, 0x10000000       # Buffer, far from the code
+    li s1, 65536            # Words per pass
+    li s2, 40               # Passes
+    li a0, 0
+pass:
+    mv t0, s0
+    mv t1, s1
+fill:
+    sw t1, 0(t0)
+    addi t0, t0, 4
+    addi t1, t1, -1
+    bnez t1, fill
+    mv t0, s0
+    mv t1, s1
+sum:
+    lw t2, 0(t0)
+    add a0, a0, t2
+    addi t0, t0, 4
+    addi t1, t1, -1
+    bnez t1, sum
+    addi s2, s2, -1
+    bnez s2, pass
+    li a7, 10
+    ecall
@@ -0,0 +1,29 @@
+# Deep recursion, recursive.c scaled up: depth(n) = n < 1 ? 1 : depth(n - 1) + 1
+# with a 16-byte frame per level, 100000 levels deep, 20 times
+    li sp, 0x01000000
+    li s0, 20
+    li s1, 0
+again:
+    li a0, 100000
+    call depth
+    add s1, s1, a0
+    addi s0, s0, -1
+    bnez s0, again
+    mv a0, s1
+    li a7, 10
+    ecall
+depth:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw a0, 8(sp)
+    bge zero, a0, base
+    addi a0, a0, -1
+    call depth
+    addi a0, a0, 1
+    j done
+base:
+    li a0, 1
+done:
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
@@ -0,0 +1,16 @@
+# Console output: ECALL 4 prints a 32-character line and ECALL 1 an integer, 100000 times
+    li s0, 100000
+    la s1, line
+loop:
+    mv a0, s1
+    li a7, 4
+    ecall
+    mv a0, s0
+    li a7, 1
+    ecall
+    addi s0, s0, -1
+    bnez s0, loop
+    li a7, 10
+    ecall
+line:
+    .string "benchmark output line, 32 chars\n"
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+
+// Batch mode: runs every .bin and .elf of a directory on a pool of worker threads and checks each
+// final register file against the matching .res in memory
+
+typedef struct {
+    sim_config config;     // Engine setup of every run (console, profile and trace are ignored,
+                           // main rejects the analysis models outright)
+    unsigned threads;      // Worker threads, 0 = one per online core
+    unsigned repeat;       // Runs of every binary, to size sweeps and scaling measurements
+    uint64_t maxInstrs;    // Per-run instruction limit, 0 = none
+    int writeAnswers;      // Also write <name>-answer.res like a single run does
+} batch_options;
+
+void batchDefaultOptions(batch_options *opts);
+
+// Prints one line per binary and an aggregate summary to out
+// Returns 0 when every binary with a .res matched, 1 otherwise and -1 if the batch could not start
+int runBatch(const char *dir, const batch_options *opts, FILE *out);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "memory.h"
+#include "predecode.h"
+
+#define MAX_BLOCK_OPS 64          // Straight-line blocks longer than this are split
+#define BLOCK_HASH_INITIAL_BITS 10 // 1024 buckets, doubled whenever blocks outnumber them
+
+struct Block;
+struct Jit;
+
+// Native translation of a block prefix, returns the guest PC to continue at
+typedef uint32_t (*native_block_fn)(uint32_t *regs, Memory *mem, struct Block *blk);
+
+// Basic block: straight-line micro_ops ending at a branch, JAL, JALR or ECALL
+// (or at MAX_BLOCK_OPS / the end of the program), stored contiguously
+typedef struct Block {
+    uint32_t startPC;
+    uint32_t endPC;            // One past the last instruction
+    uint32_t count;            // Guest instructions in ops
+    int valid;                 // Cleared when a store hits [startPC, endPC)
+    micro_op *ops;             // count entries followed by an end-of-block marker
+
+    // Chained successors, so leaving the block does not need a PC lookup
+    struct Block *taken;       // Branch/JAL target, or the last JALR target seen
+    struct Block *fallthrough; // Block at endPC
+
+    uint64_t execCount;        // Times the block was entered since it was (re)translated
+    native_block_fn native;    // JIT code for ops[0, nativeOps), NULL while interpreted
+    uint32_t nativeOps;
+    struct Block *next;        // Every block ever translated, for invalidation and teardown
+    struct Block *hashNext;    // Next block in the same BlockCache bucket
+} Block;
+
+typedef struct {
+    uint64_t lookups;          // PC lookups in the block map
+    uint64_t hits;             // Lookups that found a valid block
+    uint64_t misses;           // Lookups that had to translate a block
+    uint64_t chained;          // Block transitions that followed a chain link directly
+    uint64_t invalidations;    // Blocks dropped by stores into their code
+} block_stats;
+
+// Translated blocks hashed by start PC, a Block keeps its identity per start PC,
+// so chain links stay usable across invalidation and retranslation
+typedef struct BlockCache {
+    Block **buckets;
+    uint32_t bucketBits;       // log2 of the bucket count
+    uint32_t blockCount;
+    Block *all;
+    struct Jit *jit;           // Compiles hot blocks when set
+    block_stats stats;
+} BlockCache;
+
+int blockCacheInit(BlockCache *blocks, PredecodeCache *cache);
+void blockCacheFree(BlockCache *blocks, PredecodeCache *cache);
+void blockCacheReset(BlockCache *blocks);
+Block *blockLookup(BlockCache *blocks, PredecodeCache *cache, Memory *mem, uint32_t pc, uint32_t endPC);
+void blockInvalidate(BlockCache *blocks, uint32_t addr, uint32_t len);
+void printBlockStats(const BlockCache *blocks, FILE *out);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef BPRED_H
+#define BPRED_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+#include "loader.h"
+
+// Branch prediction models: several predictors watch the same run side by side, each
+// predicting every control transfer before the executed op tells the real outcome
+// Direction predictors (bimodal, gshare, TAGE-lite) see the conditional branches, target
+// predictors (BTB with a return address stack) the JAL and JALR jumps
+// Like the cache models they run in their own interpreter loop (runPredicted)
+
+#define BPRED_MAX 8          // Predictors in one run
+#define BPRED_TAGE_TABLES 4  // Tagged tables of TAGE-lite, over 4, 8, 16 and 32 history bits
+#define BPRED_TOP 20         // Rows of the per-PC table in the report
+
+typedef enum {
+    BPRED_BIMODAL,   // 2-bit counters indexed by PC
+    BPRED_GSHARE,    // 2-bit counters indexed by PC xor global history
+    BPRED_TAGE,      // Bimodal base plus tagged tables over geometric history lengths
+    BPRED_BTB        // Direct-mapped branch target buffer plus return address stack
+} bpred_kind;
+
+typedef struct {
+    bpred_kind kind;
+    uint32_t entries;    // Counters, entries of each tagged table, or BTB entries (power of two)
+    uint32_t history;    // gshare history bits, or RAS depth for the BTB
+} bpred_config;
+
+typedef struct {
+    uint32_t count;
+    bpred_config configs[BPRED_MAX];
+} bpred_set;
+
+// One predictor's state, only the arrays of its kind are allocated
+typedef struct {
+    bpred_config config;
+    uint8_t *counters;       // Bimodal, gshare and the TAGE base
+    uint32_t history;        // Global history, newest outcome in bit 0 (gshare)
+    uint64_t longHistory;    // TAGE
+    uint32_t folded[BPRED_TAGE_TABLES][3]; // Its history folded to the index and two tag widths
+    uint32_t foldWidth[3];
+    uint32_t foldOut[BPRED_TAGE_TABLES][3];  // Position of the bit leaving each folded history
+    struct tage_entry *tagged[BPRED_TAGE_TABLES];
+    uint32_t tick;           // TAGE branches since the useful bits were last aged
+    uint32_t *btbPc;         // BTB tags (full PCs) and targets
+    uint32_t *btbTarget;
+    uint32_t *ras;           // Circular, rasTop is the next free slot
+    uint32_t rasTop;
+    uint64_t predictions;
+    uint64_t misses;
+} Predictor;
+
+// Outcomes of one branch or jump site
+typedef struct {
+    uint32_t pc;             // UINT32_MAX for a free slot
+    uint8_t op;
+    uint64_t executions;
+    uint64_t taken;
+    uint64_t misses[BPRED_MAX];
+} bpred_site;
+
+typedef struct {
+    uint32_t count;
+    Predictor predictors[BPRED_MAX];
+    uint64_t instructions;
+    bpred_site *sites;       // Open-addressed by PC, at most half full
+    uint32_t siteMask;
+    uint32_t siteCount;
+    bpred_site lost;         // Counts the sites that found the table full and could not grow it
+    int outOfMemory;         // Sticky until the reset, sim_run then ends with HALT_ERROR
+} BranchModel;
+
+// bimodal:4096, gshare:4096 (history bits up to 32), tage:1024 and btb:512 with a 16-deep RAS
+void bpredDefaultSet(bpred_set *set);
+
+// "KIND[:ENTRIES[:BITS]]" items separated by commas, KIND is bimodal, gshare[:ENTRIES[:HISTORY]],
+// tage[:ENTRIES] or btb[:ENTRIES[:RAS]]. Returns 0, or -1 after printing what is wrong
+int parseBranchPredictors(const char *spec, bpred_set *set);
+
+// Returns 0, or -1 after printing which predictor cannot be built
+int bpredInit(BranchModel *model, const bpred_set *set);
+void bpredReset(BranchModel *model);
+void bpredFree(BranchModel *model);
+
+// Same contract as the engines, interprets predecoded micro_ops while scoring the predictors
+engine_result runPredicted(Hart *hart, PredecodeCache *cache, BranchModel *model, uint64_t budget);
+
+// Accuracy of every predictor and of the sites they miss most
+void bpredWriteReport(const BranchModel *model, const SymbolTable *symbols, FILE *out);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+#include "loader.h"
+
+// Cache model for guest performance analysis: split L1 instruction and data caches and an
+// optional unified L2 behind them, fed with every instruction fetch, load and store
+// Modelled runs use their own copy of the threaded engine's handlers (runCached), the other
+// engines leave its data access hook empty and the memory functions carry none. The caches only hold tags, data always comes from Memory
+// Each way is one uint32_t: the line number (address >> line shift) shifted left once with
+// the dirty bit in bit 0, CACHE_EMPTY when invalid. LRU keeps every set in recency order,
+// most recent first, so its victim is always the last way
+
+#define CACHE_EMPTY UINT32_MAX   // Never a tagged line, line numbers have at most 30 bits
+#define CACHE_MAX_PLRU_WAYS 32   // Tree bits of a set fit one uint32_t
+#define CACHE_TOP 20             // Rows of the per-PC table in the report
+#define CACHE_ACCESS_WRITE 0x80  // Marks the stores in cacheDataAccess
+
+typedef enum {
+    CACHE_LRU,
+    CACHE_PLRU,   // Tree pseudo-LRU, ways must be a power of two
+    CACHE_RANDOM
+} cache_policy;
+
+typedef struct {
+    uint32_t size;       // Bytes, 0 leaves the level out
+    uint32_t ways;
+    uint32_t lineSize;   // Bytes, a power of two of at least 4
+    cache_policy policy;
+    int writeBack;       // Dirty lines go to the next level when evicted, else stores write through
+    int writeAllocate;   // Store misses fill the line, else they only go to the next level
+} cache_level_config;
+
+// Accesses skip a missing L1 and go straight to the L2, or to memory without one
+typedef struct {
+    cache_level_config l1i;
+    cache_level_config l1d;
+    cache_level_config l2;
+} cache_config;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t readMisses;
+    uint64_t writeMisses;
+    uint64_t evictions;   // Valid lines replaced
+    uint64_t writebacks;  // Dirty lines among them
+} cache_stats;
+
+typedef struct CacheLevel {
+    cache_level_config config;
+    const char *name;
+    uint32_t lineShift;
+    uint32_t setMask;
+    uint32_t *tags;             // sets * ways entries
+    uint32_t *plru;             // Tree bits per set, PLRU only
+    uint32_t random;            // xorshift32 state, RANDOM only
+    cache_stats stats;
+    struct CacheLevel *next;    // NULL: misses and write-throughs go to memory
+} CacheLevel;
+
+// Counters of the instruction at one PC
+typedef struct {
+    uint64_t fetchMisses;   // Its fetches that missed the first instruction level
+    uint64_t accesses;      // Lines its loads and stores touched
+    uint64_t misses;        // Those that missed the first data level
+    uint64_t l2Misses;      // L2 misses of its fetches, loads, stores and their write-backs
+    uint64_t evictions;     // Lines its misses evicted, at every level
+} cache_pc_stats;
+
+typedef struct CacheModel {
+    CacheLevel l1i, l1d, l2;
+    CacheLevel *fetchLevel;     // First level an instruction fetch or data access reaches,
+    CacheLevel *dataLevel;      // NULL when no level is modelled for it
+    uint32_t lastFetchLine;     // Line of the last fetch, while it stays in the L1I
+    uint64_t memoryReads;       // Lines read from memory
+    uint64_t memoryWrites;      // Write-backs and write-throughs that reached memory
+    uint64_t instructions;
+
+    // Per-PC counters, same two-level layout as Memory with one slot per halfword
+    cache_pc_stats **tables[PAGE_TABLE_ENTRIES];
+    uint32_t lastVpn;
+    cache_pc_stats *lastEntries;
+    cache_pc_stats lost;        // Counts PCs whose page could not be allocated
+    int outOfMemory;            // Sticky until the reset, sim_run then ends with HALT_ERROR
+} CacheModel;
+
+// Bytes each load and store accesses (with CACHE_ACCESS_WRITE for stores), 0 for other ops
+extern const uint8_t cacheDataAccess[NUM_OPS];
+
+// 32 KiB 8-way L1s with 64-byte lines, LRU, write-back and write-allocate, no L2
+void cacheDefaultConfig(cache_config *config);
+
+// "SIZE:WAYS:LINE[:lru|plru|random][:wt][:nwa]", SIZE may end in K or M, "0" or "off" leaves
+// the level out. wt writes through, nwa does not allocate on store misses
+// Returns 0, or -1 after printing what is wrong
+int parseCacheLevel(const char *spec, cache_level_config *level);
+
+// Returns 0, or -1 after printing which level is invalid or allocation failure
+int cacheInit(CacheModel *model, const cache_config *config);
+void cacheReset(CacheModel *model);
+void cacheFree(CacheModel *model);
+
+// Same contract as the engines, interprets predecoded micro_ops while feeding the caches
+engine_result runCached(Hart *hart, PredecodeCache *cache, CacheModel *model, uint64_t budget);
+
+// Per-level statistics and the PCs with the most misses
+void cacheWriteReport(CacheModel *model, PredecodeCache *cache, Hart *hart, const SymbolTable *symbols, FILE *out);
+
+#endif
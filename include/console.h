@@ -0,0 +1,39 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "memory.h"
+
+// Guest output of the printing ECALLs, collected per hart and handed to stdio in large writes
+// when the buffer fills and whenever sim_run or sim_step returns
+// Numbers are formatted straight into the buffer and strings copied out of guest memory a page
+// at a time, so printing costs no stdio call per character
+
+#define CONSOLE_BUFFER_SIZE 16384
+#define CONSOLE_MAX_FORMATTED 64   // Longest printf result of one ECALL (a float with %f)
+
+typedef struct {
+    FILE *out;                     // NULL discards the output
+    uint32_t used;
+    char buffer[CONSOLE_BUFFER_SIZE];
+} Console;
+
+void consoleInit(Console *console, FILE *out);
+// Writes out what is buffered
+void consoleFlush(Console *console);
+void consoleWrite(Console *console, const char *data, size_t len);
+void consolePrintf(Console *console, const char *format, ...);
+// Copies the NUL-terminated guest string at addr, stopping at the top of the address space,
+// or at an access fault (mem->halted) when it runs outside bounded RAM
+void consoleGuestString(Console *console, Memory *mem, uint32_t addr);
+
+static inline void consolePutc(Console *console, char c) {
+    if (console->used == CONSOLE_BUFFER_SIZE) {
+        consoleFlush(console);
+    }
+    console->buffer[console->used++] = c;
+}
+
+#endif
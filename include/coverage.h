@@ -0,0 +1,31 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdint.h>
+#include "engine.h"
+
+// Edge coverage in the layout of AFL's shared-memory bitmap: every resolved branch, JAL and
+// JALR hashes where it went, and the counter of (that hash xor the previous one shifted right)
+// is incremented, so A -> B and B -> A land in different bytes
+// Covered runs use their own interpreter loop (runCovered) like the other analysis models,
+// which also stops on an illegal instruction with HALT_ILLEGAL instead of skipping it
+
+typedef struct {
+    uint8_t *bits;     // Not owned, e.g. AFL's shared memory
+    uint32_t mask;     // Size of the map - 1, the size is a power of two
+    uint32_t prev;     // Previous location >> 1
+} CoverageMap;
+
+// Returns 0, or -1 after printing why the map size cannot be used
+int coverageInit(CoverageMap *map, uint8_t *bits, uint32_t size);
+// Clears the counters and starts a new path
+void coverageReset(CoverageMap *map);
+// Starts a new path on the same counters, for runs whose map afl-fuzz clears itself
+void coverageNewPath(CoverageMap *map);
+// Counters that are not zero
+uint32_t coverageEdges(const CoverageMap *map);
+
+// Same contract as the engines, interprets predecoded micro_ops recording the edges taken
+engine_result runCovered(Hart *hart, PredecodeCache *cache, CoverageMap *map, uint64_t budget);
+
+#endif
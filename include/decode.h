@@ -9,6 +9,7 @@
 typedef struct{
     instruction_t instrType;
     opcode_t opcode;
+    uint8_t length; // Bytes of the encoding: 4, or 2 for an expanded RV32C instruction
     union {
         r_fields r;
         i_fields i;
@@ -16,12 +17,19 @@ typedef struct{
         u_fields u;
         b_fields b;
         j_fields j;
+        r4_fields r4;
     };
 } decoded_fields;
 
 
 decoded_fields decodeInstruction(uint32_t instr);
 
+// RV32C: 32-bit instructions have 11 in their two low bits, anything else is 16 bits long
+static inline int isCompressed(uint32_t instr)           { return (instr & 0x3) != 0x3; }
+static inline uint32_t instructionLength(uint32_t instr) { return isCompressed(instr) ? 2 : 4; }
+// 32-bit equivalent of a compressed instruction, 0 (illegal) for encodings without one
+uint32_t expandCompressed(uint16_t instr);
+
 instruction_t getInstructionType(opcode_t opcode);
 decoded_fields getRelevantFields(instruction_t instrType, opcode_t opcode, uint32_t instr);
 
@@ -31,6 +39,8 @@ static inline funct3_t getFunct3(uint32_t instr)  { return (funct3_t)((instr >>
 static inline reg_t getRs1(uint32_t instr)        { return (reg_t)((instr >> 15) & 0x1F); }
 static inline reg_t getRs2(uint32_t instr)        { return (reg_t)((instr >> 20) & 0x1F); }
 static inline funct7_t getFunct7(uint32_t instr)  { return (funct7_t)((instr >> 25) & 0x7F); }
+static inline reg_t getRs3(uint32_t instr)        { return (reg_t)((instr >> 27) & 0x1F); }
+static inline uint8_t getFmt(uint32_t instr)      { return (uint8_t)((instr >> 25) & 0x3); }
 
 
 // I-type: bits [31:20], sign-extended
@@ -0,0 +1,39 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+#include <stdint.h>
+#include "hart.h"
+
+// Memory-mapped devices at the addresses of QEMU's virt board, so bare-metal guests written
+// for it find them where they expect:
+//   UART      16550 subset, THR (write) and RBR (read, always 0) at +0, LSR at +5 reports the
+//             transmitter empty. Bytes written join the printing ECALLs in the hart's console
+//   CLINT     mtimecmp at +0x4000 and mtime at +0xBFF8, 64-bit. mtime counts 10 MHz of host
+//             time, there are no interrupts so mtimecmp is plain storage
+//   Finisher  SiFive test device, writing 0x5555 exits with 0 and 0x3333 | code << 16 with code
+
+#define UART_BASE     0x10000000u
+#define UART_SIZE     0x1000u
+#define CLINT_BASE    0x02000000u
+#define CLINT_SIZE    0x10000u
+#define FINISHER_BASE 0x00100000u
+#define FINISHER_SIZE 0x1000u
+
+#define MTIME_HZ 10000000u
+
+typedef struct {
+    Hart *hart;
+    uint64_t mtimecmp;
+    uint64_t startNs;       // Host monotonic time mtime counts from
+} Devices;
+
+// Maps the three devices into hart's memory. Returns 0, or -1 after printing the region that
+// cannot be mapped
+int devicesAttach(Devices *devices, Hart *hart);
+// Back to power-on state: mtime restarts from 0, mtimecmp is cleared
+void devicesReset(Devices *devices);
+// mtime now, and making it count on from mtime (snapshots)
+uint64_t devicesTime(const Devices *devices);
+void devicesSetTime(Devices *devices, uint64_t mtime);
+
+#endif
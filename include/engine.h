@@ -0,0 +1,38 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include "memory.h"
+#include "hart.h"
+#include "predecode.h"
+#include "block.h"
+
+// Execution engines, all produce identical architectural state
+typedef enum {
+    ENGINE_REFERENCE, // decodeInstruction + executeInstruction for every dynamic instruction
+    ENGINE_PREDECODE, // predecoded micro_ops through the executeMicroOp switch
+    ENGINE_THREADED,  // predecoded micro_ops with one final handler each, computed-goto dispatch
+    ENGINE_BLOCK,     // translated basic blocks with chained successors
+    ENGINE_JIT        // block engine with hot blocks compiled to x86-64 (needs -DRISCV_JIT)
+} engine_t;
+
+// Result of running an engine until it halts, PC leaves [basePC, endPC) or budget
+// instructions have retired (the engine leaves hart->pc on the next instruction to run)
+typedef struct {
+    int halted;        // 1 when stopped by a halting ECALL
+    uint64_t retired;  // Instructions executed
+} engine_result;
+
+int parseEngine(const char *name, engine_t *engine);
+const char *engineName(engine_t engine);
+
+// blocks is only used (and must be initialised) for ENGINE_BLOCK and ENGINE_JIT
+// The block engine never starts a block it cannot finish within budget, so it may stop
+// short of it, the caller steps the remaining instructions one at a time
+engine_result runEngine(engine_t engine, Hart *hart, PredecodeCache *cache, BlockCache *blocks, uint64_t budget);
+engine_result runReference(Hart *hart, uint64_t budget);
+engine_result runPredecoded(Hart *hart, PredecodeCache *cache, uint64_t budget);
+engine_result runThreaded(Hart *hart, PredecodeCache *cache, uint64_t budget);
+engine_result runBlocks(Hart *hart, PredecodeCache *cache, BlockCache *blocks, uint64_t budget);
+
+#endif
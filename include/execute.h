@@ -6,20 +6,68 @@
 #include "instruction.h"
 #include "registers.h"
 #include "memory.h"
+#include "hart.h"
+#include "predecode.h"
+#include "fpu.h"
 
-int executeInstruction(decoded_fields decoded, Memory *mem );
+int executeInstruction(decoded_fields decoded, Hart *hart);
     
-int handleRType(decoded_fields instr);
-int handleIType(decoded_fields instr, Memory *memory);
-int handleSType(decoded_fields instr, Memory *memory);
-int handleUType(decoded_fields instr);
-int handleBType(decoded_fields instr);
-int handleJType(decoded_fields instr);
+int handleRType(decoded_fields instr, Hart *hart);
+int handleMType(decoded_fields instr, Hart *hart);
+int handleIType(decoded_fields instr, Hart *hart);
+int handleSType(decoded_fields instr, Hart *hart);
+int handleUType(decoded_fields instr, Hart *hart);
+int handleBType(decoded_fields instr, Hart *hart);
+int handleJType(decoded_fields instr, Hart *hart);
+int handleFType(decoded_fields instr, Hart *hart);
+int handleR4Type(decoded_fields instr, Hart *hart);
 
 // I-Type Helpers
-int handleIArithmetic(decoded_fields instr);
-int handleILoad(decoded_fields instr, Memory *memory);
-int handleJALR(decoded_fields instr);
-int handleECALL(Memory *memory);
+int handleIArithmetic(decoded_fields instr, Hart *hart);
+int handleILoad(decoded_fields instr, Hart *hart);
+int handleJALR(decoded_fields instr, Hart *hart);
+int handleECALL(Hart *hart);
+int handleCSR(decoded_fields instr, Hart *hart);
+int handleFLoad(decoded_fields instr, Hart *hart);
+
+// Predecoded path, updates PC itself
+int executeMicroOp(const micro_op *op, Hart *hart);
+
+// RV32M results shared by every engine
+// Division never traps: x / 0 gives all ones (DIV and DIVU), x % 0 gives x, and the
+// overflowing INT32_MIN / -1 gives INT32_MIN with a remainder of 0
+static inline uint32_t mulh(uint32_t a, uint32_t b) {
+    return (uint32_t)(((int64_t)(int32_t)a * (int64_t)(int32_t)b) >> 32);
+}
+static inline uint32_t mulhsu(uint32_t a, uint32_t b) {
+    return (uint32_t)(((int64_t)(int32_t)a * (int64_t)b) >> 32);
+}
+static inline uint32_t mulhu(uint32_t a, uint32_t b) {
+    return (uint32_t)(((uint64_t)a * b) >> 32);
+}
+static inline uint32_t divs(uint32_t a, uint32_t b) {
+    if (b == 0) {
+        return UINT32_MAX;
+    }
+    if (a == 0x80000000u && b == UINT32_MAX) {
+        return a;
+    }
+    return (uint32_t)((int32_t)a / (int32_t)b);
+}
+static inline uint32_t divu(uint32_t a, uint32_t b) {
+    return b == 0 ? UINT32_MAX : a / b;
+}
+static inline uint32_t rems(uint32_t a, uint32_t b) {
+    if (b == 0) {
+        return a;
+    }
+    if (a == 0x80000000u && b == UINT32_MAX) {
+        return 0;
+    }
+    return (uint32_t)((int32_t)a % (int32_t)b);
+}
+static inline uint32_t remu(uint32_t a, uint32_t b) {
+    return b == 0 ? a : a % b;
+}
 
 #endif
\ No newline at end of file
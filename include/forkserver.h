@@ -0,0 +1,61 @@
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+
+// Fork server: loads a binary once and runs its startup code to the fork point, then forks a
+// child per input that goes on from there with the input in guest memory. Each child sends
+// its registers back over a pipe, so a run costs a fork instead of a process start, a load
+// and the guest's initialisation, and a guest (or simulator) crash only takes a child down
+//
+// Inputs are file paths, one per line on the input stream. The fork point is either
+//   the marker ECALL  (a7 = ECALL_MARKER) the input goes to the buffer at a0, at most a1
+//                     bytes, and the ECALL returns its length in a0
+//   entryPC           the first time pc reaches it, say the entry of parse(buf, len): the
+//                     input goes to inputAddr, at most inputSize bytes, a0 = inputAddr and
+//                     a1 = its length. The buffer must be RAM clear of the loaded image
+
+typedef struct {
+    sim_config config;     // Engine setup of every run (profiling, tracing and the models are ignored)
+    int hasEntry;          // Fork at entryPC rather than at the marker ECALL
+    uint32_t entryPC;
+    int hasInputAddr;      // inputAddr was given, which entryPC requires
+    uint32_t inputAddr;    // Where inputs go with entryPC
+    uint32_t inputSize;    // Room there, longer inputs are cut
+    uint64_t maxInstrs;    // Per-input instruction limit, 0 = none
+    int writeAnswers;      // Also write <input>-answer.res for every input
+    int persistent;        // runForkServer runs every input in this process, restoring a snapshot
+                           // of the fork point first (sim_restore) instead of forking: no fork
+                           // and only the pages the last run wrote to copy back, but a crash
+                           // takes the server down
+    uint32_t forkEvery;    // Under afl-fuzz, runs of one forked child before the next fork (0 = no limit)
+} forkserver_options;
+
+void forkServerDefaultOptions(forkserver_options *opts);
+
+// Prints one line per input and a summary to out
+// Returns 0 when every child reported back, 1 if one crashed or an input could not be read,
+// and -1 if the server could not reach the fork point
+int runForkServer(const char *binary, const forkserver_options *opts, FILE *inputs, FILE *out);
+
+// Fuzzing target for afl-fuzz, over the same fork point: the runs count edge coverage (see
+// coverage.h) into AFL's shared-memory bitmap, named by the id in __AFL_SHM_ID, and a fault
+// (bound the RAM to catch stray accesses) or an illegal instruction aborts the run, which AFL
+// records as a crash. When AFL_STATUS_FD takes the 4-byte hello this is AFL's fork server in
+// persistent mode: each 4 bytes on AFL_CONTROL_FD start a run, answered by the child's pid and
+// wait status. A forked child answers forkEvery requests itself, each run from a snapshot of
+// the fork point restored in place (sim_restore), so a run costs the pages the last one wrote
+// rather than a fork. A crash kills the child and the next request forks a new one
+#define AFL_SHM_ENV "__AFL_SHM_ID"
+#define AFL_MAP_SIZE 65536
+#define AFL_CONTROL_FD 198
+#define AFL_STATUS_FD 199
+
+// Each run reads its input from inputPath, or stdin when NULL. Without afl-fuzz it runs once
+// and prints the outcome and the edges covered to out
+// Returns 0, 1 if the input could not be read, or -1 if the target could not start
+int runFuzzTarget(const char *binary, const forkserver_options *opts, const char *inputPath, FILE *out);
+
+#endif
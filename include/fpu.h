@@ -0,0 +1,139 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "hart.h"
+
+// RV32F on the host FPU, shared by every engine
+// f registers hold raw single-precision bits. Every NaN result becomes the canonical NaN and
+// the rounding mode is the instruction's rm field, or frm when rm is DYN. Round to nearest
+// even is the host default and runs inline, the other modes go through fpRounded
+// Exception flags are left to accumulate in the host's sticky flags while an engine runs:
+// fpuBegin clears them and fpuCollect folds them into fcsr (sim_run and every fcsr access)
+
+// fflags bits
+#define FFLAG_NX 0x01 // Inexact
+#define FFLAG_UF 0x02 // Underflow
+#define FFLAG_OF 0x04 // Overflow
+#define FFLAG_DZ 0x08 // Divide by zero
+#define FFLAG_NV 0x10 // Invalid operation
+#define FFLAGS_MASK 0x1F
+#define FRM_SHIFT 5
+#define FRM_MASK 0x7
+#define FCSR_MASK 0xFF
+
+// Rounding modes, in an instruction's rm field and in frm
+typedef enum {
+    RM_RNE = 0, // To nearest, ties to even
+    RM_RTZ = 1, // Toward zero
+    RM_RDN = 2, // Down
+    RM_RUP = 3, // Up
+    RM_RMM = 4, // To nearest, ties away from zero
+    RM_DYN = 7  // Instruction only: use frm
+} rounding_t;
+
+// Floating-point CSRs, anything else reads as zero and ignores writes
+#define CSR_FFLAGS 0x001
+#define CSR_FRM    0x002
+#define CSR_FCSR   0x003
+
+#define CANONICAL_NAN 0x7FC00000u
+
+// Operations that round, for fpRounded
+typedef enum {
+    FP_ADD, FP_SUB, FP_MUL, FP_DIV, FP_SQRT,
+    FP_MADD, FP_MSUB, FP_NMSUB, FP_NMADD // rs1 * rs2 + rs3, rs1 * rs2 - rs3, -(rs1 * rs2) + rs3, -(rs1 * rs2) - rs3
+} fp_kind;
+
+static inline float f32(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+static inline uint32_t f32Bits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// NaN tests on the bits, as a host compare raises invalid for a signaling NaN
+static inline int isNaNBits(uint32_t x)       { return (x & 0x7FFFFFFF) > 0x7F800000; }
+static inline int isSignalingBits(uint32_t x) { return isNaNBits(x) && !(x & 0x00400000); }
+static inline uint32_t canonicalize(float f) {
+    uint32_t bits = f32Bits(f);
+    return isNaNBits(bits) ? CANONICAL_NAN : bits;
+}
+
+// rm (an instruction's field) means round to nearest even, the mode the host runs in
+static inline int roundsNearestEven(const Hart *hart, uint32_t rm) {
+    return rm == RM_RNE || (rm == RM_DYN && (hart->fcsr >> FRM_SHIFT) == RM_RNE);
+}
+
+void fpuBegin(void);
+void fpuCollect(Hart *hart);
+
+uint32_t fpRounded(Hart *hart, fp_kind kind, uint32_t a, uint32_t b, uint32_t c, uint32_t rm);
+uint32_t fpFma(Hart *hart, fp_kind kind, uint32_t a, uint32_t b, uint32_t c, uint32_t rm);
+uint32_t fpMin(Hart *hart, uint32_t a, uint32_t b);
+uint32_t fpMax(Hart *hart, uint32_t a, uint32_t b);
+uint32_t fpToInt(Hart *hart, uint32_t a, uint32_t rm, int isUnsigned);
+uint32_t fpFromIntRounded(Hart *hart, uint32_t x, uint32_t rm, int isUnsigned);
+uint32_t fpClass(uint32_t a);
+// CSRRW/CSRRS/CSRRC on csr: new value = (old & ~clear) | set, returns the old value
+uint32_t csrAccess(Hart *hart, uint32_t csr, uint32_t clear, uint32_t set);
+
+static inline uint32_t fpAdd(Hart *hart, uint32_t a, uint32_t b, uint32_t rm) {
+    return roundsNearestEven(hart, rm) ? canonicalize(f32(a) + f32(b)) : fpRounded(hart, FP_ADD, a, b, 0, rm);
+}
+static inline uint32_t fpSub(Hart *hart, uint32_t a, uint32_t b, uint32_t rm) {
+    return roundsNearestEven(hart, rm) ? canonicalize(f32(a) - f32(b)) : fpRounded(hart, FP_SUB, a, b, 0, rm);
+}
+static inline uint32_t fpMul(Hart *hart, uint32_t a, uint32_t b, uint32_t rm) {
+    return roundsNearestEven(hart, rm) ? canonicalize(f32(a) * f32(b)) : fpRounded(hart, FP_MUL, a, b, 0, rm);
+}
+static inline uint32_t fpDiv(Hart *hart, uint32_t a, uint32_t b, uint32_t rm) {
+    return roundsNearestEven(hart, rm) ? canonicalize(f32(a) / f32(b)) : fpRounded(hart, FP_DIV, a, b, 0, rm);
+}
+static inline uint32_t fpSqrt(Hart *hart, uint32_t a, uint32_t rm) {
+    return roundsNearestEven(hart, rm) ? canonicalize(sqrtf(f32(a))) : fpRounded(hart, FP_SQRT, a, 0, 0, rm);
+}
+static inline uint32_t fpFromInt(Hart *hart, uint32_t x, uint32_t rm, int isUnsigned) {
+    if (!roundsNearestEven(hart, rm)) {
+        return fpFromIntRounded(hart, x, rm, isUnsigned);
+    }
+    return f32Bits(isUnsigned ? (float)x : (float)(int32_t)x);
+}
+
+// Sign injection only moves bits, NaNs included
+static inline uint32_t fpSgnj(uint32_t a, uint32_t b)  { return (a & 0x7FFFFFFF) | (b & 0x80000000); }
+static inline uint32_t fpSgnjn(uint32_t a, uint32_t b) { return (a & 0x7FFFFFFF) | (~b & 0x80000000); }
+static inline uint32_t fpSgnjx(uint32_t a, uint32_t b) { return a ^ (b & 0x80000000); }
+
+// FEQ is a quiet compare (invalid only for signaling NaNs), FLT and FLE signal on any NaN
+static inline uint32_t fpEq(Hart *hart, uint32_t a, uint32_t b) {
+    if (isNaNBits(a) || isNaNBits(b)) {
+        if (isSignalingBits(a) || isSignalingBits(b)) {
+            hart->fcsr |= FFLAG_NV;
+        }
+        return 0;
+    }
+    return f32(a) == f32(b);
+}
+static inline uint32_t fpLt(Hart *hart, uint32_t a, uint32_t b) {
+    if (isNaNBits(a) || isNaNBits(b)) {
+        hart->fcsr |= FFLAG_NV;
+        return 0;
+    }
+    return f32(a) < f32(b);
+}
+static inline uint32_t fpLe(Hart *hart, uint32_t a, uint32_t b) {
+    if (isNaNBits(a) || isNaNBits(b)) {
+        hart->fcsr |= FFLAG_NV;
+        return 0;
+    }
+    return f32(a) <= f32(b);
+}
+
+#endif
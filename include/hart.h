@@ -0,0 +1,53 @@
+#ifndef HART_H
+#define HART_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "registers.h"
+#include "memory.h"
+#include "console.h"
+
+// Why a hart stopped running
+typedef enum {
+    HALT_NONE = 0,    // Still runnable
+    HALT_ECALL,       // Exit ECALL (a7 = 10 or 93)
+    HALT_END,         // PC left [basePC, endPC)
+    HALT_ERROR,       // Internal failure (e.g. out of host memory)
+    HALT_DEVICE,      // Exit through the test finisher device
+    HALT_FAULT,       // Load or store outside bounded RAM, mem.fault and mem.faultAddr say
+                      // which, pc stays on the instruction
+    HALT_MARKER,      // Marker ECALL while markerStops is set, pc stays on it until the input
+                      // is supplied (fork server)
+    HALT_ILLEGAL      // Illegal instruction or unknown ECALL under coverage (the engines skip
+                      // them), pc stays on it
+} halt_reason;
+
+// a7 of the marker ECALL, the fork point of guests written for the fork server: a0 is an
+// input buffer of a1 bytes, the ECALL returns how many bytes of input it holds in a0 (0
+// without a fork server)
+#define ECALL_MARKER 0x100
+
+// Architectural state of one RISC-V hart plus its memory, every handler works on one of these
+// so several simulations can run in the same process
+typedef struct Hart {
+    uint32_t regs[NUM_REGS];  // Register file: x0 to x31
+    uint32_t pc;              // 32-bit program counter
+    uint32_t fregs[NUM_FREGS]; // RV32F registers f0 to f31 (FLEN is 32, so never NaN-boxed)
+    uint32_t fcsr;             // frm in bits 7:5, accrued exception flags in bits 4:0
+    Memory mem;
+
+    uint32_t basePC;          // Execution stops once pc leaves [basePC, endPC), the loaded
+    uint32_t endPC;           // image or the executable segments of an ELF
+    uint64_t retired;         // Instructions executed so far
+    halt_reason halt;
+    uint32_t exitCode;        // a0 of the exit ECALL
+    Console console;          // Buffered output of the printing ECALLs
+    int markerStops;          // The marker ECALL halts with HALT_MARKER rather than return 0
+} Hart;
+
+// One compare for both bounds
+static inline int pcInRange(const Hart *hart, uint32_t pc) {
+    return pc - hart->basePC < hart->endPC - hart->basePC;
+}
+
+#endif
@@ -16,6 +16,7 @@ typedef enum{
     U_TYPE,
     B_TYPE,
     J_TYPE,
+    R4_TYPE,      // RV32F fused multiply-adds, three sources
     UNKNOWN_TYPE
 } instruction_t;
 
@@ -30,7 +31,14 @@ typedef enum{
     NONIMM = 0x33,  // 0110011 -> ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND
     LUI = 0x37,     // 0110111 -> LUI
     JAL = 0x6F,     // 1101111 -> JAL
-    SYSTEM = 0x73,  // 1110011 -> ECALL
+    SYSTEM = 0x73,  // 1110011 -> ECALL, CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI
+    FLOAD = 0x07,   // 0000111 -> FLW
+    FSTORE = 0x27,  // 0100111 -> FSW
+    FMADD = 0x43,   // 1000011 -> FMADD.S
+    FMSUB = 0x47,   // 1000111 -> FMSUB.S
+    FNMSUB = 0x4B,  // 1001011 -> FNMSUB.S
+    FNMADD = 0x4F,  // 1001111 -> FNMADD.S
+    FARITH = 0x53,  // 1010011 -> FADD.S, FSUB.S, ..., FCVT.S.W, FMV.W.X
 } opcode_t;
 
 // Interface for funct3, RISCV-I are 3 bits
@@ -71,7 +79,20 @@ typedef enum {
 //     F7_SRAI = 0x20, // 0000000 -> Constant shift right arithmetic (specificaly I-Format instructions)
 typedef enum {
     F7_0000000 = 0x00,
-    F7_0100000 = 0x20
+    F7_0000001 = 0x01, // RV32M multiply/divide, funct3 selects the operation
+    F7_0100000 = 0x20,
+    // RV32F OP-FP (single-precision format, FADD.S is 0000000)
+    F7_0000100 = 0x04, // FSUB.S
+    F7_0001000 = 0x08, // FMUL.S
+    F7_0001100 = 0x0C, // FDIV.S
+    F7_0010000 = 0x10, // FSGNJ.S, FSGNJN.S, FSGNJX.S
+    F7_0010100 = 0x14, // FMIN.S, FMAX.S
+    F7_0101100 = 0x2C, // FSQRT.S
+    F7_1010000 = 0x50, // FLE.S, FLT.S, FEQ.S
+    F7_1100000 = 0x60, // FCVT.W.S, FCVT.WU.S
+    F7_1101000 = 0x68, // FCVT.S.W, FCVT.S.WU
+    F7_1110000 = 0x70, // FMV.X.W, FCLASS.S
+    F7_1111000 = 0x78  // FMV.W.X
 } funct7_t;
 
 static inline const char *funct3Name(opcode_t opcode, funct3_t f3) {
@@ -135,7 +156,9 @@ static inline const char *funct3Name(opcode_t opcode, funct3_t f3) {
 }
 static inline const char *funct7Name(opcode_t opcode, funct3_t funct3, funct7_t funct7) {
     if (opcode == NONIMM) { // R-type
-        if (funct3 == F3_000) {
+        if (funct7 == F7_0000001) {
+            return "MULDIV";
+        } else if (funct3 == F3_000) {
             return (funct7 == F7_0100000) ? "SUB" : "ADD";
         } else if (funct3 == F3_101) {
             return (funct7 == F7_0100000) ? "SRA" : "SRL";
@@ -167,7 +190,15 @@ static inline const char *opcodeName(opcode_t opcode) {
         case JAL:
             return "JAL"; 
         case SYSTEM: 
-            return "SYSTEM";  // ECALL
+            return "SYSTEM";  // ECALL, CSR access
+        case FLOAD:
+            return "FLOAD";   // FLW
+        case FSTORE:
+            return "FSTORE";  // FSW
+        case FMADD: case FMSUB: case FNMSUB: case FNMADD:
+            return "FMA";
+        case FARITH:
+            return "FARITH";  // FADD.S, etc.
         default:     
             return "UNKNOWN";
     }
@@ -213,5 +244,15 @@ typedef struct {
     imm_t imm;
 } j_fields;
 
+// Fused multiply-add: funct3 is the rounding mode, funct7 holds rs3 and the format
+typedef struct {
+    reg_t rd;
+    reg_t rs1;
+    reg_t rs2;
+    reg_t rs3;
+    funct3_t funct3;
+    uint8_t fmt;
+} r4_fields;
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "block.h"
+
+#ifndef JIT_BUFFER_SIZE
+#define JIT_BUFFER_SIZE (8 * 1024 * 1024) // Code buffer, emptied and refilled when full
+#endif
+#define JIT_DEFAULT_THRESHOLD 64          // Block executions before it is compiled
+#define JIT_FULL (-2)                     // jitCompile found no room left in the buffer
+
+// Native x86-64 translation tier for hot blocks, built with -DRISCV_JIT
+typedef struct Jit {
+    uint8_t *code;        // mmap'd buffer, executable and only writable while a block is emitted
+    size_t size;
+    size_t used;
+    uint32_t threshold;   // execCount at which a block is compiled
+    uint64_t compiled;    // Blocks translated to native code
+    uint64_t partial;     // ...of which stop early and continue in the interpreter
+    uint64_t rejected;    // Blocks whose first instruction is not supported
+    uint64_t flushes;     // Times the full buffer was emptied, dropping all native code
+    uint64_t failures;    // Blocks that did not fit even then, or whose pages could not be
+                          // switched between writable and executable
+} Jit;
+
+#if defined(RISCV_JIT) && defined(__x86_64__)
+#define JIT_AVAILABLE 1
+
+int jitInit(Jit *jit, uint32_t threshold);
+void jitReset(Jit *jit);
+void jitFree(Jit *jit);
+// Returns 0 when blk->native was set, -1 when blk is not compiled, or JIT_FULL when the buffer
+// has no room for it: the caller then drops the native code of every block and calls jitFlush
+int jitCompile(Jit *jit, Block *blk);
+void jitFlush(Jit *jit);
+void printJitStats(const Jit *jit, FILE *out);
+
+#else
+#define JIT_AVAILABLE 0
+
+// Without the JIT every block stays interpreted
+static inline int jitInit(Jit *jit, uint32_t threshold) { (void)jit; (void)threshold; return -1; }
+static inline void jitReset(Jit *jit) { (void)jit; }
+static inline void jitFree(Jit *jit) { (void)jit; }
+static inline int jitCompile(Jit *jit, Block *blk) { (void)jit; (void)blk; return -1; }
+static inline void jitFlush(Jit *jit) { (void)jit; }
+static inline void printJitStats(const Jit *jit, FILE *out) { (void)jit; (void)out; }
+
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "memory.h"
+
+// ELF32 RISC-V executables: PT_LOAD segments are mapped straight from the file when their
+// file offset and address agree modulo the page size (copied otherwise), BSS reads as zeros
+
+typedef enum {
+    SYMBOL_FUNC,
+    SYMBOL_OBJECT,
+    SYMBOL_OTHER      // Untyped labels, e.g. from hand-written assembly
+} symbol_type;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t size;           // 0 when unknown
+    symbol_type type;
+    const char *name;        // Points into SymbolTable.names
+} elf_symbol;
+
+// Defined symbols of the .symtab, sorted by address
+typedef struct {
+    elf_symbol *symbols;
+    uint32_t count;
+    char *names;             // Copy of the string table
+} SymbolTable;
+
+typedef struct {
+    uint32_t entry;
+    uint32_t execLo;         // Span of the executable segments, execution stops outside it
+    uint32_t execHi;
+    uint32_t loadLo;         // Span of all loaded segments, loadHi exclusive like execHi
+    uint32_t loadHi;
+    uint32_t mappedBytes;    // Loaded by mapping file pages
+    uint32_t copiedBytes;
+} elf_info;
+
+int isElfImage(const uint8_t *data, uint32_t size);
+
+// Loads path into mem, returns 0 or -1 after printing why the file was rejected
+int loadElf(Memory *mem, const char *path, elf_info *info, SymbolTable *symbols);
+
+// Symbol containing addr (or the closest one before it when sizes are unknown), NULL if none
+const elf_symbol *symbolLookup(const SymbolTable *symbols, uint32_t addr);
+// "name", "name+0x10" or the bare address, symbols may be NULL
+void symbolFormat(char *buf, size_t size, const SymbolTable *symbols, uint32_t addr);
+void symbolTableFree(SymbolTable *symbols);
+
+#endif
@@ -1,25 +1,170 @@
 #ifndef MEM_H
 #define MEM_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-#define MEM_SIZE (1024 * 1024)
 #define MEM_BASE  0x00000000
 
+// Sparse guest memory over the whole 32-bit address space: 4 KiB pages allocated on first
+// write, found through a two-level table (10 + 10 bits) and cached in a direct-mapped TLB
+// Reads of pages never written return zeros without allocating anything
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1u << PAGE_SHIFT)
+#define PAGE_OFFSET_MASK (PAGE_SIZE - 1)
+#define PAGE_TABLE_SHIFT 22                          // addr >> 22 selects a second-level table
+#define PAGE_TABLE_ENTRIES 1024
+#define TLB_ENTRIES 64
+#define TLB_INVALID UINT32_MAX                       // Never a page number (those are 20 bits)
+
+#define MEM_MAX_DEVICES 8
+
+// Kind of access that faulted
+typedef enum {
+    MEM_FAULT_NONE = 0,
+    MEM_FAULT_LOAD,
+    MEM_FAULT_STORE
+} mem_fault;
+
+struct PredecodeCache;
+struct Snapshot;
+
+// Memory-mapped device region, whole pages that never enter the TLB so that RAM accesses
+// keep their single compare, a TLB miss checks the regions before walking the page table
+// Loads and stores of 1, 2 or 4 bytes inside a page reach the callbacks with the offset
+// into the region, the loaders' bulk copies see the RAM behind it instead
 typedef struct {
-    uint8_t *data;
+    uint32_t base;
     uint32_t size;
+    uint32_t (*read)(void *context, uint32_t offset, uint32_t size);
+    void (*write)(void *context, uint32_t offset, uint32_t value, uint32_t size);
+    void *context;
+} mmio_region;
+
+typedef struct {
+    uint32_t vpn;        // addr >> PAGE_SHIFT
+    uint8_t *page;
+} tlb_entry;
+
+// Private file mapping whose pages are used as guest pages directly (released with munmap)
+typedef struct {
+    uint8_t *base;
+    uint32_t len;
+} memory_mapping;
+
+typedef struct {
+    uint8_t **tables[PAGE_TABLE_ENTRIES];  // tables[addr >> 22][(addr >> 12) & 1023], NULL until used
+    tlb_entry tlb[TLB_ENTRIES];            // Only ever holds allocated pages
+    tlb_entry storeTlb[TLB_ENTRIES];       // Pages stores may write without a walk, while a snapshot
+                                           // tracks writes only those it has seen dirtied
+    uint32_t pages;                        // Pages allocated
+    memory_mapping *mappings;              // Backing of file-mapped pages, see memoryMapFile
+    uint32_t mappingCount;
+    uint32_t mappedPages;
+
+    // Address range [codeLo, codeHi) holding predecoded instructions, stores inside it
+    // invalidate the affected cache entries (empty when codeLo >= codeHi)
+    uint32_t codeLo;
+    uint32_t codeHi;
+    struct PredecodeCache *predecode;
+
+    // Copy-on-write tracking: the first store to a page since the snapshot was taken goes
+    // through the page walk, which hands the page to snapshotTouch before it changes
+    struct Snapshot *snapshot;
+
+    mmio_region devices[MEM_MAX_DEVICES];
+    uint32_t deviceCount;
+
+    // Bounded RAM (ramSize != 0): only [ramBase, ramBase + ramSize) and the devices exist, any
+    // other load or store faults. Like the devices the check sits on the TLB miss path, pages
+    // outside RAM never enter the TLB, so a hit costs no bounds check
+    uint32_t ramBase;
+    uint32_t ramSize;
+    mem_fault fault;                       // First faulting access, which has no effect
+    uint32_t faultAddr;
+
+    int halted;                            // A device write ended the run (test finisher) or an
+                                           // access faulted, the engines check it after the full
+                                           // accessors and stop on that instruction
+    int outOfMemory;                       // Sticky: a page could not be allocated, the store
+                                           // was dropped and the run halts with HALT_ERROR
 } Memory;
 
+void memoryInit(Memory *mem);
+void memoryFree(Memory *mem);
+// Returns 0, or -1 when the host runs out of memory or after recording a store fault, and
+// writing nothing, when the range is not all RAM (memoryIsRam)
+int memoryWrite(Memory *mem, uint32_t addr, const uint8_t *src, uint32_t len);
+// Returns 0, or -1 after recording a load fault when the range leaves bounded RAM
+int memoryRead(Memory *mem, uint32_t addr, uint8_t *dst, uint32_t len);
+void memoryZero(Memory *mem, uint32_t addr, uint32_t len);
+// Whether all of [addr, addr + len) is RAM: inside bounded RAM and clear of the devices
+int memoryIsRam(const Memory *mem, uint32_t addr, uint32_t len);
+int memoryMapFile(Memory *mem, uint32_t addr, int fd, uint32_t offset, uint32_t len);
+// Maps count pages of fd from offset (page aligned) at the page numbers vpns, the same way
+int memoryMapPages(Memory *mem, int fd, uint32_t offset, const uint32_t *vpns, uint32_t count);
+// Puts back the contents of page vpn from a PAGE_SIZE copy, or releases the page (NULL)
+void memoryRestorePage(Memory *mem, uint32_t vpn, const uint8_t *contents);
+// Page vpn, NULL when it was never written
+uint8_t *memoryPage(const Memory *mem, uint32_t vpn);
+// Empties the store TLB, so that the next store to each page walks the page table again
+void memoryFlushStores(Memory *mem);
+// Routes the page-aligned range [base, base + size) to a device, 0 on success or -1 after
+// printing why (overlap with another device, too many devices)
+int memoryMapDevice(Memory *mem, const mmio_region *region);
+// Limits the guest to [base, base + size) plus the devices (size 0 lifts the limit)
+void memorySetRam(Memory *mem, uint32_t base, uint32_t size);
+// Host address to read addr from, valid up to the end of its page or of bounded RAM (*len
+// bytes), pages never written read from a shared zero page. NULL when addr is a device
+// register or outside bounded RAM, which only the loads can read (or fault on)
+const uint8_t *memoryReadable(Memory *mem, uint32_t addr, uint32_t *len);
+
 uint32_t loadB(Memory *mem, uint32_t addr);
 uint32_t loadHW(Memory *mem, uint32_t addr);
 uint32_t loadW(Memory *mem, uint32_t addr);
 uint32_t loadBU(Memory *mem, uint32_t addr);
 uint32_t loadHWU(Memory *mem, uint32_t addr);
-void storeByte(uint8_t *memory, uint32_t addr, uint8_t value);
-void storeHalfword(uint8_t *memory, uint32_t addr, uint16_t value);
-void storeWord(uint8_t *memory, uint32_t addr, uint32_t value);
-   
+void storeByte(Memory *mem, uint32_t addr, uint8_t value);
+void storeHalfword(Memory *mem, uint32_t addr, uint16_t value);
+void storeWord(Memory *mem, uint32_t addr, uint32_t value);
+
+// Little-endian guest data at host address p
+static inline uint32_t readHalf(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t readWord(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static inline void writeByte(uint8_t *p, uint32_t v) { p[0] = v & 0xFF; }
+static inline void writeHalf(uint8_t *p, uint32_t v) { p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; }
+static inline void writeWord(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+// TLB hit path of the accessors above, for the engines to inline: host address of the len
+// bytes at addr when they lie in one page held by the TLB, else NULL and the access takes
+// the full accessor. Only those can reach a device or fault, so the engines look at halted
+// after them alone and a hit costs no check
+static inline const uint8_t *loadHit(const Memory *mem, uint32_t addr, uint32_t len) {
+    const tlb_entry *entry = &mem->tlb[(addr >> PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+    if (entry->vpn != addr >> PAGE_SHIFT || (addr & PAGE_OFFSET_MASK) > PAGE_SIZE - len) {
+        return NULL;
+    }
+    return entry->page + (addr & PAGE_OFFSET_MASK);
+}
+
+// Same for stores, which also miss when they overlap predecoded code (the full accessors
+// invalidate it), so a hit never changes an instruction
+static inline uint8_t *storeHit(const Memory *mem, uint32_t addr, uint32_t len) {
+    const tlb_entry *entry = &mem->storeTlb[(addr >> PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+    if (entry->vpn != addr >> PAGE_SHIFT || (addr & PAGE_OFFSET_MASK) > PAGE_SIZE - len ||
+        (addr < mem->codeHi && addr + len > mem->codeLo)) {
+        return NULL;
+    }
+    return entry->page + (addr & PAGE_OFFSET_MASK);
+}
+
 
 
-#endif
\ No newline at end of file
+#endif
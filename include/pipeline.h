@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+// Cycle-approximate timing of a classic in-order IF/ID/EX/MEM/WB pipeline, layered on the
+// functional core: runPipelined executes every micro_op exactly like the engines and only
+// accounts the cycle its EX stage would take
+// Each register remembers the first cycle a consumer may be in EX. With forwarding an ALU
+// result is ready for the next instruction and a load result one cycle later (the load-use
+// stall), without it every result waits for WB, read back by ID in the same cycle
+// Branches are predicted not taken: a taken one flushes the instructions fetched behind it.
+// Every EX takes one cycle, M and F operations included, and memory never stalls
+
+typedef struct {
+    int forwarding;          // EX/MEM and MEM/WB bypasses to EX
+    uint32_t branchPenalty;  // Cycles lost by a taken conditional branch, resolved in EX
+    uint32_t jumpPenalty;    // By JAL, its target is known in ID
+    uint32_t jalrPenalty;    // By JALR, which needs rs1 from EX
+} pipeline_config;
+
+typedef struct {
+    uint64_t instructions;
+    uint64_t cycles;          // Through the WB (or flush) of the last instruction of every region
+    uint64_t regions;         // Runs from an empty pipeline, 4 fill cycles each
+    uint64_t loadUseStalls;   // Cycles a consumer waited for a load
+    uint64_t rawStalls;       // For any other producer, only without forwarding
+    uint64_t branches;
+    uint64_t takenBranches;
+    uint64_t branchFlushCycles;
+    uint64_t jumps;           // JAL and JALR
+    uint64_t jumpFlushCycles;
+} pipeline_stats;
+
+typedef struct {
+    pipeline_config config;
+    uint16_t operands[NUM_OPS];  // Registers each op reads and writes, see pipeline.c
+    uint64_t ready[64];          // x registers, then f registers
+    uint8_t fromLoad[64];        // The register's last producer was a load
+    uint64_t nextEx;             // EX cycle of the next instruction if nothing stalls it
+    int fresh;                   // The pipeline is empty, the next instruction starts a region
+    pipeline_stats stats;
+} PipelineModel;
+
+// Forwarding on, branch penalty 2, JAL 1 and JALR 2
+void pipelineDefaultConfig(pipeline_config *config);
+
+void pipelineInit(PipelineModel *model, const pipeline_config *config);
+// Drops all counters and starts from an empty pipeline
+void pipelineReset(PipelineModel *model);
+// Starts a new region with an empty pipeline after the functional engines ran, keeping the counters
+void pipelineRestart(PipelineModel *model);
+
+// Same contract as the engines, interprets predecoded micro_ops while counting cycles
+engine_result runPipelined(Hart *hart, PredecodeCache *cache, PipelineModel *model, uint64_t budget);
+
+// CPI and the cycles of each stall cause
+void pipelineWriteReport(const PipelineModel *model, FILE *out);
+
+#endif
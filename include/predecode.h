@@ -0,0 +1,113 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include <stdint.h>
+#include "decode.h"
+#include "instruction.h"
+#include "memory.h"
+
+// Final operation of an instruction, resolved once from opcode/funct3/funct7
+// so execution never has to look at the encoding again
+typedef enum {
+    OP_UNDECODED = 0, // Cache slot has not been filled yet (calloc'd caches start here)
+
+    // R-type
+    OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+    // R-type, RV32M
+    OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+    // I-type arithmetic
+    OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+    // I-type loads
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+    // S-type
+    OP_SB, OP_SH, OP_SW,
+    // U-type
+    OP_LUI, OP_AUIPC,
+    // B-type
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+    // Jumps and system
+    OP_JAL, OP_JALR, OP_ECALL,
+    // Zicsr, the I forms keep their 5-bit immediate in rs1 (only the fcsr CSRs exist)
+    OP_CSRRW, OP_CSRRS, OP_CSRRC, OP_CSRRWI, OP_CSRRSI, OP_CSRRCI,
+    // RV32F loads and stores
+    OP_FLW, OP_FSW,
+    // RV32F arithmetic, imm holds the rounding mode (rm field) where the operation rounds
+    OP_FADD, OP_FSUB, OP_FMUL, OP_FDIV, OP_FSQRT, OP_FMADD, OP_FMSUB, OP_FNMSUB, OP_FNMADD,
+    OP_FSGNJ, OP_FSGNJN, OP_FSGNJX, OP_FMIN, OP_FMAX,
+    // RV32F conversions, moves and compares between f and x registers
+    OP_FCVT_W_S, OP_FCVT_WU_S, OP_FCVT_S_W, OP_FCVT_S_WU, OP_FMV_X_W, OP_FMV_W_X,
+    OP_FEQ, OP_FLT, OP_FLE, OP_FCLASS,
+
+    OP_ILLEGAL, // Encodings the reference handlers reject, executed as a no-op
+    NUM_OPS
+} op_t;
+
+// Compact pre-resolved instruction (12 bytes), operands already extracted from decoded_fields
+// Fields an operation does not use are left as zero, register fields name f registers
+// wherever the RV32F operation reads or writes one
+typedef struct {
+    uint8_t op;  // op_t
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    imm_t imm;
+    uint8_t len; // Encoding size, 4 or 2 (RV32C), sequential ops continue at pc + len
+    uint8_t rs3; // Addend of the fused multiply-adds
+} micro_op;
+
+struct BlockCache;
+
+#define OPS_PER_PAGE (PAGE_SIZE / 2)
+
+// Slot of the op for pc within its page
+static inline uint32_t opIndex(uint32_t pc) {
+    return (pc & PAGE_OFFSET_MASK) >> 1;
+}
+
+// One micro_op per 2-byte aligned halfword of guest code (RV32C instructions may start at
+// any of them), kept in per-page arrays allocated on the first fetch from a page (same
+// two-level layout as Memory)
+typedef struct PredecodeCache {
+    micro_op **tables[PAGE_TABLE_ENTRIES];
+    uint32_t pages;            // Op pages allocated
+    uint32_t lastVpn;          // One-entry fetch TLB, code rarely leaves its page
+    micro_op *lastOps;
+    struct BlockCache *blocks; // Translated blocks built from these ops, if any
+    micro_op scratch;          // Op handed out when its page could not be allocated
+} PredecodeCache;
+
+micro_op resolveMicroOp(decoded_fields decoded);
+// Instruction word at pc, the upper half only read for a 32-bit instruction, so a compressed
+// one in the last halfword of bounded RAM does not fault
+uint32_t fetchInstruction(Memory *mem, uint32_t pc);
+const char *opName(op_t op);
+
+int predecodeInit(PredecodeCache *cache, Memory *mem);
+void predecodeFree(PredecodeCache *cache, Memory *mem);
+void predecodeReset(PredecodeCache *cache, Memory *mem);
+const micro_op *predecodeFill(PredecodeCache *cache, Memory *mem, uint32_t pc);
+void predecodeInvalidate(PredecodeCache *cache, uint32_t addr, uint32_t len);
+
+// Branches, jumps and ECALL end a basic block
+static inline int opEndsBlock(uint8_t op) {
+    switch (op) {
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+        case OP_JAL: case OP_JALR: case OP_ECALL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Returns the cached micro_op for pc, decoding the word at pc on first fetch
+static inline const micro_op *predecodeFetch(PredecodeCache *cache, Memory *mem, uint32_t pc) {
+    if ((pc >> PAGE_SHIFT) == cache->lastVpn) {
+        const micro_op *op = &cache->lastOps[opIndex(pc)];
+        if (op->op != OP_UNDECODED) {
+            return op;
+        }
+    }
+    return predecodeFill(cache, mem, pc);
+}
+
+#endif
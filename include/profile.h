@@ -0,0 +1,67 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+#include "loader.h"
+
+// Execution profiler: instruction counts per PC, basic block entries, and a calling context
+// tree built from calls (JAL/JALR with rd == ra) and returns (jalr x0, 0(ra)), in which a
+// recursive call re-enters the context its function already has open
+// Profiled runs use their own interpreter loop (runProfiled), the engines carry no hooks
+// Only basic block entries are counted while running, per-PC counts are derived from them
+// when reporting by following each block's straight-line code to its branch
+
+#define PROFILE_MAX_NODES (1u << 20) // Calling contexts, deeper calls are charged to their caller
+#define PROFILE_TOP 20               // Rows per table of the hot-spot report
+
+// Calling context: a function reached through a particular chain of calls
+typedef struct {
+    uint32_t func;         // Entry PC
+    uint32_t parent;
+    uint32_t firstChild;   // 0 = none, the root is never anyone's child
+    uint32_t nextSibling;
+    uint64_t self;         // Instructions retired in this context (charged when it calls or returns)
+    uint64_t calls;
+} profile_node;
+
+typedef struct Profile {
+    // Basic blocks started at each PC (its first one, and after every branch, jump or ECALL),
+    // same two-level layout as Memory
+    uint64_t **tables[PAGE_TABLE_ENTRIES];
+    uint32_t lastVpn;                         // One-entry page cache for the counter lookup
+    uint64_t *lastEntries;
+    uint64_t lost;                            // Counts PCs whose page could not be allocated
+    int outOfMemory;                          // Sticky until the reset, sim_run then ends with
+                                              // HALT_ERROR
+    profile_node *nodes;                      // nodes[0] is the root, entered at the first PC run
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+    uint32_t current;
+    uint32_t *returns;                        // Context each open call returns to, a recursive
+    uint32_t returnCount;                     // call re-enters the context already open for its
+    uint32_t returnCapacity;                  // function, which need not be its caller's child
+    uint32_t lostDepth;                       // Open calls that did not get a node
+    uint64_t lostCalls;
+    uint64_t instructions;
+    uint64_t charged;                         // instructions already added to some node's self
+    int blockStart;                           // The next instruction starts a basic block
+} Profile;
+
+int profileInit(Profile *prof);
+void profileReset(Profile *prof);
+void profileFree(Profile *prof);
+
+// Same contract as the engines, interprets predecoded micro_ops while counting
+engine_result runProfiled(Hart *hart, PredecodeCache *cache, Profile *prof, uint64_t budget);
+
+// Sorted hot instructions, hot blocks and functions (self, inclusive, calls)
+// symbols names locations when available, code is read back through cache within the hart's
+// range. A run cut short by its instruction limit counts the rest of its last block as run
+void profileWriteReport(Profile *prof, PredecodeCache *cache, Hart *hart, const SymbolTable *symbols, FILE *out);
+
+// One "root;caller;callee count" line per calling context, for flamegraph tools
+void profileWriteFolded(const Profile *prof, const SymbolTable *symbols, FILE *out);
+
+#endif
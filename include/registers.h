@@ -7,12 +7,11 @@
 #include <string.h>
 
 #define NUM_REGS 32
+#define NUM_FREGS 32 // RV32F: f0 to f31
 
-// Register file: x0 to x31
-extern uint32_t regs[NUM_REGS];
-
-// 32-bit program counter
-extern uint32_t PC;
+// Words of a .res dump: x0-x31, then f0-f31 and fcsr when any of those is non-zero, so
+// programs without floating point keep the original 128-byte dump
+#define DUMP_MAX_WORDS (NUM_REGS + NUM_FREGS + 1)
 
 // Enum for readability 
 typedef enum {
@@ -61,8 +60,10 @@ static inline const char *regName(reg_t r) {
     return names[r];
 }
 
-void dumpRegisterContents();
-int dumpRegisterContentsFile(const char *filename);
+uint32_t registerDumpWords(const uint32_t *regs, const uint32_t *fregs, uint32_t fcsr, uint32_t *words);
+void dumpRegisterContents(const uint32_t *words, uint32_t count);
+int dumpRegisterContentsFile(const uint32_t *words, uint32_t count, const char *filename);
 char* makeDumpFilename(const char *input);
+char* makeSiblingFilename(const char *input, const char *suffix);
 
 #endif
@@ -0,0 +1,155 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "hart.h"
+#include "engine.h"
+#include "predecode.h"
+#include "block.h"
+#include "jit.h"
+#include "loader.h"
+#include "profile.h"
+#include "trace.h"
+#include "cache.h"
+#include "devices.h"
+#include "sweep.h"
+#include "pipeline.h"
+#include "bpred.h"
+#include "snapshot.h"
+#include "coverage.h"
+
+// Embeddable simulator (libriscvsim): one hart with its memory and engine caches
+// A Sim owns no global state, so independent Sims can run concurrently on different threads
+
+typedef struct {
+    engine_t engine;          // ENGINE_THREADED by default
+    uint32_t jitThreshold;    // Block executions before the JIT compiles it (ENGINE_JIT only)
+    FILE *console;            // Guest output, stdout by default (NULL discards it), buffered and
+                              // written when sim_run or sim_step returns
+    int profile;              // sim_run counts per PC, block and function instead of using the engine
+    const char *tracePath;    // sim_run records every instruction to this file (NULL = off),
+                              // exclusive with profile, the file is complete after sim_destroy
+    const cache_config *cache; // sim_run feeds every fetch, load and store to these caches
+                              // (NULL = off, copied by sim_create), exclusive with profile and tracePath
+    uint32_t cacheSweep;      // Line size of the single-pass data cache sweep (0 = off), exclusive
+                              // with the other three
+    const pipeline_config *pipeline; // sim_run counts the cycles of a 5-stage pipeline while
+                              // sim_set_pipeline has it on (NULL = off, copied), exclusive with the others
+    const bpred_set *predictors; // sim_run scores these branch predictors side by side (NULL = off,
+                              // copied), exclusive with the others
+    int devices;              // Maps the UART, timer and test finisher of devices.h into guest
+                              // memory, RAM everywhere when 0
+    uint32_t ramSize;         // Bounds guest RAM to this many bytes (whole pages) from the load
+                              // address, sp starts at its top and accesses outside it and the
+                              // devices halt with HALT_FAULT. 0 = the whole address space is RAM
+    uint8_t *coverage;        // sim_run counts the edges taken in this map (NULL = off, not owned)
+    uint32_t coverageSize;    // of this many bytes, a power of two, exclusive with the other models
+    int stopAtMarker;         // The marker ECALL (ECALL_MARKER) halts with HALT_MARKER until
+                              // sim_supply_input, otherwise it returns no input
+} sim_config;
+
+typedef struct Sim {
+    Hart hart;
+    sim_config config;
+    PredecodeCache predecode;
+    BlockCache blocks;        // Only initialised for ENGINE_BLOCK and ENGINE_JIT
+    Jit jit;
+    int useBlocks;
+    int useJit;
+    int isElf;                // Last load was an ELF executable, elf and symbols describe it
+    int isSnapshot;           // Last load resumed a snapshot file
+    elf_info elf;
+    SymbolTable symbols;
+    Profile *profile;         // Only allocated when config.profile is set
+    TraceWriter *trace;       // Open while config.tracePath is set
+    CacheModel *cache;        // Only allocated when config.cache is set
+    SweepModel *sweep;        // Only allocated when config.cacheSweep is set
+    PipelineModel *pipeline;  // Only allocated when config.pipeline is set
+    int pipelineOn;           // sim_run uses the timing model rather than the engine
+    BranchModel *branches;    // Only allocated when config.predictors is set
+    Devices devices;          // Attached when config.devices is set
+    Snapshot *snapshot;       // Taken by sim_snapshot, dropped by the next load
+    CoverageMap coverage;     // Used when config.coverage is set
+} Sim;
+
+void sim_default_config(sim_config *config);
+
+// Returns NULL if memory or a cache cannot be allocated, config may be NULL for the defaults
+Sim *sim_create(const sim_config *config);
+void sim_destroy(Sim *sim);
+
+// Resets the hart and memory, then loads a flat binary at MEM_BASE and runs it from there
+// Execution ends when PC leaves the loaded image, the rest of the 32-bit address space is
+// zero-filled guest memory. Returns 0, or -1 after printing the error
+// sim_load hands ELF files and snapshot files (by their magic) to sim_load_elf and
+// sim_load_snapshot
+int sim_load(Sim *sim, const char *path);
+int sim_load_image(Sim *sim, const uint8_t *image, uint32_t size);
+
+// Loads an ELF32 RISC-V executable and starts it at its entry point
+// Execution ends when PC leaves the executable segments, bounded RAM starts at the page of
+// the lowest segment
+int sim_load_elf(Sim *sim, const char *path);
+
+// Captures the hart, its memory and the devices in memory, copy-on-write (see snapshot.h):
+// the pages are only copied when the guest first writes them afterwards. Replaces an earlier
+// snapshot. Returns 0, or -1 when it cannot be allocated
+int sim_snapshot(Sim *sim);
+// Returns to the state of the last sim_snapshot, rewriting only the pages written since
+// Returns 0, or -1 when no snapshot was taken since the last load
+int sim_restore(Sim *sim);
+
+// Writes the current state to a snapshot file, which sim_load_snapshot (or sim_load) resumes
+// Returns 0, or -1 after printing the error
+int sim_save_snapshot(Sim *sim, const char *path);
+// Resets the hart and memory, then maps the pages of a snapshot file back in. The file must
+// come from this build, and the symbols of an ELF it was taken from are not kept
+int sim_load_snapshot(Sim *sim, const char *path);
+
+// Resumes a guest halted at the marker ECALL: copies up to a1 bytes of data to the buffer at
+// a0, returns their count in a0 and continues after the ECALL
+// Returns 0, or -1 when the guest is not waiting there or the buffer is not all RAM (a device
+// or outside bounded RAM), which halts it with HALT_FAULT at the ECALL
+int sim_supply_input(Sim *sim, const uint8_t *data, uint32_t len);
+
+// Executes a single instruction with the predecoded path, whatever the configured engine
+// Returns the halt reason (HALT_NONE while still runnable)
+halt_reason sim_step(Sim *sim);
+
+// Runs until the program halts or maxInstrs more instructions retired (0 = no limit)
+// Returns HALT_NONE when stopped by the limit, sim_run can then be called again to resume
+halt_reason sim_run(Sim *sim, uint64_t maxInstrs);
+
+// Writes the hot-spot report and the folded stacks of the runs since the last load
+// Returns 0, or -1 when profiling is off or a file cannot be written
+int sim_write_profile(Sim *sim, const char *reportPath, const char *foldedPath);
+
+// Writes the cache statistics of the runs since the last load
+// Returns 0, or -1 when the cache model is off or the file cannot be written
+int sim_write_cache_report(Sim *sim, const char *path);
+
+// Switches the pipeline model on or off between sim_run calls, so that only a region of
+// interest runs on it and the rest on the configured engine. It starts on
+// Each time it is switched on the pipeline starts empty, the counters keep adding up
+void sim_set_pipeline(Sim *sim, int on);
+
+// Writes CPI and the stall breakdown of the modelled instructions since the last load
+// Returns 0, or -1 when the pipeline model is off or the file cannot be written
+int sim_write_pipeline_report(Sim *sim, const char *path);
+
+// Writes the accuracy of every branch predictor, overall and per branch site
+// Returns 0, or -1 when no predictors are modelled or the file cannot be written
+int sim_write_branch_report(Sim *sim, const char *path);
+
+// Clears the coverage map before a run whose edges should be counted on their own
+void sim_reset_coverage(Sim *sim);
+
+// Writes the miss rates of the cache sweep since the last load
+// Returns 0, or -1 when the sweep is off or the file cannot be written
+int sim_write_sweep_report(Sim *sim, const char *path);
+
+// Guest memory footprint, plus the block cache and JIT counters of the configured engine
+void sim_print_stats(const Sim *sim, FILE *out);
+
+#endif
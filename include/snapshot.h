@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "hart.h"
+#include "devices.h"
+
+// Snapshots of a whole guest: the hart's architectural state, its memory and the devices
+//
+// In memory they are copy-on-write. Taking one only empties the store TLB, so the first
+// store to each page afterwards walks the page table, which hands the page to snapshotTouch
+// before it changes: the page is marked dirty and, the first time, its contents (or that it
+// did not exist) are saved. A restore rewrites only the dirty pages, so it costs the pages
+// the run wrote rather than the size of the image. Saved copies outlive the restore, running
+// variant after variant from one snapshot copies each page once
+//
+// On disk: a snapshot_header, the page numbers in ascending order, then from the next page
+// boundary the contents of each of those pages (pages of zeros are left out). Loading maps
+// the contents privately instead of reading them. The header is the host's struct layout,
+// files are meant to be read back by the same build
+//
+// Neither keeps the predecode and block caches, which refill on demand, nor the analysis
+// models, whose counters go on adding up
+
+#define SNAPSHOT_MAGIC "RVSNAP01"
+#define SNAPSHOT_MAGIC_LEN 8
+#define SNAPSHOT_VPNS (1u << (32 - PAGE_SHIFT))  // Page numbers in the address space
+
+// Everything but the pages
+typedef struct {
+    uint32_t regs[NUM_REGS];
+    uint32_t fregs[NUM_FREGS];
+    uint32_t pc;
+    uint32_t fcsr;
+    uint32_t basePC;
+    uint32_t endPC;
+    uint64_t retired;
+    uint32_t halt;            // halt_reason
+    uint32_t exitCode;
+    uint32_t memHalted;
+    uint32_t fault;           // mem_fault
+    uint32_t faultAddr;
+    uint32_t ramBase;
+    uint32_t ramSize;
+    uint32_t devices;         // The device registers below were captured
+    uint64_t mtime;
+    uint64_t mtimecmp;
+} hart_state;
+
+typedef struct {
+    char magic[SNAPSHOT_MAGIC_LEN];
+    uint32_t headerSize;      // sizeof(snapshot_header)
+    uint32_t pageCount;
+    uint32_t dataOffset;      // File offset of the first page, page aligned
+    uint32_t reserved;
+    hart_state state;
+} snapshot_header;
+
+typedef struct Snapshot {
+    hart_state state;
+    uint8_t **saved[PAGE_TABLE_ENTRIES];   // Contents at the snapshot of the pages written since,
+                                           // indexed like Memory.tables (NULL = not saved yet)
+    uint32_t savedPages;
+    uint64_t dirty[SNAPSHOT_VPNS / 64];    // Pages written since the snapshot or the last restore
+    uint32_t *dirtyList;                   // The same pages in the order they were first written
+    uint32_t dirtyCount;
+    uint32_t dirtyCapacity;
+} Snapshot;
+
+// Returns NULL after printing the error
+Snapshot *snapshotCreate(void);
+// The caller detaches it from the memory first
+void snapshotFree(Snapshot *snapshot);
+
+// Captures hart (and devices unless NULL) and starts tracking the writes to its memory,
+// dropping what an earlier snapshot held
+void snapshotTake(Snapshot *snapshot, Hart *hart, Devices *devices);
+// Back to the state snapshotTake captured, tracking goes on from there
+void snapshotRestore(Snapshot *snapshot, Hart *hart, Devices *devices);
+
+// Called by the memory before the first write to page vpn (NULL when it does not exist yet)
+// Returns 0, or -1 when the copy could not be allocated and the write must not happen
+int snapshotTouch(Snapshot *snapshot, uint32_t vpn, const uint8_t *page);
+
+int isSnapshotImage(const uint8_t *data, uint32_t size);
+
+// Writes the current state to path. Returns 0, or -1 after printing the error
+int snapshotWrite(Hart *hart, const Devices *devices, const char *path);
+// Loads path into a freshly reset hart. Returns 0, or -1 after printing why the file was
+// rejected (the hart must then be reset again)
+int snapshotRead(Hart *hart, Devices *devices, const char *path);
+
+#endif
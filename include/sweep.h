@@ -0,0 +1,68 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+// Single-pass cache sweep: LRU stack distances of every load and store (Mattson's stack
+// algorithm) give the miss rate of a whole grid of data cache sizes and associativities from
+// one run, instead of one --cache run per configuration
+// LRU caches with the same line size and set count are inclusive in their associativity: an
+// access hits a W-way cache exactly when fewer than W other lines of its set were used since
+// its own last use. So each set count keeps per-set recency stacks SWEEP_MAX_WAYS deep and a
+// histogram of the depths the accesses hit at. The fully associative column needs unbounded
+// distances, those come from an order-statistics tree (Fenwick tree over access times)
+// Stores allocate like loads, the grid matches --dcache=SIZE:WAYS:LINE with LRU and write-allocate
+
+#define SWEEP_MAX_WAYS 16      // Deepest set-associative stack, the grid has 1 to 16 ways
+#define SWEEP_SET_BITS 16      // Set counts 1 to 65536
+#define SWEEP_MIN_SIZE 1024    // Smallest and largest cache sizes reported
+#define SWEEP_MAX_SIZE (4u * 1024 * 1024)
+
+// Last access time of one line, the fully associative stack
+typedef struct {
+    uint32_t line;             // CACHE_EMPTY for a free slot
+    uint32_t time;
+} sweep_slot;
+
+typedef struct {
+    uint32_t lineSize;
+    uint32_t lineShift;
+    uint64_t instructions;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t accesses;         // Lines touched, an access that straddles lines touches both
+
+    // stacks[b] holds 2^b sets of SWEEP_MAX_WAYS lines each, most recent first,
+    // hits[b][d] counts the accesses that found their line at depth d
+    uint32_t *stacks[SWEEP_SET_BITS + 1];
+    uint64_t hits[SWEEP_SET_BITS + 1][SWEEP_MAX_WAYS];
+
+    // Fully associative: every line's last access time in a hash table, and a Fenwick tree
+    // with a one at each time that is still some line's last. The lines used since time t are
+    // the ones between t and now. Times are renumbered when the tree is full
+    sweep_slot *slots;
+    uint32_t slotMask;
+    uint32_t lines;            // Distinct lines so far, the cold misses
+    uint32_t *tree;            // Fenwick tree over times 1 to capacity
+    uint32_t *timeLine;        // Line accessed at each time
+    uint32_t capacity;
+    uint32_t now;
+    uint64_t distances[33];    // Bucket b: distance 0 for b = 0, else in [2^(b-1), 2^b)
+    int outOfMemory;           // The tables could not grow and the distances stopped there,
+                               // sticky until the reset, sim_run then ends with HALT_ERROR
+} SweepModel;
+
+// Returns 0, or -1 after printing why (line size not a power of two of at least 4, no memory)
+int sweepInit(SweepModel *model, uint32_t lineSize);
+void sweepReset(SweepModel *model);
+void sweepFree(SweepModel *model);
+
+// Same contract as the engines, interprets predecoded micro_ops while feeding the stacks
+engine_result runSweep(Hart *hart, PredecodeCache *cache, SweepModel *model, uint64_t budget);
+
+// Miss rate of every size and associativity in the grid
+void sweepWriteReport(const SweepModel *model, FILE *out);
+
+#endif
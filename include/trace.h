@@ -0,0 +1,113 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+// Binary execution trace, one record per retired instruction
+// The simulation thread only stores raw records into one of two chunks, a writer thread
+// encodes the other one and writes it out, so tracing never formats anything inline
+//
+// File: TRACE_MAGIC, then per record a flags byte followed by the fields it announces
+//   TRACE_PC     zigzag varint, pc - (previous pc + its instruction's length)
+//   TRACE_WORD   raw instruction, 4 bytes little-endian (2 for an RV32C one), omitted when
+//                the word cache already holds this pc's instruction
+//   TRACE_RD     zigzag varint, new rd value - last value recorded for rd (rd from the word,
+//                expanded first when it is compressed, a0 for an ECALL that changed it)
+//   TRACE_MEM    zigzag varint, load/store address - previous memory address
+//   TRACE_STORE  varint, value stored, zero-extended from the access size
+// Decoders keep the same state (trace_codec), so every delta resolves exactly
+// Only x registers are traced: RV32F writes to f registers and fcsr leave no TRACE_RD, FLW
+// and FSW record their address and FSW its value
+
+#define TRACE_MAGIC "RVTRACE1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_CHUNK_RECORDS 65536  // Records per chunk, two chunks in flight
+#define TRACE_WORD_CACHE 4096      // Direct-mapped pc -> word entries, a power of two
+
+#define TRACE_PC    0x01
+#define TRACE_WORD  0x02
+#define TRACE_RD    0x04
+#define TRACE_MEM   0x08
+#define TRACE_STORE 0x10
+
+typedef struct {
+    uint32_t pc;
+    uint32_t word;       // Only the low half for a compressed instruction
+    uint32_t rdValue;    // rd after the instruction
+    uint32_t memAddr;    // rs1 + imm, meaningful for loads and stores only
+    uint32_t memValue;   // Stores: the value stored (the reader zero-extends it)
+    uint8_t flags;       // Set by the reader, the fields present in the file
+} trace_record;
+
+typedef struct {
+    uint32_t nextPC;
+    uint32_t lastMem;
+    uint32_t regs[32];
+    uint32_t cachePC[TRACE_WORD_CACHE];
+    uint32_t cacheWord[TRACE_WORD_CACHE];
+} trace_codec;
+
+typedef struct TraceWriter {
+    FILE *file;
+    trace_record *chunks[2];
+    uint32_t fill;               // Records in the chunk being filled
+    int active;                  // Chunk the simulation fills
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;                 // Chunk handed to the writer thread, -1 when it is idle
+    uint32_t pendingCount;
+    int stop;
+
+    // Writer thread only
+    trace_codec codec;
+    uint8_t *encoded;
+    uint64_t records;
+    uint64_t bytes;
+    int error;
+} TraceWriter;
+
+typedef struct {
+    FILE *file;
+    trace_codec codec;
+} TraceReader;
+
+// Returns NULL after printing the error
+TraceWriter *traceOpen(const char *path);
+// Flushes the last chunk and stops the writer thread, returns 0 or -1 if writing failed
+int traceClose(TraceWriter *trace);
+
+void traceSwap(TraceWriter *trace);
+
+// The x register a TRACE_RD field of this instruction updates
+uint32_t traceRd(uint32_t word);
+
+// Slot for the next record, blocks only when the writer thread is a whole chunk behind
+static inline trace_record *traceNext(TraceWriter *trace) {
+    if (trace->fill == TRACE_CHUNK_RECORDS) {
+        traceSwap(trace);
+    }
+    return &trace->chunks[trace->active][trace->fill++];
+}
+
+// The marker ECALL halted the traced run and sim_supply_input then set a0: its record,
+// still the last one taken, gets the value the guest will see
+static inline void traceSetLastA0(TraceWriter *trace, uint32_t value) {
+    if (trace->fill > 0) {
+        trace->chunks[trace->active][trace->fill - 1].rdValue = value;
+    }
+}
+
+// Same contract as the engines, interprets predecoded micro_ops recording each one
+engine_result runTraced(Hart *hart, PredecodeCache *cache, TraceWriter *trace, uint64_t budget);
+
+int traceReaderOpen(TraceReader *reader, const char *path);
+// Returns 1 with the next record, 0 at the end of the trace and -1 when it is corrupt
+int traceRead(TraceReader *reader, trace_record *rec);
+void traceReaderClose(TraceReader *reader);
+
+#endif
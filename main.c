@@ -4,77 +4,356 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include "include/decode.h"
+#include <string.h>
+#include <time.h>
 #include "include/registers.h"
-#include "include/execute.h"
-#include "include/memory.h"
+#include "include/sim.h"
+#include "include/batch.h"
+#include "include/forkserver.h"
 
 
-// Register and Program Counter setup
-uint32_t regs[NUM_REGS] = {0};
-uint32_t PC = MEM_BASE;
+// "SIZE[K|M]" of guest RAM, 0 when malformed or not below 4 GiB
+static uint32_t parseRamSize(const char *spec) {
+    char *end;
+    unsigned long long size = strtoull(spec, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    return (*end == '\0' && size <= UINT32_MAX) ? (uint32_t)size : 0;
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <binary_file>\n", argv[0]);
-        return 1;
+    const char *binary = NULL;
+    const char *batchDir = NULL;
+    const char *consolePath = NULL;
+    const char *snapshotPath = NULL;
+    uint64_t snapshotAt = 0;                    // Instructions run before the snapshot is written
+    int showStats = 0;
+    int profile = 0;
+    int useCache = 0;
+    uint32_t sweepLineSize = 0;
+    int usePipeline = 0;
+    uint64_t regionStart = 0, regionLength = 0; // Instructions before and inside the modelled region
+    pipeline_config pipeline;
+    pipelineDefaultConfig(&pipeline);
+    int usePredictors = 0;
+    bpred_set predictors;
+    bpredDefaultSet(&predictors);
+    cache_config caches;
+    cacheDefaultConfig(&caches);
+    batch_options batch;
+    batchDefaultOptions(&batch);
+    int forkServer = 0;
+    int fuzz = 0;
+    const char *fuzzInput = NULL;
+    forkserver_options forkOpts;
+    forkServerDefaultOptions(&forkOpts);
+    sim_config config;
+    sim_default_config(&config);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            showStats = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = 1;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            config.tracePath = argv[i] + 8;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            useCache = 1;
+        } else if (strncmp(argv[i], "--icache=", 9) == 0) {
+            useCache = 1;
+            if (parseCacheLevel(argv[i] + 9, &caches.l1i) != 0) {
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--dcache=", 9) == 0) {
+            useCache = 1;
+            if (parseCacheLevel(argv[i] + 9, &caches.l1d) != 0) {
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--l2=", 5) == 0) {
+            useCache = 1;
+            if (parseCacheLevel(argv[i] + 5, &caches.l2) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache-sweep") == 0) {
+            sweepLineSize = 64;
+        } else if (strncmp(argv[i], "--cache-sweep=", 14) == 0) {
+            sweepLineSize = (uint32_t)strtoul(argv[i] + 14, NULL, 0);
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            usePipeline = 1;
+        } else if (strncmp(argv[i], "--pipeline=", 11) == 0) {
+            char *end;
+            usePipeline = 1;
+            regionStart = strtoull(argv[i] + 11, &end, 0);
+            if (*end == ':') {
+                regionLength = strtoull(end + 1, NULL, 0);
+            }
+        } else if (strcmp(argv[i], "--bpred") == 0) {
+            usePredictors = 1;
+        } else if (strncmp(argv[i], "--bpred=", 8) == 0) {
+            usePredictors = 1;
+            if (parseBranchPredictors(argv[i] + 8, &predictors) != 0) {
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--ram=", 6) == 0) {
+            config.ramSize = parseRamSize(argv[i] + 6);
+            if (config.ramSize == 0) {
+                fprintf(stderr, "Bad RAM size: %s\n", argv[i] + 6);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--save-snapshot=", 16) == 0) {
+            char *end;
+            snapshotAt = strtoull(argv[i] + 16, &end, 0);
+            if (*end != ':' || end[1] == '\0') {
+                fprintf(stderr, "Expected --save-snapshot=N:FILE\n");
+                return 1;
+            }
+            snapshotPath = end + 1;
+        } else if (strcmp(argv[i], "--devices") == 0) {
+            config.devices = 1;
+        } else if (strncmp(argv[i], "--console=", 10) == 0) {
+            consolePath = argv[i] + 10;
+        } else if (strcmp(argv[i], "--no-forwarding") == 0) {
+            pipeline.forwarding = 0;
+        } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+            if (parseEngine(argv[i] + 9, &config.engine) != 0) {
+                fprintf(stderr, "Unknown engine '%s' (reference, predecode, threaded, block%s)\n",
+                        argv[i] + 9, JIT_AVAILABLE ? ", jit" : "");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--jit-threshold=", 16) == 0) {
+            config.jitThreshold = (uint32_t)strtoul(argv[i] + 16, NULL, 0);
+        } else if (strcmp(argv[i], "--fork-server") == 0) {
+            forkServer = 1;
+        } else if (strncmp(argv[i], "--fork-server=", 14) == 0) {
+            forkServer = 1;
+            forkOpts.hasEntry = 1;
+            forkOpts.entryPC = (uint32_t)strtoul(argv[i] + 14, NULL, 0);
+        } else if (strcmp(argv[i], "--persistent") == 0) {
+            forkOpts.persistent = 1;
+        } else if (strncmp(argv[i], "--fork-every=", 13) == 0) {
+            forkOpts.forkEvery = (uint32_t)strtoul(argv[i] + 13, NULL, 0);
+        } else if (strcmp(argv[i], "--fuzz") == 0) {
+            fuzz = 1;
+        } else if (strncmp(argv[i], "--fuzz=", 7) == 0) {
+            fuzz = 1;
+            forkOpts.hasEntry = 1;
+            forkOpts.entryPC = (uint32_t)strtoul(argv[i] + 7, NULL, 0);
+        } else if (strncmp(argv[i], "--input=", 8) == 0) {
+            fuzzInput = argv[i] + 8;
+        } else if (strncmp(argv[i], "--input-addr=", 13) == 0) {
+            forkOpts.hasInputAddr = 1;
+            forkOpts.inputAddr = (uint32_t)strtoul(argv[i] + 13, NULL, 0);
+        } else if (strncmp(argv[i], "--input-size=", 13) == 0) {
+            forkOpts.inputSize = (uint32_t)strtoul(argv[i] + 13, NULL, 0);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchDir = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            batch.threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            batch.threads = (unsigned)strtoul(argv[i] + 2, NULL, 0);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            batch.repeat = (unsigned)strtoul(argv[i] + 9, NULL, 0);
+        } else if (strncmp(argv[i], "--max-instrs=", 13) == 0) {
+            batch.maxInstrs = strtoull(argv[i] + 13, NULL, 0);
+        } else if (strcmp(argv[i], "--write-answers") == 0) {
+            batch.writeAnswers = 1;
+        } else {
+            binary = argv[i];
+        }
     }
 
-    Memory mem;
-    mem.size = MEM_SIZE;
-    mem.data = (uint8_t *)calloc(mem.size, sizeof(uint8_t));
-    if (!mem.data) {
-        fprintf(stderr, "Memory allocation failed\n");
+    // Batch and fork-server runs leave the analysis models out, so asking for one is an error
+    int analysis = profile || config.tracePath || useCache || sweepLineSize || usePipeline || usePredictors;
+    if (analysis && (batchDir || forkServer || fuzz)) {
+        fprintf(stderr, "--profile, --trace, --cache, --cache-sweep, --pipeline and --bpred need a single run, not %s\n",
+                batchDir ? "--batch" : fuzz ? "--fuzz" : "--fork-server");
         return 1;
     }
 
-    FILE *file = fopen(argv[1], "rb");
-    if (!file) {
-        perror("Failed to open file");
-        free(mem.data);
+    if (batchDir) {
+        batch.config = config;
+        return runBatch(batchDir, &batch, stdout) == 0 ? 0 : 1;
+    }
+
+    if (!binary) {
+        printf("Usage: %s [--engine=reference|predecode|threaded|block|jit] [--jit-threshold=N] [--stats] [--profile | --trace=FILE | --cache | --cache-sweep[=LINE] | --pipeline[=START[:COUNT]] | --bpred[=LIST]] <binary_file>\n", argv[0]);
+        printf("       --cache models 32K 8-way L1 caches with 64-byte lines, --icache=, --dcache= and --l2=\n");
+        printf("       SIZE:WAYS:LINE[:lru|plru|random][:wt][:nwa] (or off) change a level and imply --cache\n");
+        printf("       --cache-sweep reports LRU data miss rates of 1K to 4M caches with 1 to 16 ways in one run\n");
+        printf("       --pipeline times COUNT instructions (0 = the rest) on a 5-stage pipeline after running START\n");
+        printf("       on the engine, add --no-forwarding to take the bypasses out\n");
+        printf("       --bpred scores predictors side by side, LIST defaults to bimodal:4096,gshare:4096:12,tage:1024,btb:512:16\n");
+        printf("       --devices maps a UART at 0x10000000, a CLINT timer at 0x02000000 and a test finisher at 0x00100000\n");
+        printf("       --ram=SIZE[K|M] bounds guest RAM from the load address, stray loads and stores stop with an access fault\n");
+        printf("       --save-snapshot=N:FILE writes the whole state to FILE after N instructions and goes on,\n");
+        printf("       giving FILE as the binary resumes from there\n");
+        printf("       --console=FILE sends the guest's printing ECALLs to FILE, --console=none drops them\n");
+        printf("       %s [engine options] --batch <dir> [-j N] [--repeat=N] [--max-instrs=N] [--write-answers]\n", argv[0]);
+        printf("       %s [engine options] --fork-server[=PC] [--persistent] [--input-addr=ADDR [--input-size=N]] [--max-instrs=N] [--write-answers] <binary>\n", argv[0]);
+        printf("       runs to the marker ECALL (or to PC), then forks a run per input file named on stdin,\n");
+        printf("       --persistent runs them all in this process, each from a restored snapshot of that point.\n");
+        printf("       With PC the inputs go to ADDR, at most N bytes (default 4096), clear of the image\n");
+        printf("       %s [engine options] --fuzz[=PC] [--input=FILE] [--input-addr=ADDR [--input-size=N]] [--ram=SIZE] [--fork-every=N] <binary>\n", argv[0]);
+        printf("       is an afl-fuzz target with edge coverage, reading FILE (e.g. @@) or stdin, faults and\n");
+        printf("       illegal instructions abort. Without afl-fuzz it runs once and prints the edges covered,\n");
+        printf("       with it a child runs N inputs (default 1000, 0 = no limit) from a restored snapshot\n");
         return 1;
     }
 
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    FILE *console = NULL; // Opened here, so the guest's output does not mix with ours on stdout
+    if (consolePath && strcmp(consolePath, "none") == 0) {
+        config.console = NULL;
+    } else if (consolePath) {
+        console = fopen(consolePath, "w");
+        if (!console) {
+            perror("Failed to open the console file");
+            return 1;
+        }
+        config.console = console;
+    }
+
+    if (forkServer || fuzz) {
+        forkOpts.config = config;
+        forkOpts.maxInstrs = batch.maxInstrs;
+        forkOpts.writeAnswers = batch.writeAnswers;
+        int status = fuzz ? runFuzzTarget(binary, &forkOpts, fuzzInput, stdout)
+                          : runForkServer(binary, &forkOpts, stdin, stdout);
+        if (console) {
+            fclose(console);
+        }
+        return status == 0 ? 0 : 1;
+    }
 
-    if (fsize < 0 || fsize > mem.size) {
-        fprintf(stderr, "File too big\n");
-        fclose(file);
-        free(mem.data);  
+    config.profile = profile;
+    config.cache = useCache ? &caches : NULL;
+    config.cacheSweep = sweepLineSize;
+    config.pipeline = usePipeline ? &pipeline : NULL;
+    config.predictors = usePredictors ? &predictors : NULL;
+    Sim *sim = sim_create(&config);
+    if (!sim) {
+        if (console) {
+            fclose(console);
+        }
+        return 1;
+    }
+    if (sim_load(sim, binary) != 0) {
+        sim_destroy(sim);
+        if (console) {
+            fclose(console);
+        }
         return 1;
     }
 
-    fread(&mem.data[0], 1, fsize, file);
-    fclose(file);
+    if (sim->isElf) {
+        printf("Loaded ELF with entry 0x%08X\n", sim->elf.entry);
+    } else if (sim->isSnapshot) {
+        printf("Resumed snapshot at PC 0x%08X after %llu instructions\n", sim->hart.pc,
+               (unsigned long long)sim->hart.retired);
+    } else {
+        printf("Loaded %u bytes into memory\n", sim->hart.endPC - MEM_BASE);
+    }
 
-    printf("Loaded %ld bytes into memory\n", fsize);
+    clock_t start = clock();
+    halt_reason reason = HALT_NONE;
+    if (snapshotPath) {
+        if (snapshotAt) {
+            reason = sim_run(sim, snapshotAt);
+        }
+        if (sim_save_snapshot(sim, snapshotPath) == 0) {
+            printf("Snapshot written to %s after %llu instructions\n", snapshotPath,
+                   (unsigned long long)sim->hart.retired);
+        }
+    }
+    if (usePipeline && regionStart && reason == HALT_NONE) { // The engine runs up to the region of interest
+        sim_set_pipeline(sim, 0);
+        reason = sim_run(sim, regionStart);
+        sim_set_pipeline(sim, 1);
+    }
+    if (usePipeline && regionLength && reason == HALT_NONE) { // And after it
+        reason = sim_run(sim, regionLength);
+        sim_set_pipeline(sim, 0);
+    }
+    if (reason == HALT_NONE) {
+        reason = sim_run(sim, 0);
+    }
+    if (reason == HALT_ECALL) {
+        printf("Program halted by ECALL\n");
+    } else if (reason == HALT_DEVICE) {
+        printf("Program halted by the test finisher with code %u\n", sim->hart.exitCode);
+    } else if (reason == HALT_FAULT) {
+        printf("Access fault: %s 0x%08X at PC 0x%08X\n", sim->hart.mem.fault == MEM_FAULT_STORE ? "store to" : "load from",
+               sim->hart.mem.faultAddr, sim->hart.pc);
+    } else if (reason == HALT_ERROR) {
+        printf("Simulation stopped by an internal error at PC 0x%08X\n", sim->hart.pc);
+    }
 
-    while (PC < fsize) {
-        uint32_t instr = loadW(&mem, PC);                 
-        decoded_fields decoded = decodeInstruction(instr); 
-        int status = executeInstruction(decoded, &mem); 
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (showStats) {
+        uint64_t retired = sim->hart.retired;
+        fprintf(stderr, "Retired %llu instructions in %.3f s (%.2f MIPS, %s engine)\n",
+                (unsigned long long)retired, seconds,
+                seconds > 0 ? retired / seconds / 1e6 : 0.0, engineName(config.engine));
+        sim_print_stats(sim, stderr);
+    }
 
-        if (status == 1) {
-            printf("Program halted by ECALL\n");
-            break;
+    // Profiling, tracing and the cache models run on their own interpreter loops whatever the engine
+    if (profile) {
+        char *reportPath = makeSiblingFilename(binary, "-profile.txt");
+        char *foldedPath = makeSiblingFilename(binary, "-profile.folded");
+        if (reportPath && foldedPath && sim_write_profile(sim, reportPath, foldedPath) == 0) {
+            printf("Profile written to %s and %s\n", reportPath, foldedPath);
         }
-
-        // Advance PC unless modified by branch/jump
-        if (decoded.instrType != B_TYPE && decoded.instrType != J_TYPE && !(decoded.instrType == I_TYPE && decoded.opcode == JALR))
-            PC += 4;
+        free(reportPath);
+        free(foldedPath);
+    }
+    if (useCache) {
+        char *reportPath = makeSiblingFilename(binary, "-cache.txt");
+        if (reportPath && sim_write_cache_report(sim, reportPath) == 0) {
+            printf("Cache report written to %s\n", reportPath);
+        }
+        free(reportPath);
     }
+    if (usePipeline) {
+        char *reportPath = makeSiblingFilename(binary, "-pipeline.txt");
+        if (reportPath && sim_write_pipeline_report(sim, reportPath) == 0) {
+            printf("Pipeline report written to %s\n", reportPath);
+        }
+        free(reportPath);
+    }
+    if (usePredictors) {
+        char *reportPath = makeSiblingFilename(binary, "-bpred.txt");
+        if (reportPath && sim_write_branch_report(sim, reportPath) == 0) {
+            printf("Branch prediction report written to %s\n", reportPath);
+        }
+        free(reportPath);
+    }
+    if (sweepLineSize) {
+        char *reportPath = makeSiblingFilename(binary, "-sweep.txt");
+        if (reportPath && sim_write_sweep_report(sim, reportPath) == 0) {
+            printf("Cache sweep written to %s\n", reportPath);
+        }
+        free(reportPath);
+    }
+
     // Have some logic to flush registers to a file...
-    dumpRegisterContents();
-    int wroteFile = dumpRegisterContentsFile(argv[1]);
+    uint32_t dump[DUMP_MAX_WORDS];
+    uint32_t dumpWords = registerDumpWords(sim->hart.regs, sim->hart.fregs, sim->hart.fcsr, dump);
+    dumpRegisterContents(dump, dumpWords);
+    int wroteFile = dumpRegisterContentsFile(dump, dumpWords, binary);
 
+    sim_destroy(sim);
+    if (console) {
+        fclose(console);
+    }
     if(wroteFile < 0){
         perror("Failed to write register to a file\n");
-        free(mem.data);
         return 1;
     }
 
-    free(mem.data);  
-    return 0;
-}
\ No newline at end of file
+    return reason == HALT_ERROR;
+}
@@ -0,0 +1,425 @@
+#define _POSIX_C_SOURCE 200809L // pthreads, dirent, clock_gettime and sysconf under -std=c99
+
+#include "../include/batch.h"
+#include "../include/registers.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Outcome of one run, ordered so the worst outcome of a binary's runs is the largest
+typedef enum {
+    RUN_PASS = 0,   // Registers match the .res
+    RUN_NO_RES,     // Ran to completion, nothing to compare against
+    RUN_LIMIT,      // Stopped by maxInstrs
+    RUN_FAIL,       // Registers differ from the .res
+    RUN_ERROR       // Could not be loaded, never ran or ran out of host memory
+} run_status;
+
+static const char *runStatusName(run_status status) {
+    static const char *names[] = { "PASS", "NO-RES", "LIMIT", "FAIL", "ERROR" };
+    return names[status];
+}
+
+// A guest binary, read once and shared read-only by every run of it
+typedef struct {
+    char *path;
+    const char *name;              // File name inside path
+    uint8_t *image;
+    uint32_t size;
+    int loaded;
+    int hasExpected;
+    uint32_t expected[DUMP_MAX_WORDS]; // Contents of the .res
+    uint32_t expectedWords;            // NUM_REGS, or DUMP_MAX_WORDS with the RV32F registers
+} batch_binary;
+
+typedef struct {
+    run_status status;
+    uint64_t retired;
+    double seconds;                // Load and run time on the worker
+} batch_result;
+
+// Work-stealing queue: the jobs [head, tail) of one worker, the owner takes from head
+// while idle workers steal the upper half from tail, jobs only ever move between queues
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t tail;
+} work_queue;
+
+typedef struct {
+    const batch_options *opts;
+    sim_config config;
+    batch_binary *bins;
+    uint32_t binCount;
+    batch_result *results;         // One slot per job, only written by the worker that ran it
+    work_queue *queues;
+    unsigned threads;
+} batch_state;
+
+typedef struct {
+    batch_state *state;
+    unsigned id;
+    pthread_t thread;
+} batch_worker;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int hasSuffix(const char *name, const char *suffix) {
+    size_t len = strlen(name);
+    size_t suffixLen = strlen(suffix);
+    return len > suffixLen && strcmp(name + len - suffixLen, suffix) == 0;
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Reads a whole file into a malloc'd buffer, returns NULL if it cannot be read or exceeds maxSize
+static uint8_t *readFile(const char *path, uint32_t maxSize, uint32_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t *data = NULL;
+    if (fsize >= 0 && fsize <= (long)maxSize) {
+        data = (uint8_t *)malloc(fsize ? (size_t)fsize : 1);
+    }
+    if (data && fread(data, 1, (size_t)fsize, file) != (size_t)fsize) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = (uint32_t)fsize;
+    return data;
+}
+
+// Loads a binary and its expected register file (<name>.res next to it)
+// ELF files are read too, but only to recognise them, each run maps them afresh
+static void loadBinary(batch_binary *bin) {
+    bin->image = readFile(bin->path, UINT32_MAX, &bin->size);
+    bin->loaded = (bin->image != NULL);
+
+    size_t len = strlen(bin->path);
+    char *resPath = (char *)malloc(len + 1);
+    if (!resPath) {
+        return;
+    }
+    memcpy(resPath, bin->path, len - 4);
+    strcpy(resPath + len - 4, ".res");
+
+    uint32_t resSize = 0;
+    uint8_t *res = readFile(resPath, sizeof(bin->expected), &resSize);
+    if (res && (resSize == NUM_REGS * sizeof(uint32_t) || resSize == sizeof(bin->expected))) {
+        memcpy(bin->expected, res, resSize);
+        bin->expectedWords = resSize / sizeof(uint32_t);
+        bin->hasExpected = 1;
+    }
+    free(res);
+    free(resPath);
+}
+
+// Collects the .bin and .elf files of dir in name order, returns the count or -1
+static int scanDirectory(const char *dir, batch_binary **bins) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror("Failed to open batch directory");
+        return -1;
+    }
+
+    char **names = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(d)) != NULL) {
+        if (!hasSuffix(entry->d_name, ".bin") && !hasSuffix(entry->d_name, ".elf")) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = (char **)realloc(names, capacity * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count]) {
+            count++;
+        }
+    }
+    closedir(d);
+
+    qsort(names, count, sizeof(char *), compareNames);
+
+    *bins = (batch_binary *)calloc(count ? count : 1, sizeof(batch_binary));
+    if (!*bins) {
+        count = 0;
+    }
+
+    size_t dirLen = strlen(dir);
+    int slash = (dirLen > 0 && dir[dirLen - 1] == '/');
+    for (uint32_t i = 0; i < count; i++) {
+        batch_binary *bin = &(*bins)[i];
+        bin->path = (char *)malloc(dirLen + strlen(names[i]) + 2);
+        if (bin->path) {
+            sprintf(bin->path, slash ? "%s%s" : "%s/%s", dir, names[i]);
+            bin->name = bin->path + dirLen + !slash;
+        }
+        free(names[i]);
+    }
+    free(names);
+    return (int)count;
+}
+
+// Takes the next job of worker id, stealing half of another worker's jobs when it has none left
+static int takeJob(batch_state *st, unsigned id, uint32_t *job) {
+    work_queue *own = &st->queues[id];
+
+    pthread_mutex_lock(&own->lock);
+    if (own->head < own->tail) {
+        *job = own->head++;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (unsigned i = 1; i < st->threads; i++) {
+        work_queue *victim = &st->queues[(id + i) % st->threads];
+
+        pthread_mutex_lock(&victim->lock);
+        uint32_t left = victim->tail - victim->head;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        uint32_t first = victim->tail - (left + 1) / 2;
+        uint32_t last = victim->tail;
+        victim->tail = first;
+        pthread_mutex_unlock(&victim->lock);
+
+        // Run the first stolen job now, the rest becomes stealable from this worker
+        pthread_mutex_lock(&own->lock);
+        own->head = first + 1;
+        own->tail = last;
+        pthread_mutex_unlock(&own->lock);
+        *job = first;
+        return 1;
+    }
+    return 0;
+}
+
+static void runJob(batch_state *st, Sim *sim, uint32_t job) {
+    batch_binary *bin = &st->bins[job % st->binCount];
+    batch_result *r = &st->results[job];
+
+    if (!bin->loaded) {
+        return; // Stays RUN_ERROR
+    }
+
+    double start = nowSeconds();
+    int loaded = isElfImage(bin->image, bin->size) ? sim_load_elf(sim, bin->path)
+                                                   : sim_load_image(sim, bin->image, bin->size);
+    if (loaded != 0) {
+        return;
+    }
+    halt_reason halt = sim_run(sim, st->opts->maxInstrs);
+    r->seconds = nowSeconds() - start;
+    r->retired = sim->hart.retired;
+    if (halt == HALT_ERROR) {
+        return; // Stays RUN_ERROR
+    }
+
+    uint32_t dump[DUMP_MAX_WORDS];
+    uint32_t dumpWords = registerDumpWords(sim->hart.regs, sim->hart.fregs, sim->hart.fcsr, dump);
+
+    if (halt == HALT_NONE) {
+        r->status = RUN_LIMIT;
+    } else if (!bin->hasExpected) {
+        r->status = RUN_NO_RES;
+    } else if (dumpWords == bin->expectedWords && memcmp(dump, bin->expected, dumpWords * sizeof(uint32_t)) == 0) {
+        r->status = RUN_PASS;
+    } else {
+        r->status = RUN_FAIL;
+    }
+
+    // Only the first run of a binary writes its answer file
+    if (st->opts->writeAnswers && job < st->binCount) {
+        dumpRegisterContentsFile(dump, dumpWords, bin->path);
+    }
+}
+
+static void *batchWorker(void *arg) {
+    batch_worker *w = (batch_worker *)arg;
+    batch_state *st = w->state;
+
+    // One simulator per worker, reset by every load (its jobs are stolen if this fails)
+    Sim *sim = sim_create(&st->config);
+    if (!sim) {
+        return NULL;
+    }
+
+    uint32_t job;
+    while (takeJob(st, w->id, &job)) {
+        runJob(st, sim, job);
+    }
+    sim_destroy(sim);
+    return NULL;
+}
+
+void batchDefaultOptions(batch_options *opts) {
+    sim_default_config(&opts->config);
+    opts->threads = 0;
+    opts->repeat = 1;
+    opts->maxInstrs = 0;
+    opts->writeAnswers = 0;
+}
+
+// Aggregates the runs of every binary, prints them and the batch totals
+static int printSummary(const batch_state *st, uint32_t jobs, double wall, FILE *out) {
+    uint32_t counts[RUN_ERROR + 1] = { 0 };
+    uint64_t totalRetired = 0;
+    double totalSeconds = 0;
+
+    for (uint32_t b = 0; b < st->binCount; b++) {
+        run_status worst = RUN_PASS;
+        uint64_t retired = 0;
+        double seconds = 0;
+
+        for (uint32_t job = b; job < jobs; job += st->binCount) {
+            const batch_result *r = &st->results[job];
+            if (r->status > worst) {
+                worst = r->status;
+            }
+            retired += r->retired;
+            seconds += r->seconds;
+        }
+
+        counts[worst]++;
+        totalRetired += retired;
+        totalSeconds += seconds;
+        fprintf(out, "%-6s %-24s %12llu instrs %10.3f ms/run %9.2f MIPS\n",
+                runStatusName(worst), st->bins[b].name,
+                (unsigned long long)st->results[b].retired,
+                seconds * 1e3 / st->opts->repeat,
+                seconds > 0 ? retired / seconds / 1e6 : 0.0);
+    }
+
+    fprintf(out, "Summary: %u passed, %u failed, %u without .res, %u hit the limit, %u errors\n",
+            counts[RUN_PASS], counts[RUN_FAIL], counts[RUN_NO_RES], counts[RUN_LIMIT], counts[RUN_ERROR]);
+    fprintf(out, "Retired %llu instructions in %.3f s wall on %u threads "
+            "(%.2f MIPS aggregate, %.2f MIPS per thread)\n",
+            (unsigned long long)totalRetired, wall, st->threads,
+            wall > 0 ? totalRetired / wall / 1e6 : 0.0,
+            totalSeconds > 0 ? totalRetired / totalSeconds / 1e6 : 0.0);
+
+    return (counts[RUN_FAIL] || counts[RUN_LIMIT] || counts[RUN_ERROR]) ? 1 : 0;
+}
+
+int runBatch(const char *dir, const batch_options *opts, FILE *out) {
+    batch_state st;
+    memset(&st, 0, sizeof(st));
+    st.opts = opts;
+    st.config = opts->config;
+    st.config.console = NULL; // Interleaved guest output from many threads is useless
+    st.config.profile = 0;
+    st.config.tracePath = NULL;
+
+    int found = scanDirectory(dir, &st.bins);
+    if (found < 0) {
+        return -1;
+    }
+    if (found == 0) {
+        fprintf(stderr, "No .bin or .elf files in %s\n", dir);
+        free(st.bins);
+        return -1;
+    }
+    st.binCount = (uint32_t)found;
+
+    for (uint32_t i = 0; i < st.binCount; i++) {
+        if (st.bins[i].path) {
+            loadBinary(&st.bins[i]);
+        }
+    }
+
+    unsigned repeat = opts->repeat ? opts->repeat : 1;
+    uint32_t jobs = st.binCount * repeat;
+    st.threads = opts->threads;
+    if (st.threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        st.threads = cores > 0 ? (unsigned)cores : 1;
+    }
+    if (st.threads > jobs) {
+        st.threads = jobs;
+    }
+
+    st.results = (batch_result *)calloc(jobs, sizeof(batch_result));
+    st.queues = (work_queue *)calloc(st.threads, sizeof(work_queue));
+    batch_worker *workers = (batch_worker *)calloc(st.threads, sizeof(batch_worker));
+    int status = -1;
+
+    if (st.results && st.queues && workers) {
+        for (uint32_t job = 0; job < jobs; job++) {
+            st.results[job].status = RUN_ERROR;
+        }
+        // Contiguous slices, so a worker's own jobs cycle through every binary
+        for (unsigned t = 0; t < st.threads; t++) {
+            pthread_mutex_init(&st.queues[t].lock, NULL);
+            st.queues[t].head = (uint32_t)((uint64_t)jobs * t / st.threads);
+            st.queues[t].tail = (uint32_t)((uint64_t)jobs * (t + 1) / st.threads);
+        }
+
+        fprintf(out, "Batch: %u binaries x %u runs on %u threads (%s engine)\n",
+                st.binCount, repeat, st.threads, engineName(st.config.engine));
+
+        double start = nowSeconds();
+        unsigned started = 0;
+        for (unsigned t = 0; t < st.threads; t++) {
+            workers[t].state = &st;
+            workers[t].id = t;
+            if (pthread_create(&workers[t].thread, NULL, batchWorker, &workers[t]) != 0) {
+                break; // The started workers steal the jobs of the missing ones
+            }
+            started++;
+        }
+        for (unsigned t = 0; t < started; t++) {
+            pthread_join(workers[t].thread, NULL);
+        }
+        double wall = nowSeconds() - start;
+
+        if (started == 0) {
+            fprintf(stderr, "Failed to start batch worker threads\n");
+        } else {
+            status = printSummary(&st, jobs, wall, out);
+        }
+
+        for (unsigned t = 0; t < st.threads; t++) {
+            pthread_mutex_destroy(&st.queues[t].lock);
+        }
+    } else {
+        fprintf(stderr, "Batch allocation failed\n");
+    }
+
+    for (uint32_t i = 0; i < st.binCount; i++) {
+        free(st.bins[i].image);
+        free(st.bins[i].path);
+    }
+    free(st.bins);
+    free(st.results);
+    free(st.queues);
+    free(workers);
+    return status;
+}
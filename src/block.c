@@ -0,0 +1,336 @@
+#include "../include/block.h"
+#include "../include/engine.h"
+#include "../include/execute.h"
+#include "../include/jit.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Pseudo-op appended after the last instruction of every block
+#define OP_BLOCK_END NUM_OPS
+
+static inline uint32_t blockHash(const BlockCache *blocks, uint32_t pc) {
+    return ((pc >> 1) * 2654435761u) >> (32 - blocks->bucketBits);
+}
+
+int blockCacheInit(BlockCache *blocks, PredecodeCache *cache) {
+    blocks->bucketBits = BLOCK_HASH_INITIAL_BITS;
+    blocks->buckets = (Block **)calloc(1u << blocks->bucketBits, sizeof(Block *));
+    blocks->blockCount = 0;
+    blocks->all = NULL;
+    blocks->jit = NULL;
+    blocks->stats = (block_stats){ 0, 0, 0, 0, 0 };
+
+    if (!blocks->buckets) {
+        return -1;
+    }
+
+    // Stores reach blockInvalidate through the predecode cache they are built from
+    cache->blocks = blocks;
+    return 0;
+}
+
+// Drops every translated block but keeps the buckets, for running another program
+void blockCacheReset(BlockCache *blocks) {
+    Block *blk = blocks->all;
+    while (blk) {
+        Block *next = blk->next;
+        free(blk->ops);
+        free(blk);
+        blk = next;
+    }
+
+    memset(blocks->buckets, 0, (1u << blocks->bucketBits) * sizeof(Block *));
+    blocks->blockCount = 0;
+    blocks->all = NULL;
+    blocks->stats = (block_stats){ 0, 0, 0, 0, 0 };
+}
+
+void blockCacheFree(BlockCache *blocks, PredecodeCache *cache) {
+    blockCacheReset(blocks);
+    free(blocks->buckets);
+    blocks->buckets = NULL;
+    cache->blocks = NULL;
+}
+
+// Doubles the bucket array, keeps the old one if that fails
+static void growBuckets(BlockCache *blocks) {
+    uint32_t bits = blocks->bucketBits + 1;
+    Block **buckets = (Block **)calloc(1u << bits, sizeof(Block *));
+    if (!buckets) {
+        return;
+    }
+
+    free(blocks->buckets);
+    blocks->buckets = buckets;
+    blocks->bucketBits = bits;
+    for (Block *blk = blocks->all; blk; blk = blk->next) {
+        uint32_t h = blockHash(blocks, blk->startPC);
+        blk->hashNext = buckets[h];
+        buckets[h] = blk;
+    }
+}
+
+// Fills blk with the instructions starting at its startPC
+static int translateBlock(Block *blk, PredecodeCache *cache, Memory *mem, uint32_t endPC) {
+    micro_op buf[MAX_BLOCK_OPS + 1];
+    uint32_t pc = blk->startPC;
+    uint32_t count = 0;
+
+    while (pc < endPC && count < MAX_BLOCK_OPS) {
+        buf[count] = *predecodeFetch(cache, mem, pc);
+        pc += buf[count].len;
+        if (opEndsBlock(buf[count++].op)) {
+            break;
+        }
+    }
+    buf[count] = (micro_op){ OP_BLOCK_END, 0, 0, 0, 0, 0, 0 };
+
+    micro_op *ops = (micro_op *)realloc(blk->ops, (count + 1) * sizeof(micro_op));
+    if (!ops) {
+        return -1;
+    }
+    for (uint32_t i = 0; i <= count; i++) {
+        ops[i] = buf[i];
+    }
+
+    blk->ops = ops;
+    blk->count = count;
+    blk->endPC = pc;
+    blk->valid = 1;
+    blk->execCount = 0;
+    blk->native = NULL; // Old native code (if any) stays in the JIT buffer until it is flushed
+    blk->nativeOps = 0;
+    return 0;
+}
+
+// Instructions of blk that start before pc
+static uint32_t opsBefore(const Block *blk, uint32_t pc) {
+    uint32_t n = 0;
+    for (uint32_t at = blk->startPC; n < blk->count && at < pc; n++) {
+        at += blk->ops[n].len;
+    }
+    return n;
+}
+
+// Returns the valid block starting at pc, translating it on a miss (NULL if out of memory)
+Block *blockLookup(BlockCache *blocks, PredecodeCache *cache, Memory *mem, uint32_t pc, uint32_t endPC) {
+    Block *blk = blocks->buckets[blockHash(blocks, pc)];
+    while (blk && blk->startPC != pc) {
+        blk = blk->hashNext;
+    }
+    blocks->stats.lookups++;
+
+    if (blk && blk->valid) {
+        blocks->stats.hits++;
+        return blk;
+    }
+    blocks->stats.misses++;
+
+    if (!blk) {
+        blk = (Block *)calloc(1, sizeof(Block));
+        if (!blk) {
+            return NULL;
+        }
+        if (blocks->blockCount >= (1u << blocks->bucketBits)) {
+            growBuckets(blocks);
+        }
+        uint32_t h = blockHash(blocks, pc);
+        blk->startPC = pc;
+        blk->next = blocks->all;
+        blocks->all = blk;
+        blk->hashNext = blocks->buckets[h];
+        blocks->buckets[h] = blk;
+        blocks->blockCount++;
+    }
+
+    if (translateBlock(blk, cache, mem, endPC) != 0) {
+        return NULL;
+    }
+    return blk;
+}
+
+// Drops every block whose code overlaps a store to [addr, addr + len)
+// Only reached when the store overwrote a decoded instruction (see predecodeInvalidate)
+void blockInvalidate(BlockCache *blocks, uint32_t addr, uint32_t len) {
+    for (Block *blk = blocks->all; blk; blk = blk->next) {
+        if (blk->valid && addr < blk->endPC && addr + len > blk->startPC) {
+            blk->valid = 0;
+            blocks->stats.invalidations++;
+        }
+    }
+}
+
+void printBlockStats(const BlockCache *blocks, FILE *out) {
+    const block_stats *s = &blocks->stats;
+    uint64_t transitions = s->lookups + s->chained;
+
+    fprintf(out, "Blocks: %u translated, %llu invalidated\n", blocks->blockCount, (unsigned long long)s->invalidations);
+    fprintf(out, "Block lookups: %llu (%llu hits, %llu misses)\n",
+            (unsigned long long)s->lookups, (unsigned long long)s->hits, (unsigned long long)s->misses);
+    fprintf(out, "Chained transitions: %llu of %llu (%.1f%%)\n",
+            (unsigned long long)s->chained, (unsigned long long)transitions,
+            transitions ? 100.0 * s->chained / transitions : 0.0);
+}
+
+// Hands blk to the JIT. When its buffer is full, every block drops its native code and counts
+// its executions afresh, so that the blocks still hot get compiled again into the emptied buffer
+static void compileBlock(BlockCache *blocks, Block *blk) {
+    if (jitCompile(blocks->jit, blk) != JIT_FULL) {
+        return;
+    }
+    for (Block *b = blocks->all; b; b = b->next) {
+        b->native = NULL;
+        b->nativeOps = 0;
+        b->execCount = 0;
+    }
+    jitFlush(blocks->jit);
+    blk->execCount = blocks->jit->threshold;
+    if (jitCompile(blocks->jit, blk) == JIT_FULL) {
+        blocks->jit->failures++;
+    }
+}
+
+#if defined(__GNUC__)
+
+// Block engine: runs whole blocks with the shared threaded handlers, and only goes back to
+// a PC lookup when leaving a block through an edge that has not been chained yet
+// With blocks->jit set, blocks entered jit->threshold times run as native code instead
+
+// v is evaluated even for x0, CSR accesses and FP compares and conversions have side effects
+#define RD(v)     do { uint32_t rdValue = (v); if (op->rd != ZERO) regs[op->rd] = rdValue; } while (0)
+#define RS1       regs[op->rs1]
+#define RS2       regs[op->rs2]
+#define IMM       op->imm
+#define LEN       op->len
+#define FRD(v)    (fregs[op->rd] = (v))
+#define FRS1      fregs[op->rs1]
+#define FRS2      fregs[op->rs2]
+#define FRS3      fregs[op->rs3]
+#define ZIMM      op->rs1
+
+// Following an edge: use the chained block when it is still valid, else look it up and link it
+#define FOLLOW(slot, target) do {                                       \
+        pc = (target);                                                  \
+        link = &blk->slot;                                              \
+        if (*link && (*link)->valid && (*link)->startPC == pc) {        \
+            blocks->stats.chained++;                                    \
+            blk = *link;                                                \
+            goto enter;                                                 \
+        }                                                               \
+        goto lookup;                                                    \
+    } while (0)
+
+#define NEXT_SEQ()       do { pc += LEN; op++; goto *handlers[op->op]; } while (0)
+#define NEXT_STORE()     do {                                           \
+        if (!blk->valid) { /* Overwrote its own block, stop using stale ops */ \
+            budget += (uint64_t)(blk->ops + blk->count - op - 1);       \
+            pc += LEN;                                                  \
+            link = NULL;                                                \
+            goto lookup;                                                \
+        }                                                               \
+        NEXT_SEQ();                                                     \
+    } while (0)
+#define NEXT_BRANCH(c)   do {                                           \
+        if (c) FOLLOW(taken, pc + IMM);                                 \
+        FOLLOW(fallthrough, pc + LEN);                                  \
+    } while (0)
+#define NEXT_JUMP(t)     FOLLOW(taken, t)
+#define NEXT_INDIRECT(t) FOLLOW(taken, t)
+#define NEXT_ECALL()     FOLLOW(fallthrough, pc + LEN)
+#define STOP()           do {                                           \
+        budget += (uint64_t)(blk->ops + blk->count - op - 1); /* Give back the rest of the block */ \
+        res.halted = 1;                                                 \
+        goto out;                                                       \
+    } while (0)
+
+engine_result runBlocks(Hart *hart, PredecodeCache *cache, BlockCache *blocks, uint64_t budget) {
+    static void *const handlers[NUM_OPS + 1] = {
+#include "optable.inc"
+        [OP_BLOCK_END] = &&block_end,
+    };
+
+    engine_result res = { 0, 0 };
+    const uint64_t initialBudget = budget;
+    uint32_t *const regs = hart->regs;
+    uint32_t *const fregs = hart->fregs;
+    Memory *const mem = &hart->mem;
+    const uint32_t basePC = hart->basePC;
+    const uint32_t endPC = hart->endPC;
+    uint32_t pc = hart->pc;
+    Block *blk;
+    Block **link = NULL;
+    const micro_op *op;
+
+lookup:
+    if (pc - basePC >= endPC - basePC) {
+        goto out;
+    }
+    blk = blockLookup(blocks, cache, mem, pc, endPC);
+    if (!blk) {
+        fprintf(stderr, "Block translation failed at PC 0x%08X\n", pc);
+        goto out;
+    }
+    if (link) {
+        *link = blk;
+    }
+
+enter:
+    if (blk->count > budget) { // Leave the rest of the budget to single steps
+        pc = blk->startPC;
+        goto out;
+    }
+    blk->execCount++;
+    budget -= blk->count; // Whole block charged up front, so budget counts down what is left
+    pc = blk->startPC;
+
+    if (blocks->jit && !blk->native && blk->execCount == blocks->jit->threshold) {
+        compileBlock(blocks, blk);
+    }
+    if (blk->native) {
+        pc = blk->native(regs, mem, blk);
+
+        if (mem->halted) { // A native load or store faulted or halted the hart, pc is on it
+            budget += blk->count - opsBefore(blk, pc) - 1;
+            res.halted = 1;
+            goto out;
+        }
+        if (!blk->valid) { // A native store overwrote this block, pc is the instruction after it
+            budget += blk->count - opsBefore(blk, pc);
+            link = NULL;
+            goto lookup;
+        }
+        if (blk->nativeOps < blk->count) { // Interpret the unsupported rest (e.g. the ECALL)
+            op = blk->ops + blk->nativeOps;
+            goto *handlers[op->op];
+        }
+
+        // The native terminator picked the successor, follow whichever edge it matches
+        if (pc == blk->endPC) {
+            FOLLOW(fallthrough, pc);
+        }
+        FOLLOW(taken, pc);
+    }
+
+    op = blk->ops;
+    goto *handlers[op->op];
+
+#include "ophandlers.inc"
+
+block_end: // Block was cut short of a control transfer, continue at endPC
+    FOLLOW(fallthrough, pc);
+
+out:
+    hart->pc = pc;
+    res.retired = initialBudget - budget;
+    return res;
+}
+
+#else
+
+// Without labels-as-values fall back to the switch engine
+engine_result runBlocks(Hart *hart, PredecodeCache *cache, BlockCache *blocks, uint64_t budget) {
+    (void)blocks;
+    return runPredecoded(hart, cache, budget);
+}
+
+#endif
@@ -0,0 +1,572 @@
+#include "../include/bpred.h"
+#include "../include/execute.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TAGE_TAG_BITS 9
+#define TAGE_NO_TAG 0xFFFF          // Tags have TAGE_TAG_BITS bits, so this never matches
+#define TAGE_AGING (1u << 18)       // Branches between two halvings of the useful bits
+#define MAX_RAS 1024
+#define FREE_SITE UINT32_MAX
+
+static const uint32_t tageHistory[BPRED_TAGE_TABLES] = { 4, 8, 16, 32 };
+static const char *kindNames[] = { "bimodal", "gshare", "tage", "btb" };
+
+struct tage_entry {
+    int8_t ctr;      // -4 to 3, predicts taken when not negative
+    uint8_t useful;  // 0 to 3
+    uint16_t tag;
+};
+
+void bpredDefaultSet(bpred_set *set) {
+    const bpred_config defaults[] = {
+        { BPRED_BIMODAL, 4096, 0 },
+        { BPRED_GSHARE, 4096, 12 },
+        { BPRED_TAGE, 1024, 0 },
+        { BPRED_BTB, 512, 16 },
+    };
+    set->count = sizeof(defaults) / sizeof(defaults[0]);
+    memcpy(set->configs, defaults, sizeof(defaults));
+}
+
+static int isPowerOfTwo(uint32_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t log2u(uint32_t x) {
+    uint32_t n = 0;
+    while (x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+// One "KIND[:ENTRIES[:BITS]]" item of len characters
+static int parseItem(const char *item, size_t len, bpred_config *config) {
+    size_t nameLen = strcspn(item, ":,");
+    int kind = -1;
+    for (int k = 0; k <= BPRED_BTB; k++) {
+        if (nameLen == strlen(kindNames[k]) && strncmp(item, kindNames[k], nameLen) == 0) {
+            kind = k;
+        }
+    }
+    if (kind < 0) {
+        return -1;
+    }
+
+    const uint32_t defaultEntries[] = { 4096, 4096, 1024, 512 };
+    config->kind = (bpred_kind)kind;
+    config->entries = defaultEntries[kind];
+    config->history = kind == BPRED_BTB ? 16 : 0;
+
+    char *end = (char *)item + nameLen;
+    if (*end == ':') {
+        config->entries = (uint32_t)strtoul(end + 1, &end, 0);
+    }
+    if (*end == ':' && (kind == BPRED_GSHARE || kind == BPRED_BTB)) {
+        config->history = (uint32_t)strtoul(end + 1, &end, 0);
+    } else if (kind == BPRED_GSHARE) {
+        config->history = log2u(config->entries) < 32 ? log2u(config->entries) : 32;
+    }
+    if (end != item + len || !isPowerOfTwo(config->entries) || config->entries < 2 ||
+        (kind == BPRED_GSHARE && config->history > 32) || (kind == BPRED_BTB && config->history > MAX_RAS)) {
+        return -1;
+    }
+    return 0;
+}
+
+int parseBranchPredictors(const char *spec, bpred_set *set) {
+    set->count = 0;
+    while (*spec) {
+        size_t len = strcspn(spec, ",");
+        if (set->count == BPRED_MAX) {
+            fprintf(stderr, "At most %d branch predictors run together\n", BPRED_MAX);
+            return -1;
+        }
+        if (parseItem(spec, len, &set->configs[set->count]) != 0) {
+            fprintf(stderr, "Bad branch predictor '%.*s', expected bimodal[:ENTRIES], gshare[:ENTRIES[:HISTORY]], "
+                    "tage[:ENTRIES] or btb[:ENTRIES[:RAS]] with power-of-two entries\n", (int)len, spec);
+            return -1;
+        }
+        set->count++;
+        spec += len + (spec[len] == ',');
+    }
+    return set->count ? 0 : -1;
+}
+
+static int predictorInit(Predictor *p, const bpred_config *config) {
+    memset(p, 0, sizeof(*p));
+    p->config = *config;
+    int failed = 0;
+
+    switch (config->kind) {
+        case BPRED_BIMODAL:
+        case BPRED_GSHARE:
+            failed = !(p->counters = (uint8_t *)malloc(config->entries));
+            break;
+        case BPRED_TAGE:
+            p->foldWidth[0] = log2u(config->entries);
+            p->foldWidth[1] = TAGE_TAG_BITS;
+            p->foldWidth[2] = TAGE_TAG_BITS - 1;
+            for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+                for (int f = 0; f < 3; f++) {
+                    p->foldOut[t][f] = tageHistory[t] % p->foldWidth[f];
+                }
+            }
+            failed = !(p->counters = (uint8_t *)malloc(config->entries));
+            for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+                p->tagged[t] = (struct tage_entry *)malloc(config->entries * sizeof(struct tage_entry));
+                failed |= !p->tagged[t];
+            }
+            break;
+        case BPRED_BTB:
+            p->btbPc = (uint32_t *)malloc(config->entries * sizeof(uint32_t));
+            p->btbTarget = (uint32_t *)malloc(config->entries * sizeof(uint32_t));
+            p->ras = (uint32_t *)malloc((config->history ? config->history : 1) * sizeof(uint32_t));
+            failed = !p->btbPc || !p->btbTarget || !p->ras;
+            break;
+    }
+    return failed ? -1 : 0;
+}
+
+static void predictorReset(Predictor *p) {
+    uint32_t entries = p->config.entries;
+    if (p->counters) {
+        memset(p->counters, 1, entries); // Weakly not taken
+    }
+    for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+        for (uint32_t i = 0; p->tagged[t] && i < entries; i++) {
+            p->tagged[t][i].ctr = 0;
+            p->tagged[t][i].useful = 0;
+            p->tagged[t][i].tag = TAGE_NO_TAG;
+        }
+    }
+    if (p->btbPc) {
+        memset(p->btbPc, 0xFF, entries * sizeof(uint32_t)); // No instruction sits at 0xFFFFFFFF
+        memset(p->ras, 0, (p->config.history ? p->config.history : 1) * sizeof(uint32_t));
+    }
+    p->history = 0;
+    p->longHistory = 0;
+    memset(p->folded, 0, sizeof(p->folded));
+    p->tick = 0;
+    p->rasTop = 0;
+    p->predictions = 0;
+    p->misses = 0;
+}
+
+static void predictorFree(Predictor *p) {
+    free(p->counters);
+    for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+        free(p->tagged[t]);
+    }
+    free(p->btbPc);
+    free(p->btbTarget);
+    free(p->ras);
+    memset(p, 0, sizeof(*p));
+}
+
+int bpredInit(BranchModel *model, const bpred_set *set) {
+    memset(model, 0, sizeof(*model));
+    for (uint32_t i = 0; i < set->count; i++) {
+        model->count++;
+        if (predictorInit(&model->predictors[i], &set->configs[i]) != 0) {
+            fprintf(stderr, "Branch predictor %s:%u: table allocation failed\n", kindNames[set->configs[i].kind],
+                    set->configs[i].entries);
+            bpredFree(model);
+            return -1;
+        }
+    }
+    model->siteMask = 1023;
+    model->sites = (bpred_site *)malloc((model->siteMask + 1) * sizeof(bpred_site));
+    if (!model->sites) {
+        fprintf(stderr, "Branch site table allocation failed\n");
+        bpredFree(model);
+        return -1;
+    }
+    bpredReset(model);
+    return 0;
+}
+
+// Cold predictors and no sites, the site table keeps its grown size
+void bpredReset(BranchModel *model) {
+    for (uint32_t i = 0; i < model->count; i++) {
+        predictorReset(&model->predictors[i]);
+    }
+    for (uint32_t i = 0; i <= model->siteMask; i++) {
+        model->sites[i].pc = FREE_SITE;
+    }
+    model->siteCount = 0;
+    model->instructions = 0;
+    model->outOfMemory = 0;
+}
+
+void bpredFree(BranchModel *model) {
+    for (uint32_t i = 0; i < model->count; i++) {
+        predictorFree(&model->predictors[i]);
+    }
+    free(model->sites);
+    model->sites = NULL;
+    model->count = 0;
+}
+
+static bpred_site *findSite(bpred_site *sites, uint32_t mask, uint32_t pc) {
+    for (uint32_t i = ((pc >> 1) * 0x9E3779B1u >> 7) & mask;; i = (i + 1) & mask) {
+        if (sites[i].pc == pc || sites[i].pc == FREE_SITE) {
+            return &sites[i];
+        }
+    }
+}
+
+static bpred_site *site(BranchModel *model, uint32_t pc, uint8_t op) {
+    bpred_site *s = findSite(model->sites, model->siteMask, pc);
+    if (s->pc == pc) {
+        return s;
+    }
+
+    if ((model->siteCount + 1) * 2 > model->siteMask) { // Keep it at most half full
+        uint32_t mask = model->siteMask * 2 + 1;
+        bpred_site *grown = (bpred_site *)malloc(((size_t)mask + 1) * sizeof(bpred_site));
+        if (!grown) {
+            if (!model->outOfMemory) {
+                fprintf(stderr, "Out of host memory for branch sites\n");
+            }
+            model->outOfMemory = 1;
+            return &model->lost;
+        }
+        for (uint32_t i = 0; i <= mask; i++) {
+            grown[i].pc = FREE_SITE;
+        }
+        for (uint32_t i = 0; i <= model->siteMask; i++) {
+            if (model->sites[i].pc != FREE_SITE) {
+                *findSite(grown, mask, model->sites[i].pc) = model->sites[i];
+            }
+        }
+        free(model->sites);
+        model->sites = grown;
+        model->siteMask = mask;
+        s = findSite(grown, mask, pc);
+    }
+    memset(s, 0, sizeof(*s));
+    s->pc = pc;
+    s->op = op;
+    model->siteCount++;
+    return s;
+}
+
+static inline void train(uint8_t *counter, int taken) {
+    if (taken && *counter < 3) {
+        (*counter)++;
+    } else if (!taken && *counter > 0) {
+        (*counter)--;
+    }
+}
+
+// Shifts outcome into the TAGE history and its folded copies. Each folded register xors the
+// newest history bits down to its width, updated incrementally: the new bit enters at the
+// bottom and the bit leaving the table's history length is xored back out
+static void tageShift(Predictor *p, int taken) {
+    p->longHistory = (p->longHistory << 1) | (uint64_t)taken;
+    for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+        uint32_t leaving = (uint32_t)(p->longHistory >> tageHistory[t]) & 1;
+        for (int f = 0; f < 3; f++) {
+            uint32_t width = p->foldWidth[f];
+            uint32_t folded = (p->folded[t][f] << 1) | (uint32_t)taken;
+            folded ^= leaving << p->foldOut[t][f];
+            folded ^= folded >> width;
+            p->folded[t][f] = folded & ((1u << width) - 1);
+        }
+    }
+}
+
+// TAGE-lite: the longest-history tagged table whose entry matches provides the prediction,
+// the next matching one (or the base) is the alternative. A misprediction allocates an entry
+// in a longer table whose useful counter is zero, the useful counters record where the
+// provider was right and the alternative wrong
+static int tagePredict(Predictor *p, uint32_t pc, int taken) {
+    uint32_t bits = p->foldWidth[0];
+    uint32_t mask = p->config.entries - 1;
+    uint32_t index[BPRED_TAGE_TABLES], tag[BPRED_TAGE_TABLES];
+    int provider = -1, alternative = -1;
+
+    for (int t = BPRED_TAGE_TABLES - 1; t >= 0; t--) {
+        index[t] = ((pc >> 1) ^ (pc >> (1 + bits)) ^ p->folded[t][0]) & mask;
+        tag[t] = ((pc >> 1) ^ p->folded[t][1] ^ (p->folded[t][2] << 1)) & ((1u << TAGE_TAG_BITS) - 1);
+        if (p->tagged[t][index[t]].tag == tag[t]) {
+            if (provider < 0) {
+                provider = t;
+            } else if (alternative < 0) {
+                alternative = t;
+            }
+        }
+    }
+
+    uint8_t *base = &p->counters[(pc >> 1) & mask];
+    int basePrediction = *base >= 2;
+    int altPrediction = alternative >= 0 ? p->tagged[alternative][index[alternative]].ctr >= 0 : basePrediction;
+    int prediction = basePrediction;
+
+    if (provider >= 0) {
+        struct tage_entry *e = &p->tagged[provider][index[provider]];
+        prediction = e->ctr >= 0;
+        if (prediction != altPrediction) {
+            if (prediction == taken && e->useful < 3) {
+                e->useful++;
+            } else if (prediction != taken && e->useful > 0) {
+                e->useful--;
+            }
+        }
+        if (taken && e->ctr < 3) {
+            e->ctr++;
+        } else if (!taken && e->ctr > -4) {
+            e->ctr--;
+        }
+    } else {
+        train(base, taken);
+    }
+
+    if (prediction != taken && provider < BPRED_TAGE_TABLES - 1) {
+        int allocated = 0;
+        for (int t = provider + 1; t < BPRED_TAGE_TABLES && !allocated; t++) {
+            struct tage_entry *e = &p->tagged[t][index[t]];
+            if (e->useful == 0) {
+                e->tag = (uint16_t)tag[t];
+                e->ctr = taken ? 0 : -1;
+                allocated = 1;
+            }
+        }
+        for (int t = provider + 1; t < BPRED_TAGE_TABLES && !allocated; t++) {
+            p->tagged[t][index[t]].useful--;
+        }
+    }
+
+    if (++p->tick == TAGE_AGING) {
+        p->tick = 0;
+        for (int t = 0; t < BPRED_TAGE_TABLES; t++) {
+            for (uint32_t i = 0; i < p->config.entries; i++) {
+                p->tagged[t][i].useful >>= 1;
+            }
+        }
+    }
+    tageShift(p, taken);
+    return prediction;
+}
+
+// Predicts and trains on one conditional branch, returns whether the prediction was right
+static int predictBranch(Predictor *p, uint32_t pc, int taken) {
+    int prediction;
+    uint32_t mask = p->config.entries - 1;
+
+    switch (p->config.kind) {
+        case BPRED_BIMODAL: {
+            uint8_t *counter = &p->counters[(pc >> 1) & mask];
+            prediction = *counter >= 2;
+            train(counter, taken);
+            break;
+        }
+        case BPRED_GSHARE: {
+            uint32_t history = p->config.history < 32 ? p->history & ((1u << p->config.history) - 1) : p->history;
+            uint8_t *counter = &p->counters[((pc >> 1) ^ history) & mask];
+            prediction = *counter >= 2;
+            train(counter, taken);
+            p->history = (p->history << 1) | (uint32_t)taken;
+            break;
+        }
+        default:
+            prediction = tagePredict(p, pc, taken);
+            break;
+    }
+    return prediction == taken;
+}
+
+static inline int isLink(uint32_t reg) {
+    return reg == RA || reg == T0;
+}
+
+// Predicts and trains on one JAL or JALR, returns whether the predicted target was right
+// The RAS follows the RISC-V hints: rd = ra or t0 pushes the return address, rs1 = ra or t0
+// with another rd pops (both when they are different link registers)
+static int predictJump(Predictor *p, uint32_t pc, const micro_op *op, uint32_t target) {
+    uint32_t depth = p->config.history;
+    int pushes = isLink(op->rd);
+    int pops = op->op == OP_JALR && isLink(op->rs1) && (!pushes || op->rd != op->rs1);
+    uint32_t index = (pc >> 1) & (p->config.entries - 1);
+    int correct;
+
+    if (pops && depth) {
+        p->rasTop = (p->rasTop + depth - 1) % depth;
+        correct = p->ras[p->rasTop] == target;
+    } else {
+        correct = p->btbPc[index] == pc && p->btbTarget[index] == target;
+        p->btbPc[index] = pc;
+        p->btbTarget[index] = target;
+    }
+    if (pushes && depth) {
+        p->ras[p->rasTop] = pc + op->len;
+        p->rasTop = (p->rasTop + 1) % depth;
+    }
+    return correct;
+}
+
+static inline int isBranch(uint8_t op) {
+    return op >= OP_BEQ && op <= OP_BGEU;
+}
+
+engine_result runPredicted(Hart *hart, PredecodeCache *cache, BranchModel *model, uint64_t budget) {
+    engine_result res = { 0, 0 };
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        uint32_t pc = hart->pc;
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, pc);
+
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        if (isBranch(op.op) || op.op == OP_JAL || op.op == OP_JALR) {
+            int branch = isBranch(op.op);
+            int taken = !branch || hart->pc != pc + op.len;
+            bpred_site *s = site(model, pc, op.op);
+            s->executions++;
+            s->taken += (uint64_t)taken;
+
+            for (uint32_t i = 0; i < model->count; i++) {
+                Predictor *p = &model->predictors[i];
+                if (branch != (p->config.kind != BPRED_BTB)) {
+                    continue;
+                }
+                int correct = branch ? predictBranch(p, pc, taken) : predictJump(p, pc, &op, hart->pc);
+                p->predictions++;
+                if (!correct) {
+                    p->misses++;
+                    s->misses[i]++;
+                }
+            }
+        }
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+
+    model->instructions += res.retired;
+    return res;
+}
+
+static void predictorName(char *buf, size_t size, const bpred_config *config) {
+    if (config->kind == BPRED_GSHARE || config->kind == BPRED_BTB) {
+        snprintf(buf, size, "%s:%u:%u", kindNames[config->kind], config->entries, config->history);
+    } else {
+        snprintf(buf, size, "%s:%u", kindNames[config->kind], config->entries);
+    }
+}
+
+// Bits of state the predictor's tables hold
+static uint64_t storageBits(const bpred_config *config) {
+    uint64_t entries = config->entries;
+    switch (config->kind) {
+        case BPRED_BIMODAL: return entries * 2;
+        case BPRED_GSHARE:  return entries * 2 + config->history;
+        case BPRED_TAGE:    return entries * 2 + BPRED_TAGE_TABLES * entries * (3 + 2 + TAGE_TAG_BITS) + 64;
+        default:            return entries * 62 + (uint64_t)config->history * 32; // 31-bit halfword PCs and targets
+    }
+}
+
+static uint64_t siteMisses(const BranchModel *model, const bpred_site *s) {
+    uint64_t misses = 0;
+    for (uint32_t i = 0; i < model->count; i++) {
+        misses += s->misses[i];
+    }
+    return misses;
+}
+
+typedef struct {
+    uint64_t misses;         // Of all predictors together
+    bpred_site site;
+} ranked_site;
+
+static int compareSites(const void *a, const void *b) {
+    const ranked_site *x = (const ranked_site *)a;
+    const ranked_site *y = (const ranked_site *)b;
+    if (x->misses != y->misses) {
+        return x->misses > y->misses ? -1 : 1;
+    }
+    if (x->site.executions != y->site.executions) {
+        return x->site.executions > y->site.executions ? -1 : 1;
+    }
+    return x->site.pc < y->site.pc ? -1 : x->site.pc > y->site.pc;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+void bpredWriteReport(const BranchModel *model, const SymbolTable *symbols, FILE *out) {
+    uint64_t branches = 0, taken = 0, jumps = 0;
+    for (uint32_t i = 0; i <= model->siteMask; i++) {
+        const bpred_site *s = &model->sites[i];
+        if (s->pc == FREE_SITE) {
+            continue;
+        }
+        if (isBranch(s->op)) {
+            branches += s->executions;
+            taken += s->taken;
+        } else {
+            jumps += s->executions;
+        }
+    }
+
+    fprintf(out, "Branch predictors: %llu instructions, %llu conditional branches (%.2f%% taken), %llu jumps\n\n",
+            (unsigned long long)model->instructions, (unsigned long long)branches, percent(taken, branches),
+            (unsigned long long)jumps);
+    fprintf(out, "%-18s %10s %14s %12s %9s %8s\n", "predictor", "storage", "predictions", "misses", "accuracy", "MPKI");
+    char name[BPRED_MAX][32];
+    for (uint32_t i = 0; i < model->count; i++) {
+        const Predictor *p = &model->predictors[i];
+        predictorName(name[i], sizeof(name[i]), &p->config);
+        fprintf(out, "%-18s %6.1f KiB %14llu %12llu %8.2f%% %8.3f\n", name[i],
+                (double)storageBits(&p->config) / 8192.0, (unsigned long long)p->predictions,
+                (unsigned long long)p->misses, 100.0 - percent(p->misses, p->predictions),
+                model->instructions ? 1000.0 * (double)p->misses / (double)model->instructions : 0.0);
+    }
+
+    // Sites with a misprediction, most missed first
+    ranked_site *list = (ranked_site *)malloc((model->siteCount ? model->siteCount : 1) * sizeof(ranked_site));
+    uint32_t n = 0;
+    for (uint32_t i = 0; list && i <= model->siteMask; i++) {
+        uint64_t misses = model->sites[i].pc != FREE_SITE ? siteMisses(model, &model->sites[i]) : 0;
+        if (misses) {
+            list[n].misses = misses;
+            list[n].site = model->sites[i];
+            n++;
+        }
+    }
+    if (list) {
+        qsort(list, n, sizeof(ranked_site), compareSites);
+    }
+
+    fprintf(out, "\nSites with the most mispredictions, accuracy of each predictor\n%-10s  %-6s %12s %7s", "pc", "op",
+            "executions", "taken");
+    for (uint32_t i = 0; i < model->count; i++) {
+        fprintf(out, " %18s", name[i]);
+    }
+    fprintf(out, "  location\n");
+
+    char loc[128];
+    for (uint32_t r = 0; r < n && r < BPRED_TOP; r++) {
+        const bpred_site *s = &list[r].site;
+        fprintf(out, "0x%08X  %-6s %12llu %6.2f%%", s->pc, opName((op_t)s->op), (unsigned long long)s->executions,
+                percent(s->taken, s->executions));
+        for (uint32_t i = 0; i < model->count; i++) {
+            int applies = isBranch(s->op) == (model->predictors[i].config.kind != BPRED_BTB);
+            if (applies) {
+                fprintf(out, " %17.2f%%", 100.0 - percent(s->misses[i], s->executions));
+            } else {
+                fprintf(out, " %18s", "-");
+            }
+        }
+        symbolFormat(loc, sizeof(loc), symbols, s->pc);
+        fprintf(out, "  %s\n", loc);
+    }
+    free(list);
+}
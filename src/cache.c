@@ -0,0 +1,661 @@
+#include "../include/cache.h"
+#include "../include/execute.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_SEED 0x2545F491u
+
+const uint8_t cacheDataAccess[NUM_OPS] = {
+    [OP_LB] = 1, [OP_LBU] = 1, [OP_LH] = 2, [OP_LHU] = 2, [OP_LW] = 4, [OP_FLW] = 4,
+    [OP_SB] = 1 | CACHE_ACCESS_WRITE, [OP_SH] = 2 | CACHE_ACCESS_WRITE, [OP_SW] = 4 | CACHE_ACCESS_WRITE,
+    [OP_FSW] = 4 | CACHE_ACCESS_WRITE,
+};
+
+static const char *policyNames[] = { "LRU", "PLRU", "random" };
+
+void cacheDefaultConfig(cache_config *config) {
+    cache_level_config l1 = { 32 * 1024, 8, 64, CACHE_LRU, 1, 1 };
+    config->l1i = l1;
+    config->l1d = l1;
+    memset(&config->l2, 0, sizeof(config->l2));
+}
+
+int parseCacheLevel(const char *spec, cache_level_config *level) {
+    memset(level, 0, sizeof(*level));
+    if (strcmp(spec, "0") == 0 || strcmp(spec, "off") == 0) {
+        return 0;
+    }
+
+    char *end;
+    unsigned long size = strtoul(spec, &end, 0);
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    if (*end != ':') {
+        goto bad;
+    }
+    level->ways = (uint32_t)strtoul(end + 1, &end, 0);
+    if (*end != ':') {
+        goto bad;
+    }
+    level->lineSize = (uint32_t)strtoul(end + 1, &end, 0);
+    level->size = (uint32_t)size;
+    level->policy = CACHE_LRU;
+    level->writeBack = 1;
+    level->writeAllocate = 1;
+
+    while (*end == ':') {
+        const char *option = end + 1;
+        size_t len = strcspn(option, ":");
+        if (len == 3 && strncmp(option, "lru", 3) == 0) {
+            level->policy = CACHE_LRU;
+        } else if (len == 4 && strncmp(option, "plru", 4) == 0) {
+            level->policy = CACHE_PLRU;
+        } else if (len == 6 && strncmp(option, "random", 6) == 0) {
+            level->policy = CACHE_RANDOM;
+        } else if (len == 2 && strncmp(option, "wt", 2) == 0) {
+            level->writeBack = 0;
+        } else if (len == 3 && strncmp(option, "nwa", 3) == 0) {
+            level->writeAllocate = 0;
+        } else {
+            goto bad;
+        }
+        end = (char *)option + len;
+    }
+    if (*end == '\0') {
+        return 0;
+    }
+
+bad:
+    fprintf(stderr, "Bad cache level '%s', expected SIZE:WAYS:LINE[:lru|plru|random][:wt][:nwa]\n", spec);
+    return -1;
+}
+
+static int isPowerOfTwo(uint32_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static uint32_t log2u(uint32_t x) {
+    uint32_t n = 0;
+    while (x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+static int levelInit(CacheLevel *c, const cache_level_config *config, const char *name) {
+    memset(c, 0, sizeof(*c));
+    c->config = *config;
+    c->name = name;
+    if (config->size == 0) {
+        return 0;
+    }
+
+    uint32_t sets = (config->ways && config->lineSize) ? config->size / config->ways / config->lineSize : 0;
+    if (!isPowerOfTwo(config->lineSize) || config->lineSize < 4 || !isPowerOfTwo(sets) ||
+        (uint64_t)sets * config->ways * config->lineSize != config->size) {
+        fprintf(stderr, "%s: %u bytes, %u ways and %u-byte lines do not make a power-of-two number of sets\n",
+                name, config->size, config->ways, config->lineSize);
+        return -1;
+    }
+    if (config->policy == CACHE_PLRU && (!isPowerOfTwo(config->ways) || config->ways > CACHE_MAX_PLRU_WAYS)) {
+        fprintf(stderr, "%s: PLRU needs a power of two of at most %u ways\n", name, CACHE_MAX_PLRU_WAYS);
+        return -1;
+    }
+
+    c->lineShift = log2u(config->lineSize);
+    c->setMask = sets - 1;
+    c->tags = (uint32_t *)malloc((size_t)sets * config->ways * sizeof(uint32_t));
+    c->plru = config->policy == CACHE_PLRU ? (uint32_t *)malloc(sets * sizeof(uint32_t)) : NULL;
+    if (!c->tags || (config->policy == CACHE_PLRU && !c->plru)) {
+        fprintf(stderr, "%s: tag array allocation failed\n", name);
+        free(c->tags);
+        free(c->plru);
+        c->tags = NULL;
+        c->plru = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void levelReset(CacheLevel *c) {
+    uint32_t sets = c->setMask + 1;
+    if (c->tags) {
+        memset(c->tags, 0xFF, (size_t)sets * c->config.ways * sizeof(uint32_t)); // CACHE_EMPTY
+    }
+    if (c->plru) {
+        memset(c->plru, 0, sets * sizeof(uint32_t));
+    }
+    c->random = RANDOM_SEED;
+    memset(&c->stats, 0, sizeof(c->stats));
+}
+
+static void levelFree(CacheLevel *c) {
+    free(c->tags);
+    free(c->plru);
+    c->tags = NULL;
+    c->plru = NULL;
+}
+
+int cacheInit(CacheModel *model, const cache_config *config) {
+    memset(model, 0, sizeof(*model));
+    if (levelInit(&model->l1i, &config->l1i, "L1I") != 0 ||
+        levelInit(&model->l1d, &config->l1d, "L1D") != 0 ||
+        levelInit(&model->l2, &config->l2, "L2") != 0) {
+        cacheFree(model);
+        return -1;
+    }
+
+    CacheLevel *l2 = config->l2.size ? &model->l2 : NULL;
+    model->l1i.next = l2;
+    model->l1d.next = l2;
+    model->fetchLevel = config->l1i.size ? &model->l1i : l2;
+    model->dataLevel = config->l1d.size ? &model->l1d : l2;
+    cacheReset(model);
+    return 0;
+}
+
+// Empties every level and drops all counters, the per-PC pages are released
+void cacheReset(CacheModel *model) {
+    levelReset(&model->l1i);
+    levelReset(&model->l1d);
+    levelReset(&model->l2);
+    model->lastFetchLine = CACHE_EMPTY;
+    model->memoryReads = 0;
+    model->memoryWrites = 0;
+    model->instructions = 0;
+
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        if (!model->tables[t]) {
+            continue;
+        }
+        for (uint32_t p = 0; p < PAGE_TABLE_ENTRIES; p++) {
+            free(model->tables[t][p]);
+        }
+        free(model->tables[t]);
+        model->tables[t] = NULL;
+    }
+    model->lastVpn = TLB_INVALID;
+    model->lastEntries = NULL;
+    model->outOfMemory = 0;
+}
+
+void cacheFree(CacheModel *model) {
+    cacheReset(model);
+    levelFree(&model->l1i);
+    levelFree(&model->l1d);
+    levelFree(&model->l2);
+}
+
+// Slow path of the counter lookup, allocates the page of counters on first use (NULL when
+// that fails)
+static cache_pc_stats *statsPage(CacheModel *model, uint32_t pc) {
+    cache_pc_stats ***table = &model->tables[pc >> PAGE_TABLE_SHIFT];
+    if (!*table) {
+        *table = (cache_pc_stats **)calloc(PAGE_TABLE_ENTRIES, sizeof(cache_pc_stats *));
+    }
+    cache_pc_stats **page = *table ? &(*table)[(pc >> PAGE_SHIFT) & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+    if (page && !*page) {
+        *page = (cache_pc_stats *)calloc(OPS_PER_PAGE, sizeof(cache_pc_stats));
+    }
+    if (!page || !*page) {
+        if (!model->outOfMemory) {
+            fprintf(stderr, "Out of host memory for cache counters\n");
+        }
+        model->outOfMemory = 1;
+        return NULL;
+    }
+    model->lastVpn = pc >> PAGE_SHIFT;
+    model->lastEntries = *page;
+    return *page;
+}
+
+static inline cache_pc_stats *pcStats(CacheModel *model, uint32_t pc) {
+    cache_pc_stats *entries = (pc >> PAGE_SHIFT) == model->lastVpn ? model->lastEntries : statsPage(model, pc);
+    return entries ? &entries[opIndex(pc)] : &model->lost;
+}
+
+// Marks way as the most recently used of its set (tags points at the set)
+static inline void touch(CacheLevel *c, uint32_t set, uint32_t *tags, uint32_t way) {
+    switch (c->config.policy) {
+        case CACHE_LRU:
+            if (way != 0) {
+                uint32_t tag = tags[way];
+                memmove(tags + 1, tags, way * sizeof(uint32_t));
+                tags[0] = tag;
+            }
+            break;
+        case CACHE_PLRU: { // Every node on the way's path points away from it
+            uint32_t node = 1;
+            for (uint32_t half = c->config.ways >> 1; half; half >>= 1) {
+                uint32_t right = (way & half) != 0;
+                if (right) {
+                    c->plru[set] &= ~(1u << node);
+                } else {
+                    c->plru[set] |= 1u << node;
+                }
+                node = node * 2 + right;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Way to refill: an empty one if any, else the one the policy picks
+static uint32_t victim(CacheLevel *c, uint32_t set, const uint32_t *tags) {
+    uint32_t ways = c->config.ways;
+    if (c->config.policy == CACHE_LRU) {
+        return ways - 1; // Empty ways collect at the end
+    }
+    for (uint32_t w = 0; w < ways; w++) {
+        if (tags[w] == CACHE_EMPTY) {
+            return w;
+        }
+    }
+    if (c->config.policy == CACHE_PLRU) {
+        uint32_t node = 1, way = 0;
+        for (uint32_t half = ways >> 1; half; half >>= 1) {
+            uint32_t right = (c->plru[set] >> node) & 1;
+            way |= right ? half : 0;
+            node = node * 2 + right;
+        }
+        return way;
+    }
+    c->random ^= c->random << 13;
+    c->random ^= c->random >> 17;
+    c->random ^= c->random << 5;
+    return c->random % ways;
+}
+
+static int cacheAccess(CacheModel *model, CacheLevel *c, uint32_t addr, int write);
+
+static inline void nextLevel(CacheModel *model, CacheLevel *c, uint32_t addr, int write) {
+    if (c->next) {
+        cacheAccess(model, c->next, addr, write);
+    } else if (write) {
+        model->memoryWrites++;
+    } else {
+        model->memoryReads++;
+    }
+}
+
+// One access to the line holding addr, returns 1 on a miss
+static int cacheAccess(CacheModel *model, CacheLevel *c, uint32_t addr, int write) {
+    uint32_t line = addr >> c->lineShift;
+    uint32_t set = line & c->setMask;
+    uint32_t ways = c->config.ways;
+    uint32_t *tags = c->tags + (size_t)set * ways;
+
+    if (write) {
+        c->stats.writes++;
+    } else {
+        c->stats.reads++;
+    }
+    for (uint32_t w = 0; w < ways; w++) {
+        if ((tags[w] >> 1) == line) { // CACHE_EMPTY >> 1 is no line number
+            if (write && c->config.writeBack) {
+                tags[w] |= 1;
+            } else if (write) {
+                nextLevel(model, c, addr, 1);
+            }
+            touch(c, set, tags, w);
+            return 0;
+        }
+    }
+
+    if (write) {
+        c->stats.writeMisses++;
+        if (!c->config.writeAllocate) {
+            nextLevel(model, c, addr, 1);
+            return 1;
+        }
+    } else {
+        c->stats.readMisses++;
+    }
+
+    uint32_t w = victim(c, set, tags);
+    if (tags[w] != CACHE_EMPTY) {
+        c->stats.evictions++;
+        if (tags[w] & 1) {
+            c->stats.writebacks++;
+            nextLevel(model, c, (tags[w] >> 1) << c->lineShift, 1);
+        }
+    }
+    nextLevel(model, c, addr, 0); // Line fill
+    tags[w] = (line << 1) | (write && c->config.writeBack);
+    if (write && !c->config.writeBack) {
+        nextLevel(model, c, addr, 1);
+    }
+    touch(c, set, tags, w);
+    return 1;
+}
+
+static inline uint64_t l2Misses(const CacheModel *model) {
+    return model->l2.stats.readMisses + model->l2.stats.writeMisses;
+}
+
+static inline uint64_t evictions(const CacheModel *model) {
+    return model->l1i.stats.evictions + model->l1d.stats.evictions + model->l2.stats.evictions;
+}
+
+// Accesses every line of [addr, addr + size) in c, returns the misses
+static uint32_t accessLines(CacheModel *model, CacheLevel *c, uint32_t addr, uint32_t size, int write, uint32_t *lines) {
+    uint32_t first = addr >> c->lineShift;
+    uint32_t last = (addr + size - 1) >> c->lineShift;
+    uint32_t misses = 0;
+
+    if (last < first) { // Wrapped around the top of the address space
+        last = first;
+    }
+    *lines = last - first + 1;
+    for (uint32_t line = first;; line++) {
+        misses += (uint32_t)cacheAccess(model, c, line << c->lineShift, write);
+        if (line == last) {
+            return misses;
+        }
+    }
+}
+
+static void fetchSlow(CacheModel *model, uint32_t pc, uint32_t len) {
+    CacheLevel *c = model->fetchLevel;
+    uint64_t l2Before = l2Misses(model);
+    uint64_t evictionsBefore = evictions(model);
+    uint32_t lines;
+    uint32_t misses = accessLines(model, c, pc, len, 0, &lines);
+
+    if (c == &model->l1i) {
+        model->lastFetchLine = (pc + len - 1) >> c->lineShift;
+    }
+    if (misses) { // A read hit changes nothing further down
+        cache_pc_stats *stats = pcStats(model, pc);
+        stats->fetchMisses += misses;
+        stats->l2Misses += l2Misses(model) - l2Before;
+        stats->evictions += evictions(model) - evictionsBefore;
+    }
+}
+
+static inline void cacheFetch(CacheModel *model, uint32_t pc, uint32_t len) {
+    CacheLevel *c = model->fetchLevel;
+    uint32_t line = pc >> c->lineShift;
+
+    // Only fetches reach the L1I, so the line fetched last is still its most recent one and
+    // hitting it again changes no replacement state
+    if (line == model->lastFetchLine && ((pc + len - 1) >> c->lineShift) == line) {
+        c->stats.reads++;
+        return;
+    }
+    fetchSlow(model, pc, len);
+}
+
+// A read of [addr, addr + len) that hits the most recent way of its LRU set, which changes no
+// replacement state and needs nothing from the next level
+static inline int mruRead(const CacheLevel *c, uint32_t addr, uint32_t len) {
+    uint32_t line = addr >> c->lineShift;
+    return c->config.policy == CACHE_LRU && ((addr + len - 1) >> c->lineShift) == line &&
+           (c->tags[(size_t)(line & c->setMask) * c->config.ways] >> 1) == line;
+}
+
+static void dataSlow(CacheModel *model, uint32_t pc, uint32_t addr, uint32_t size, int write) {
+    cache_pc_stats *stats = pcStats(model, pc);
+    uint64_t l2Before = l2Misses(model);
+    uint64_t evictionsBefore = evictions(model);
+    uint32_t lines;
+    uint32_t misses = accessLines(model, model->dataLevel, addr, size, write, &lines);
+
+    stats->accesses += lines;
+    stats->misses += misses;
+    stats->l2Misses += l2Misses(model) - l2Before; // Write-throughs can miss further down on a hit
+    stats->evictions += evictions(model) - evictionsBefore;
+}
+
+// A hit on the most recent way of an LRU set that needs nothing from the next level only
+// counts, the usual case for stack and streaming accesses. Returns 0 for anything else,
+// which the full path (with the same result for such hits) takes instead, as it does the
+// hits whose PC is off the counter page looked up last
+static inline int dataHit(CacheModel *model, uint32_t pc, uint32_t addr, uint32_t size, int write) {
+    CacheLevel *c = model->dataLevel;
+    uint32_t line = addr >> c->lineShift;
+    uint32_t *mru = &c->tags[(size_t)(line & c->setMask) * c->config.ways];
+
+    if ((*mru >> 1) != line || c->config.policy != CACHE_LRU || ((addr + size - 1) >> c->lineShift) != line ||
+        (write && !c->config.writeBack) || (pc >> PAGE_SHIFT) != model->lastVpn) {
+        return 0;
+    }
+    if (write) {
+        c->stats.writes++;
+        *mru |= 1;
+    } else {
+        c->stats.reads++;
+    }
+    model->lastEntries[opIndex(pc)].accesses++;
+    return 1;
+}
+
+static inline void cacheData(CacheModel *model, uint32_t pc, uint32_t addr, uint32_t access) {
+    uint32_t size = access & ~CACHE_ACCESS_WRITE;
+    int write = (access & CACHE_ACCESS_WRITE) != 0;
+    if (!dataHit(model, pc, addr, size, write)) {
+        dataSlow(model, pc, addr, size, write);
+    }
+}
+
+#if defined(__GNUC__)
+
+// The threaded engine's handlers (see threaded.c) feeding the model: every fetch from the
+// dispatch, every load and store from its handler before it is done. A fetch from the L1I line
+// fetched last (kept in a local) or from the most recent way of an LRU set is only counted,
+// which covers straight-line code and loops spanning a few lines
+#define RD(v)     do { uint32_t rdValue = (v); if (op->rd != ZERO) regs[op->rd] = rdValue; } while (0)
+#define RS1       regs[op->rs1]
+#define RS2       regs[op->rs2]
+#define IMM       op->imm
+#define LEN       op->len
+#define FRD(v)    (fregs[op->rd] = (v))
+#define FRS1      fregs[op->rs1]
+#define FRS2      fregs[op->rs2]
+#define FRS3      fregs[op->rs3]
+#define ZIMM      op->rs1
+#define DISPATCH() do {                                                  \
+        if (pc - basePC >= span || budget == 0)                          \
+            goto out;                                                    \
+        op = predecodeFetch(cache, mem, pc);                             \
+        budget--;                                                        \
+        if (((pc >> lineShift) != fetchLine ||                           \
+             ((pc + op->len - 1) >> lineShift) != fetchLine) && fetches && \
+            !mruRead(model->fetchLevel, pc, op->len)) {                  \
+            fetchSlow(model, pc, op->len);                               \
+            fetchLine = model->lastFetchLine;                            \
+            slowFetches++;                                               \
+        }                                                                \
+        goto *handlers[op->op];                                          \
+    } while (0)
+#define DATA_ACCESS(addr, len, write) do {                               \
+        if (data && !dataHit(model, pc, addr, len, write)) {             \
+            dataSlow(model, pc, addr, len, write);                       \
+        }                                                                \
+    } while (0)
+#define NEXT(npc) do { pc = (npc); DISPATCH(); } while (0)
+#define NEXT_PC()        do { if (LEN == 2) NEXT(pc + 2); NEXT(pc + 4); } while (0)
+#define NEXT_SEQ()       NEXT_PC()
+#define NEXT_STORE()     NEXT_PC()
+#define NEXT_BRANCH(c)   do { if (c) NEXT(pc + IMM); NEXT_PC(); } while (0)
+#define NEXT_JUMP(t)     NEXT(t)
+#define NEXT_INDIRECT(t) NEXT(t)
+#define NEXT_ECALL()     NEXT_PC()
+#define STOP()           do { res.halted = 1; goto out; } while (0)
+
+engine_result runCached(Hart *hart, PredecodeCache *cache, CacheModel *model, uint64_t budget) {
+    static void *const handlers[NUM_OPS] = {
+#include "optable.inc"
+    };
+
+    engine_result res = { 0, 0 };
+    const uint64_t initialBudget = budget;
+    uint32_t *const regs = hart->regs;
+    uint32_t *const fregs = hart->fregs;
+    Memory *const mem = &hart->mem;
+    const uint32_t basePC = hart->basePC;
+    const uint32_t span = hart->endPC - basePC;
+    const int fetches = model->fetchLevel != NULL;
+    const int data = model->dataLevel != NULL;
+    const uint32_t lineShift = fetches ? model->fetchLevel->lineShift : 0;
+    uint32_t fetchLine = model->lastFetchLine; // CACHE_EMPTY unless the L1I holds it
+    uint64_t slowFetches = 0;
+    uint32_t pc = hart->pc;
+    const micro_op *op;
+
+    DISPATCH();
+
+#include "ophandlers.inc"
+
+out:
+    hart->pc = pc;
+    res.retired = initialBudget - budget;
+    model->instructions += res.retired;
+    if (fetches) { // The fetches that stayed in the line were only counted in retired
+        model->fetchLevel->stats.reads += res.retired - slowFetches;
+    }
+    return res;
+}
+
+#else
+
+engine_result runCached(Hart *hart, PredecodeCache *cache, CacheModel *model, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    uint32_t *regs = hart->regs;
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        uint32_t pc = hart->pc;
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, pc);
+        if (model->fetchLevel) {
+            cacheFetch(model, pc, op.len);
+        }
+        uint32_t access = cacheDataAccess[op.op];
+        if (access && model->dataLevel) {
+            cacheData(model, pc, regs[op.rs1] + op.imm, access);
+        }
+
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+
+    model->instructions += res.retired;
+    return res;
+}
+
+#endif
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+static void writeLevel(const CacheLevel *c, FILE *out) {
+    const cache_level_config *config = &c->config;
+    const cache_stats *stats = &c->stats;
+    if (config->size == 0) {
+        return;
+    }
+    fprintf(out, "%-4s %9u %5u %5u  %-7s %-6s %-8s %14llu %12llu %6.2f%% %14llu %12llu %6.2f%% %12llu %12llu\n",
+            c->name, config->size, config->ways, config->lineSize, policyNames[config->policy],
+            config->writeBack ? "back" : "through", config->writeAllocate ? "allocate" : "around",
+            (unsigned long long)stats->reads, (unsigned long long)stats->readMisses,
+            percent(stats->readMisses, stats->reads), (unsigned long long)stats->writes,
+            (unsigned long long)stats->writeMisses, percent(stats->writeMisses, stats->writes),
+            (unsigned long long)stats->evictions, (unsigned long long)stats->writebacks);
+}
+
+typedef struct {
+    uint32_t pc;
+    cache_pc_stats stats;
+} pc_entry;
+
+static uint64_t l1Misses(const pc_entry *e) {
+    return e->stats.fetchMisses + e->stats.misses;
+}
+
+static int compareMisses(const void *a, const void *b) {
+    const pc_entry *x = (const pc_entry *)a;
+    const pc_entry *y = (const pc_entry *)b;
+    if (l1Misses(x) != l1Misses(y)) {
+        return l1Misses(x) > l1Misses(y) ? -1 : 1;
+    }
+    if (x->stats.l2Misses != y->stats.l2Misses) {
+        return x->stats.l2Misses > y->stats.l2Misses ? -1 : 1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+// Every PC with a miss, NULL when there are none
+static pc_entry *collectMisses(const CacheModel *model, uint32_t *count) {
+    uint32_t n = 0, capacity = 0;
+    pc_entry *list = NULL;
+
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        for (uint32_t p = 0; model->tables[t] && p < PAGE_TABLE_ENTRIES; p++) {
+            const cache_pc_stats *entries = model->tables[t][p];
+            for (uint32_t i = 0; entries && i < OPS_PER_PAGE; i++) {
+                if (!entries[i].fetchMisses && !entries[i].misses && !entries[i].l2Misses) {
+                    continue;
+                }
+                if (n == capacity) {
+                    capacity = capacity ? capacity * 2 : 1024;
+                    pc_entry *grown = (pc_entry *)realloc(list, capacity * sizeof(pc_entry));
+                    if (!grown) {
+                        free(list);
+                        *count = 0;
+                        return NULL;
+                    }
+                    list = grown;
+                }
+                list[n].pc = (t << PAGE_TABLE_SHIFT) | (p << PAGE_SHIFT) | (i << 1);
+                list[n].stats = entries[i];
+                n++;
+            }
+        }
+    }
+    *count = n;
+    return list;
+}
+
+void cacheWriteReport(CacheModel *model, PredecodeCache *cache, Hart *hart, const SymbolTable *symbols, FILE *out) {
+    char loc[128];
+
+    fprintf(out, "Cache model: %llu instructions\n\n", (unsigned long long)model->instructions);
+    fprintf(out, "%-4s %9s %5s %5s  %-7s %-6s %-8s %14s %12s %7s %14s %12s %7s %12s %12s\n", "", "size", "ways",
+            "line", "policy", "write", "", "reads", "misses", "%", "writes", "misses", "%", "evictions",
+            "writebacks");
+    writeLevel(&model->l1i, out);
+    writeLevel(&model->l1d, out);
+    writeLevel(&model->l2, out);
+    fprintf(out, "Memory: %llu line reads, %llu writes\n", (unsigned long long)model->memoryReads,
+            (unsigned long long)model->memoryWrites);
+
+    uint32_t n = 0;
+    pc_entry *pcs = collectMisses(model, &n);
+    if (pcs) {
+        qsort(pcs, n, sizeof(pc_entry), compareMisses);
+    }
+    fprintf(out, "\nPCs with the most misses\n%12s %12s %12s %12s %12s  %-10s  %-8s  %s\n", "fetch miss",
+            "accesses", "data miss", "L2 miss", "evictions", "pc", "op", "location");
+    for (uint32_t i = 0; i < n && i < CACHE_TOP; i++) {
+        const cache_pc_stats *stats = &pcs[i].stats;
+        symbolFormat(loc, sizeof(loc), symbols, pcs[i].pc);
+        fprintf(out, "%12llu %12llu %12llu %12llu %12llu  0x%08X  %-8s  %s\n", (unsigned long long)stats->fetchMisses,
+                (unsigned long long)stats->accesses, (unsigned long long)stats->misses,
+                (unsigned long long)stats->l2Misses, (unsigned long long)stats->evictions, pcs[i].pc,
+                opName((op_t)predecodeFetch(cache, &hart->mem, pcs[i].pc)->op), loc);
+    }
+    free(pcs);
+}
@@ -0,0 +1,190 @@
+#include "../include/decode.h"
+
+// RV32C expansion: every 16-bit instruction is rewritten into the 32-bit instruction it is
+// defined as, so decoding and execution stay the RV32I ones
+// Double-precision loads/stores (C.FLD, C.FSD, ...) and RV64/RV128-only encodings expand to 0,
+// which is an illegal instruction
+
+// Bits [hi:lo] of a compressed instruction
+static inline uint32_t bits(uint16_t c, int hi, int lo) {
+    return ((uint32_t)c >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// Sign-extends the low width bits of value
+static inline int32_t signExtend(uint32_t value, int width) {
+    return (int32_t)(value << (32 - width)) >> (32 - width);
+}
+
+// rd', rs1', rs2': 3-bit fields naming x8-x15
+static inline uint32_t compactReg(uint32_t r) {
+    return r + 8;
+}
+
+static uint32_t encodeR(funct7_t funct7, uint32_t rs2, uint32_t rs1, funct3_t funct3, uint32_t rd, opcode_t opcode) {
+    return ((uint32_t)funct7 << 25) | (rs2 << 20) | (rs1 << 15) | ((uint32_t)funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t encodeI(int32_t imm, uint32_t rs1, funct3_t funct3, uint32_t rd, opcode_t opcode) {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | ((uint32_t)funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t encodeS(int32_t imm, uint32_t rs2, uint32_t rs1, funct3_t funct3, opcode_t opcode) {
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 5 & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | ((uint32_t)funct3 << 12) | ((u & 0x1F) << 7) | opcode;
+}
+
+static uint32_t encodeB(int32_t imm, uint32_t rs2, uint32_t rs1, funct3_t funct3) {
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 12 & 1) << 31) | ((u >> 5 & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) |
+           ((uint32_t)funct3 << 12) | ((u >> 1 & 0xF) << 8) | ((u >> 11 & 1) << 7) | BRANCH;
+}
+
+static uint32_t encodeJ(int32_t imm, uint32_t rd) {
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 20 & 1) << 31) | ((u >> 1 & 0x3FF) << 21) | ((u >> 11 & 1) << 20) |
+           ((u >> 12 & 0xFF) << 12) | (rd << 7) | JAL;
+}
+
+// C.J / C.JAL offset[11|4|9:8|10|6|7|3:1|5]
+static int32_t jumpOffset(uint16_t c) {
+    uint32_t imm = (bits(c, 12, 12) << 11) | (bits(c, 11, 11) << 4) | (bits(c, 10, 9) << 8) |
+                   (bits(c, 8, 8) << 10) | (bits(c, 7, 7) << 6) | (bits(c, 6, 6) << 7) |
+                   (bits(c, 5, 3) << 1) | (bits(c, 2, 2) << 5);
+    return signExtend(imm, 12);
+}
+
+// C.BEQZ / C.BNEZ offset[8|4:3] in [12:10], offset[7:6|2:1|5] in [6:2]
+static int32_t branchOffset(uint16_t c) {
+    uint32_t imm = (bits(c, 12, 12) << 8) | (bits(c, 11, 10) << 3) | (bits(c, 6, 5) << 6) |
+                   (bits(c, 4, 3) << 1) | (bits(c, 2, 2) << 5);
+    return signExtend(imm, 9);
+}
+
+// imm[5] in [12], imm[4:0] in [6:2], sign-extended (C.ADDI, C.LI, C.ANDI)
+static int32_t immediate6(uint16_t c) {
+    return signExtend((bits(c, 12, 12) << 5) | bits(c, 6, 2), 6);
+}
+
+static uint32_t expandQuadrant0(uint16_t c) {
+    uint32_t rdp = compactReg(bits(c, 4, 2));
+    uint32_t rs1p = compactReg(bits(c, 9, 7));
+    // C.LW / C.SW / C.FLW / C.FSW uimm[5:3] in [12:10], uimm[2] in [6], uimm[6] in [5]
+    int32_t wordOffset = (int32_t)((bits(c, 12, 10) << 3) | (bits(c, 6, 6) << 2) | (bits(c, 5, 5) << 6));
+
+    switch (bits(c, 15, 13)) {
+        case 0: { // C.ADDI4SPN: addi rd', x2, nzuimm[5:4|9:6|2|3]
+            uint32_t imm = (bits(c, 12, 11) << 4) | (bits(c, 10, 7) << 6) | (bits(c, 6, 6) << 2) | (bits(c, 5, 5) << 3);
+            return imm ? encodeI((int32_t)imm, SP, F3_000, rdp, IMM) : 0;
+        }
+        case 2: // C.LW
+            return encodeI(wordOffset, rs1p, F3_010, rdp, LOAD);
+        case 3: // C.FLW, RV32 only
+            return encodeI(wordOffset, rs1p, F3_010, rdp, FLOAD);
+        case 6: // C.SW
+            return encodeS(wordOffset, rdp, rs1p, F3_010, STORE);
+        case 7: // C.FSW, RV32 only
+            return encodeS(wordOffset, rdp, rs1p, F3_010, FSTORE);
+        default: // C.FLD, C.FSD
+            return 0;
+    }
+}
+
+static uint32_t expandQuadrant1(uint16_t c) {
+    uint32_t rd = bits(c, 11, 7);
+    uint32_t rdp = compactReg(bits(c, 9, 7));
+    uint32_t rs2p = compactReg(bits(c, 4, 2));
+
+    switch (bits(c, 15, 13)) {
+        case 0: // C.ADDI (C.NOP with rd = x0)
+            return encodeI(immediate6(c), rd, F3_000, rd, IMM);
+        case 1: // C.JAL, RV32 only
+            return encodeJ(jumpOffset(c), RA);
+        case 2: // C.LI
+            return encodeI(immediate6(c), ZERO, F3_000, rd, IMM);
+        case 3:
+            if (rd == SP) { // C.ADDI16SP: nzimm[9] in [12], nzimm[4|6|8:7|5] in [6:2]
+                uint32_t imm = (bits(c, 12, 12) << 9) | (bits(c, 6, 6) << 4) | (bits(c, 5, 5) << 6) |
+                               (bits(c, 4, 3) << 7) | (bits(c, 2, 2) << 5);
+                return imm ? encodeI(signExtend(imm, 10), SP, F3_000, SP, IMM) : 0;
+            } else { // C.LUI: nzimm[17] in [12], nzimm[16:12] in [6:2]
+                int32_t imm = immediate6(c);
+                return imm ? ((uint32_t)imm << 12) | (rd << 7) | LUI : 0;
+            }
+        case 4:
+            switch (bits(c, 11, 10)) {
+                case 0: // C.SRLI, shamt[5] must be 0 on RV32
+                    return bits(c, 12, 12) ? 0 : encodeI((int32_t)bits(c, 6, 2), rdp, F3_101, rdp, IMM);
+                case 1: // C.SRAI
+                    return bits(c, 12, 12) ? 0 : encodeI((int32_t)(bits(c, 6, 2) | 0x400), rdp, F3_101, rdp, IMM);
+                case 2: // C.ANDI
+                    return encodeI(immediate6(c), rdp, F3_111, rdp, IMM);
+                default:
+                    if (bits(c, 12, 12)) { // C.SUBW, C.ADDW are RV64 only
+                        return 0;
+                    }
+                    switch (bits(c, 6, 5)) {
+                        case 0:  return encodeR(F7_0100000, rs2p, rdp, F3_000, rdp, NONIMM); // C.SUB
+                        case 1:  return encodeR(F7_0000000, rs2p, rdp, F3_100, rdp, NONIMM); // C.XOR
+                        case 2:  return encodeR(F7_0000000, rs2p, rdp, F3_110, rdp, NONIMM); // C.OR
+                        default: return encodeR(F7_0000000, rs2p, rdp, F3_111, rdp, NONIMM); // C.AND
+                    }
+            }
+        case 5: // C.J
+            return encodeJ(jumpOffset(c), ZERO);
+        case 6: // C.BEQZ
+            return encodeB(branchOffset(c), ZERO, rdp, F3_000);
+        default: // C.BNEZ
+            return encodeB(branchOffset(c), ZERO, rdp, F3_001);
+    }
+}
+
+static uint32_t expandQuadrant2(uint16_t c) {
+    uint32_t rd = bits(c, 11, 7);
+    uint32_t rs2 = bits(c, 6, 2);
+
+    switch (bits(c, 15, 13)) {
+        case 0: // C.SLLI, shamt[5] must be 0 on RV32
+            return bits(c, 12, 12) ? 0 : encodeI((int32_t)rs2, rd, F3_001, rd, IMM);
+        case 2: { // C.LWSP: uimm[5] in [12], uimm[4:2|7:6] in [6:2], rd = x0 is reserved
+            uint32_t imm = (bits(c, 12, 12) << 5) | (bits(c, 6, 4) << 2) | (bits(c, 3, 2) << 6);
+            return rd ? encodeI((int32_t)imm, SP, F3_010, rd, LOAD) : 0;
+        }
+        case 3: { // C.FLWSP, same offset as C.LWSP and any f register
+            uint32_t imm = (bits(c, 12, 12) << 5) | (bits(c, 6, 4) << 2) | (bits(c, 3, 2) << 6);
+            return encodeI((int32_t)imm, SP, F3_010, rd, FLOAD);
+        }
+        case 4:
+            if (!bits(c, 12, 12)) {
+                if (rs2 == 0) { // C.JR, rs1 = x0 is reserved
+                    return rd ? encodeI(0, rd, F3_000, ZERO, JALR) : 0;
+                }
+                return encodeR(F7_0000000, rs2, ZERO, F3_000, rd, NONIMM); // C.MV
+            }
+            if (rs2 == 0) {
+                if (rd == 0) { // C.EBREAK
+                    return encodeI(1, ZERO, F3_000, ZERO, SYSTEM);
+                }
+                return encodeI(0, rd, F3_000, RA, JALR); // C.JALR
+            }
+            return encodeR(F7_0000000, rs2, rd, F3_000, rd, NONIMM); // C.ADD
+        case 6: { // C.SWSP: uimm[5:2|7:6] in [12:7]
+            uint32_t imm = (bits(c, 12, 9) << 2) | (bits(c, 8, 7) << 6);
+            return encodeS((int32_t)imm, rs2, SP, F3_010, STORE);
+        }
+        case 7: { // C.FSWSP
+            uint32_t imm = (bits(c, 12, 9) << 2) | (bits(c, 8, 7) << 6);
+            return encodeS((int32_t)imm, rs2, SP, F3_010, FSTORE);
+        }
+        default: // C.FLDSP, C.FSDSP
+            return 0;
+    }
+}
+
+uint32_t expandCompressed(uint16_t instr) {
+    switch (instr & 0x3) {
+        case 0:  return expandQuadrant0(instr);
+        case 1:  return expandQuadrant1(instr);
+        case 2:  return expandQuadrant2(instr);
+        default: return 0; // Not a compressed instruction
+    }
+}
@@ -0,0 +1,68 @@
+#include "../include/console.h"
+#include <stdarg.h>
+#include <string.h>
+
+void consoleInit(Console *console, FILE *out) {
+    console->out = out;
+    console->used = 0;
+}
+
+void consoleFlush(Console *console) {
+    if (console->used && console->out) {
+        fwrite(console->buffer, 1, console->used, console->out);
+    }
+    console->used = 0;
+}
+
+void consoleWrite(Console *console, const char *data, size_t len) {
+    if (len > CONSOLE_BUFFER_SIZE - console->used) {
+        consoleFlush(console);
+        if (len >= CONSOLE_BUFFER_SIZE) { // Would fill the buffer on its own, skip the copy
+            if (console->out) {
+                fwrite(data, 1, len, console->out);
+            }
+            return;
+        }
+    }
+    memcpy(console->buffer + console->used, data, len);
+    console->used += (uint32_t)len;
+}
+
+void consolePrintf(Console *console, const char *format, ...) {
+    if (CONSOLE_BUFFER_SIZE - console->used < CONSOLE_MAX_FORMATTED) {
+        consoleFlush(console);
+    }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(console->buffer + console->used, CONSOLE_MAX_FORMATTED, format, args);
+    va_end(args);
+    if (len > 0) {
+        console->used += len < CONSOLE_MAX_FORMATTED ? (uint32_t)len : CONSOLE_MAX_FORMATTED - 1;
+    }
+}
+
+void consoleGuestString(Console *console, Memory *mem, uint32_t addr) {
+    for (;;) {
+        uint32_t len;
+        const uint8_t *chunk = memoryReadable(mem, addr, &len);
+        if (!chunk) { // A device, or outside bounded RAM where the load faults and halts
+            uint8_t c = (uint8_t)loadBU(mem, addr);
+            if (mem->halted || c == '\0') {
+                return;
+            }
+            consolePutc(console, (char)c);
+            if (++addr == 0) {
+                return;
+            }
+            continue;
+        }
+        const uint8_t *end = (const uint8_t *)memchr(chunk, '\0', len);
+
+        consoleWrite(console, (const char *)chunk, end ? (size_t)(end - chunk) : len);
+        if (end || addr + len == 0) {
+            return;
+        }
+        addr += len;
+    }
+}
@@ -0,0 +1,74 @@
+#include "../include/coverage.h"
+#include "../include/execute.h"
+#include <stdio.h>
+#include <string.h>
+
+int coverageInit(CoverageMap *map, uint8_t *bits, uint32_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        fprintf(stderr, "Coverage map: the size must be a power of two, not %u\n", size);
+        return -1;
+    }
+    map->bits = bits;
+    map->mask = size - 1;
+    coverageReset(map);
+    return 0;
+}
+
+void coverageReset(CoverageMap *map) {
+    memset(map->bits, 0, (size_t)map->mask + 1);
+    map->prev = 0;
+}
+
+void coverageNewPath(CoverageMap *map) {
+    map->prev = 0;
+}
+
+uint32_t coverageEdges(const CoverageMap *map) {
+    uint32_t edges = 0;
+    for (uint32_t i = 0; i <= map->mask; i++) {
+        edges += map->bits[i] != 0;
+    }
+    return edges;
+}
+
+// Location of a PC, spread over the whole map
+static inline uint32_t location(uint32_t pc) {
+    uint32_t h = pc * 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
+
+engine_result runCovered(Hart *hart, PredecodeCache *cache, CoverageMap *map, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    uint8_t *bits = map->bits;
+    uint32_t mask = map->mask;
+    uint32_t prev = map->prev;
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        uint32_t pc = hart->pc;
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, pc);
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        // Branches (taken or not), JAL and JALR, which are contiguous in op_t
+        if ((uint32_t)(op.op - OP_BEQ) <= OP_JALR - OP_BEQ) {
+            uint32_t cur = location(hart->pc);
+            bits[(cur ^ prev) & mask]++;
+            prev = cur >> 1;
+        }
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+        if (status < 0) { // A crash for the fuzzer, the engines skip it
+            hart->pc = pc;
+            hart->halt = HALT_ILLEGAL;
+            res.halted = 1;
+            break;
+        }
+    }
+
+    map->prev = prev;
+    return res;
+}
@@ -24,6 +24,17 @@ instruction_t getInstructionType(opcode_t opcode){
             return B_TYPE;
         case JAL:
             return J_TYPE;
+        case FLOAD:
+            return I_TYPE;
+        case FSTORE:
+            return S_TYPE;
+        case FARITH:
+            return R_TYPE;
+        case FMADD:
+        case FMSUB:
+        case FNMSUB:
+        case FNMADD:
+            return R4_TYPE;
         default: 
             return UNKNOWN_TYPE;
     }
@@ -69,6 +80,14 @@ decoded_fields getRelevantFields(instruction_t instrType, opcode_t opcode, uint3
             decodedInstr.j.rd = getRd(instr);
             decodedInstr.j.imm = getImmJFormat(instr);
             break;
+        case R4_TYPE:
+            decodedInstr.r4.rd = getRd(instr);
+            decodedInstr.r4.rs1 = getRs1(instr);
+            decodedInstr.r4.rs2 = getRs2(instr);
+            decodedInstr.r4.rs3 = getRs3(instr);
+            decodedInstr.r4.funct3 = getFunct3(instr);
+            decodedInstr.r4.fmt = getFmt(instr);
+            break;
         case UNKNOWN_TYPE:
             // TODO BAD INSTRUCTION
             break;
@@ -133,6 +152,16 @@ static void debugPrintInstructionFields(decoded_fields decoded) {
             printf("  imm    = %d (%#010x) \n", decoded.j.imm, (uint32_t)decoded.j.imm);
             break;
 
+        case R4_TYPE:
+            printf("R4-type:\n");
+            printf("Opcode: 0x%02X (%s)\n", decoded.opcode, opcodeName(decoded.opcode));
+            printf("  rd     = f%d\n", decoded.r4.rd);
+            printf("  rs1    = f%d\n", decoded.r4.rs1);
+            printf("  rs2    = f%d\n", decoded.r4.rs2);
+            printf("  rs3    = f%d\n", decoded.r4.rs3);
+            printf("  rm     = 0x%X\n", decoded.r4.funct3);
+            break;
+
         default:
             printf("Unknown format.\n");
             break;
@@ -144,10 +173,18 @@ static void debugPrintInstructionFields(decoded_fields decoded) {
 decoded_fields decodeInstruction(uint32_t instr){
     // Extra debug information - Prints the formated instruction
     // printf("Instruction: 0x%08X\n", instr);
+
+    // Only the low half belongs to a compressed instruction, it runs as its 32-bit expansion
+    uint8_t length = 4;
+    if (isCompressed(instr)) {
+        instr = expandCompressed((uint16_t)instr);
+        length = 2;
+    }
     
     opcode_t opcode = getOpcode(instr);
     instruction_t instrType = getInstructionType(opcode);
     decoded_fields decoded = getRelevantFields(instrType, opcode, instr);
+    decoded.length = length;
 
     // Extra debug information - Prints the values stored in decoded_fields
     // debugPrintInstructionFields(decoded);
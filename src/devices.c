@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime under -std=c99
+
+#include "../include/devices.h"
+#include <time.h>
+
+#define UART_LSR 5
+#define UART_LSR_IDLE 0x60        // THR empty and transmitter idle
+#define CLINT_MTIMECMP 0x4000
+#define CLINT_MTIME 0xBFF8
+#define FINISHER_PASS 0x5555
+#define FINISHER_FAIL 0x3333
+
+static uint64_t hostNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// The size bytes of a little-endian 64-bit register at byte offset within it
+static uint32_t registerBytes(uint64_t value, uint32_t offset, uint32_t size) {
+    uint64_t part = value >> (8 * offset);
+    return size == 4 ? (uint32_t)part : (uint32_t)part & ((1u << (8 * size)) - 1);
+}
+
+static uint32_t uartRead(void *context, uint32_t offset, uint32_t size) {
+    (void)context;
+    (void)size;
+    return offset == UART_LSR ? UART_LSR_IDLE : 0;
+}
+
+static void uartWrite(void *context, uint32_t offset, uint32_t value, uint32_t size) {
+    Devices *devices = (Devices *)context;
+    (void)size;
+    if (offset == 0) {
+        consolePutc(&devices->hart->console, (char)(value & 0xFF));
+    }
+}
+
+static uint32_t clintRead(void *context, uint32_t offset, uint32_t size) {
+    Devices *devices = (Devices *)context;
+
+    if (offset - CLINT_MTIME < 8) {
+        return registerBytes(devicesTime(devices), offset - CLINT_MTIME, size);
+    }
+    if (offset - CLINT_MTIMECMP < 8) {
+        return registerBytes(devices->mtimecmp, offset - CLINT_MTIMECMP, size);
+    }
+    return 0;
+}
+
+static void clintWrite(void *context, uint32_t offset, uint32_t value, uint32_t size) {
+    Devices *devices = (Devices *)context;
+
+    if (offset - CLINT_MTIMECMP < 8) { // mtime itself is read-only here
+        uint32_t shift = 8 * (offset - CLINT_MTIMECMP);
+        uint64_t mask = (size == 4 ? 0xFFFFFFFFull : (1ull << (8 * size)) - 1) << shift;
+        devices->mtimecmp = (devices->mtimecmp & ~mask) | (((uint64_t)value << shift) & mask);
+    }
+}
+
+static uint32_t finisherRead(void *context, uint32_t offset, uint32_t size) {
+    (void)context;
+    (void)offset;
+    (void)size;
+    return 0;
+}
+
+// Ends the run like an exit ECALL, the engines see mem.halted after the store
+static void finisherWrite(void *context, uint32_t offset, uint32_t value, uint32_t size) {
+    Hart *hart = ((Devices *)context)->hart;
+    (void)size;
+
+    if (offset != 0) {
+        return;
+    }
+    if ((value & 0xFFFF) == FINISHER_PASS) {
+        hart->exitCode = 0;
+        hart->mem.halted = 1;
+    } else if ((value & 0xFFFF) == FINISHER_FAIL) {
+        hart->exitCode = value >> 16;
+        hart->mem.halted = 1;
+    }
+}
+
+int devicesAttach(Devices *devices, Hart *hart) {
+    const mmio_region regions[] = {
+        { UART_BASE, UART_SIZE, uartRead, uartWrite, devices },
+        { CLINT_BASE, CLINT_SIZE, clintRead, clintWrite, devices },
+        { FINISHER_BASE, FINISHER_SIZE, finisherRead, finisherWrite, devices },
+    };
+
+    devices->hart = hart;
+    devicesReset(devices);
+    for (uint32_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        if (memoryMapDevice(&hart->mem, &regions[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void devicesReset(Devices *devices) {
+    devices->mtimecmp = 0;
+    devices->startNs = hostNs();
+}
+
+uint64_t devicesTime(const Devices *devices) {
+    return (hostNs() - devices->startNs) / (1000000000u / MTIME_HZ);
+}
+
+void devicesSetTime(Devices *devices, uint64_t mtime) {
+    devices->startNs = hostNs() - mtime * (1000000000u / MTIME_HZ);
+}
@@ -0,0 +1,86 @@
+#include "../include/engine.h"
+#include "../include/execute.h"
+#include "../include/jit.h"
+#include <string.h>
+
+int parseEngine(const char *name, engine_t *engine) {
+    if (strcmp(name, "reference") == 0) {
+        *engine = ENGINE_REFERENCE;
+    } else if (strcmp(name, "predecode") == 0) {
+        *engine = ENGINE_PREDECODE;
+    } else if (strcmp(name, "threaded") == 0) {
+        *engine = ENGINE_THREADED;
+    } else if (strcmp(name, "block") == 0) {
+        *engine = ENGINE_BLOCK;
+    } else if (strcmp(name, "jit") == 0 && JIT_AVAILABLE) {
+        *engine = ENGINE_JIT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *engineName(engine_t engine) {
+    switch (engine) {
+        case ENGINE_REFERENCE: return "reference";
+        case ENGINE_PREDECODE: return "predecode";
+        case ENGINE_THREADED:  return "threaded";
+        case ENGINE_BLOCK:     return "block";
+        case ENGINE_JIT:       return "jit";
+        default:               return "unknown";
+    }
+}
+
+// Original fetch/decode/execute loop, kept as the semantic reference for the faster engines
+engine_result runReference(Hart *hart, uint64_t budget) {
+    engine_result res = { 0, 0 };
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        uint32_t instr = fetchInstruction(&hart->mem, hart->pc);
+        decoded_fields decoded = decodeInstruction(instr);
+        int status = executeInstruction(decoded, hart);
+        res.retired++;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+
+        // Advance PC unless modified by branch/jump
+        if (decoded.instrType != B_TYPE && decoded.instrType != J_TYPE && !(decoded.instrType == I_TYPE && decoded.opcode == JALR))
+            hart->pc += decoded.length;
+    }
+    return res;
+}
+
+engine_result runPredecoded(Hart *hart, PredecodeCache *cache, uint64_t budget) {
+    engine_result res = { 0, 0 };
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        // Decoding only happens the first time a PC is fetched (or after its code was overwritten)
+        const micro_op *op = predecodeFetch(cache, &hart->mem, hart->pc);
+        int status = executeMicroOp(op, hart);
+        res.retired++;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+    return res;
+}
+
+engine_result runEngine(engine_t engine, Hart *hart, PredecodeCache *cache, BlockCache *blocks, uint64_t budget) {
+    switch (engine) {
+        case ENGINE_REFERENCE:
+            return runReference(hart, budget);
+        case ENGINE_THREADED:
+            return runThreaded(hart, cache, budget);
+        case ENGINE_BLOCK:
+        case ENGINE_JIT: // The JIT tier is attached through blocks->jit
+            return runBlocks(hart, cache, blocks, budget);
+        case ENGINE_PREDECODE:
+        default:
+            return runPredecoded(hart, cache, budget);
+    }
+}
@@ -1,10 +1,17 @@
 #include "../include/execute.h"
 
-int handleRType(decoded_fields instr) {
-    uint32_t rs1 = regs[instr.r.rs1]; // Soucre register
-    uint32_t rs2 = regs[instr.r.rs2]; // Source register
+int handleRType(decoded_fields instr, Hart *hart) {
+    uint32_t rs1 = hart->regs[instr.r.rs1]; // Soucre register
+    uint32_t rs2 = hart->regs[instr.r.rs2]; // Source register
     uint32_t result = 0; // The value to place in the destination register
 
+    if (instr.opcode == FARITH) {
+        return handleFType(instr, hart);
+    }
+    if (instr.r.funct7 == F7_0000001) {
+        return handleMType(instr, hart);
+    }
+
     switch (instr.r.funct3) {
         case F3_000: // ADD or SUB
             // ADD: funct7 = 0x00
@@ -55,13 +62,143 @@ int handleRType(decoded_fields instr) {
     
     // Prevents destination register from updating if its the x0 (ZERO) register
     if (instr.r.rd != ZERO) {
-        regs[instr.r.rd] = result;
+        hart->regs[instr.r.rd] = result;
+    }
+
+    return 0;
+}
+// RV32M, R-type with funct7 = 0x01
+int handleMType(decoded_fields instr, Hart *hart) {
+    uint32_t rs1 = hart->regs[instr.r.rs1];
+    uint32_t rs2 = hart->regs[instr.r.rs2];
+    uint32_t result = 0;
+
+    switch (instr.r.funct3) {
+        case F3_000: result = rs1 * rs2; break;        // MUL: low 32 bits
+        case F3_001: result = mulh(rs1, rs2); break;   // MULH: high bits, signed x signed
+        case F3_010: result = mulhsu(rs1, rs2); break; // MULHSU: signed x unsigned
+        case F3_011: result = mulhu(rs1, rs2); break;  // MULHU: unsigned x unsigned
+        case F3_100: result = divs(rs1, rs2); break;   // DIV
+        case F3_101: result = divu(rs1, rs2); break;   // DIVU
+        case F3_110: result = rems(rs1, rs2); break;   // REM
+        case F3_111: result = remu(rs1, rs2); break;   // REMU
+        default:
+            return -1;
+    }
+
+    if (instr.r.rd != ZERO) {
+        hart->regs[instr.r.rd] = result;
+    }
+    return 0;
+}
+// Rounding modes 5 and 6 are reserved, 7 (DYN) uses frm
+static int validRounding(uint32_t rm) {
+    return rm <= RM_RMM || rm == RM_DYN;
+}
+// RV32F OP-FP, funct7 selects the operation (format S) and funct3 is the rounding mode or
+// picks among related operations
+int handleFType(decoded_fields instr, Hart *hart) {
+    uint32_t a = hart->fregs[instr.r.rs1];
+    uint32_t b = hart->fregs[instr.r.rs2];
+    uint32_t x = hart->regs[instr.r.rs1]; // Source of the conversions and moves from x
+    funct3_t rm = instr.r.funct3;
+    uint32_t result = 0;
+    int toX = 0; // Compares, conversions to integer and FMV.X.W/FCLASS write an x register
+
+    switch (instr.r.funct7) {
+        case F7_0000000: case F7_0000100: case F7_0001000: case F7_0001100: case F7_0101100: case F7_1100000: case F7_1101000: // Rounded
+            if (!validRounding(rm)) {
+                return -1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    switch (instr.r.funct7) {
+        case F7_0000000: result = fpAdd(hart, a, b, rm); break; // FADD.S
+        case F7_0000100: result = fpSub(hart, a, b, rm); break; // FSUB.S
+        case F7_0001000: result = fpMul(hart, a, b, rm); break; // FMUL.S
+        case F7_0001100: result = fpDiv(hart, a, b, rm); break; // FDIV.S
+        case F7_0101100: // FSQRT.S
+            if (instr.r.rs2 != 0) {
+                return -1;
+            }
+            result = fpSqrt(hart, a, rm);
+            break;
+        case F7_0010000: // FSGNJ.S, FSGNJN.S, FSGNJX.S
+            switch (rm) {
+                case F3_000: result = fpSgnj(a, b); break;
+                case F3_001: result = fpSgnjn(a, b); break;
+                case F3_010: result = fpSgnjx(a, b); break;
+                default: return -1;
+            }
+            break;
+        case F7_0010100: // FMIN.S, FMAX.S
+            switch (rm) {
+                case F3_000: result = fpMin(hart, a, b); break;
+                case F3_001: result = fpMax(hart, a, b); break;
+                default: return -1;
+            }
+            break;
+        case F7_1010000: // FLE.S, FLT.S, FEQ.S
+            toX = 1;
+            switch (rm) {
+                case F3_000: result = fpLe(hart, a, b); break;
+                case F3_001: result = fpLt(hart, a, b); break;
+                case F3_010: result = fpEq(hart, a, b); break;
+                default: return -1;
+            }
+            break;
+        case F7_1100000: // FCVT.W.S, FCVT.WU.S
+            if (instr.r.rs2 > 1) {
+                return -1;
+            }
+            toX = 1;
+            result = fpToInt(hart, a, rm, instr.r.rs2 == 1);
+            break;
+        case F7_1101000: // FCVT.S.W, FCVT.S.WU
+            if (instr.r.rs2 > 1) {
+                return -1;
+            }
+            result = fpFromInt(hart, x, rm, instr.r.rs2 == 1);
+            break;
+        case F7_1110000: // FMV.X.W, FCLASS.S
+            if (instr.r.rs2 != 0 || rm > F3_001) {
+                return -1;
+            }
+            toX = 1;
+            result = (rm == F3_000) ? a : fpClass(a);
+            break;
+        case F7_1111000: // FMV.W.X
+            if (instr.r.rs2 != 0 || rm != F3_000) {
+                return -1;
+            }
+            result = x;
+            break;
+        default:
+            return -1;
     }
 
+    if (!toX) {
+        hart->fregs[instr.r.rd] = result;
+    } else if (instr.r.rd != ZERO) {
+        hart->regs[instr.r.rd] = result;
+    }
+    return 0;
+}
+// FMADD.S, FMSUB.S, FNMSUB.S, FNMADD.S
+int handleR4Type(decoded_fields instr, Hart *hart) {
+    if (instr.r4.fmt != 0 || !validRounding(instr.r4.funct3)) {
+        return -1;
+    }
+    fp_kind kind = (fp_kind)(FP_MADD + ((instr.opcode - FMADD) >> 2));
+    hart->fregs[instr.r4.rd] = fpFma(hart, kind, hart->fregs[instr.r4.rs1], hart->fregs[instr.r4.rs2],
+                                     hart->fregs[instr.r4.rs3], instr.r4.funct3);
     return 0;
 }
-int handleIArithmetic(decoded_fields instr) {
-    uint32_t rs1 = regs[instr.i.rs1]; // source register
+int handleIArithmetic(decoded_fields instr, Hart *hart) {
+    uint32_t rs1 = hart->regs[instr.i.rs1]; // source register
     imm_t imm = instr.i.imm; // imm value
     uint32_t result = 0; // The value to place in the destination register
 
@@ -120,161 +257,219 @@ int handleIArithmetic(decoded_fields instr) {
 
     // Prevents destination register from updating if its the x0 (ZERO) register.
     if (instr.i.rd != ZERO) {
-        regs[instr.i.rd] = result;
+        hart->regs[instr.i.rd] = result;
     }
 
     return 0;
 }
-int handleILoad(decoded_fields instr, Memory *memory) {
-    uint32_t rs1 = regs[instr.i.rs1];
+int handleILoad(decoded_fields instr, Hart *hart) {
+    uint32_t rs1 = hart->regs[instr.i.rs1];
     imm_t offset = instr.i.imm;
     uint32_t address = rs1 + offset; // Memory address to load from
     uint32_t result = 0; // The value to place in the destination register
 
     switch (instr.i.funct3) {
         case F3_000: // LB, Load Byte (8 bits, signed)
-            result = loadB(memory, address);
+            result = loadB(&hart->mem, address);
             break;
 
         case F3_001: // LH, Load halfword (16 bits, signed)
-            result = loadHW(memory, address);
+            result = loadHW(&hart->mem, address);
             break;
 
         case F3_010: // LW, Load word (32 bits, signed)
-            result = loadW(memory, address);
+            result = loadW(&hart->mem, address);
             break;
 
         case F3_100: // LBU, Load byte (8 bits, unsigned)
-            result = loadBU(memory, address);
+            result = loadBU(&hart->mem, address);
             break;
 
         case F3_101: // LHU — Load halfword (16 bits, unsigned)
-            result = loadHWU(memory, address);
+            result = loadHWU(&hart->mem, address);
             break;
 
         default:
             return -1; // Invalid load funct3
     }
+    if (hart->mem.halted) { // Faulted (or a device halted the hart), rd keeps its value
+        return 1;
+    }
 
     // Prevents destination register from updating if its the x0 (ZERO) register
     if (instr.i.rd != ZERO) {
-        regs[instr.i.rd] = result;
+        hart->regs[instr.i.rd] = result;
     }
 
     return 0;
 }
-int handleJALR(decoded_fields instr){
-    uint32_t rs1 = regs[instr.i.rs1]; // Soucre register
+int handleFLoad(decoded_fields instr, Hart *hart) {
+    if (instr.i.funct3 != F3_010) { // FLW is the only RV32F load
+        return -1;
+    }
+    uint32_t value = loadW(&hart->mem, hart->regs[instr.i.rs1] + instr.i.imm);
+    if (hart->mem.halted) {
+        return 1;
+    }
+    hart->fregs[instr.i.rd] = value;
+    return 0;
+}
+int handleJALR(decoded_fields instr, Hart *hart){
+    uint32_t rs1 = hart->regs[instr.i.rs1]; // Soucre register
     imm_t offset = instr.i.imm; 
     uint32_t target = (rs1 + offset) & 0xFFFFFFFE;
 
-    // Like JAL, if we are jumping we need to store the return address (current PC + 4) 
+    // Like JAL, if we are jumping we need to store the return address (the next instruction,
+    // PC + 2 after C.JALR)
     if (instr.i.rd != ZERO) { // If rd is x0, then we cannot override it (ie. we aren't returning)
-        regs[instr.i.rd] = PC + 4;
+        hart->regs[instr.i.rd] = hart->pc + instr.length;
     }
 
-    PC = target;
+    hart->pc = target;
     return 0;
 }
-int handleECALL(Memory *memory){
+int handleECALL(Hart *hart){
     // Load a7 and a0 to identify ecall 
-    uint32_t a0 = regs[A0];
-    uint32_t a7 = regs[A7];
+    uint32_t a0 = hart->regs[A0];
+    uint32_t a7 = hart->regs[A7];
+    Console *console = &hart->console; // A NULL console->out discards the guest's output
 
     // ECALL's from Ripes documentation
     switch (a7) {
         case 1: // Prints the value located in a0 as a signed int
-            printf("%d", (int32_t) a0);
+            if (!console->out) break;
+            consolePrintf(console, "%d", (int32_t) a0);
             break;
         case 2: // Prints the value located in a0 as a floating point number
-            printf("%f", *(float *) &a0);
+            if (!console->out) break;
+            consolePrintf(console, "%f", *(float *) &a0);
             break;
         case 4: // Prints the null-terminated string located at address in a0
-            while(1){ 
-                uint8_t a = loadB(memory, a0++);
-                if(a == '\0'){ // Assumes that a null-terminated string is present (since if not it will run forever)
-                    break;
-                }else{
-                    printf("%c", a);
-                }
+            // Read even without a console, a string outside bounded RAM faults either way
+            consoleGuestString(console, &hart->mem, a0); // Page by page, up to the NUL or the top of memory
+            if (hart->mem.halted) {
+                return 1;
             }
             break;
         case 10: // Halts the simulator
+            hart->exitCode = 0;
             return 1; // By returning 1 we signal to the main loop to exit
         case 11: // Prints the value located in a0 as an ASCII character
-            printf("%c", (char) a0); // Assuming that a0 is a valid ASCII char
+            if (!console->out) break;
+            consolePutc(console, (char) a0); // Assuming that a0 is a valid ASCII char
             break;
         case 34: // Prints the value located in a0 as a hex number
-            printf("0x%X", a0);
+            if (!console->out) break;
+            consolePrintf(console, "0x%X", a0);
             break;
-        case 35: // Prints the value located in a0 as a binary number
+        case 35: { // Prints the value located in a0 as a binary number
+            if (!console->out) break;
+            char bits[32];
             for(int i = 31; i>= 0 ; i--){ // From MSB to LSB
-                char a = (a0 & (1U << i)) ? '1' : '0'; // Masks each bit (one by one) in a0 to determine what to print
-                printf("%c", a);
+                bits[31 - i] = (a0 & (1U << i)) ? '1' : '0'; // Masks each bit (one by one) in a0 to determine what to print
             }
+            consoleWrite(console, bits, sizeof(bits));
             break;
+        }
         case 36: // Prints the value located in a0 as an unsigned integer
-            printf("%u", a0);
+            if (!console->out) break;
+            consolePrintf(console, "%u", a0);
             break;
         case 93: // Halts the simulator and exits with status code in a0
+            hart->exitCode = a0;
             return 1; // By returning 1 we signal to the main loop to exit 
+        case ECALL_MARKER: // Fork point, a0 and a1 describe the guest's input buffer
+            if (hart->markerStops) {
+                hart->halt = HALT_MARKER;
+                return 1; // The fork server fills the buffer and resumes after it
+            }
+            hart->regs[A0] = 0; // No input
+            break;
         default:
             return -1; // Unknown ECALL type
     }
     return 0;
 }
-int handleIType(decoded_fields instr, Memory *memory){
+// Zicsr CSRRW/CSRRS/CSRRC, the immediate forms (funct3 bit 2) use the rs1 field as the value
+int handleCSR(decoded_fields instr, Hart *hart) {
+    uint32_t csr = (uint32_t)instr.i.imm & 0xFFF;
+    uint32_t value = (instr.i.funct3 & 0x4) ? (uint32_t)instr.i.rs1 : hart->regs[instr.i.rs1];
+    uint32_t old = 0;
+
+    switch (instr.i.funct3 & 0x3) {
+        case 1: old = csrAccess(hart, csr, UINT32_MAX, value); break; // Write
+        case 2: old = csrAccess(hart, csr, 0, value); break;          // Set bits
+        case 3: old = csrAccess(hart, csr, value, 0); break;          // Clear bits
+        default: return -1;
+    }
+
+    if (instr.i.rd != ZERO) {
+        hart->regs[instr.i.rd] = old;
+    }
+    return 0;
+}
+int handleIType(decoded_fields instr, Hart *hart){
     switch (instr.opcode) {
         case IMM: // Arithmetic/logical immediates
-            return handleIArithmetic(instr);
+            return handleIArithmetic(instr, hart);
         case LOAD: // Loads from memory
-            return handleILoad(instr, memory);
+            return handleILoad(instr, hart);
         case JALR: // Jump and link register
-            return handleJALR(instr);
-        case SYSTEM: // Handles the ecall instructions 
-            return handleECALL(memory); 
+            return handleJALR(instr, hart);
+        case SYSTEM: // Handles the ecall instructions and the CSR accesses
+            return (instr.i.funct3 == F3_000) ? handleECALL(hart) : handleCSR(instr, hart);
+        case FLOAD: // Loads into an f register
+            return handleFLoad(instr, hart);
         default:
             return -1; // Unknown I-type opcode
     }
 }
-int handleSType(decoded_fields instr, Memory *memory){
-    uint32_t rs1 = regs[instr.s.rs1];
-    uint32_t rs2 = regs[instr.s.rs2];
+int handleSType(decoded_fields instr, Hart *hart){
+    uint32_t rs1 = hart->regs[instr.s.rs1];
+    uint32_t rs2 = hart->regs[instr.s.rs2];
     imm_t offset = instr.s.imm;
     uint32_t address = rs1 + offset;
 
+    if (instr.opcode == FSTORE) { // FSW, the only RV32F store
+        if (instr.s.funct3 != F3_010) {
+            return -1;
+        }
+        storeWord(&hart->mem, address, hart->fregs[instr.s.rs2]);
+        return hart->mem.halted ? 1 : 0;
+    }
+
     switch (instr.s.funct3) {
         case F3_000: // Store byte
             // rs2 & 0xFF (8 bit mask), ensures we only store 8 bits (a byte)
-            storeByte(memory->data, address,  rs2 & 0xFF);
+            storeByte(&hart->mem, address,  rs2 & 0xFF);
             break;
         case F3_001: // Store halfword
             // rs2 & 0xFFFF (16 bit mask), ensures we only store 16 bits (halfword)
-            storeHalfword(memory->data, address,  rs2 & 0xFFFF);
+            storeHalfword(&hart->mem, address,  rs2 & 0xFFFF);
             break;
         case F3_010: // Store word
             // rs2 (without a mask), as we want the whole 32 bits (word)
-            storeWord(memory->data, address,  rs2 );
+            storeWord(&hart->mem, address,  rs2 );
             break;
         default:
             return -1; // Invalid S-Type funct3
     }
 
-    return 0;
+    return hart->mem.halted ? 1 : 0; // A fault or the test finisher may have ended the run
 
 }
-int handleUType(decoded_fields instr){
+int handleUType(decoded_fields instr, Hart *hart){
     switch (instr.opcode) {
         case LUI: // Load Upper Immediate (loads 20 bit imm (<< 12) into upper 20 bits of reg)
             // rd = imm
             if(instr.u.rd != ZERO){
-                regs[instr.u.rd] = instr.u.imm;
+                hart->regs[instr.u.rd] = instr.u.imm;
             }
             break;
         case AUIPC: // Add Upper Immediate to PC (adds 20 bit imm (<< 12) to PC)
             if(instr.u.rd != ZERO){
                 // rd = PC + imm
-                regs[instr.u.rd] = PC + instr.u.imm;
+                hart->regs[instr.u.rd] = hart->pc + instr.u.imm;
             }
             break;
         default:
@@ -283,9 +478,9 @@ int handleUType(decoded_fields instr){
 
     return 0;
 }
-int handleBType(decoded_fields instr) {
-    uint32_t rs1 = regs[instr.b.rs1]; // Source register
-    uint32_t rs2 = regs[instr.b.rs2]; // Source register
+int handleBType(decoded_fields instr, Hart *hart) {
+    uint32_t rs1 = hart->regs[instr.b.rs1]; // Source register
+    uint32_t rs2 = hart->regs[instr.b.rs2]; // Source register
     imm_t pcOffset = instr.b.imm; //
 
     int shouldBranch = 0;
@@ -312,48 +507,237 @@ int handleBType(decoded_fields instr) {
             shouldBranch = (rs1 < rs2);
             break;
         case F3_111: // BGEU
-            // Branch if greater tahn or equal (unsigned)
-            shouldBranch = (rs1 > rs2);
+            // Branch if greater than or equal (unsigned)
+            shouldBranch = (rs1 >= rs2);
             break;
         default:
             return -1; // Invalid B-Type funct3
     }
 
     if(shouldBranch == 1){
-        PC += pcOffset;
+        hart->pc += pcOffset;
     }else{
-        PC += 4; // DONT ALSO INCREMENT PC IN MAIN
+        hart->pc += instr.length; // DONT ALSO INCREMENT PC IN MAIN
     }
 
     return 0;
 }
-int handleJType(decoded_fields instr) {
+int handleJType(decoded_fields instr, Hart *hart) {
     imm_t pcOffset = instr.j.imm;
 
-    // Since we are jumping we need to store the return address (current PC + 4) 
+    // Since we are jumping we need to store the return address (PC + 4, or PC + 2 after C.JAL)
     if (instr.j.rd != ZERO){  // If rd is x0, then we cannot override it (ie. we aren't returning)
-        regs[instr.j.rd] = PC + 4;
+        hart->regs[instr.j.rd] = hart->pc + instr.length;
     }
-    PC += pcOffset;
+    hart->pc += pcOffset;
 
     return 0;
 }
 
-int executeInstruction(decoded_fields instr, Memory *memory){
+int executeInstruction(decoded_fields instr, Hart *hart){
     switch(instr.instrType){
     case R_TYPE:
-        return handleRType(instr);
+        return handleRType(instr, hart);
     case I_TYPE:
-        return handleIType(instr, memory);
+        return handleIType(instr, hart);
     case S_TYPE:
-        return handleSType(instr, memory);
+        return handleSType(instr, hart);
     case U_TYPE:
-        return handleUType(instr);
+        return handleUType(instr, hart);
     case B_TYPE:
-        return handleBType(instr);
+        return handleBType(instr, hart);
     case J_TYPE:
-        return handleJType(instr);
+        return handleJType(instr, hart);
+    case R4_TYPE:
+        return handleR4Type(instr, hart);
     default:
         return -1;
     }
-}
\ No newline at end of file
+}
+// Loads and stores of the micro_ops hit the TLB inline (see loadHit), only the full accessors
+// behind a miss can fault or go to the test finisher, so only they are followed by a look at
+// mem.halted. The hart then halts on the access like on a halting ECALL, and a faulting load
+// leaves its destination alone. read takes the value from `host`
+#define LOAD(addr, len, read, full) do {                                 \
+        uint32_t at = (addr);                                            \
+        const uint8_t *host = loadHit(&hart->mem, at, len);              \
+        if (host) {                                                      \
+            result = (read);                                             \
+        } else {                                                         \
+            result = full(&hart->mem, at);                               \
+            if (hart->mem.halted) return 1;                              \
+        }                                                                \
+    } while (0)
+
+// Nothing is read from the op after a store, a miss may have invalidated it
+#define STORE(addr, len, write, full, v) do {                            \
+        uint32_t at = (addr);                                            \
+        uint8_t *host = storeHit(&hart->mem, at, len);                   \
+        if (host) {                                                      \
+            write(host, v);                                              \
+        } else {                                                         \
+            full(&hart->mem, at, v);                                     \
+            if (hart->mem.halted) return 1;                              \
+        }                                                                \
+        hart->pc = nextPC;                                               \
+        return 0;                                                        \
+    } while (0)
+// RV32F part of executeMicroOp, everything here falls through to the next instruction
+static int executeFloatOp(const micro_op *op, Hart *hart, uint32_t nextPC) {
+    uint32_t *f = hart->fregs;
+    uint32_t a = f[op->rs1];
+    uint32_t b = f[op->rs2];
+    uint32_t x = hart->regs[op->rs1];
+    uint32_t rm = (uint32_t)op->imm;
+    uint32_t result = 0;
+    int toX = 0;
+
+    switch ((op_t)op->op) {
+        case OP_FLW:       LOAD(x + op->imm, 4, readWord(host), loadW); break;
+        case OP_FSW:       STORE(x + op->imm, 4, writeWord, storeWord, b);
+
+        case OP_FADD:      result = fpAdd(hart, a, b, rm); break;
+        case OP_FSUB:      result = fpSub(hart, a, b, rm); break;
+        case OP_FMUL:      result = fpMul(hart, a, b, rm); break;
+        case OP_FDIV:      result = fpDiv(hart, a, b, rm); break;
+        case OP_FSQRT:     result = fpSqrt(hart, a, rm); break;
+        case OP_FMADD:     result = fpFma(hart, FP_MADD, a, b, f[op->rs3], rm); break;
+        case OP_FMSUB:     result = fpFma(hart, FP_MSUB, a, b, f[op->rs3], rm); break;
+        case OP_FNMSUB:    result = fpFma(hart, FP_NMSUB, a, b, f[op->rs3], rm); break;
+        case OP_FNMADD:    result = fpFma(hart, FP_NMADD, a, b, f[op->rs3], rm); break;
+        case OP_FSGNJ:     result = fpSgnj(a, b); break;
+        case OP_FSGNJN:    result = fpSgnjn(a, b); break;
+        case OP_FSGNJX:    result = fpSgnjx(a, b); break;
+        case OP_FMIN:      result = fpMin(hart, a, b); break;
+        case OP_FMAX:      result = fpMax(hart, a, b); break;
+        case OP_FCVT_S_W:  result = fpFromInt(hart, x, rm, 0); break;
+        case OP_FCVT_S_WU: result = fpFromInt(hart, x, rm, 1); break;
+        case OP_FMV_W_X:   result = x; break;
+
+        // The rest write an x register
+        case OP_FCVT_W_S:  result = fpToInt(hart, a, rm, 0); toX = 1; break;
+        case OP_FCVT_WU_S: result = fpToInt(hart, a, rm, 1); toX = 1; break;
+        case OP_FMV_X_W:   result = a; toX = 1; break;
+        case OP_FEQ:       result = fpEq(hart, a, b); toX = 1; break;
+        case OP_FLT:       result = fpLt(hart, a, b); toX = 1; break;
+        case OP_FLE:       result = fpLe(hart, a, b); toX = 1; break;
+        case OP_FCLASS:    result = fpClass(a); toX = 1; break;
+        default:
+            hart->pc = nextPC;
+            return -1;
+    }
+
+    if (!toX) {
+        f[op->rd] = result;
+    } else if (op->rd != ZERO) {
+        hart->regs[op->rd] = result;
+    }
+    hart->pc = nextPC;
+    return 0;
+}
+
+// Executes a predecoded instruction, including its next-PC update
+// Same semantics as executeInstruction, without re-inspecting the encoding
+int executeMicroOp(const micro_op *op, Hart *hart){
+    uint32_t rs1 = hart->regs[op->rs1];
+    uint32_t rs2 = hart->regs[op->rs2];
+    imm_t imm = op->imm;
+    uint32_t result = 0;
+    uint32_t nextPC = hart->pc + op->len;
+
+    switch ((op_t)op->op) {
+        case OP_ADD:   result = rs1 + rs2; break;
+        case OP_SUB:   result = rs1 - rs2; break;
+        case OP_SLL:   result = rs1 << (rs2 & 0x1F); break;
+        case OP_SLT:   result = ((int32_t)rs1 < (int32_t)rs2) ? 1 : 0; break;
+        case OP_SLTU:  result = (rs1 < rs2) ? 1 : 0; break;
+        case OP_XOR:   result = rs1 ^ rs2; break;
+        case OP_SRL:   result = rs1 >> (rs2 & 0x1F); break;
+        case OP_SRA:   result = (int32_t)rs1 >> (rs2 & 0x1F); break;
+        case OP_OR:    result = rs1 | rs2; break;
+        case OP_AND:   result = rs1 & rs2; break;
+
+        case OP_MUL:    result = rs1 * rs2; break;
+        case OP_MULH:   result = mulh(rs1, rs2); break;
+        case OP_MULHSU: result = mulhsu(rs1, rs2); break;
+        case OP_MULHU:  result = mulhu(rs1, rs2); break;
+        case OP_DIV:    result = divs(rs1, rs2); break;
+        case OP_DIVU:   result = divu(rs1, rs2); break;
+        case OP_REM:    result = rems(rs1, rs2); break;
+        case OP_REMU:   result = remu(rs1, rs2); break;
+
+        case OP_ADDI:  result = rs1 + imm; break;
+        case OP_SLTI:  result = ((int32_t)rs1 < imm) ? 1 : 0; break;
+        case OP_SLTIU: result = (rs1 < (uint32_t)imm) ? 1 : 0; break;
+        case OP_XORI:  result = rs1 ^ imm; break;
+        case OP_ORI:   result = rs1 | imm; break;
+        case OP_ANDI:  result = rs1 & imm; break;
+        case OP_SLLI:  result = rs1 << imm; break;
+        case OP_SRLI:  result = rs1 >> imm; break;
+        case OP_SRAI:  result = (int32_t)rs1 >> imm; break;
+
+        case OP_LB:    LOAD(rs1 + imm, 1, (int8_t)host[0], loadB); break;
+        case OP_LH:    LOAD(rs1 + imm, 2, (int16_t)readHalf(host), loadHW); break;
+        case OP_LW:    LOAD(rs1 + imm, 4, readWord(host), loadW); break;
+        case OP_LBU:   LOAD(rs1 + imm, 1, host[0], loadBU); break;
+        case OP_LHU:   LOAD(rs1 + imm, 2, readHalf(host), loadHWU); break;
+
+        case OP_SB:    STORE(rs1 + imm, 1, writeByte, storeByte, rs2 & 0xFF);
+        case OP_SH:    STORE(rs1 + imm, 2, writeHalf, storeHalfword, rs2 & 0xFFFF);
+        case OP_SW:    STORE(rs1 + imm, 4, writeWord, storeWord, rs2);
+
+        case OP_LUI:   result = imm; break;
+        case OP_AUIPC: result = hart->pc + imm; break;
+
+        case OP_BEQ:   if (rs1 == rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+        case OP_BNE:   if (rs1 != rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+        case OP_BLT:   if ((int32_t)rs1 < (int32_t)rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+        case OP_BGE:   if ((int32_t)rs1 >= (int32_t)rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+        case OP_BLTU:  if (rs1 < rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+        case OP_BGEU:  if (rs1 >= rs2) nextPC = hart->pc + imm; hart->pc = nextPC; return 0;
+
+        case OP_JAL: // Return address is the following instruction
+            result = nextPC;
+            nextPC = hart->pc + imm;
+            break;
+        case OP_JALR: // rs1 was read above, so rd == rs1 still jumps to the old value
+            result = nextPC;
+            nextPC = (rs1 + imm) & 0xFFFFFFFE;
+            break;
+
+        // Zicsr, the I forms take the value from the rs1 field
+        case OP_CSRRW:  result = csrAccess(hart, imm, UINT32_MAX, rs1); break;
+        case OP_CSRRS:  result = csrAccess(hart, imm, 0, rs1); break;
+        case OP_CSRRC:  result = csrAccess(hart, imm, rs1, 0); break;
+        case OP_CSRRWI: result = csrAccess(hart, imm, UINT32_MAX, op->rs1); break;
+        case OP_CSRRSI: result = csrAccess(hart, imm, 0, op->rs1); break;
+        case OP_CSRRCI: result = csrAccess(hart, imm, op->rs1, 0); break;
+
+        case OP_FLW: case OP_FSW:
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV: case OP_FSQRT:
+        case OP_FMADD: case OP_FMSUB: case OP_FNMSUB: case OP_FNMADD:
+        case OP_FSGNJ: case OP_FSGNJN: case OP_FSGNJX: case OP_FMIN: case OP_FMAX:
+        case OP_FCVT_W_S: case OP_FCVT_WU_S: case OP_FCVT_S_W: case OP_FCVT_S_WU:
+        case OP_FMV_X_W: case OP_FMV_W_X: case OP_FEQ: case OP_FLT: case OP_FLE: case OP_FCLASS:
+            return executeFloatOp(op, hart, nextPC);
+
+        case OP_ECALL: {
+            int status = handleECALL(hart);
+            if (status != 1) { // A halting ECALL leaves PC on itself, like the reference loop
+                hart->pc = nextPC;
+            }
+            return status;
+        }
+
+        default: // OP_ILLEGAL, skipped like the reference handlers do
+            hart->pc = nextPC;
+            return -1;
+    }
+
+    // Prevents destination register from updating if its the x0 (ZERO) register
+    if (op->rd != ZERO) {
+        hart->regs[op->rd] = result;
+    }
+    hart->pc = nextPC;
+    return 0;
+}
@@ -0,0 +1,467 @@
+#define _XOPEN_SOURCE 700 // fork, waitpid, getline, clock_gettime and shmat under -std=c99
+
+#include "../include/forkserver.h"
+#include "../include/registers.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// What a child sends back, small enough for one atomic pipe write
+typedef struct {
+    uint32_t halt;         // halt_reason
+    uint32_t exitCode;
+    uint32_t pc;
+    uint32_t dumpWords;
+    uint64_t retired;      // Since the fork point
+    uint32_t dump[DUMP_MAX_WORDS];
+} fork_result;
+
+static const char *haltName(halt_reason halt) {
+    static const char *names[] = { "LIMIT", "EXIT", "END", "ERROR", "EXIT", "FAULT", "MARKER", "ILLEGAL" };
+    return names[halt];
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void forkServerDefaultOptions(forkserver_options *opts) {
+    sim_default_config(&opts->config);
+    opts->hasEntry = 0;
+    opts->entryPC = 0;
+    opts->hasInputAddr = 0;
+    opts->inputAddr = 0;
+    opts->inputSize = 4096;
+    opts->maxInstrs = 0;
+    opts->writeAnswers = 0;
+    opts->persistent = 0;
+    opts->forkEvery = 1000;
+}
+
+// Reads file to its end into *data (grown as needed), returns 0 or -1 after printing why
+static int readStream(FILE *file, const char *name, uint8_t **data, size_t *capacity, uint32_t *len) {
+    size_t used = 0, got;
+    do {
+        if (used == *capacity) {
+            size_t grown = *capacity ? *capacity * 2 : 4096;
+            uint8_t *buffer = grown <= UINT32_MAX ? (uint8_t *)realloc(*data, grown) : NULL;
+            if (!buffer) {
+                fprintf(stderr, "%s: too big\n", name);
+                return -1;
+            }
+            *data = buffer;
+            *capacity = grown;
+        }
+        got = fread(*data + used, 1, *capacity - used, file);
+        used += got;
+    } while (got > 0);
+
+    *len = (uint32_t)used;
+    return 0;
+}
+
+static int readInput(const char *path, uint8_t **data, size_t *capacity, uint32_t *len) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    int status = readStream(file, path, data, capacity, len);
+    fclose(file);
+    return status;
+}
+
+// Hands the input to a guest waiting at the fork point
+static void feedInput(Sim *sim, const forkserver_options *opts, const uint8_t *input, uint32_t len) {
+    Hart *hart = &sim->hart;
+
+    if (opts->hasEntry) {
+        if (len > opts->inputSize) {
+            len = opts->inputSize;
+        }
+        memoryWrite(&hart->mem, opts->inputAddr, input, len);
+        hart->regs[A0] = opts->inputAddr;
+        hart->regs[A1] = len;
+    } else {
+        sim_supply_input(sim, input, len);
+    }
+}
+
+// Runs from the fork point on the input into result
+static void runFromForkPoint(Sim *sim, const forkserver_options *opts, const uint8_t *input, uint32_t len,
+                             fork_result *result) {
+    Hart *hart = &sim->hart;
+
+    feedInput(sim, opts, input, len);
+    uint64_t start = hart->retired;
+    memset(result, 0, sizeof(*result));
+    result->halt = (uint32_t)sim_run(sim, opts->maxInstrs);
+    result->exitCode = hart->exitCode;
+    result->pc = hart->pc;
+    result->retired = hart->retired - start;
+    result->dumpWords = registerDumpWords(hart->regs, hart->fregs, hart->fcsr, result->dump);
+}
+
+// Runs from the fork point on the input and reports over fd, never returns
+static void runChild(Sim *sim, const forkserver_options *opts, const uint8_t *input, uint32_t len, int fd) {
+    fork_result result;
+    runFromForkPoint(sim, opts, input, len, &result);
+
+    fflush(NULL); // The guest's console output
+    const uint8_t *p = (const uint8_t *)&result;
+    size_t left = sizeof(result);
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    _exit(left == 0 ? 0 : 1);
+}
+
+// Forks a child for one input and collects its result, returns 0 or -1 when it crashed
+static int runInput(Sim *sim, const forkserver_options *opts, const uint8_t *input, uint32_t len,
+                    fork_result *result, int *signal) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    fflush(NULL); // Or the child writes out our buffered output again
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        runChild(sim, opts, input, len, fds[1]);
+    }
+    close(fds[1]);
+
+    uint8_t *p = (uint8_t *)result;
+    size_t got = 0;
+    while (got < sizeof(*result)) {
+        ssize_t n = read(fds[0], p + got, sizeof(*result) - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    *signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    return got == sizeof(*result) ? 0 : -1;
+}
+
+// Runs the input in this process from the snapshot of the fork point, returns 0 or -1 when
+// the snapshot could not be restored
+static int runPersistent(Sim *sim, const forkserver_options *opts, const uint8_t *input, uint32_t len,
+                         fork_result *result) {
+    if (sim_restore(sim) != 0) {
+        return -1;
+    }
+    runFromForkPoint(sim, opts, input, len, result);
+    fflush(NULL); // The guest's console output, as a child would have
+    return 0;
+}
+
+// Runs the startup code, returns 0 once the hart waits at the fork point
+static int reachForkPoint(Sim *sim, const forkserver_options *opts, const char *binary) {
+    Hart *hart = &sim->hart;
+
+    if (opts->hasEntry) {
+        // Stepped, so that it stops exactly there whatever the engine
+        while (hart->pc != opts->entryPC) {
+            if (sim_step(sim) != HALT_NONE) {
+                fprintf(stderr, "%s halted before reaching 0x%08X\n", binary, opts->entryPC);
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (sim_run(sim, 0) != HALT_MARKER) {
+        fprintf(stderr, "%s halted without reaching the marker ECALL (a7 = 0x%X)\n", binary, ECALL_MARKER);
+        return -1;
+    }
+    return 0;
+}
+
+// With entryPC the input buffer must be RAM and leave the loaded image alone
+// Returns 0, or -1 after printing why it cannot be used
+static int checkInputBuffer(Sim *sim, const forkserver_options *opts, const char *binary) {
+    uint32_t lo = sim->isElf ? sim->elf.loadLo : sim->hart.basePC;
+    uint32_t hi = sim->isElf ? sim->elf.loadHi : sim->hart.endPC;
+    uint64_t end = (uint64_t)opts->inputAddr + opts->inputSize;
+
+    if (!opts->hasInputAddr) {
+        fprintf(stderr, "A fork point at a PC needs --input-addr for the inputs\n");
+        return -1;
+    }
+    if (opts->inputSize == 0 || end > (1ull << 32) || !memoryIsRam(&sim->hart.mem, opts->inputAddr, opts->inputSize)) {
+        fprintf(stderr, "The %u-byte input buffer at 0x%08X is not all RAM\n", opts->inputSize, opts->inputAddr);
+        return -1;
+    }
+    if (opts->inputAddr < hi && lo < end) {
+        fprintf(stderr, "The %u-byte input buffer at 0x%08X overlaps %s at 0x%08X to 0x%08X\n", opts->inputSize,
+                opts->inputAddr, binary, lo, hi);
+        return -1;
+    }
+    return 0;
+}
+
+// Loads binary and runs it to the fork point, counting coverage in the map bits unless NULL
+static Sim *startServer(const char *binary, const forkserver_options *opts, uint8_t *bits, uint32_t size) {
+    sim_config config = opts->config;
+    config.profile = 0;
+    config.tracePath = NULL; // A writer thread does not survive fork
+    config.cache = NULL;
+    config.cacheSweep = 0;
+    config.pipeline = NULL;
+    config.predictors = NULL;
+    config.coverage = bits;
+    config.coverageSize = size;
+    config.stopAtMarker = !opts->hasEntry;
+
+    Sim *sim = sim_create(&config);
+    if (!sim) {
+        return NULL;
+    }
+    if (sim_load(sim, binary) != 0 || (opts->hasEntry && checkInputBuffer(sim, opts, binary) != 0) ||
+        reachForkPoint(sim, opts, binary) != 0) {
+        sim_destroy(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+int runForkServer(const char *binary, const forkserver_options *opts, FILE *inputs, FILE *out) {
+    Sim *sim = startServer(binary, opts, NULL, 0);
+    if (!sim) {
+        return -1;
+    }
+    if (opts->persistent && sim_snapshot(sim) != 0) {
+        sim_destroy(sim);
+        return -1;
+    }
+    fprintf(out, "Fork server: %s waits at PC 0x%08X after %llu instructions (%s engine%s)\n", binary,
+            sim->hart.pc, (unsigned long long)sim->hart.retired, engineName(sim->config.engine),
+            opts->persistent ? ", persistent" : "");
+
+    char *line = NULL;
+    size_t lineSize = 0;
+    uint8_t *input = NULL;
+    size_t inputCapacity = 0;
+    uint32_t runs = 0, faults = 0, failures = 0;
+    uint64_t retired = 0;
+    double start = nowSeconds();
+
+    ssize_t lineLen;
+    while ((lineLen = getline(&line, &lineSize, inputs)) >= 0) {
+        while (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) {
+            line[--lineLen] = '\0';
+        }
+        if (lineLen == 0) {
+            continue;
+        }
+
+        uint32_t len;
+        if (readInput(line, &input, &inputCapacity, &len) != 0) {
+            failures++;
+            continue;
+        }
+
+        fork_result result;
+        int signal = 0;
+        runs++;
+        if (opts->persistent) {
+            if (runPersistent(sim, opts, input, len, &result) != 0) {
+                failures++;
+                fprintf(out, "%-6s %s: the fork point could not be restored\n", "ERROR", line);
+                break;
+            }
+        } else if (runInput(sim, opts, input, len, &result, &signal) != 0) {
+            failures++;
+            if (signal) {
+                fprintf(out, "%-6s %s: child killed by signal %d\n", "CRASH", line, signal);
+            } else {
+                fprintf(out, "%-6s %s: child exited without a result\n", "CRASH", line);
+            }
+            continue;
+        }
+
+        retired += result.retired;
+        faults += result.halt == HALT_FAULT;
+        fprintf(out, "%-6s %s: %llu instrs, exit %u, pc 0x%08X\n", haltName((halt_reason)result.halt), line,
+                (unsigned long long)result.retired, result.exitCode, result.pc);
+        if (opts->writeAnswers) {
+            dumpRegisterContentsFile(result.dump, result.dumpWords, line);
+        }
+    }
+    double wall = nowSeconds() - start;
+
+    fprintf(out, "Summary: %u runs, %u faults, %u crashes or unreadable inputs, %.0f runs/s, %llu instructions\n",
+            runs, faults, failures, wall > 0 ? runs / wall : 0.0, (unsigned long long)retired);
+    free(line);
+    free(input);
+    sim_destroy(sim);
+    return failures ? 1 : 0;
+}
+
+// One fuzzing run from the fork point on the input in path (stdin when NULL). A fault or
+// illegal instruction aborts, which is how a crash looks to AFL, otherwise returns the halt
+// reason after printing the run and its coverage to out. Without out it runs for afl-fuzz,
+// which clears the map before every run, so only the path starts over. The input is read
+// into *input, grown as needed and kept for the next run
+static halt_reason fuzzOne(Sim *sim, const forkserver_options *opts, const char *path, uint8_t **input,
+                           size_t *capacity, FILE *out) {
+    Hart *hart = &sim->hart;
+    uint32_t len = 0;
+
+    clearerr(stdin); // afl-fuzz rewinds it for the next run
+    int status = path ? readInput(path, input, capacity, &len) : readStream(stdin, "stdin", input, capacity, &len);
+    if (status != 0) {
+        return HALT_ERROR;
+    }
+    feedInput(sim, opts, *input, len);
+
+    uint64_t start = hart->retired;
+    if (out) {
+        sim_reset_coverage(sim);
+    } else {
+        coverageNewPath(&sim->coverage);
+    }
+    halt_reason halt = sim_run(sim, opts->maxInstrs);
+    if (out) {
+        fprintf(out, "%-6s %llu instrs, exit %u, pc 0x%08X, %u edges\n", haltName(halt),
+                (unsigned long long)(hart->retired - start), hart->exitCode, hart->pc, coverageEdges(&sim->coverage));
+    }
+    if (halt == HALT_FAULT || halt == HALT_ILLEGAL) {
+        fprintf(stderr, "Crash: %s at PC 0x%08X\n", halt == HALT_FAULT ? "access fault" : "illegal instruction", hart->pc);
+        fflush(NULL);
+        abort();
+    }
+    return halt;
+}
+
+// Exit statuses of a fuzzChild that answered all its runs
+#define CHILD_DONE 0      // Ran forkEvery inputs
+#define CHILD_CLOSED 2    // afl-fuzz closed the control pipe
+
+// A child of the AFL fork server, which leaves it the pipes: up to forkEvery runs, each from
+// the snapshot of the fork point restored in place, announced with the child's pid and
+// answered with a wait status of 0. A crash kills it mid-run and the server answers with its
+// wait status instead. Never returns
+static void fuzzChild(Sim *sim, const forkserver_options *opts, const char *path) {
+    int32_t pid = (int32_t)getpid();
+    int32_t exited = 0;
+    uint32_t wasKilled;
+    uint8_t *input = NULL;
+    size_t capacity = 0;
+
+    for (uint32_t run = 1;; run++) {
+        // The server read the request of the first run
+        if ((run > 1 && read(AFL_CONTROL_FD, &wasKilled, sizeof(wasKilled)) != (ssize_t)sizeof(wasKilled)) ||
+            write(AFL_STATUS_FD, &pid, sizeof(pid)) != (ssize_t)sizeof(pid)) {
+            _exit(CHILD_CLOSED);
+        }
+        if (sim_restore(sim) != 0) {
+            _exit(1);
+        }
+        fuzzOne(sim, opts, path, &input, &capacity, NULL);
+        if (write(AFL_STATUS_FD, &exited, sizeof(exited)) != (ssize_t)sizeof(exited)) {
+            _exit(CHILD_CLOSED);
+        }
+        if (run == opts->forkEvery) {
+            _exit(CHILD_DONE);
+        }
+    }
+}
+
+int runFuzzTarget(const char *binary, const forkserver_options *opts, const char *inputPath, FILE *out) {
+    const char *shmId = getenv(AFL_SHM_ENV);
+    uint8_t *bits;
+
+    if (shmId) {
+        bits = (uint8_t *)shmat(atoi(shmId), NULL, 0);
+        if (bits == (uint8_t *)-1) {
+            perror("shmat");
+            return -1;
+        }
+    } else {
+        bits = (uint8_t *)malloc(AFL_MAP_SIZE);
+        if (!bits) {
+            fprintf(stderr, "Coverage map allocation failed\n");
+            return -1;
+        }
+    }
+
+    int status = -1;
+    Sim *sim = startServer(binary, opts, bits, AFL_MAP_SIZE);
+    uint32_t hello = 0;
+    if (!sim) {
+        // Nothing to run
+    } else if (sim_snapshot(sim) != 0) {
+        // Nothing to restore the runs from
+    } else if (write(AFL_STATUS_FD, &hello, sizeof(hello)) == (ssize_t)sizeof(hello)) {
+        // afl-fuzz is on the other end: a request with no child left forks one, which runs
+        // it and the next ones (see fuzzChild), until afl-fuzz closes the control pipe
+        uint32_t wasKilled;
+        while (read(AFL_CONTROL_FD, &wasKilled, sizeof(wasKilled)) == (ssize_t)sizeof(wasKilled)) {
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                break;
+            }
+            if (pid == 0) {
+                fuzzChild(sim, opts, inputPath);
+            }
+
+            int childStatus = 0;
+            if (waitpid(pid, &childStatus, 0) < 0 ||
+                (WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == CHILD_CLOSED)) {
+                break;
+            }
+            if (!(WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == CHILD_DONE) &&
+                write(AFL_STATUS_FD, &childStatus, sizeof(childStatus)) != (ssize_t)sizeof(childStatus)) {
+                break;
+            }
+        }
+        status = 0;
+    } else {
+        // Run by hand (or by afl-fuzz without its fork server): once, in this process
+        uint8_t *input = NULL;
+        size_t capacity = 0;
+        status = fuzzOne(sim, opts, inputPath, &input, &capacity, out) == HALT_ERROR ? 1 : 0;
+        free(input);
+    }
+
+    sim_destroy(sim);
+    if (shmId) {
+        shmdt(bits);
+    } else {
+        free(bits);
+    }
+    return status;
+}
@@ -0,0 +1,268 @@
+#include "../include/fpu.h"
+#include <fenv.h>
+
+// Host rounding direction of RNE, RTZ, RDN and RUP, RMM has none
+static const int hostRounding[RM_RMM] = { FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD };
+
+static uint32_t toFflags(int raised) {
+    return ((raised & FE_INEXACT) ? FFLAG_NX : 0) | ((raised & FE_UNDERFLOW) ? FFLAG_UF : 0) |
+           ((raised & FE_OVERFLOW) ? FFLAG_OF : 0) | ((raised & FE_DIVBYZERO) ? FFLAG_DZ : 0) |
+           ((raised & FE_INVALID) ? FFLAG_NV : 0);
+}
+
+void fpuBegin(void) {
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+void fpuCollect(Hart *hart) {
+    hart->fcsr |= toFflags(fetestexcept(FE_ALL_EXCEPT));
+    feclearexcept(FE_ALL_EXCEPT);
+}
+
+// Rounding mode an instruction runs with. frm values without a mode (5 to 7) make DYN
+// instructions illegal, they round to nearest even here instead of trapping
+static uint32_t resolveRounding(const Hart *hart, uint32_t rm) {
+    if (rm == RM_DYN) {
+        rm = (hart->fcsr >> FRM_SHIFT) & FRM_MASK;
+    }
+    return rm <= RM_RMM ? rm : RM_RNE;
+}
+
+static float compute(fp_kind kind, float x, float y, float z) {
+    switch (kind) {
+        case FP_ADD:   return x + y;
+        case FP_SUB:   return x - y;
+        case FP_MUL:   return x * y;
+        case FP_DIV:   return x / y;
+        case FP_SQRT:  return sqrtf(x);
+        case FP_MADD:  return fmaf(x, y, z);
+        case FP_MSUB:  return fmaf(x, y, -z);
+        case FP_NMSUB: return fmaf(-x, y, z);
+        default:       return fmaf(-x, y, -z);
+    }
+}
+
+static double computeDouble(fp_kind kind, double x, double y, double z) {
+    switch (kind) {
+        case FP_ADD:   return x + y;
+        case FP_SUB:   return x - y;
+        case FP_MUL:   return x * y;
+        case FP_DIV:   return x / y;
+        case FP_SQRT:  return sqrt(x);
+        case FP_MADD:  return fma(x, y, z);
+        case FP_MSUB:  return fma(x, y, -z);
+        case FP_NMSUB: return fma(-x, y, z);
+        default:       return fma(-x, y, -z);
+    }
+}
+
+// Rounds the positive value a to an integer, ties away from zero
+static double roundHalfAway(double a) {
+    double whole = floor(a);
+    return (a - whole >= 0.5) ? whole + 1 : whole;
+}
+
+// Rounds d to single precision with ties away from zero (RMM) and records the flags
+// d must hold the exact result truncated toward zero, inexact says whether that lost bits
+static uint32_t roundMaxMagnitude(Hart *hart, double d, int inexact) {
+    if (isnan(d)) {
+        return CANONICAL_NAN;
+    }
+    uint32_t sign = signbit(d) ? 0x80000000u : 0;
+    double a = fabs(d);
+    if (isinf(d) || a == 0) {
+        return sign | f32Bits((float)a);
+    }
+
+    // Tininess is decided after rounding to 24 bits with an unbounded exponent, subnormal
+    // results then round again on the 2^-149 grid
+    int exponent;
+    frexp(a, &exponent);
+    double unbounded = ldexp(roundHalfAway(ldexp(a, 24 - exponent)), exponent - 24);
+    double rounded = unbounded < 0x1p-126 ? ldexp(roundHalfAway(ldexp(a, 149)), -149) : unbounded;
+
+    uint32_t flags = (rounded != a || inexact) ? FFLAG_NX : 0;
+    uint32_t bits;
+    if (rounded >= 0x1p128) {
+        flags |= FFLAG_OF | FFLAG_NX;
+        bits = sign | 0x7F800000u;
+    } else {
+        bits = sign | f32Bits((float)rounded);
+    }
+    if (unbounded < 0x1p-126 && (flags & FFLAG_NX)) {
+        flags |= FFLAG_UF;
+    }
+    hart->fcsr |= flags;
+    return bits;
+}
+
+// RMM has no host rounding direction. The operation runs in double precision rounding toward
+// zero instead: products of singles are exact there and the sums, quotients and roots keep
+// every bit up to the single-precision midpoints, so the ties-away rounding that follows sees
+// the same side of each midpoint as the exact result
+static uint32_t fpMaxMagnitude(Hart *hart, fp_kind kind, uint32_t a, uint32_t b, uint32_t c) {
+    fexcept_t saved;
+    fegetexceptflag(&saved, FE_ALL_EXCEPT);
+    feclearexcept(FE_ALL_EXCEPT);
+
+    // volatile keeps the arithmetic between the two fesetround calls
+    volatile double x = f32(a), y = f32(b), z = f32(c);
+    volatile double r;
+    fesetround(FE_TOWARDZERO);
+    r = computeDouble(kind, x, y, z);
+    fesetround(FE_TONEAREST);
+
+    // The double never overflows or underflows, only its invalid, divide by zero and
+    // inexact flags say something about the single-precision result
+    int raised = fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_INEXACT);
+    fesetexceptflag(&saved, FE_ALL_EXCEPT);
+    hart->fcsr |= toFflags(raised & (FE_INVALID | FE_DIVBYZERO));
+    return roundMaxMagnitude(hart, r, raised & FE_INEXACT);
+}
+
+// Arithmetic in a rounding mode other than round to nearest even (or any mode for DYN)
+uint32_t fpRounded(Hart *hart, fp_kind kind, uint32_t a, uint32_t b, uint32_t c, uint32_t rm) {
+    rm = resolveRounding(hart, rm);
+    if (rm == RM_RMM) {
+        return fpMaxMagnitude(hart, kind, a, b, c);
+    }
+
+    // The host raises the flags as for any other operation
+    volatile float x = f32(a), y = f32(b), z = f32(c);
+    volatile float r;
+    fesetround(hostRounding[rm]);
+    r = compute(kind, x, y, z);
+    fesetround(FE_TONEAREST);
+    return canonicalize(r);
+}
+
+// Fused multiply-adds, always through libm's fmaf
+uint32_t fpFma(Hart *hart, fp_kind kind, uint32_t a, uint32_t b, uint32_t c, uint32_t rm) {
+    // Infinity times zero is invalid even when the addend is a quiet NaN
+    if (((a & 0x7FFFFFFF) == 0x7F800000 && (b & 0x7FFFFFFF) == 0) ||
+        ((a & 0x7FFFFFFF) == 0 && (b & 0x7FFFFFFF) == 0x7F800000)) {
+        hart->fcsr |= FFLAG_NV;
+    }
+    if (roundsNearestEven(hart, rm)) {
+        return canonicalize(compute(kind, f32(a), f32(b), f32(c)));
+    }
+    return fpRounded(hart, kind, a, b, c, rm);
+}
+
+// FMIN/FMAX: a NaN operand loses to a number, -0 is below +0
+static uint32_t minMax(Hart *hart, uint32_t a, uint32_t b, int isMax) {
+    if (isSignalingBits(a) || isSignalingBits(b)) {
+        hart->fcsr |= FFLAG_NV;
+    }
+    if (isNaNBits(a)) {
+        return isNaNBits(b) ? CANONICAL_NAN : b;
+    }
+    if (isNaNBits(b)) {
+        return a;
+    }
+    if (((a | b) & 0x7FFFFFFF) == 0) {
+        return isMax ? (a & b) : (a | b);
+    }
+    return ((f32(a) < f32(b)) != isMax) ? a : b;
+}
+
+uint32_t fpMin(Hart *hart, uint32_t a, uint32_t b) {
+    return minMax(hart, a, b, 0);
+}
+
+uint32_t fpMax(Hart *hart, uint32_t a, uint32_t b) {
+    return minMax(hart, a, b, 1);
+}
+
+// FCVT.W.S / FCVT.WU.S, out of range inputs saturate and NaN converts to the largest value
+uint32_t fpToInt(Hart *hart, uint32_t a, uint32_t rm, int isUnsigned) {
+    if (isNaNBits(a)) {
+        hart->fcsr |= FFLAG_NV;
+        return isUnsigned ? UINT32_MAX : INT32_MAX;
+    }
+
+    float f = f32(a);
+    float r;
+    switch (resolveRounding(hart, rm)) { // None of these raise host flags for a number
+        case RM_RTZ: r = truncf(f); break;
+        case RM_RDN: r = floorf(f); break;
+        case RM_RUP: r = ceilf(f); break;
+        case RM_RMM: r = roundf(f); break;
+        default:     r = nearbyintf(f); break;
+    }
+
+    uint32_t result;
+    if (isUnsigned) {
+        if (r < 0.0f || r >= 4294967296.0f) {
+            hart->fcsr |= FFLAG_NV;
+            return r < 0.0f ? 0 : UINT32_MAX;
+        }
+        result = (uint32_t)r;
+    } else {
+        if (r < -2147483648.0f || r >= 2147483648.0f) {
+            hart->fcsr |= FFLAG_NV;
+            return r < 0.0f ? (uint32_t)INT32_MIN : (uint32_t)INT32_MAX;
+        }
+        result = (uint32_t)(int32_t)r;
+    }
+    if (r != f) {
+        hart->fcsr |= FFLAG_NX;
+    }
+    return result;
+}
+
+// FCVT.S.W / FCVT.S.WU in a mode other than round to nearest even
+uint32_t fpFromIntRounded(Hart *hart, uint32_t x, uint32_t rm, int isUnsigned) {
+    double exact = isUnsigned ? (double)x : (double)(int32_t)x;
+
+    rm = resolveRounding(hart, rm);
+    if (rm == RM_RMM) {
+        return roundMaxMagnitude(hart, exact, 0);
+    }
+
+    volatile double in = exact;
+    volatile float r;
+    fesetround(hostRounding[rm]);
+    r = (float)in;
+    fesetround(FE_TONEAREST);
+    return f32Bits(r);
+}
+
+// FCLASS.S: one bit per class, from negative infinity (bit 0) to quiet NaN (bit 9)
+uint32_t fpClass(uint32_t a) {
+    uint32_t sign = a >> 31;
+    uint32_t exponent = (a >> 23) & 0xFF;
+    uint32_t fraction = a & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        if (fraction == 0) {
+            return sign ? 1u << 0 : 1u << 7; // Infinity
+        }
+        return (fraction & 0x400000) ? 1u << 9 : 1u << 8; // Quiet or signaling NaN
+    }
+    if (exponent == 0) {
+        if (fraction == 0) {
+            return sign ? 1u << 3 : 1u << 4; // Zero
+        }
+        return sign ? 1u << 2 : 1u << 5; // Subnormal
+    }
+    return sign ? 1u << 1 : 1u << 6; // Normal
+}
+
+uint32_t csrAccess(Hart *hart, uint32_t csr, uint32_t clear, uint32_t set) {
+    uint32_t shift = 0;
+    uint32_t mask;
+
+    switch (csr) {
+        case CSR_FFLAGS: mask = FFLAGS_MASK; break;
+        case CSR_FRM:    mask = FRM_MASK; shift = FRM_SHIFT; break;
+        case CSR_FCSR:   mask = FCSR_MASK; break;
+        default:         return 0;
+    }
+
+    fpuCollect(hart); // The flags accrued so far are part of the old value
+    uint32_t old = (hart->fcsr >> shift) & mask;
+    uint32_t value = ((old & ~clear) | set) & mask;
+    hart->fcsr = (hart->fcsr & ~(mask << shift)) | (value << shift);
+    return old;
+}
@@ -0,0 +1,495 @@
+#define _DEFAULT_SOURCE // mmap flags and sysconf under -std=c99
+#include "../include/jit.h"
+
+#if defined(RISCV_JIT) && defined(__x86_64__)
+
+#include "../include/execute.h"
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Generated code follows the System V ABI: native_block_fn(regs, mem, blk) arrives in
+// rdi/rsi/rdx and is kept in callee-saved registers for the whole block
+//   rbx = guest regs[] base, every guest register lives at [rbx + 4 * index]
+//   r12 = Memory *, whose TLBs loads and stores probe inline, only a miss calls the
+//         loadX/storeX helpers and then checks its halted flag
+//   r13 = Block *, checked after a store helper in case the block overwrote itself
+// eax/ecx/edx/esi/edi are scratch, the returned eax is the next guest PC
+
+#define MAX_OP_BYTES 160 // Upper bound of the code emitted for one micro_op (a store, 150 bytes)
+
+typedef struct {
+    uint8_t *p;
+} emitter;
+
+enum { EAX = 0, ECX = 1, EDX = 2, ESI = 6, EDI = 7 };
+
+static void emit8(emitter *e, uint8_t b) { *e->p++ = b; }
+
+static void emit32(emitter *e, uint32_t v) {
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+static void emitBytes(emitter *e, const uint8_t *bytes, size_t n) {
+    memcpy(e->p, bytes, n);
+    e->p += n;
+}
+
+// mov r32, [rbx + 4 * reg] / mov [rbx + 4 * reg], r32
+static void emitRegAccess(emitter *e, uint8_t opcode, int hostReg, reg_t guestReg) {
+    uint32_t disp = 4u * guestReg;
+    emit8(e, opcode);
+    if (disp < 0x80) {
+        emit8(e, (uint8_t)(0x43 | (hostReg << 3))); // mod=01 rm=rbx, disp8
+        emit8(e, (uint8_t)disp);
+    } else {
+        emit8(e, (uint8_t)(0x83 | (hostReg << 3))); // mod=10 rm=rbx, disp32
+        emit32(e, disp);
+    }
+}
+
+static void loadGuest(emitter *e, int hostReg, reg_t r) { emitRegAccess(e, 0x8B, hostReg, r); }
+
+// x0 is never written, so it keeps reading back as zero
+static void storeGuest(emitter *e, reg_t r) {
+    if (r != ZERO) {
+        emitRegAccess(e, 0x89, EAX, r);
+    }
+}
+
+static void movImm(emitter *e, int hostReg, uint32_t v) {
+    emit8(e, (uint8_t)(0xB8 + hostReg));
+    emit32(e, v);
+}
+
+static void emitEpilogue(emitter *e) {
+    static const uint8_t epilogue[] = { 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3 }; // pop r13, r12, rbx; ret
+    emitBytes(e, epilogue, sizeof(epilogue));
+}
+
+// Returns nextPC from the block
+static void emitExit(emitter *e, uint32_t nextPC) {
+    movImm(e, EAX, nextPC);
+    emitEpilogue(e);
+}
+
+static void emitCall(emitter *e, const void *fn) {
+    uint64_t addr = (uint64_t)(uintptr_t)fn;
+    emit8(e, 0x48); emit8(e, 0xB8); // mov rax, imm64
+    memcpy(e->p, &addr, 8);
+    e->p += 8;
+    emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+}
+
+// cmp dword [r12 + halted], 0; je +11; leave on the access at pc when it faulted or halted
+// the hart through a device (mem->halted after a loadX/storeX helper)
+static void emitHaltCheck(emitter *e, uint32_t pc) {
+    emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0xBC); emit8(e, 0x24);
+    emit32(e, (uint32_t)offsetof(Memory, halted)); emit8(e, 0x00);
+    emit8(e, 0x74); emit8(e, 11);
+    emitExit(e, pc);
+}
+
+// eax = regs[rs1] + imm, the effective address of a load/store
+static void emitAddress(emitter *e, const micro_op *op) {
+    loadGuest(e, EAX, op->rs1);
+    if (op->imm != 0) {
+        emit8(e, 0x05); emit32(e, (uint32_t)op->imm); // add eax, imm32
+    }
+}
+
+// Forward jcc/jmp rel8 whose target is set later with patchJump
+static uint8_t *emitJump(emitter *e, uint8_t opcode) {
+    emit8(e, opcode);
+    emit8(e, 0);
+    return e->p - 1;
+}
+
+static void patchJump(emitter *e, uint8_t *rel) {
+    *rel = (uint8_t)(e->p - (rel + 1));
+}
+
+// TLB hit path of loadHit/storeHit for the len-byte access at eax: reg (rdx or rsi) = the
+// TLB entry and ecx = the page offset, else a jump to each returned patch (at most two) for
+// the helper call. eax is left alone for that call
+static int emitTlbProbe(emitter *e, int reg, size_t tlb, uint32_t len, uint8_t **misses) {
+    int n = 0;
+    emit8(e, 0x89); emit8(e, 0xC1);                       // mov ecx, eax
+    emit8(e, 0xC1); emit8(e, 0xE9); emit8(e, PAGE_SHIFT); // shr ecx, PAGE_SHIFT
+    emit8(e, 0x89); emit8(e, (uint8_t)(0xC8 | reg));      // mov reg, ecx
+    emit8(e, 0x81); emit8(e, (uint8_t)(0xE0 | reg)); emit32(e, TLB_ENTRIES - 1); // and reg, TLB_ENTRIES - 1
+    emit8(e, 0xC1); emit8(e, (uint8_t)(0xE0 | reg)); emit8(e, 4); // shl reg, 4 (sizeof(tlb_entry))
+    emit8(e, 0x4C); emit8(e, 0x01); emit8(e, (uint8_t)(0xE0 | reg)); // add reg, r12
+    emit8(e, 0x3B); emit8(e, (uint8_t)(0x88 | reg)); emit32(e, (uint32_t)(tlb + offsetof(tlb_entry, vpn))); // cmp ecx, [reg + vpn]
+    misses[n++] = emitJump(e, 0x75);                       // jne miss
+    emit8(e, 0x89); emit8(e, 0xC1);                       // mov ecx, eax
+    emit8(e, 0x81); emit8(e, 0xE1); emit32(e, PAGE_OFFSET_MASK); // and ecx, PAGE_OFFSET_MASK
+    if (len > 1) { // Straddles two pages
+        emit8(e, 0x81); emit8(e, 0xF9); emit32(e, PAGE_SIZE - len); // cmp ecx, PAGE_SIZE - len
+        misses[n++] = emitJump(e, 0x77);                   // ja miss
+    }
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, (uint8_t)(0x80 | (reg << 3) | reg));
+    emit32(e, (uint32_t)(tlb + offsetof(tlb_entry, page))); // mov reg, [reg + page]
+    return n;
+}
+
+// eax = (eax <cc> ecx) ? 1 : 0
+static void emitSetCC(emitter *e, uint8_t cc) {
+    emit8(e, 0x39); emit8(e, 0xC8);             // cmp eax, ecx
+    emit8(e, 0x0F); emit8(e, 0x90 | cc); emit8(e, 0xC0); // setcc al
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0xC0);      // movzx eax, al
+}
+
+// x86 condition codes
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD };
+
+static int isBranch(uint8_t op, uint8_t *cc) {
+    switch (op) {
+        case OP_BEQ:  *cc = CC_E;  return 1;
+        case OP_BNE:  *cc = CC_NE; return 1;
+        case OP_BLT:  *cc = CC_L;  return 1;
+        case OP_BGE:  *cc = CC_GE; return 1;
+        case OP_BLTU: *cc = CC_B;  return 1;
+        case OP_BGEU: *cc = CC_AE; return 1;
+        default:      return 0;
+    }
+}
+
+// Emits one micro_op at guest address pc, returns 0 if it is not supported
+// (the block then ends there and the interpreter takes over)
+static int emitOp(emitter *e, const micro_op *op, uint32_t pc) {
+    static const uint8_t aluRegOps[] = {
+        [OP_ADD] = 0x01, [OP_SUB] = 0x29, [OP_XOR] = 0x31, [OP_OR] = 0x09, [OP_AND] = 0x21
+    };
+    static const uint8_t aluImmOps[] = {
+        [OP_ADDI] = 0x05, [OP_XORI] = 0x35, [OP_ORI] = 0x0D, [OP_ANDI] = 0x25
+    };
+    uint8_t cc;
+
+    switch ((op_t)op->op) {
+        case OP_ADD: case OP_SUB: case OP_XOR: case OP_OR: case OP_AND:
+            loadGuest(e, EAX, op->rs1);
+            loadGuest(e, ECX, op->rs2);
+            emit8(e, aluRegOps[op->op]); emit8(e, 0xC8); // op eax, ecx
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_SLL: case OP_SRL: case OP_SRA: // x86 masks the count to 5 bits like RV32
+            loadGuest(e, EAX, op->rs1);
+            loadGuest(e, ECX, op->rs2);
+            emit8(e, 0xD3);
+            emit8(e, op->op == OP_SLL ? 0xE0 : op->op == OP_SRL ? 0xE8 : 0xF8); // shl/shr/sar eax, cl
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_MUL:
+            loadGuest(e, EAX, op->rs1);
+            loadGuest(e, ECX, op->rs2);
+            emit8(e, 0x0F); emit8(e, 0xAF); emit8(e, 0xC1); // imul eax, ecx
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_MULH: case OP_MULHU:
+            loadGuest(e, EAX, op->rs1);
+            loadGuest(e, ECX, op->rs2);
+            emit8(e, 0xF7); emit8(e, op->op == OP_MULH ? 0xE9 : 0xE1); // imul/mul ecx, edx:eax
+            emit8(e, 0x89); emit8(e, 0xD0);                           // mov eax, edx
+            storeGuest(e, op->rd);
+            return 1;
+
+        // Division has to avoid the host's #DE on zero and overflow, so it calls the shared
+        // helpers like loads and stores do
+        case OP_MULHSU: case OP_DIV: case OP_DIVU: case OP_REM: case OP_REMU: {
+            static const void *const helpers[] = {
+                [OP_MULHSU] = (const void *)mulhsu, [OP_DIV] = (const void *)divs,
+                [OP_DIVU] = (const void *)divu, [OP_REM] = (const void *)rems, [OP_REMU] = (const void *)remu
+            };
+            loadGuest(e, EDI, op->rs1);
+            loadGuest(e, ESI, op->rs2);
+            emitCall(e, helpers[op->op]);
+            storeGuest(e, op->rd);
+            return 1;
+        }
+
+        case OP_SLT: case OP_SLTU:
+            loadGuest(e, EAX, op->rs1);
+            loadGuest(e, ECX, op->rs2);
+            emitSetCC(e, op->op == OP_SLT ? CC_L : CC_B);
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_ADDI: case OP_XORI: case OP_ORI: case OP_ANDI:
+            loadGuest(e, EAX, op->rs1);
+            emit8(e, aluImmOps[op->op]); emit32(e, (uint32_t)op->imm); // op eax, imm32
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_SLLI: case OP_SRLI: case OP_SRAI:
+            loadGuest(e, EAX, op->rs1);
+            emit8(e, 0xC1);
+            emit8(e, op->op == OP_SLLI ? 0xE0 : op->op == OP_SRLI ? 0xE8 : 0xF8); // shl/shr/sar eax, imm8
+            emit8(e, (uint8_t)op->imm);
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_SLTI: case OP_SLTIU:
+            loadGuest(e, EAX, op->rs1);
+            movImm(e, ECX, (uint32_t)op->imm);
+            emitSetCC(e, op->op == OP_SLTI ? CC_L : CC_B);
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_LUI:
+            movImm(e, EAX, (uint32_t)op->imm);
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_AUIPC:
+            movImm(e, EAX, pc + op->imm);
+            storeGuest(e, op->rd);
+            return 1;
+
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: {
+            static const void *const loads[] = {
+                [OP_LB] = (const void *)loadB, [OP_LH] = (const void *)loadHW, [OP_LW] = (const void *)loadW,
+                [OP_LBU] = (const void *)loadBU, [OP_LHU] = (const void *)loadHWU
+            };
+            // movsx/movzx eax, byte/word [rdx + rcx]; mov eax, [rdx + rcx]
+            static const uint8_t hitLoads[][2] = {
+                [OP_LB] = { 0x0F, 0xBE }, [OP_LH] = { 0x0F, 0xBF }, [OP_LW] = { 0x00, 0x8B },
+                [OP_LBU] = { 0x0F, 0xB6 }, [OP_LHU] = { 0x0F, 0xB7 }
+            };
+            static const uint8_t sizes[] = { [OP_LB] = 1, [OP_LH] = 2, [OP_LW] = 4, [OP_LBU] = 1, [OP_LHU] = 2 };
+            uint8_t *misses[2];
+            emitAddress(e, op);
+            int n = emitTlbProbe(e, EDX, offsetof(Memory, tlb), sizes[op->op], misses);
+            if (hitLoads[op->op][0]) {
+                emit8(e, hitLoads[op->op][0]);
+            }
+            emit8(e, hitLoads[op->op][1]); emit8(e, 0x04); emit8(e, 0x0A);
+            uint8_t *done = emitJump(e, 0xEB);                 // jmp done
+
+            while (n > 0) {
+                patchJump(e, misses[--n]);
+            }
+            emit8(e, 0x89); emit8(e, 0xC6);                 // mov esi, eax
+            emit8(e, 0x4C); emit8(e, 0x89); emit8(e, 0xE7); // mov rdi, r12
+            emitCall(e, loads[op->op]);
+            emitHaltCheck(e, pc); // Before rd is written
+
+            patchJump(e, done);
+            storeGuest(e, op->rd);
+            return 1;
+        }
+
+        case OP_SB: case OP_SH: case OP_SW: {
+            static const void *const stores[] = {
+                [OP_SB] = (const void *)storeByte, [OP_SH] = (const void *)storeHalfword,
+                [OP_SW] = (const void *)storeWord
+            };
+            uint32_t len = op->op == OP_SB ? 1 : op->op == OP_SH ? 2 : 4;
+            uint8_t *misses[4];
+            emitAddress(e, op);
+            loadGuest(e, EDX, op->rs2);
+            if (op->op == OP_SB) {
+                emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0xD2); // movzx edx, dl
+            } else if (op->op == OP_SH) {
+                emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0xD2); // movzx edx, dx
+            }
+            // The store TLB entry goes to rsi, edx keeps the value for the helper
+            int n = emitTlbProbe(e, ESI, offsetof(Memory, storeTlb), len, misses);
+
+            // Overlapping predecoded code (eax < codeHi && eax + len > codeLo) takes the helper,
+            // which invalidates it, so a hit never overwrites this block
+            emit8(e, 0x41); emit8(e, 0x3B); emit8(e, 0x84); emit8(e, 0x24);
+            emit32(e, (uint32_t)offsetof(Memory, codeHi));         // cmp eax, [r12 + codeHi]
+            uint8_t *noCode = emitJump(e, 0x73);                    // jae noCode
+            emit8(e, 0x8D); emit8(e, 0x78); emit8(e, (uint8_t)len); // lea edi, [rax + len]
+            emit8(e, 0x41); emit8(e, 0x3B); emit8(e, 0xBC); emit8(e, 0x24);
+            emit32(e, (uint32_t)offsetof(Memory, codeLo));         // cmp edi, [r12 + codeLo]
+            misses[n++] = emitJump(e, 0x77);                        // ja miss
+            patchJump(e, noCode);
+
+            if (op->op == OP_SH) {
+                emit8(e, 0x66); // Operand size prefix
+            }
+            emit8(e, op->op == OP_SB ? 0x88 : 0x89); emit8(e, 0x14); emit8(e, 0x0E); // mov [rsi + rcx], dl/dx/edx
+            uint8_t *done = emitJump(e, 0xEB);                      // jmp done
+
+            while (n > 0) {
+                patchJump(e, misses[--n]);
+            }
+            emit8(e, 0x89); emit8(e, 0xC6);             // mov esi, eax
+            emit8(e, 0x4C); emit8(e, 0x89); emit8(e, 0xE7); // mov rdi, r12
+            emitCall(e, stores[op->op]);
+
+            emitHaltCheck(e, pc);
+
+            // cmp dword [r13 + valid], 0; jne +11; leave at the next instruction if the store
+            // invalidated this block
+            emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0x7D);
+            emit8(e, (uint8_t)offsetof(Block, valid)); emit8(e, 0x00);
+            emit8(e, 0x75); emit8(e, 11);
+            emitExit(e, pc + op->len);
+
+            patchJump(e, done);
+            return 1;
+        }
+
+        case OP_JAL:
+            movImm(e, EAX, pc + op->len);
+            storeGuest(e, op->rd);
+            emitExit(e, pc + op->imm);
+            return 1;
+
+        case OP_JALR:
+            loadGuest(e, EAX, op->rs1);
+            emit8(e, 0x05); emit32(e, (uint32_t)op->imm); // add eax, imm32
+            emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0xFE); // and eax, ~1
+            emit8(e, 0x89); emit8(e, 0xC1);                 // mov ecx, eax (target, rd may equal rs1)
+            movImm(e, EAX, pc + op->len);
+            storeGuest(e, op->rd);
+            emit8(e, 0x89); emit8(e, 0xC8);                 // mov eax, ecx
+            emitEpilogue(e);
+            return 1;
+
+        default:
+            if (isBranch(op->op, &cc)) {
+                loadGuest(e, EAX, op->rs1);
+                loadGuest(e, ECX, op->rs2);
+                emit8(e, 0x39); emit8(e, 0xC8);             // cmp eax, ecx
+                movImm(e, EAX, pc + op->len);
+                movImm(e, ECX, pc + op->imm);
+                emit8(e, 0x0F); emit8(e, 0x40 | cc); emit8(e, 0xC1); // cmovcc eax, ecx
+                emitEpilogue(e);
+                return 1;
+            }
+            return 0; // ECALL, illegal encodings
+    }
+}
+
+int jitInit(Jit *jit, uint32_t threshold) {
+    void *code = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return -1;
+    }
+
+    jit->code = (uint8_t *)code;
+    jit->size = JIT_BUFFER_SIZE;
+    jit->used = 0;
+    jit->threshold = threshold;
+    jit->compiled = 0;
+    jit->partial = 0;
+    jit->rejected = 0;
+    jit->flushes = 0;
+    jit->failures = 0;
+    return 0;
+}
+
+// Forgets all compiled code so the buffer can be refilled, the blocks using it must be gone
+void jitReset(Jit *jit) {
+    jit->used = 0;
+    jit->compiled = 0;
+    jit->partial = 0;
+    jit->rejected = 0;
+    jit->flushes = 0;
+    jit->failures = 0;
+}
+
+// Empties the full buffer, the blocks no longer point into it
+void jitFlush(Jit *jit) {
+    jit->used = 0;
+    jit->flushes++;
+}
+
+// The pages holding [from, from + len) of the buffer become writable, or executable again:
+// code is never both. Returns 0, or -1 when mprotect fails
+static int protect(Jit *jit, size_t from, size_t len, int writable) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t lo = from & ~(page - 1);
+    size_t hi = (from + len + page - 1) & ~(page - 1);
+    if (hi > jit->size) {
+        hi = jit->size;
+    }
+    return mprotect(jit->code + lo, hi - lo, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+}
+
+void jitFree(Jit *jit) {
+    if (jit->code) {
+        munmap(jit->code, jit->size);
+    }
+    jit->code = NULL;
+    jit->size = 0;
+    jit->used = 0;
+}
+
+// Translates the longest supported prefix of blk, returns 0 when blk->native was set
+int jitCompile(Jit *jit, Block *blk) {
+    static const uint8_t prologue[] = {
+        0x53, 0x41, 0x54, 0x41, 0x55, // push rbx, r12, r13 (rsp 16-byte aligned for calls)
+        0x48, 0x89, 0xFB,             // mov rbx, rdi
+        0x49, 0x89, 0xF4,             // mov r12, rsi
+        0x49, 0x89, 0xD5              // mov r13, rdx
+    };
+
+    // Worst case: prologue + every op + a final exit
+    size_t worst = sizeof(prologue) + (size_t)(blk->count + 1) * MAX_OP_BYTES;
+    if (worst > jit->size - jit->used) {
+        return JIT_FULL;
+    }
+    if (protect(jit, jit->used, worst, 1) != 0) {
+        jit->failures++;
+        return -1;
+    }
+
+    emitter e = { jit->code + jit->used };
+    uint8_t *start = e.p;
+    uint32_t pc = blk->startPC;
+    uint32_t n = 0;
+
+    emitBytes(&e, prologue, sizeof(prologue));
+    while (n < blk->count && emitOp(&e, &blk->ops[n], pc)) {
+        pc += blk->ops[n].len;
+        n++;
+    }
+
+    if (n == 0) {
+        jit->rejected++;
+        if (protect(jit, jit->used, worst, 0) != 0) {
+            jit->failures++;
+        }
+        return -1;
+    }
+
+    // Control transfers return on their own, anything else falls out of the prefix here
+    op_t last = (op_t)blk->ops[n - 1].op;
+    uint8_t cc;
+    if (!(last == OP_JAL || last == OP_JALR || isBranch(last, &cc))) {
+        emitExit(&e, pc);
+    }
+
+    if (protect(jit, jit->used, worst, 0) != 0) { // Not executable, the block stays interpreted
+        jit->failures++;
+        return -1;
+    }
+    jit->used += (size_t)(e.p - start);
+    blk->native = (native_block_fn)(void *)start;
+    blk->nativeOps = n;
+
+    jit->compiled++;
+    if (n < blk->count) {
+        jit->partial++;
+    }
+    return 0;
+}
+
+void printJitStats(const Jit *jit, FILE *out) {
+    fprintf(out, "JIT: %llu blocks compiled (%llu partial, %llu rejected, %llu failed), %zu of %zu code bytes used, "
+            "%llu flushes\n", (unsigned long long)jit->compiled, (unsigned long long)jit->partial,
+            (unsigned long long)jit->rejected, (unsigned long long)jit->failures, jit->used, jit->size,
+            (unsigned long long)jit->flushes);
+}
+
+#endif
@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L // mmap, fstat under -std=c99
+
+#include "../include/loader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The few ELF32 fields the loader needs, read little-endian straight from the file image
+#define EI_NIDENT 16
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define ET_EXEC 2
+#define EM_RISCV 243
+#define PT_LOAD 1
+#define PF_X 1
+#define SHT_SYMTAB 2
+#define SHN_UNDEF 0
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+
+#define EHDR_SIZE 52
+#define PHDR_SIZE 32
+#define SHDR_SIZE 40
+#define SYM_SIZE 16
+
+static uint16_t get16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int isElfImage(const uint8_t *data, uint32_t size) {
+    return size >= 4 && memcmp(data, "\177ELF", 4) == 0;
+}
+
+// Table [off, off + count * entsize) must lie inside the file with entries at least minSize long
+static int tableFits(uint64_t fileSize, uint32_t off, uint32_t count, uint32_t entsize, uint32_t minSize) {
+    return count == 0 || (entsize >= minSize && (uint64_t)off + (uint64_t)count * entsize <= fileSize);
+}
+
+// Copies or maps the file part of a PT_LOAD segment, then clears its BSS
+static void loadSegment(Memory *mem, int fd, const uint8_t *file, uint32_t vaddr, uint32_t offset,
+                        uint32_t filesz, uint32_t memsz, elf_info *info) {
+    uint32_t fileEnd = vaddr + filesz;
+    uint32_t mapLo = (vaddr + PAGE_OFFSET_MASK) & ~PAGE_OFFSET_MASK;
+    uint32_t mapHi = fileEnd & ~PAGE_OFFSET_MASK;
+
+    // Whole pages can share the file's pages only when offset and address agree within a page
+    if ((offset & PAGE_OFFSET_MASK) == (vaddr & PAGE_OFFSET_MASK) && mapLo >= vaddr && mapLo < mapHi &&
+        memoryMapFile(mem, mapLo, fd, offset + (mapLo - vaddr), mapHi - mapLo) == 0) {
+        memoryWrite(mem, vaddr, file + offset, mapLo - vaddr);
+        memoryWrite(mem, mapHi, file + offset + (mapHi - vaddr), fileEnd - mapHi);
+        info->mappedBytes += mapHi - mapLo;
+        info->copiedBytes += filesz - (mapHi - mapLo);
+    } else {
+        memoryWrite(mem, vaddr, file + offset, filesz);
+        info->copiedBytes += filesz;
+    }
+
+    // Only the tail of the last file page can hold stale bytes, the rest was never allocated
+    memoryZero(mem, fileEnd, memsz - filesz);
+}
+
+static int loadSymbols(const uint8_t *file, uint64_t fileSize, SymbolTable *symbols) {
+    uint32_t shoff = get32(file + 32);
+    uint32_t shentsize = get16(file + 46);
+    uint32_t shnum = get16(file + 48);
+
+    if (!tableFits(fileSize, shoff, shnum, shentsize, SHDR_SIZE)) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < shnum; i++) {
+        const uint8_t *sh = file + shoff + i * shentsize;
+        if (get32(sh + 4) != SHT_SYMTAB) {
+            continue;
+        }
+
+        uint32_t symoff = get32(sh + 16);
+        uint32_t symsize = get32(sh + 20);
+        uint32_t link = get32(sh + 24);
+        if (link >= shnum || (uint64_t)symoff + symsize > fileSize) {
+            return -1;
+        }
+        const uint8_t *strsh = file + shoff + link * shentsize;
+        uint32_t stroff = get32(strsh + 16);
+        uint32_t strsize = get32(strsh + 20);
+        if (strsize == 0 || (uint64_t)stroff + strsize > fileSize) {
+            return -1;
+        }
+
+        symbols->names = (char *)malloc(strsize + 1);
+        symbols->symbols = (elf_symbol *)malloc((symsize / SYM_SIZE + 1) * sizeof(elf_symbol));
+        if (!symbols->names || !symbols->symbols) {
+            return -1;
+        }
+        memcpy(symbols->names, file + stroff, strsize);
+        symbols->names[strsize] = '\0';
+
+        for (uint32_t s = 0; s + SYM_SIZE <= symsize; s += SYM_SIZE) {
+            const uint8_t *sym = file + symoff + s;
+            uint32_t name = get32(sym);
+            uint8_t type = sym[12] & 0xF;
+            if (get16(sym + 14) == SHN_UNDEF || name == 0 || name >= strsize ||
+                (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)) {
+                continue;
+            }
+            elf_symbol *out = &symbols->symbols[symbols->count++];
+            out->addr = get32(sym + 4);
+            out->size = get32(sym + 8);
+            out->type = type == STT_FUNC ? SYMBOL_FUNC : type == STT_OBJECT ? SYMBOL_OBJECT : SYMBOL_OTHER;
+            out->name = symbols->names + name;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+static int compareSymbols(const void *a, const void *b) {
+    const elf_symbol *x = (const elf_symbol *)a;
+    const elf_symbol *y = (const elf_symbol *)b;
+    if (x->addr != y->addr) {
+        return x->addr < y->addr ? -1 : 1;
+    }
+    // Typed symbols first, so lookups prefer a function over a label at the same address
+    return (int)x->type - (int)y->type;
+}
+
+static int parseElf(Memory *mem, int fd, const uint8_t *file, uint64_t fileSize, const char *path,
+                    elf_info *info, SymbolTable *symbols) {
+    if (fileSize < EHDR_SIZE || !isElfImage(file, (uint32_t)fileSize)) {
+        fprintf(stderr, "%s: not an ELF file\n", path);
+        return -1;
+    }
+    if (file[4] != ELFCLASS32 || file[5] != ELFDATA2LSB || get16(file + 18) != EM_RISCV) {
+        fprintf(stderr, "%s: not a little-endian ELF32 RISC-V file\n", path);
+        return -1;
+    }
+    if (get16(file + 16) != ET_EXEC) {
+        fprintf(stderr, "%s: not an executable (ET_EXEC) file\n", path);
+        return -1;
+    }
+
+    uint32_t phoff = get32(file + 28);
+    uint32_t phentsize = get16(file + 42);
+    uint32_t phnum = get16(file + 44);
+    if (!tableFits(fileSize, phoff, phnum, phentsize, PHDR_SIZE)) {
+        fprintf(stderr, "%s: truncated program headers\n", path);
+        return -1;
+    }
+
+    uint32_t loadLo = UINT32_MAX, loadHi = 0;
+    info->entry = get32(file + 24);
+    info->execLo = UINT32_MAX;
+    info->execHi = 0;
+
+    for (uint32_t i = 0; i < phnum; i++) {
+        const uint8_t *ph = file + phoff + i * phentsize;
+        if (get32(ph) != PT_LOAD) {
+            continue;
+        }
+
+        uint32_t offset = get32(ph + 4);
+        uint32_t vaddr = get32(ph + 8);
+        uint32_t filesz = get32(ph + 16);
+        uint32_t memsz = get32(ph + 20);
+        uint32_t flags = get32(ph + 24);
+
+        if (filesz > memsz || (uint64_t)offset + filesz > fileSize || (uint64_t)vaddr + memsz > (1ull << 32)) {
+            fprintf(stderr, "%s: malformed PT_LOAD segment %u\n", path, i);
+            return -1;
+        }
+        if (memsz == 0) {
+            continue;
+        }
+
+        if (!memoryIsRam(mem, vaddr, memsz)) {
+            fprintf(stderr, "%s: PT_LOAD segment %u overlaps a device\n", path, i);
+            return -1;
+        }
+        loadSegment(mem, fd, file, vaddr, offset, filesz, memsz, info);
+
+        uint32_t end = vaddr + (memsz - 1); // Inclusive, a segment may end at the top of memory
+        if (vaddr < loadLo) loadLo = vaddr;
+        if (end > loadHi) loadHi = end;
+        if (flags & PF_X) {
+            if (vaddr < info->execLo) info->execLo = vaddr;
+            if (end > info->execHi) info->execHi = end;
+        }
+    }
+
+    if (loadLo > loadHi) {
+        fprintf(stderr, "%s: no loadable segments\n", path);
+        return -1;
+    }
+    // Without flagged code segments, anything loaded may run
+    if (info->execLo > info->execHi) {
+        info->execLo = loadLo;
+        info->execHi = loadHi;
+    }
+    info->execHi++; // Exclusive again, 0 standing for the end of the address space
+    info->loadLo = loadLo;
+    info->loadHi = loadHi + 1;
+
+    if (loadSymbols(file, fileSize, symbols) != 0) {
+        fprintf(stderr, "%s: ignoring malformed symbol table\n", path);
+        symbolTableFree(symbols);
+    }
+    if (symbols->count > 1) {
+        qsort(symbols->symbols, symbols->count, sizeof(elf_symbol), compareSymbols);
+    }
+    return 0;
+}
+
+int loadElf(Memory *mem, const char *path, elf_info *info, SymbolTable *symbols) {
+    memset(info, 0, sizeof(*info));
+    memset(symbols, 0, sizeof(*symbols));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        fprintf(stderr, "%s: cannot size file\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Headers are parsed and copied segment parts read straight from the page cache
+    void *file = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file == MAP_FAILED) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    int rc = parseElf(mem, fd, (const uint8_t *)file, (uint64_t)st.st_size, path, info, symbols);
+
+    // Segment mappings hold their own reference to the file
+    munmap(file, (size_t)st.st_size);
+    close(fd);
+    return rc;
+}
+
+const elf_symbol *symbolLookup(const SymbolTable *symbols, uint32_t addr) {
+    // Last symbol starting at or below addr
+    uint32_t lo = 0, hi = symbols->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (symbols->symbols[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+
+    // Back up to the first (preferred) symbol at that address
+    const elf_symbol *sym = &symbols->symbols[lo - 1];
+    while (sym > symbols->symbols && sym[-1].addr == sym->addr) {
+        sym--;
+    }
+    if (sym->size != 0 && addr - sym->addr >= sym->size) {
+        return NULL;
+    }
+    return sym;
+}
+
+void symbolFormat(char *buf, size_t size, const SymbolTable *symbols, uint32_t addr) {
+    const elf_symbol *sym = symbols ? symbolLookup(symbols, addr) : NULL;
+    if (!sym) {
+        snprintf(buf, size, "0x%08X", addr);
+    } else if (sym->addr == addr) {
+        snprintf(buf, size, "%s", sym->name);
+    } else {
+        snprintf(buf, size, "%s+0x%X", sym->name, addr - sym->addr);
+    }
+}
+
+void symbolTableFree(SymbolTable *symbols) {
+    free(symbols->symbols);
+    free(symbols->names);
+    symbols->symbols = NULL;
+    symbols->names = NULL;
+    symbols->count = 0;
+}
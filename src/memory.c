@@ -1,45 +1,555 @@
+#define _POSIX_C_SOURCE 200809L // mmap under -std=c99
+
 #include "../include/memory.h"
+#include "../include/predecode.h"
+#include "../include/snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Backs reads of pages that were never written
+static const uint8_t zeroPage[PAGE_SIZE];
+
+void memoryFlushStores(Memory *mem) {
+    for (uint32_t i = 0; i < TLB_ENTRIES; i++) {
+        mem->storeTlb[i].vpn = TLB_INVALID;
+        mem->storeTlb[i].page = NULL;
+    }
+}
+
+static void flushTLB(Memory *mem) {
+    for (uint32_t i = 0; i < TLB_ENTRIES; i++) {
+        mem->tlb[i].vpn = TLB_INVALID;
+        mem->tlb[i].page = NULL;
+    }
+    memoryFlushStores(mem);
+}
+
+void memoryInit(Memory *mem) {
+    memset(mem->tables, 0, sizeof(mem->tables));
+    flushTLB(mem);
+    mem->pages = 0;
+    mem->mappings = NULL;
+    mem->mappingCount = 0;
+    mem->mappedPages = 0;
+    mem->codeLo = UINT32_MAX;
+    mem->codeHi = 0;
+    mem->predecode = NULL;
+    mem->snapshot = NULL;
+    mem->deviceCount = 0;
+    mem->ramBase = 0;
+    mem->ramSize = 0;
+    mem->fault = MEM_FAULT_NONE;
+    mem->faultAddr = 0;
+    mem->halted = 0;
+    mem->outOfMemory = 0;
+}
+
+static int isMappedPage(const Memory *mem, const uint8_t *page) {
+    for (uint32_t i = 0; i < mem->mappingCount; i++) {
+        if (page >= mem->mappings[i].base && page < mem->mappings[i].base + mem->mappings[i].len) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Releases every page, the memory reads as all zeros again and stays usable
+void memoryFree(Memory *mem) {
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        if (!mem->tables[t]) {
+            continue;
+        }
+        for (uint32_t p = 0; p < PAGE_TABLE_ENTRIES; p++) {
+            if (mem->tables[t][p] && !isMappedPage(mem, mem->tables[t][p])) {
+                free(mem->tables[t][p]);
+            }
+        }
+        free(mem->tables[t]);
+        mem->tables[t] = NULL;
+    }
+
+    for (uint32_t i = 0; i < mem->mappingCount; i++) {
+        munmap(mem->mappings[i].base, mem->mappings[i].len);
+    }
+    free(mem->mappings);
+    mem->mappings = NULL;
+    mem->mappingCount = 0;
+    mem->mappedPages = 0;
+
+    flushTLB(mem);
+    mem->pages = 0;
+}
+
+// Records that page addr could not be allocated and halts the run, the access is dropped
+static uint8_t *outOfMemory(Memory *mem, uint32_t addr) {
+    if (!mem->outOfMemory) {
+        fprintf(stderr, "Out of host memory for guest page 0x%08X\n", addr & ~PAGE_OFFSET_MASK);
+    }
+    mem->outOfMemory = 1;
+    mem->halted = 1;
+    return NULL;
+}
+
+// Slow path: walks the page table, allocating the page (and its table) when writing
+// A read of a missing page gets the shared zero page, which never enters the TLB
+// NULL when a write finds no host memory for the page
+static uint8_t *lookupPage(Memory *mem, uint32_t addr, int write) {
+    uint32_t vpn = addr >> PAGE_SHIFT;
+    uint8_t **table = mem->tables[addr >> PAGE_TABLE_SHIFT];
+    uint8_t *page = table ? table[vpn & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+
+    // Before the write, and before it allocates
+    if (write && mem->snapshot && snapshotTouch(mem->snapshot, vpn, page) != 0) {
+        return outOfMemory(mem, addr);
+    }
+    if (!page) {
+        if (!write) {
+            return (uint8_t *)zeroPage;
+        }
+        if (!table) {
+            table = (uint8_t **)calloc(PAGE_TABLE_ENTRIES, sizeof(uint8_t *));
+            mem->tables[addr >> PAGE_TABLE_SHIFT] = table;
+        }
+        page = table ? (uint8_t *)calloc(1, PAGE_SIZE) : NULL;
+        if (!page) {
+            return outOfMemory(mem, addr);
+        }
+        table[vpn & (PAGE_TABLE_ENTRIES - 1)] = page;
+        mem->pages++;
+    }
+
+    tlb_entry *entry = &mem->tlb[vpn & (TLB_ENTRIES - 1)];
+    entry->vpn = vpn;
+    entry->page = page;
+    if (write) {
+        mem->storeTlb[vpn & (TLB_ENTRIES - 1)] = *entry;
+    }
+    return page;
+}
+
+// Region holding addr, NULL for RAM
+static const mmio_region *findDevice(const Memory *mem, uint32_t addr) {
+    for (uint32_t i = 0; i < mem->deviceCount; i++) {
+        if (addr - mem->devices[i].base < mem->devices[i].size) {
+            return &mem->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static inline int inRam(const Memory *mem, uint32_t addr) {
+    return mem->ramSize == 0 || addr - mem->ramBase < mem->ramSize;
+}
 
+static int isRam(const Memory *mem, uint32_t addr) {
+    return inRam(mem, addr) && !findDevice(mem, addr);
+}
+
+// RAM or a device
+static int accessible(const Memory *mem, uint32_t addr) {
+    return inRam(mem, addr) || findDevice(mem, addr);
+}
+
+// Records the first faulting access and halts the hart on it
+static void accessFault(Memory *mem, uint32_t addr, mem_fault kind) {
+    if (mem->fault == MEM_FAULT_NONE) {
+        mem->fault = kind;
+        mem->faultAddr = addr;
+    }
+    mem->halted = 1;
+}
+
+// Host address of [addr, addr + len), NULL when the access straddles two pages, goes to a
+// device or is outside bounded RAM. Only RAM pages enter the TLB, so a hit needs no check
+// write is a constant once inlined, stores look in their own TLB
+static inline uint8_t *hostAddress(Memory *mem, uint32_t addr, uint32_t len, int write) {
+    if ((addr & PAGE_OFFSET_MASK) > PAGE_SIZE - len) {
+        return NULL;
+    }
+
+    const tlb_entry *entry = &(write ? mem->storeTlb : mem->tlb)[(addr >> PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+    if (entry->vpn == addr >> PAGE_SHIFT) {
+        return entry->page + (addr & PAGE_OFFSET_MASK);
+    }
+    if ((mem->deviceCount || mem->ramSize) && !isRam(mem, addr)) {
+        return NULL;
+    }
+    uint8_t *page = lookupPage(mem, addr, write);
+    return page ? page + (addr & PAGE_OFFSET_MASK) : NULL;
+}
+
+// Slow path of the loads: a device register, an address outside bounded RAM (which faults),
+// or an access straddling two pages that is put together from bytes (each RAM or device)
+static uint32_t loadSlow(Memory *mem, uint32_t addr, uint32_t size) {
+    if ((addr & PAGE_OFFSET_MASK) <= PAGE_SIZE - size) {
+        const mmio_region *device = findDevice(mem, addr);
+        if (!device) {
+            accessFault(mem, addr, MEM_FAULT_LOAD);
+            return 0;
+        }
+        return device->read(device->context, addr - device->base, size);
+    }
+    if (!accessible(mem, addr) || !accessible(mem, addr + size - 1)) {
+        accessFault(mem, addr, MEM_FAULT_LOAD);
+        return 0;
+    }
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        value |= loadBU(mem, addr + i) << (8 * i);
+    }
+    return value;
+}
 
 uint32_t loadB(Memory *mem, uint32_t addr){
     // Load 8 bits (signed), then sign-extend to 32 bits (implicitly)
-    return (int8_t)mem->data[addr];
+    return (int8_t)loadBU(mem, addr);
 }
 
 uint32_t loadHW(Memory *mem, uint32_t addr){
     // Load 16 bits (signed), then sign-extend to 32 bits (implicitly)
-    return (int16_t)(mem->data[addr] | (mem->data[addr + 1] << 8));
+    return (int16_t)loadHWU(mem, addr);
 }
 
 uint32_t loadW(Memory *mem, uint32_t addr) {
-    return mem->data[addr] |
-           (mem->data[addr + 1] << 8) |
-           (mem->data[addr + 2] << 16) |
-           (mem->data[addr + 3] << 24);
+    const uint8_t *p = hostAddress(mem, addr, 4, 0);
+    if (!p) { // Device, or misaligned across a page boundary
+        return loadSlow(mem, addr, 4);
+    }
+    return readWord(p);
 }
 
 uint32_t loadBU(Memory *mem, uint32_t addr){
      // Load 8 bits and zero-extend to 32 bits (implicitly)
-     return mem->data[addr];
+     const uint8_t *p = hostAddress(mem, addr, 1, 0);
+     return p ? *p : loadSlow(mem, addr, 1);
 }
 
 uint32_t loadHWU(Memory *mem, uint32_t addr){
     // Load 2 bytes and zero-extend to 32 bits (implicitly)
-    return mem->data[addr] | (mem->data[addr + 1] << 8);
+    const uint8_t *p = hostAddress(mem, addr, 2, 0);
+    if (!p) {
+        return loadSlow(mem, addr, 2);
+    }
+    return readHalf(p);
+}
+
+// Drops predecoded instructions overlapping a store to [addr, addr + len)
+static inline void checkCodeWrite(Memory *mem, uint32_t addr, uint32_t len) {
+    if (addr < mem->codeHi && addr + len > mem->codeLo) {
+        predecodeInvalidate(mem->predecode, addr, len);
+    }
+}
+
+// Slow path of the stores, the counterpart of loadSlow
+static void storeSlow(Memory *mem, uint32_t addr, uint32_t value, uint32_t size) {
+    if ((addr & PAGE_OFFSET_MASK) <= PAGE_SIZE - size) {
+        const mmio_region *device = findDevice(mem, addr);
+        if (!device) {
+            if (!mem->outOfMemory) { // Else RAM whose page could not be allocated
+                accessFault(mem, addr, MEM_FAULT_STORE);
+            }
+            return;
+        }
+        device->write(device->context, addr - device->base, value, size);
+        return;
+    }
+    if (!accessible(mem, addr) || !accessible(mem, addr + size - 1)) { // Nothing is written then
+        accessFault(mem, addr, MEM_FAULT_STORE);
+        return;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        storeByte(mem, addr + i, (value >> (8 * i)) & 0xFF);
+    }
 }
 
-void storeByte(uint8_t *memory, uint32_t addr, uint8_t value) {
-    memory[addr] = value;
+void storeByte(Memory *mem, uint32_t addr, uint8_t value) {
+    uint8_t *p = hostAddress(mem, addr, 1, 1);
+    if (!p) {
+        storeSlow(mem, addr, value, 1);
+        return;
+    }
+    *p = value;
+    checkCodeWrite(mem, addr, 1);
 }
 
-void storeHalfword(uint8_t *memory, uint32_t addr, uint16_t value) {
-    memory[addr]     = value & 0xFF;
-    memory[addr + 1] = (value >> 8) & 0xFF;
+void storeHalfword(Memory *mem, uint32_t addr, uint16_t value) {
+    uint8_t *p = hostAddress(mem, addr, 2, 1);
+    if (!p) {
+        storeSlow(mem, addr, value, 2);
+        return;
+    }
+    writeHalf(p, value);
+    checkCodeWrite(mem, addr, 2);
 }
 
-void storeWord(uint8_t *memory, uint32_t addr, uint32_t value) {
-    memory[addr]     = value & 0xFF;
-    memory[addr + 1] = (value >> 8) & 0xFF;
-    memory[addr + 2] = (value >> 16) & 0xFF;
-    memory[addr + 3] = (value >> 24) & 0xFF;
-}
\ No newline at end of file
+void storeWord(Memory *mem, uint32_t addr, uint32_t value) {
+    uint8_t *p = hostAddress(mem, addr, 4, 1);
+    if (!p) {
+        storeSlow(mem, addr, value, 4);
+        return;
+    }
+    writeWord(p, value);
+    checkCodeWrite(mem, addr, 4);
+}
+
+int memoryIsRam(const Memory *mem, uint32_t addr, uint32_t len) {
+    if (len == 0) {
+        return 1;
+    }
+    if (mem->ramSize && (addr - mem->ramBase >= mem->ramSize || len > mem->ramSize - (addr - mem->ramBase))) {
+        return 0;
+    }
+    uint64_t end = (uint64_t)addr + len;
+    for (uint32_t i = 0; i < mem->deviceCount; i++) {
+        const mmio_region *device = &mem->devices[i];
+        if (addr < (uint64_t)device->base + device->size && device->base < end) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Bulk copies for loaders and guest input, a page at a time
+int memoryWrite(Memory *mem, uint32_t addr, const uint8_t *src, uint32_t len) {
+    if (!memoryIsRam(mem, addr, len)) { // Would back a device or unbounded addresses with pages
+        accessFault(mem, addr, MEM_FAULT_STORE);
+        return -1;
+    }
+    while (len > 0) {
+        uint32_t chunk = PAGE_SIZE - (addr & PAGE_OFFSET_MASK);
+        if (chunk > len) {
+            chunk = len;
+        }
+        uint8_t *page = lookupPage(mem, addr, 1);
+        if (!page) {
+            return -1;
+        }
+        memcpy(page + (addr & PAGE_OFFSET_MASK), src, chunk);
+        checkCodeWrite(mem, addr, chunk);
+        addr += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// Clears [addr, addr + len), pages that were never written already read as zeros and stay unallocated
+void memoryZero(Memory *mem, uint32_t addr, uint32_t len) {
+    while (len > 0) {
+        uint32_t chunk = PAGE_SIZE - (addr & PAGE_OFFSET_MASK);
+        if (chunk > len) {
+            chunk = len;
+        }
+        uint8_t **table = mem->tables[addr >> PAGE_TABLE_SHIFT];
+        uint8_t *page = table ? table[(addr >> PAGE_SHIFT) & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+        if (page) {
+            if (mem->snapshot && snapshotTouch(mem->snapshot, addr >> PAGE_SHIFT, page) != 0) {
+                outOfMemory(mem, addr);
+                return;
+            }
+            memset(page + (addr & PAGE_OFFSET_MASK), 0, chunk);
+            checkCodeWrite(mem, addr, chunk);
+        }
+        addr += chunk;
+        len -= chunk;
+    }
+}
+
+// Private mapping of [offset, offset + len) of fd, recorded for memoryFree, NULL on failure
+static uint8_t *mapRegion(Memory *mem, int fd, uint32_t offset, uint32_t len) {
+    memory_mapping *grown = (memory_mapping *)realloc(mem->mappings, (mem->mappingCount + 1) * sizeof(memory_mapping));
+    if (!grown) {
+        return NULL;
+    }
+    mem->mappings = grown;
+
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)offset);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    mem->mappings[mem->mappingCount++] = (memory_mapping){ (uint8_t *)base, len };
+    return (uint8_t *)base;
+}
+
+// Slot of page addr in its second-level table, which is allocated when missing (NULL when
+// that fails)
+static uint8_t **pageSlot(Memory *mem, uint32_t addr) {
+    uint8_t **table = mem->tables[addr >> PAGE_TABLE_SHIFT];
+
+    if (!table) {
+        table = (uint8_t **)calloc(PAGE_TABLE_ENTRIES, sizeof(uint8_t *));
+        if (!table) {
+            return (uint8_t **)outOfMemory(mem, addr);
+        }
+        mem->tables[addr >> PAGE_TABLE_SHIFT] = table;
+    }
+    return &table[(addr >> PAGE_SHIFT) & (PAGE_TABLE_ENTRIES - 1)];
+}
+
+// Uses the mapped page src as page addr, or copies it into the page already there
+static void installMapped(Memory *mem, uint32_t addr, uint8_t *src) {
+    uint8_t **slot = pageSlot(mem, addr);
+
+    if (!slot) {
+        return;
+    }
+    if (mem->snapshot && snapshotTouch(mem->snapshot, addr >> PAGE_SHIFT, *slot) != 0) {
+        outOfMemory(mem, addr);
+        return;
+    }
+    if (*slot) {
+        memcpy(*slot, src, PAGE_SIZE);
+    } else {
+        *slot = src;
+        mem->mappedPages++;
+    }
+    checkCodeWrite(mem, addr, PAGE_SIZE);
+}
+
+// Maps [offset, offset + len) of fd at addr without copying (all three page aligned)
+// The mapping is private, so guest stores copy-on-write and never reach the file
+// Pages that already exist keep their identity and get the file contents copied in
+// Returns 0, or -1 when mmap fails and the caller should copy instead
+int memoryMapFile(Memory *mem, uint32_t addr, int fd, uint32_t offset, uint32_t len) {
+    if (len == 0) {
+        return 0;
+    }
+
+    uint8_t *base = mapRegion(mem, fd, offset, len);
+    if (!base) {
+        return -1;
+    }
+    for (uint32_t done = 0; done < len; done += PAGE_SIZE) {
+        installMapped(mem, addr + done, base + done);
+    }
+    return 0;
+}
+
+int memoryMapPages(Memory *mem, int fd, uint32_t offset, const uint32_t *vpns, uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    uint8_t *base = mapRegion(mem, fd, offset, count * PAGE_SIZE);
+    if (!base) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        installMapped(mem, vpns[i] << PAGE_SHIFT, base + (size_t)i * PAGE_SIZE);
+    }
+    return 0;
+}
+
+uint8_t *memoryPage(const Memory *mem, uint32_t vpn) {
+    uint8_t **table = mem->tables[vpn >> (PAGE_TABLE_SHIFT - PAGE_SHIFT)];
+    return table ? table[vpn & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+}
+
+void memoryRestorePage(Memory *mem, uint32_t vpn, const uint8_t *contents) {
+    uint32_t addr = vpn << PAGE_SHIFT;
+
+    if (contents) {
+        uint8_t **slot = pageSlot(mem, addr);
+        if (slot && !*slot) {
+            *slot = (uint8_t *)malloc(PAGE_SIZE);
+            mem->pages += *slot != NULL;
+        }
+        if (!slot || !*slot) {
+            outOfMemory(mem, addr);
+            return;
+        }
+        memcpy(*slot, contents, PAGE_SIZE);
+    } else {
+        uint8_t **table = mem->tables[addr >> PAGE_TABLE_SHIFT];
+        uint8_t **slot = table ? &table[vpn & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+        if (!slot || !*slot) {
+            return;
+        }
+        if (isMappedPage(mem, *slot)) {
+            mem->mappedPages--; // Stays mapped until memoryFree
+        } else {
+            free(*slot);
+            mem->pages--;
+        }
+        *slot = NULL;
+    }
+
+    // The page may be gone or clean again
+    uint32_t index = vpn & (TLB_ENTRIES - 1);
+    if (mem->tlb[index].vpn == vpn) {
+        mem->tlb[index].vpn = TLB_INVALID;
+        mem->tlb[index].page = NULL;
+    }
+    if (mem->storeTlb[index].vpn == vpn) {
+        mem->storeTlb[index].vpn = TLB_INVALID;
+        mem->storeTlb[index].page = NULL;
+    }
+    checkCodeWrite(mem, addr, PAGE_SIZE);
+}
+
+int memoryMapDevice(Memory *mem, const mmio_region *region) {
+    if ((region->base | region->size) & PAGE_OFFSET_MASK || region->size == 0 ||
+        region->base + region->size - 1 < region->base) {
+        fprintf(stderr, "Device at 0x%08X: the region must be whole pages inside the address space\n", region->base);
+        return -1;
+    }
+    if (mem->deviceCount == MEM_MAX_DEVICES) {
+        fprintf(stderr, "Device at 0x%08X: at most %u devices\n", region->base, MEM_MAX_DEVICES);
+        return -1;
+    }
+    for (uint32_t i = 0; i < mem->deviceCount; i++) {
+        const mmio_region *other = &mem->devices[i];
+        if (region->base <= other->base + (other->size - 1) && other->base <= region->base + (region->size - 1)) {
+            fprintf(stderr, "Device at 0x%08X overlaps the one at 0x%08X\n", region->base, other->base);
+            return -1;
+        }
+    }
+
+    mem->devices[mem->deviceCount++] = *region;
+    flushTLB(mem); // Its pages may have been cached as RAM
+    return 0;
+}
+
+void memorySetRam(Memory *mem, uint32_t base, uint32_t size) {
+    mem->ramBase = base;
+    mem->ramSize = size;
+    flushTLB(mem); // Pages outside the new bounds may be cached
+}
+
+const uint8_t *memoryReadable(Memory *mem, uint32_t addr, uint32_t *len) {
+    if ((mem->deviceCount || mem->ramSize) && !isRam(mem, addr)) {
+        *len = 0;
+        return NULL;
+    }
+    *len = PAGE_SIZE - (addr & PAGE_OFFSET_MASK);
+    if (mem->ramSize && mem->ramSize - (addr - mem->ramBase) < *len) { // RAM ends inside the page
+        *len = mem->ramSize - (addr - mem->ramBase);
+    }
+    return lookupPage(mem, addr, 0) + (addr & PAGE_OFFSET_MASK);
+}
+
+int memoryRead(Memory *mem, uint32_t addr, uint8_t *dst, uint32_t len) {
+    while (len > 0) {
+        uint32_t chunk;
+        const uint8_t *src = memoryReadable(mem, addr, &chunk);
+        if (!src) {
+            if (!accessible(mem, addr)) {
+                accessFault(mem, addr, MEM_FAULT_LOAD);
+                return -1;
+            }
+            *dst = (uint8_t)loadBU(mem, addr); // A device register
+            chunk = 1;
+        } else {
+            if (chunk > len) {
+                chunk = len;
+            }
+            memcpy(dst, src, chunk);
+        }
+        addr += chunk;
+        dst += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include "../include/pipeline.h"
+#include "../include/execute.h"
+#include <string.h>
+
+// Registers an op reads and writes
+#define USE_RS1_X 0x001
+#define USE_RS1_F 0x002
+#define USE_RS2_X 0x004
+#define USE_RS2_F 0x008
+#define USE_RS3_F 0x010
+#define USE_RD_X  0x020
+#define USE_RD_F  0x040
+#define USE_LOAD  0x080  // rd comes from memory
+#define USE_ECALL 0x100  // Reads a0 and a7
+
+#define F_BASE 32        // Index of f0 in ready and fromLoad
+
+static uint16_t operandsOf(op_t op) {
+    switch (op) {
+        case OP_ADD: case OP_SUB: case OP_SLL: case OP_SLT: case OP_SLTU:
+        case OP_XOR: case OP_SRL: case OP_SRA: case OP_OR: case OP_AND:
+        case OP_MUL: case OP_MULH: case OP_MULHSU: case OP_MULHU:
+        case OP_DIV: case OP_DIVU: case OP_REM: case OP_REMU:
+            return USE_RS1_X | USE_RS2_X | USE_RD_X;
+        case OP_ADDI: case OP_SLTI: case OP_SLTIU: case OP_XORI: case OP_ORI: case OP_ANDI:
+        case OP_SLLI: case OP_SRLI: case OP_SRAI: case OP_JALR:
+        case OP_CSRRW: case OP_CSRRS: case OP_CSRRC:
+            return USE_RS1_X | USE_RD_X;
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+            return USE_RS1_X | USE_RD_X | USE_LOAD;
+        case OP_SB: case OP_SH: case OP_SW:
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+            return USE_RS1_X | USE_RS2_X;
+        case OP_LUI: case OP_AUIPC: case OP_JAL:
+        case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI:
+            return USE_RD_X;
+        case OP_ECALL:
+            return USE_ECALL;
+        case OP_FLW:
+            return USE_RS1_X | USE_RD_F | USE_LOAD;
+        case OP_FSW:
+            return USE_RS1_X | USE_RS2_F;
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV:
+        case OP_FSGNJ: case OP_FSGNJN: case OP_FSGNJX: case OP_FMIN: case OP_FMAX:
+            return USE_RS1_F | USE_RS2_F | USE_RD_F;
+        case OP_FSQRT:
+            return USE_RS1_F | USE_RD_F;
+        case OP_FMADD: case OP_FMSUB: case OP_FNMSUB: case OP_FNMADD:
+            return USE_RS1_F | USE_RS2_F | USE_RS3_F | USE_RD_F;
+        case OP_FCVT_W_S: case OP_FCVT_WU_S: case OP_FMV_X_W: case OP_FCLASS:
+            return USE_RS1_F | USE_RD_X;
+        case OP_FCVT_S_W: case OP_FCVT_S_WU: case OP_FMV_W_X:
+            return USE_RS1_X | USE_RD_F;
+        case OP_FEQ: case OP_FLT: case OP_FLE:
+            return USE_RS1_F | USE_RS2_F | USE_RD_X;
+        default:
+            return 0;
+    }
+}
+
+void pipelineDefaultConfig(pipeline_config *config) {
+    config->forwarding = 1;
+    config->branchPenalty = 2;
+    config->jumpPenalty = 1;
+    config->jalrPenalty = 2;
+}
+
+void pipelineInit(PipelineModel *model, const pipeline_config *config) {
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    for (int op = 0; op < NUM_OPS; op++) {
+        model->operands[op] = operandsOf((op_t)op);
+    }
+    pipelineReset(model);
+}
+
+void pipelineReset(PipelineModel *model) {
+    memset(&model->stats, 0, sizeof(model->stats));
+    pipelineRestart(model);
+}
+
+void pipelineRestart(PipelineModel *model) {
+    // Every earlier producer has written back, the first instruction reaches EX after IF and ID
+    memset(model->ready, 0, sizeof(model->ready));
+    memset(model->fromLoad, 0, sizeof(model->fromLoad));
+    model->nextEx = model->stats.cycles + 3;
+    model->fresh = 1;
+}
+
+// The cycle reg lets a consumer into EX, noting whether a load holds it up
+static inline void waitFor(const PipelineModel *model, uint32_t reg, uint64_t *ex, int *load) {
+    if (model->ready[reg] > *ex) {
+        *ex = model->ready[reg];
+        *load = model->fromLoad[reg];
+    }
+}
+
+engine_result runPipelined(Hart *hart, PredecodeCache *cache, PipelineModel *model, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    pipeline_stats *stats = &model->stats;
+    const pipeline_config *config = &model->config;
+
+    if (model->fresh && budget > 0 && pcInRange(hart, hart->pc)) {
+        stats->regions++;
+        model->fresh = 0;
+    }
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        uint32_t pc = hart->pc;
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, pc);
+        uint16_t uses = model->operands[op.op];
+
+        // Data hazards, x0 is never waited for as its ready cycle stays 0
+        uint64_t ex = model->nextEx;
+        int load = 0;
+        if (uses & USE_RS1_X) waitFor(model, op.rs1, &ex, &load);
+        if (uses & USE_RS1_F) waitFor(model, F_BASE + op.rs1, &ex, &load);
+        if (uses & USE_RS2_X) waitFor(model, op.rs2, &ex, &load);
+        if (uses & USE_RS2_F) waitFor(model, F_BASE + op.rs2, &ex, &load);
+        if (uses & USE_RS3_F) waitFor(model, F_BASE + op.rs3, &ex, &load);
+        if (uses & USE_ECALL) {
+            waitFor(model, A0, &ex, &load);
+            waitFor(model, A7, &ex, &load);
+        }
+        if (load) {
+            stats->loadUseStalls += ex - model->nextEx;
+        } else {
+            stats->rawStalls += ex - model->nextEx;
+        }
+
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        // A loaded value leaves MEM one cycle after an ALU result leaves EX, both are in the
+        // register file for ID two cycles after EX
+        uint32_t latency = config->forwarding ? ((uses & USE_LOAD) ? 2 : 1) : 3;
+        if ((uses & USE_RD_X) && op.rd != ZERO) {
+            model->ready[op.rd] = ex + latency;
+            model->fromLoad[op.rd] = (uses & USE_LOAD) != 0;
+        } else if (uses & USE_RD_F) {
+            model->ready[F_BASE + op.rd] = ex + latency;
+            model->fromLoad[F_BASE + op.rd] = (uses & USE_LOAD) != 0;
+        }
+
+        // Control hazards, the outcome comes from executing the op
+        uint32_t penalty = 0;
+        switch (op.op) {
+            case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+                stats->branches++;
+                if (hart->pc != pc + op.len) {
+                    stats->takenBranches++;
+                    penalty = config->branchPenalty;
+                    stats->branchFlushCycles += penalty;
+                }
+                break;
+            case OP_JAL:
+            case OP_JALR:
+                stats->jumps++;
+                penalty = op.op == OP_JAL ? config->jumpPenalty : config->jalrPenalty;
+                stats->jumpFlushCycles += penalty;
+                break;
+            default:
+                break;
+        }
+
+        // Its WB, or the last bubble it causes, so that every cycle has a cause
+        stats->instructions++;
+        stats->cycles = ex + 2 + penalty;
+        model->nextEx = ex + 1 + penalty;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+    return res;
+}
+
+static void writeCause(const pipeline_stats *stats, const char *name, uint64_t cycles, FILE *out) {
+    double instructions = stats->instructions ? (double)stats->instructions : 1.0;
+    double total = stats->cycles ? (double)stats->cycles : 1.0;
+    fprintf(out, "  %-18s %14llu %8.3f %7.2f%%\n", name, (unsigned long long)cycles, (double)cycles / instructions,
+            100.0 * (double)cycles / total);
+}
+
+void pipelineWriteReport(const PipelineModel *model, FILE *out) {
+    const pipeline_stats *stats = &model->stats;
+    const pipeline_config *config = &model->config;
+    uint64_t fill = 4 * stats->regions;
+
+    fprintf(out, "Pipeline model: 5-stage in-order, forwarding %s, penalties branch %u, jal %u, jalr %u\n",
+            config->forwarding ? "on" : "off", config->branchPenalty, config->jumpPenalty, config->jalrPenalty);
+    fprintf(out, "Instructions %llu in %llu regions\n", (unsigned long long)stats->instructions,
+            (unsigned long long)stats->regions);
+    fprintf(out, "Cycles       %llu\n", (unsigned long long)stats->cycles);
+    fprintf(out, "CPI          %.3f\n\n", stats->instructions ? (double)stats->cycles / (double)stats->instructions : 0.0);
+
+    fprintf(out, "  %-18s %14s %8s %8s\n", "cycles", "count", "CPI", "share");
+    writeCause(stats, "issue", stats->instructions, out);
+    writeCause(stats, "pipeline fill", fill, out);
+    writeCause(stats, "load-use stalls", stats->loadUseStalls, out);
+    writeCause(stats, "RAW stalls", stats->rawStalls, out);
+    writeCause(stats, "branch flushes", stats->branchFlushCycles, out);
+    writeCause(stats, "jump flushes", stats->jumpFlushCycles, out);
+
+    fprintf(out, "\nBranches %llu, %llu taken (%.2f%%), jumps %llu\n", (unsigned long long)stats->branches,
+            (unsigned long long)stats->takenBranches,
+            stats->branches ? 100.0 * (double)stats->takenBranches / (double)stats->branches : 0.0,
+            (unsigned long long)stats->jumps);
+}
@@ -0,0 +1,368 @@
+#include "../include/predecode.h"
+#include "../include/block.h"
+#include "../include/fpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static micro_op resolveRType(r_fields r) {
+    micro_op op = { OP_ILLEGAL, r.rd, r.rs1, r.rs2, 0, 0, 0 };
+    int alt = (r.funct7 == F7_0100000); // SUB/SRA, any other funct7 behaves like ADD/SRL
+
+    if (r.funct7 == F7_0000001) { // RV32M, funct3 enumerates the eight operations in order
+        op.op = (uint8_t)(OP_MUL + r.funct3);
+        return op;
+    }
+
+    switch (r.funct3) {
+        case F3_000: op.op = alt ? OP_SUB : OP_ADD; break;
+        case F3_001: op.op = OP_SLL; break;
+        case F3_010: op.op = OP_SLT; break;
+        case F3_011: op.op = OP_SLTU; break;
+        case F3_100: op.op = OP_XOR; break;
+        case F3_101: op.op = alt ? OP_SRA : OP_SRL; break;
+        case F3_110: op.op = OP_OR; break;
+        case F3_111: op.op = OP_AND; break;
+    }
+    return op;
+}
+
+// Rounding modes 5 and 6 are reserved, 7 (DYN) reads frm at run time
+static int validRounding(uint32_t rm) {
+    return rm <= RM_RMM || rm == RM_DYN;
+}
+
+// RV32F OP-FP, funct7 selects the operation (its low two bits are the format, S = 00)
+static micro_op resolveFType(r_fields r) {
+    micro_op op = { OP_ILLEGAL, r.rd, r.rs1, r.rs2, 0, 0, 0 };
+    op_t rounded = OP_ILLEGAL; // Set for operations that take the rounding mode
+    op_t exact = OP_ILLEGAL;
+
+    switch (r.funct7) {
+        case F7_0000000: rounded = OP_FADD; break;
+        case F7_0000100: rounded = OP_FSUB; break;
+        case F7_0001000: rounded = OP_FMUL; break;
+        case F7_0001100: rounded = OP_FDIV; break;
+        case F7_0101100: rounded = (r.rs2 == 0) ? OP_FSQRT : OP_ILLEGAL; break;
+        case F7_1100000: rounded = (r.rs2 == 0) ? OP_FCVT_W_S : (r.rs2 == 1) ? OP_FCVT_WU_S : OP_ILLEGAL; break;
+        case F7_1101000: rounded = (r.rs2 == 0) ? OP_FCVT_S_W : (r.rs2 == 1) ? OP_FCVT_S_WU : OP_ILLEGAL; break;
+        case F7_0010000: // FSGNJ, FSGNJN, FSGNJX
+            exact = (r.funct3 <= F3_010) ? (op_t)(OP_FSGNJ + r.funct3) : OP_ILLEGAL;
+            break;
+        case F7_0010100: // FMIN, FMAX
+            exact = (r.funct3 <= F3_001) ? (op_t)(OP_FMIN + r.funct3) : OP_ILLEGAL;
+            break;
+        case F7_1010000: // FLE, FLT, FEQ
+            exact = (r.funct3 == F3_000) ? OP_FLE : (r.funct3 == F3_001) ? OP_FLT :
+                    (r.funct3 == F3_010) ? OP_FEQ : OP_ILLEGAL;
+            break;
+        case F7_1110000: // FMV.X.W, FCLASS.S
+            if (r.rs2 == 0) {
+                exact = (r.funct3 == F3_000) ? OP_FMV_X_W : (r.funct3 == F3_001) ? OP_FCLASS : OP_ILLEGAL;
+            }
+            break;
+        case F7_1111000:
+            exact = (r.rs2 == 0 && r.funct3 == F3_000) ? OP_FMV_W_X : OP_ILLEGAL;
+            break;
+        default:
+            break;
+    }
+
+    if (rounded != OP_ILLEGAL && validRounding(r.funct3)) {
+        op.op = rounded;
+        op.imm = r.funct3;
+    } else if (exact != OP_ILLEGAL) {
+        op.op = exact;
+    }
+    return op;
+}
+
+// FMADD.S, FMSUB.S, FNMSUB.S, FNMADD.S, in opcode order
+static micro_op resolveR4Type(opcode_t opcode, r4_fields r) {
+    micro_op op = { OP_ILLEGAL, r.rd, r.rs1, r.rs2, r.funct3, 0, r.rs3 };
+
+    if (r.fmt == 0 && validRounding(r.funct3)) {
+        op.op = (uint8_t)(OP_FMADD + ((opcode - FMADD) >> 2));
+    }
+    return op;
+}
+
+static micro_op resolveIType(opcode_t opcode, i_fields i) {
+    micro_op op = { OP_ILLEGAL, i.rd, i.rs1, 0, i.imm, 0, 0 };
+
+    switch (opcode) {
+        case IMM:
+            switch (i.funct3) {
+                case F3_000: op.op = OP_ADDI; break;
+                case F3_010: op.op = OP_SLTI; break;
+                case F3_011: op.op = OP_SLTIU; break;
+                case F3_100: op.op = OP_XORI; break;
+                case F3_110: op.op = OP_ORI; break;
+                case F3_111: op.op = OP_ANDI; break;
+                case F3_001: op.op = OP_SLLI; op.imm &= 0x1F; break;
+                case F3_101: // imm[10:5] selects SRLI/SRAI, anything else is invalid
+                    if ((i.imm >> 5) == 0x00) {
+                        op.op = OP_SRLI;
+                    } else if ((i.imm >> 5) == 0x20) {
+                        op.op = OP_SRAI;
+                    }
+                    op.imm &= 0x1F;
+                    break;
+            }
+            break;
+        case LOAD:
+            switch (i.funct3) {
+                case F3_000: op.op = OP_LB; break;
+                case F3_001: op.op = OP_LH; break;
+                case F3_010: op.op = OP_LW; break;
+                case F3_100: op.op = OP_LBU; break;
+                case F3_101: op.op = OP_LHU; break;
+                default: break;
+            }
+            break;
+        case JALR:
+            op.op = OP_JALR;
+            break;
+        case SYSTEM: // funct3 0 is ECALL (and EBREAK), the rest are CSR accesses with the CSR in imm
+            op.imm &= 0xFFF;
+            switch (i.funct3) {
+                case F3_000: op.op = OP_ECALL; op.imm = i.imm; break;
+                case F3_001: op.op = OP_CSRRW; break;
+                case F3_010: op.op = OP_CSRRS; break;
+                case F3_011: op.op = OP_CSRRC; break;
+                case F3_101: op.op = OP_CSRRWI; break;
+                case F3_110: op.op = OP_CSRRSI; break;
+                case F3_111: op.op = OP_CSRRCI; break;
+                default: break;
+            }
+            break;
+        case FLOAD:
+            if (i.funct3 == F3_010) {
+                op.op = OP_FLW;
+            }
+            break;
+        default:
+            break;
+    }
+    return op;
+}
+
+static micro_op resolveSType(opcode_t opcode, s_fields s) {
+    micro_op op = { OP_ILLEGAL, 0, s.rs1, s.rs2, s.imm, 0, 0 };
+
+    if (opcode == FSTORE) {
+        if (s.funct3 == F3_010) {
+            op.op = OP_FSW;
+        }
+        return op;
+    }
+    switch (s.funct3) {
+        case F3_000: op.op = OP_SB; break;
+        case F3_001: op.op = OP_SH; break;
+        case F3_010: op.op = OP_SW; break;
+        default: break;
+    }
+    return op;
+}
+
+static micro_op resolveBType(b_fields b) {
+    micro_op op = { OP_ILLEGAL, 0, b.rs1, b.rs2, b.imm, 0, 0 };
+
+    switch (b.funct3) {
+        case F3_000: op.op = OP_BEQ; break;
+        case F3_001: op.op = OP_BNE; break;
+        case F3_100: op.op = OP_BLT; break;
+        case F3_101: op.op = OP_BGE; break;
+        case F3_110: op.op = OP_BLTU; break;
+        case F3_111: op.op = OP_BGEU; break;
+        default: break;
+    }
+    return op;
+}
+
+static micro_op resolveFields(decoded_fields decoded) {
+    micro_op op = { OP_ILLEGAL, 0, 0, 0, 0, 0, 0 };
+
+    switch (decoded.instrType) {
+        case R_TYPE:
+            return (decoded.opcode == FARITH) ? resolveFType(decoded.r) : resolveRType(decoded.r);
+        case R4_TYPE:
+            return resolveR4Type(decoded.opcode, decoded.r4);
+        case I_TYPE:
+            return resolveIType(decoded.opcode, decoded.i);
+        case S_TYPE:
+            return resolveSType(decoded.opcode, decoded.s);
+        case U_TYPE:
+            op.op = (decoded.opcode == LUI) ? OP_LUI : OP_AUIPC;
+            op.rd = decoded.u.rd;
+            op.imm = decoded.u.imm;
+            return op;
+        case B_TYPE:
+            return resolveBType(decoded.b);
+        case J_TYPE:
+            op.op = OP_JAL;
+            op.rd = decoded.j.rd;
+            op.imm = decoded.j.imm;
+            return op;
+        default: // Unknown opcode, or a compressed encoding that expands to none (0)
+            op.op = OP_ILLEGAL;
+            return op;
+    }
+}
+
+// Maps a decoded instruction to its final operation
+micro_op resolveMicroOp(decoded_fields decoded) {
+    micro_op op = resolveFields(decoded);
+    op.len = decoded.length;
+    return op;
+}
+
+uint32_t fetchInstruction(Memory *mem, uint32_t pc) {
+    uint32_t instr = loadHWU(mem, pc);
+    if (!isCompressed(instr)) {
+        instr |= loadHWU(mem, pc + 2) << 16;
+    }
+    return instr;
+}
+
+const char *opName(op_t op) {
+    static const char *names[NUM_OPS] = {
+        "UNDECODED",
+        "ADD", "SUB", "SLL", "SLT", "SLTU", "XOR", "SRL", "SRA", "OR", "AND",
+        "MUL", "MULH", "MULHSU", "MULHU", "DIV", "DIVU", "REM", "REMU",
+        "ADDI", "SLTI", "SLTIU", "XORI", "ORI", "ANDI", "SLLI", "SRLI", "SRAI",
+        "LB", "LH", "LW", "LBU", "LHU",
+        "SB", "SH", "SW",
+        "LUI", "AUIPC",
+        "BEQ", "BNE", "BLT", "BGE", "BLTU", "BGEU",
+        "JAL", "JALR", "ECALL",
+        "CSRRW", "CSRRS", "CSRRC", "CSRRWI", "CSRRSI", "CSRRCI",
+        "FLW", "FSW",
+        "FADD.S", "FSUB.S", "FMUL.S", "FDIV.S", "FSQRT.S", "FMADD.S", "FMSUB.S", "FNMSUB.S", "FNMADD.S",
+        "FSGNJ.S", "FSGNJN.S", "FSGNJX.S", "FMIN.S", "FMAX.S",
+        "FCVT.W.S", "FCVT.WU.S", "FCVT.S.W", "FCVT.S.WU", "FMV.X.W", "FMV.W.X",
+        "FEQ.S", "FLT.S", "FLE.S", "FCLASS.S",
+        "ILLEGAL"
+    };
+    return (op < NUM_OPS) ? names[op] : "UNKNOWN";
+}
+
+int predecodeInit(PredecodeCache *cache, Memory *mem) {
+    memset(cache->tables, 0, sizeof(cache->tables));
+    cache->pages = 0;
+    cache->lastVpn = TLB_INVALID;
+    cache->lastOps = NULL;
+    cache->blocks = NULL;
+
+    // Nothing cached yet, so the store path has nothing to check
+    mem->codeLo = UINT32_MAX;
+    mem->codeHi = 0;
+    mem->predecode = cache;
+    return 0;
+}
+
+// Forgets every cached op, the cache stays attached to mem
+void predecodeReset(PredecodeCache *cache, Memory *mem) {
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        if (!cache->tables[t]) {
+            continue;
+        }
+        for (uint32_t p = 0; p < PAGE_TABLE_ENTRIES; p++) {
+            free(cache->tables[t][p]);
+        }
+        free(cache->tables[t]);
+        cache->tables[t] = NULL;
+    }
+    cache->pages = 0;
+    cache->lastVpn = TLB_INVALID;
+    cache->lastOps = NULL;
+
+    mem->codeLo = UINT32_MAX;
+    mem->codeHi = 0;
+}
+
+void predecodeFree(PredecodeCache *cache, Memory *mem) {
+    predecodeReset(cache, mem);
+    mem->predecode = NULL;
+}
+
+// Op page holding pc, NULL if nothing was fetched from that page yet and alloc is not set,
+// or if the page cannot be allocated
+static micro_op *opPage(PredecodeCache *cache, uint32_t pc, int alloc) {
+    micro_op **table = cache->tables[pc >> PAGE_TABLE_SHIFT];
+    uint32_t index = (pc >> PAGE_SHIFT) & (PAGE_TABLE_ENTRIES - 1);
+
+    if (table && table[index]) {
+        return table[index];
+    }
+    if (!alloc) {
+        return NULL;
+    }
+
+    if (!table) {
+        table = (micro_op **)calloc(PAGE_TABLE_ENTRIES, sizeof(micro_op *));
+        cache->tables[pc >> PAGE_TABLE_SHIFT] = table;
+    }
+    micro_op *ops = table ? (micro_op *)calloc(OPS_PER_PAGE, sizeof(micro_op)) : NULL;
+    if (!ops) {
+        return NULL;
+    }
+    table[index] = ops;
+    cache->pages++;
+    return ops;
+}
+
+// Slow path of predecodeFetch: refills the fetch TLB, then decodes the instruction at pc if
+// needed and widens the watched code range
+// Without host memory for the op page the instruction is decoded into a scratch op so it
+// still runs, and the memory halts the run with HALT_ERROR
+const micro_op *predecodeFill(PredecodeCache *cache, Memory *mem, uint32_t pc) {
+    micro_op *ops = opPage(cache, pc, 1);
+    micro_op *op = ops ? &ops[opIndex(pc)] : &cache->scratch;
+
+    if (!ops) {
+        if (!mem->outOfMemory) {
+            fprintf(stderr, "Out of host memory for predecoded page 0x%08X\n", pc & ~PAGE_OFFSET_MASK);
+        }
+        mem->outOfMemory = 1;
+        mem->halted = 1;
+        op->op = OP_UNDECODED;
+    } else {
+        cache->lastVpn = pc >> PAGE_SHIFT;
+        cache->lastOps = ops;
+    }
+    if (op->op != OP_UNDECODED) {
+        return op;
+    }
+
+    pc &= ~1u;
+    *op = resolveMicroOp(decodeInstruction(fetchInstruction(mem, pc)));
+
+    if (pc < mem->codeLo) {
+        mem->codeLo = pc;
+    }
+    if (pc + op->len > mem->codeHi) {
+        mem->codeHi = pc + op->len;
+    }
+    return op;
+}
+
+// Called by the store path when a write lands inside [codeLo, codeHi)
+// Every translated block is made of decoded ops, so blocks only need checking when one was hit
+void predecodeInvalidate(PredecodeCache *cache, uint32_t addr, uint32_t len) {
+    int hit = 0;
+
+    // A 32-bit instruction starting in the halfword before addr covers it as well
+    uint32_t first = (addr & ~1u) - 2;
+    for (uint32_t half = first; half - first < len + (addr & 1u) + 2; half += 2) {
+        micro_op *ops = opPage(cache, half, 0);
+        if (ops && ops[opIndex(half)].op != OP_UNDECODED) {
+            ops[opIndex(half)].op = OP_UNDECODED;
+            hit = 1;
+        }
+    }
+
+    if (hit && cache->blocks) {
+        blockInvalidate(cache->blocks, addr, len);
+    }
+}
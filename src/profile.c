@@ -0,0 +1,493 @@
+#include "../include/profile.h"
+#include "../include/execute.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NODES_INITIAL 256
+
+int profileInit(Profile *prof) {
+    memset(prof, 0, sizeof(*prof));
+    prof->nodes = (profile_node *)malloc(NODES_INITIAL * sizeof(profile_node));
+    if (!prof->nodes) {
+        return -1;
+    }
+    prof->nodeCapacity = NODES_INITIAL;
+    profileReset(prof);
+    return 0;
+}
+
+// Drops every count, the slot pages are released and the node array kept
+void profileReset(Profile *prof) {
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        if (!prof->tables[t]) {
+            continue;
+        }
+        for (uint32_t p = 0; p < PAGE_TABLE_ENTRIES; p++) {
+            free(prof->tables[t][p]);
+        }
+        free(prof->tables[t]);
+        prof->tables[t] = NULL;
+    }
+    prof->lastVpn = TLB_INVALID;
+    prof->lastEntries = NULL;
+    prof->outOfMemory = 0;
+
+    memset(&prof->nodes[0], 0, sizeof(profile_node));
+    prof->nodeCount = 1;
+    prof->current = 0;
+    prof->returnCount = 0;
+    prof->lostDepth = 0;
+    prof->lostCalls = 0;
+    prof->instructions = 0;
+    prof->charged = 0;
+    prof->blockStart = 1;
+}
+
+void profileFree(Profile *prof) {
+    profileReset(prof);
+    free(prof->nodes);
+    free(prof->returns);
+    prof->nodes = NULL;
+    prof->returns = NULL;
+}
+
+// Slow path of the counter lookup, allocates the page of counters on first use (NULL when
+// that fails)
+static uint64_t *entryPage(Profile *prof, uint32_t pc) {
+    uint64_t ***table = &prof->tables[pc >> PAGE_TABLE_SHIFT];
+    if (!*table) {
+        *table = (uint64_t **)calloc(PAGE_TABLE_ENTRIES, sizeof(uint64_t *));
+    }
+    uint64_t **page = *table ? &(*table)[(pc >> PAGE_SHIFT) & (PAGE_TABLE_ENTRIES - 1)] : NULL;
+    if (page && !*page) {
+        *page = (uint64_t *)calloc(OPS_PER_PAGE, sizeof(uint64_t));
+    }
+    if (!page || !*page) {
+        if (!prof->outOfMemory) {
+            fprintf(stderr, "Out of host memory for profile counters\n");
+        }
+        prof->outOfMemory = 1;
+        return NULL;
+    }
+    prof->lastVpn = pc >> PAGE_SHIFT;
+    prof->lastEntries = *page;
+    return *page;
+}
+
+static inline uint64_t *blockEntries(Profile *prof, uint32_t pc) {
+    uint64_t *entries = (pc >> PAGE_SHIFT) == prof->lastVpn ? prof->lastEntries : entryPage(prof, pc);
+    return entries ? &entries[opIndex(pc)] : &prof->lost;
+}
+
+// Charges the instructions retired since the last call or return to the current context
+static inline void chargeCurrent(Profile *prof, uint64_t instructions) {
+    prof->nodes[prof->current].self += instructions - prof->charged;
+    prof->charged = instructions;
+}
+
+// Child context of the current one for func, created when missing, 0 when there is no room
+static uint32_t childContext(Profile *prof, uint32_t func) {
+    profile_node *parent = &prof->nodes[prof->current];
+    uint32_t child = parent->firstChild;
+    while (child && prof->nodes[child].func != func) {
+        child = prof->nodes[child].nextSibling;
+    }
+    if (child) {
+        return child;
+    }
+
+    if (prof->nodeCount == prof->nodeCapacity) {
+        uint32_t capacity = prof->nodeCapacity * 2;
+        profile_node *grown = capacity <= PROFILE_MAX_NODES
+            ? (profile_node *)realloc(prof->nodes, capacity * sizeof(profile_node)) : NULL;
+        if (!grown) {
+            return 0;
+        }
+        prof->nodes = grown;
+        prof->nodeCapacity = capacity;
+        parent = &prof->nodes[prof->current];
+    }
+    child = prof->nodeCount++;
+    profile_node *node = &prof->nodes[child];
+    memset(node, 0, sizeof(*node));
+    node->func = func;
+    node->parent = prof->current;
+    node->nextSibling = parent->firstChild;
+    parent->firstChild = child;
+    return child;
+}
+
+// Enters the context of func called from the current one
+// Recursion is collapsed: when func is already open on the current path its context is
+// entered again, so the tree (and the folded stacks) do not grow with the recursion depth
+static void profileCall(Profile *prof, uint32_t func) {
+    if (prof->lostDepth > 0) {
+        prof->lostDepth++;
+        prof->lostCalls++;
+        return;
+    }
+
+    if (prof->returnCount == prof->returnCapacity) {
+        uint32_t capacity = prof->returnCapacity ? prof->returnCapacity * 2 : NODES_INITIAL;
+        uint32_t *grown = (uint32_t *)realloc(prof->returns, capacity * sizeof(uint32_t));
+        if (!grown) {
+            prof->lostDepth = 1;
+            prof->lostCalls++;
+            return;
+        }
+        prof->returns = grown;
+        prof->returnCapacity = capacity;
+    }
+
+    uint32_t child = prof->current;
+    while (child != 0 && prof->nodes[child].func != func) {
+        child = prof->nodes[child].parent;
+    }
+    if (prof->nodes[child].func != func) {
+        child = childContext(prof, func);
+        if (!child) {
+            prof->lostDepth = 1;
+            prof->lostCalls++;
+            return;
+        }
+    }
+
+    prof->nodes[child].calls++;
+    prof->returns[prof->returnCount++] = prof->current;
+    prof->current = child;
+}
+
+static void profileReturn(Profile *prof) {
+    if (prof->lostDepth > 0) {
+        prof->lostDepth--;
+    } else if (prof->returnCount > 0) {
+        prof->current = prof->returns[--prof->returnCount];
+    }
+}
+
+engine_result runProfiled(Hart *hart, PredecodeCache *cache, Profile *prof, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    int blockStart = prof->blockStart;
+
+    if (prof->instructions == 0) {
+        prof->nodes[0].func = hart->pc;
+    }
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        if (blockStart) {
+            (*blockEntries(prof, hart->pc))++;
+        }
+
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, hart->pc);
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        blockStart = opEndsBlock(op.op);
+        // Branches and ECALL leave rd zero, so only JAL/JALR can look like calls
+        if (blockStart && (op.rd == RA || (op.op == OP_JALR && op.rd == ZERO && op.rs1 == RA && op.imm == 0))) {
+            // The call or return itself belongs to the context it leaves
+            chargeCurrent(prof, prof->instructions + res.retired);
+            if (op.rd == RA) {
+                profileCall(prof, hart->pc);
+            } else {
+                profileReturn(prof);
+            }
+        }
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+
+    prof->blockStart = blockStart;
+    prof->instructions += res.retired;
+    chargeCurrent(prof, prof->instructions);
+    return res;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+typedef struct {
+    uint32_t pc;
+    uint32_t end;          // Blocks: one past the last instruction
+    uint64_t count;
+    uint64_t entries;
+} hot_entry;
+
+static int compareHot(const void *a, const void *b) {
+    const hot_entry *x = (const hot_entry *)a;
+    const hot_entry *y = (const hot_entry *)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+static int appendEntry(hot_entry **list, uint32_t *n, uint32_t *capacity, hot_entry entry) {
+    if (*n == *capacity) {
+        uint32_t grownCapacity = *capacity ? *capacity * 2 : 1024;
+        hot_entry *grown = (hot_entry *)realloc(*list, grownCapacity * sizeof(hot_entry));
+        if (!grown) {
+            return -1;
+        }
+        *list = grown;
+        *capacity = grownCapacity;
+    }
+    (*list)[(*n)++] = entry;
+    return 0;
+}
+
+// Every PC that retired instructions, in address order, NULL when there are none
+// A block entry executes every instruction from its PC up to the next branch, so each PC
+// counts the entries of its own and of the straight-line code leading into it
+static hot_entry *collectPCs(const Profile *prof, PredecodeCache *cache, Hart *hart, uint32_t *count) {
+    uint32_t leaderCount = 0, leaderCapacity = 0;
+    hot_entry *leaders = NULL;
+
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        for (uint32_t p = 0; prof->tables[t] && p < PAGE_TABLE_ENTRIES; p++) {
+            const uint64_t *entries = prof->tables[t][p];
+            for (uint32_t i = 0; entries && i < OPS_PER_PAGE; i++) {
+                uint32_t pc = (t << PAGE_TABLE_SHIFT) | (p << PAGE_SHIFT) | (i << 1);
+                if (entries[i] && appendEntry(&leaders, &leaderCount, &leaderCapacity,
+                                              (hot_entry){ pc, pc, entries[i], entries[i] }) != 0) {
+                    free(leaders);
+                    *count = 0;
+                    return NULL;
+                }
+            }
+        }
+    }
+
+    uint32_t n = 0, capacity = 0;
+    hot_entry *pcs = NULL;
+    uint64_t carry = 0;
+    uint32_t pc = 0;
+
+    for (uint32_t next = 0; next < leaderCount || carry;) {
+        if (!carry) {
+            pc = leaders[next].pc;
+        }
+        const micro_op *op = predecodeFetch(cache, &hart->mem, pc);
+        hot_entry entry = { pc, pc + op->len, carry, 0 };
+        if (next < leaderCount && leaders[next].pc == pc) {
+            entry.count += leaders[next].entries;
+            entry.entries = leaders[next].entries;
+            next++;
+        }
+        if (appendEntry(&pcs, &n, &capacity, entry) != 0) {
+            free(pcs);
+            pcs = NULL;
+            n = 0;
+            break;
+        }
+
+        int falls = !opEndsBlock(op->op) && entry.end != 0 && pcInRange(hart, entry.end);
+        carry = falls ? entry.count : 0;
+        pc = entry.end;
+    }
+
+    free(leaders);
+    *count = n;
+    return pcs;
+}
+
+// Splits the executed PCs into blocks: each starts where blocks were entered (or after a gap)
+// and runs to its branch, the next entry point or the next gap, taking its PCs' counts
+static uint32_t buildBlocks(hot_entry *pcs, uint32_t n, PredecodeCache *cache, Hart *hart, hot_entry *blocks) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        int starts = (i == 0 || pcs[i].entries > 0 || pcs[i].pc != pcs[i - 1].end ||
+                      opEndsBlock(predecodeFetch(cache, &hart->mem, pcs[i - 1].pc)->op));
+        if (starts) {
+            blocks[count++] = (hot_entry){ pcs[i].pc, pcs[i].end, 0, pcs[i].entries };
+        }
+        blocks[count - 1].end = pcs[i].end;
+        blocks[count - 1].count += pcs[i].count;
+    }
+    return count;
+}
+
+typedef struct {
+    uint32_t func;
+    uint64_t self;
+    uint64_t inclusive;
+    uint64_t calls;
+} func_entry;
+
+static int compareU32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int compareFuncs(const void *a, const void *b) {
+    const func_entry *x = (const func_entry *)a;
+    const func_entry *y = (const func_entry *)b;
+    if (x->self != y->self) {
+        return x->self > y->self ? -1 : 1;
+    }
+    return x->func < y->func ? -1 : x->func > y->func;
+}
+
+// Aggregates the calling contexts per function, inclusive counts a recursive function once
+static func_entry *collectFunctions(const Profile *prof, uint32_t *count) {
+    uint32_t n = prof->nodeCount;
+    uint32_t *ids = (uint32_t *)malloc(n * sizeof(uint32_t));
+    uint32_t *funcs = (uint32_t *)malloc(n * sizeof(uint32_t));
+    uint64_t *totals = (uint64_t *)malloc(n * sizeof(uint64_t));
+    uint32_t *active = (uint32_t *)calloc(n, sizeof(uint32_t));
+    func_entry *out = (func_entry *)calloc(n, sizeof(func_entry));
+    *count = 0;
+
+    if (!ids || !funcs || !totals || !active || !out) {
+        free(ids);
+        free(funcs);
+        free(totals);
+        free(active);
+        free(out);
+        return NULL;
+    }
+
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        funcs[i] = prof->nodes[i].func;
+    }
+    qsort(funcs, n, sizeof(uint32_t), compareU32);
+    for (uint32_t i = 0; i < n; i++) {
+        if (i == 0 || funcs[i] != funcs[i - 1]) {
+            funcs[unique] = funcs[i];
+            out[unique].func = funcs[i];
+            unique++;
+        }
+    }
+
+    // Children always come after their parent, so a reverse sweep sums every subtree
+    for (uint32_t i = 0; i < n; i++) {
+        const profile_node *node = &prof->nodes[i];
+        ids[i] = (uint32_t)((uint32_t *)bsearch(&node->func, funcs, unique, sizeof(uint32_t), compareU32) - funcs);
+        totals[i] = node->self;
+        out[ids[i]].self += node->self;
+        out[ids[i]].calls += node->calls;
+    }
+    for (uint32_t i = n - 1; i > 0; i--) {
+        totals[prof->nodes[i].parent] += totals[i];
+    }
+
+    // Depth-first walk, a context adds to its function's inclusive count unless it is already open
+    uint32_t i = 0;
+    for (;;) {
+        if (active[ids[i]]++ == 0) {
+            out[ids[i]].inclusive += totals[i];
+        }
+        if (prof->nodes[i].firstChild) {
+            i = prof->nodes[i].firstChild;
+            continue;
+        }
+        for (;;) {
+            active[ids[i]]--;
+            if (i == 0) {
+                goto sorted;
+            }
+            if (prof->nodes[i].nextSibling) {
+                i = prof->nodes[i].nextSibling;
+                break;
+            }
+            i = prof->nodes[i].parent;
+        }
+    }
+
+sorted:
+    qsort(out, unique, sizeof(func_entry), compareFuncs);
+    *count = unique;
+    free(ids);
+    free(funcs);
+    free(totals);
+    free(active);
+    return out;
+}
+
+void profileWriteReport(Profile *prof, PredecodeCache *cache, Hart *hart, const SymbolTable *symbols, FILE *out) {
+    uint64_t total = prof->instructions;
+    char loc[128];
+    uint32_t n = 0;
+    hot_entry *pcs = collectPCs(prof, cache, hart, &n);
+    hot_entry *blocks = n ? (hot_entry *)malloc(n * sizeof(hot_entry)) : NULL;
+    uint32_t blockCount = blocks ? buildBlocks(pcs, n, cache, hart, blocks) : 0;
+    uint64_t entered = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        entered += pcs[i].entries;
+    }
+
+    fprintf(out, "Profile: %llu instructions, %u PCs, %llu block entries, %u calling contexts\n",
+            (unsigned long long)total, n, (unsigned long long)entered, prof->nodeCount);
+    if (prof->lostCalls) {
+        fprintf(out, "(%llu calls past %u contexts were charged to their callers)\n",
+                (unsigned long long)prof->lostCalls, PROFILE_MAX_NODES);
+    }
+
+    if (pcs) {
+        qsort(pcs, n, sizeof(hot_entry), compareHot);
+    }
+    fprintf(out, "\nHot instructions\n%14s %7s  %-10s  %-6s  %s\n", "count", "%", "pc", "op", "location");
+    for (uint32_t i = 0; i < n && i < PROFILE_TOP; i++) {
+        symbolFormat(loc, sizeof(loc), symbols, pcs[i].pc);
+        fprintf(out, "%14llu %6.2f%%  0x%08X  %-6s  %s\n", (unsigned long long)pcs[i].count,
+                percent(pcs[i].count, total), pcs[i].pc, opName((op_t)predecodeFetch(cache, &hart->mem, pcs[i].pc)->op), loc);
+    }
+
+    if (blocks) {
+        qsort(blocks, blockCount, sizeof(hot_entry), compareHot);
+    }
+    fprintf(out, "\nHot blocks\n%14s %7s %12s  %-21s  %s\n", "instructions", "%", "entries", "range", "location");
+    for (uint32_t i = 0; i < blockCount && i < PROFILE_TOP; i++) {
+        symbolFormat(loc, sizeof(loc), symbols, blocks[i].pc);
+        fprintf(out, "%14llu %6.2f%% %12llu  0x%08X-0x%08X  %s\n", (unsigned long long)blocks[i].count,
+                percent(blocks[i].count, total), (unsigned long long)blocks[i].entries, blocks[i].pc,
+                blocks[i].end, loc);
+    }
+
+    uint32_t funcCount = 0;
+    func_entry *funcs = collectFunctions(prof, &funcCount);
+    fprintf(out, "\nFunctions\n%14s %7s %14s %7s %12s  %s\n", "self", "%", "inclusive", "%", "calls", "function");
+    for (uint32_t i = 0; i < funcCount && i < PROFILE_TOP; i++) {
+        symbolFormat(loc, sizeof(loc), symbols, funcs[i].func);
+        fprintf(out, "%14llu %6.2f%% %14llu %6.2f%% %12llu  %s\n", (unsigned long long)funcs[i].self,
+                percent(funcs[i].self, total), (unsigned long long)funcs[i].inclusive,
+                percent(funcs[i].inclusive, total), (unsigned long long)funcs[i].calls, loc);
+    }
+
+    free(funcs);
+    free(blocks);
+    free(pcs);
+}
+
+void profileWriteFolded(const Profile *prof, const SymbolTable *symbols, FILE *out) {
+    uint32_t *path = (uint32_t *)malloc(prof->nodeCount * sizeof(uint32_t));
+    char loc[128];
+    if (!path) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < prof->nodeCount; i++) {
+        if (prof->nodes[i].self == 0) {
+            continue;
+        }
+        uint32_t depth = 0;
+        for (uint32_t n = i; ; n = prof->nodes[n].parent) {
+            path[depth++] = n;
+            if (n == 0) {
+                break;
+            }
+        }
+        while (depth-- > 0) {
+            symbolFormat(loc, sizeof(loc), symbols, prof->nodes[path[depth]].func);
+            fprintf(out, "%s%c", loc, depth ? ';' : ' ');
+        }
+        fprintf(out, "%llu\n", (unsigned long long)prof->nodes[i].self);
+    }
+    free(path);
+}
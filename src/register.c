@@ -1,14 +1,38 @@
 #include "../include/registers.h"
 
-void dumpRegisterContents(){
+// Builds the .res contents in words (DUMP_MAX_WORDS long), returns the number of words used
+uint32_t registerDumpWords(const uint32_t *regs, const uint32_t *fregs, uint32_t fcsr, uint32_t *words) {
+    uint32_t used = fcsr;
+
+    memcpy(words, regs, NUM_REGS * sizeof(uint32_t));
+    for (int i = 0; i < NUM_FREGS; i++) {
+        words[NUM_REGS + i] = fregs[i];
+        used |= fregs[i];
+    }
+    words[NUM_REGS + NUM_FREGS] = fcsr;
+    return used ? DUMP_MAX_WORDS : NUM_REGS;
+}
+
+void dumpRegisterContents(const uint32_t *words, uint32_t count){
     for (int i = 0; i < NUM_REGS; i++) {
-        printf("x%d (%s): 0x%08X\n", i, regName((reg_t)i), regs[i]);
+        printf("x%d (%s): 0x%08X\n", i, regName((reg_t)i), words[i]);
+    }
+    if (count < DUMP_MAX_WORDS) {
+        return;
     }
-    return;
+    for (int i = 0; i < NUM_FREGS; i++) {
+        printf("f%d: 0x%08X\n", i, words[NUM_REGS + i]);
+    }
+    printf("fcsr: 0x%02X\n", words[NUM_REGS + NUM_FREGS]);
 }
 
 // Returns new filename with <basename>-answer.res
 char *makeDumpFilename(const char *input) {
+    return makeSiblingFilename(input, "-answer.res");
+}
+
+// Returns <input without its extension><suffix>
+char *makeSiblingFilename(const char *input, const char *suffix) {
     const char *dot = strrchr(input, '.'); // Strip ext
     size_t len;
 
@@ -18,8 +42,6 @@ char *makeDumpFilename(const char *input) {
         len = strlen(input); // else just get the length of the whole filename
     } 
 
-    const char *suffix = "-answer.res";
-
     // Total length = prefix + base + suffix + null terminator
     size_t totalLen = + len + strlen(suffix) + 1;
 
@@ -36,7 +58,7 @@ char *makeDumpFilename(const char *input) {
     return output;
 }
 
-int dumpRegisterContentsFile(const char *filename) {
+int dumpRegisterContentsFile(const uint32_t *words, uint32_t count, const char *filename) {
     char *dumpFilename = makeDumpFilename(filename);
     if (!dumpFilename) {
         fprintf(stderr, "Failed to allocate dump filename\n");
@@ -49,11 +71,11 @@ int dumpRegisterContentsFile(const char *filename) {
         return -1;
     }
 
-    size_t written = fwrite(regs, sizeof(uint32_t), NUM_REGS, file);
+    size_t written = fwrite(words, sizeof(uint32_t), count, file);
     fclose(file);
 
-    if (written != NUM_REGS) {
-        fprintf(stderr, "Incomplete dump, only wrote %zu of %d\n", written, NUM_REGS);
+    if (written != count) {
+        fprintf(stderr, "Incomplete dump, only wrote %zu of %u\n", written, count);
         free(dumpFilename);
         return -1;
     }
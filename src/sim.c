@@ -0,0 +1,635 @@
+#include "../include/sim.h"
+#include "../include/execute.h"
+#include <stdlib.h>
+#include <string.h>
+
+void sim_default_config(sim_config *config) {
+    config->engine = ENGINE_THREADED;
+    config->jitThreshold = JIT_DEFAULT_THRESHOLD;
+    config->console = stdout;
+    config->profile = 0;
+    config->tracePath = NULL;
+    config->cache = NULL;
+    config->cacheSweep = 0;
+    config->pipeline = NULL;
+    config->predictors = NULL;
+    config->devices = 0;
+    config->ramSize = 0;
+    config->coverage = NULL;
+    config->coverageSize = 0;
+    config->stopAtMarker = 0;
+}
+
+// Builds the caches the configured engine runs from, for freshly zeroed memory
+static int attachCaches(Sim *sim) {
+    Memory *mem = &sim->hart.mem;
+
+    if (predecodeInit(&sim->predecode, mem) != 0) {
+        fprintf(stderr, "Predecode cache allocation failed\n");
+        return -1;
+    }
+
+    sim->useBlocks = (sim->config.engine == ENGINE_BLOCK || sim->config.engine == ENGINE_JIT);
+    if (sim->useBlocks && blockCacheInit(&sim->blocks, &sim->predecode) != 0) {
+        fprintf(stderr, "Block cache allocation failed\n");
+        predecodeFree(&sim->predecode, mem);
+        sim->useBlocks = 0;
+        return -1;
+    }
+
+    sim->useJit = 0;
+    if (sim->config.engine == ENGINE_JIT) {
+        if (jitInit(&sim->jit, sim->config.jitThreshold) != 0) {
+            fprintf(stderr, "JIT code buffer allocation failed, blocks stay interpreted\n");
+        } else {
+            sim->blocks.jit = &sim->jit;
+            sim->useJit = 1;
+        }
+    }
+    return 0;
+}
+
+static void detachCaches(Sim *sim) {
+    if (sim->useJit) {
+        jitFree(&sim->jit);
+        sim->useJit = 0;
+    }
+    if (sim->useBlocks) {
+        blockCacheFree(&sim->blocks, &sim->predecode);
+        sim->useBlocks = 0;
+    }
+    predecodeFree(&sim->predecode, &sim->hart.mem);
+}
+
+Sim *sim_create(const sim_config *config) {
+    Sim *sim = (Sim *)calloc(1, sizeof(Sim));
+    if (!sim) {
+        fprintf(stderr, "Simulator allocation failed\n");
+        return NULL;
+    }
+
+    if (config) {
+        sim->config = *config;
+    } else {
+        sim_default_config(&sim->config);
+    }
+
+    if ((sim->config.profile != 0) + (sim->config.tracePath != NULL) + (sim->config.cache != NULL) +
+        (sim->config.cacheSweep != 0) + (sim->config.pipeline != NULL) + (sim->config.predictors != NULL) +
+        (sim->config.coverage != NULL) > 1) {
+        fprintf(stderr, "Profiling, tracing, the cache models, the pipeline model, branch prediction and coverage "
+                "cannot be combined\n");
+        free(sim);
+        return NULL;
+    }
+
+    if (sim->config.coverage && coverageInit(&sim->coverage, sim->config.coverage, sim->config.coverageSize) != 0) {
+        free(sim);
+        return NULL;
+    }
+
+    if (sim->config.ramSize & PAGE_OFFSET_MASK) {
+        fprintf(stderr, "The RAM size must be a multiple of %u bytes\n", PAGE_SIZE);
+        free(sim);
+        return NULL;
+    }
+
+    Hart *hart = &sim->hart;
+    memoryInit(&hart->mem);
+    if (sim->config.devices && devicesAttach(&sim->devices, hart) != 0) {
+        free(sim);
+        return NULL;
+    }
+
+    if (attachCaches(sim) != 0) {
+        free(sim);
+        return NULL;
+    }
+
+    if (sim->config.profile) {
+        sim->profile = (Profile *)malloc(sizeof(Profile));
+        if (!sim->profile || profileInit(sim->profile) != 0) {
+            fprintf(stderr, "Profile allocation failed\n");
+            free(sim->profile);
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+    }
+
+    if (sim->config.tracePath) {
+        sim->trace = traceOpen(sim->config.tracePath);
+        if (!sim->trace) {
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+    }
+
+    if (sim->config.cache) {
+        sim->cache = (CacheModel *)malloc(sizeof(CacheModel));
+        if (!sim->cache || cacheInit(sim->cache, sim->config.cache) != 0) {
+            free(sim->cache);
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+        sim->config.cache = NULL; // The model keeps its own copy
+    }
+
+    if (sim->config.cacheSweep) {
+        sim->sweep = (SweepModel *)malloc(sizeof(SweepModel));
+        if (!sim->sweep || sweepInit(sim->sweep, sim->config.cacheSweep) != 0) {
+            free(sim->sweep);
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+    }
+
+    if (sim->config.pipeline) {
+        sim->pipeline = (PipelineModel *)malloc(sizeof(PipelineModel));
+        if (!sim->pipeline) {
+            fprintf(stderr, "Pipeline model allocation failed\n");
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+        pipelineInit(sim->pipeline, sim->config.pipeline);
+        sim->pipelineOn = 1;
+        sim->config.pipeline = NULL; // The model keeps its own copy
+    }
+
+    if (sim->config.predictors) {
+        sim->branches = (BranchModel *)malloc(sizeof(BranchModel));
+        if (!sim->branches || bpredInit(sim->branches, sim->config.predictors) != 0) {
+            free(sim->branches);
+            detachCaches(sim);
+            free(sim);
+            return NULL;
+        }
+        sim->config.predictors = NULL; // The model keeps its own copy
+    }
+
+    hart->pc = MEM_BASE;
+    hart->basePC = MEM_BASE;
+    hart->endPC = MEM_BASE;
+    consoleInit(&hart->console, sim->config.console);
+    hart->markerStops = sim->config.stopAtMarker;
+    return sim;
+}
+
+void sim_destroy(Sim *sim) {
+    if (!sim) {
+        return;
+    }
+    detachCaches(sim);
+    memoryFree(&sim->hart.mem);
+    symbolTableFree(&sim->symbols);
+    if (sim->profile) {
+        profileFree(sim->profile);
+        free(sim->profile);
+    }
+    traceClose(sim->trace);
+    snapshotFree(sim->snapshot);
+    if (sim->cache) {
+        cacheFree(sim->cache);
+        free(sim->cache);
+    }
+    if (sim->sweep) {
+        sweepFree(sim->sweep);
+        free(sim->sweep);
+    }
+    free(sim->pipeline);
+    if (sim->branches) {
+        bpredFree(sim->branches);
+        free(sim->branches);
+    }
+    free(sim);
+}
+
+// Returns the hart to its power-on state with empty memory and caches, the cache tables are
+// reused and only the pages the previous program touched are released
+static void resetSim(Sim *sim) {
+    Hart *hart = &sim->hart;
+
+    if (sim->useBlocks) {
+        blockCacheReset(&sim->blocks);
+    }
+    if (sim->useJit) {
+        jitReset(&sim->jit);
+    }
+    predecodeReset(&sim->predecode, &hart->mem);
+    memoryFree(&hart->mem);
+    symbolTableFree(&sim->symbols);
+    sim->isElf = 0;
+    sim->isSnapshot = 0;
+    hart->mem.snapshot = NULL;
+    snapshotFree(sim->snapshot);
+    sim->snapshot = NULL;
+    if (sim->profile) {
+        profileReset(sim->profile);
+    }
+    if (sim->cache) {
+        cacheReset(sim->cache);
+    }
+    if (sim->sweep) {
+        sweepReset(sim->sweep);
+    }
+    if (sim->pipeline) {
+        pipelineReset(sim->pipeline);
+    }
+    if (sim->branches) {
+        bpredReset(sim->branches);
+    }
+    memset(hart->regs, 0, sizeof(hart->regs));
+    memset(hart->fregs, 0, sizeof(hart->fregs));
+    hart->fcsr = 0;
+    hart->pc = MEM_BASE;
+    hart->basePC = MEM_BASE;
+    hart->endPC = MEM_BASE;
+    hart->retired = 0;
+    hart->halt = HALT_NONE;
+    hart->exitCode = 0;
+    hart->mem.halted = 0;
+    hart->mem.outOfMemory = 0;
+    hart->mem.fault = MEM_FAULT_NONE;
+    memorySetRam(&hart->mem, 0, 0); // The load sets the bounds
+    if (sim->config.devices) {
+        devicesReset(&sim->devices);
+    }
+}
+
+// With config.ramSize, limits memory to the RAM from base and puts the stack at its top
+static void boundRam(Sim *sim, uint32_t base) {
+    if (sim->config.ramSize) {
+        memorySetRam(&sim->hart.mem, base, sim->config.ramSize);
+        sim->hart.regs[SP] = base + sim->config.ramSize;
+    }
+}
+
+int sim_load_image(Sim *sim, const uint8_t *image, uint32_t size) {
+    if (size > UINT32_MAX - MEM_BASE) {
+        fprintf(stderr, "File too big\n");
+        return -1;
+    }
+    resetSim(sim);
+
+    if (sim->config.ramSize && size > sim->config.ramSize) {
+        fprintf(stderr, "The %u-byte image does not fit in %u bytes of RAM\n", size, sim->config.ramSize);
+        return -1;
+    }
+
+    if (memoryWrite(&sim->hart.mem, MEM_BASE, image, size) != 0) {
+        if (!sim->hart.mem.outOfMemory) {
+            fprintf(stderr, "The image overlaps a device\n");
+        }
+        resetSim(sim);
+        return -1;
+    }
+    sim->hart.endPC = MEM_BASE + size;
+    boundRam(sim, MEM_BASE);
+    return 0;
+}
+
+int sim_load_elf(Sim *sim, const char *path) {
+    resetSim(sim);
+
+    Hart *hart = &sim->hart;
+    if (loadElf(&hart->mem, path, &sim->elf, &sim->symbols) != 0 || hart->mem.outOfMemory) {
+        resetSim(sim);
+        return -1;
+    }
+    uint32_t ramBase = sim->elf.loadLo & ~PAGE_OFFSET_MASK;
+    if (sim->config.ramSize && (sim->elf.loadHi - 1) - ramBase >= sim->config.ramSize) {
+        fprintf(stderr, "%s: segments end beyond %u bytes of RAM from 0x%08X\n", path, sim->config.ramSize, ramBase);
+        resetSim(sim);
+        return -1;
+    }
+    hart->pc = sim->elf.entry;
+    hart->basePC = sim->elf.execLo;
+    hart->endPC = sim->elf.execHi;
+    sim->isElf = 1;
+    boundRam(sim, ramBase);
+    return 0;
+}
+
+int sim_load(Sim *sim, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Failed to open file");
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t magic[SNAPSHOT_MAGIC_LEN];
+    size_t magicLen = fread(magic, 1, sizeof(magic), file);
+    if (isElfImage(magic, (uint32_t)magicLen)) {
+        fclose(file);
+        return sim_load_elf(sim, path);
+    }
+    if (isSnapshotImage(magic, (uint32_t)magicLen)) {
+        fclose(file);
+        return sim_load_snapshot(sim, path);
+    }
+    fseek(file, 0, SEEK_SET);
+
+    if (fsize < 0 || (unsigned long)fsize > UINT32_MAX - MEM_BASE) {
+        fprintf(stderr, "File too big\n");
+        fclose(file);
+        return -1;
+    }
+
+    uint8_t *image = (uint8_t *)malloc(fsize ? (size_t)fsize : 1);
+    if (!image) {
+        fprintf(stderr, "Image buffer allocation failed\n");
+        fclose(file);
+        return -1;
+    }
+    size_t got = fread(image, 1, (size_t)fsize, file);
+    fclose(file);
+
+    int status = -1;
+    if (got != (size_t)fsize) {
+        fprintf(stderr, "Short read from %s\n", path);
+    } else {
+        status = sim_load_image(sim, image, (uint32_t)fsize);
+    }
+    free(image);
+    return status;
+}
+
+// The devices' registers belong to the snapshots too
+static Devices *attachedDevices(Sim *sim) {
+    return sim->config.devices ? &sim->devices : NULL;
+}
+
+int sim_snapshot(Sim *sim) {
+    if (!sim->snapshot) {
+        sim->snapshot = snapshotCreate();
+        if (!sim->snapshot) {
+            return -1;
+        }
+    }
+    snapshotTake(sim->snapshot, &sim->hart, attachedDevices(sim));
+    return 0;
+}
+
+int sim_restore(Sim *sim) {
+    if (!sim->snapshot) {
+        fprintf(stderr, "No snapshot to restore\n");
+        return -1;
+    }
+    consoleFlush(&sim->hart.console); // Output already produced stays
+    snapshotRestore(sim->snapshot, &sim->hart, attachedDevices(sim));
+    return sim->hart.mem.outOfMemory ? -1 : 0; // A page that could not come back
+}
+
+int sim_save_snapshot(Sim *sim, const char *path) {
+    return snapshotWrite(&sim->hart, attachedDevices(sim), path);
+}
+
+int sim_load_snapshot(Sim *sim, const char *path) {
+    resetSim(sim);
+    if (snapshotRead(&sim->hart, attachedDevices(sim), path) != 0 || sim->hart.mem.outOfMemory) {
+        resetSim(sim);
+        return -1;
+    }
+    sim->isSnapshot = 1;
+    return 0;
+}
+
+int sim_supply_input(Sim *sim, const uint8_t *data, uint32_t len) {
+    Hart *hart = &sim->hart;
+
+    if (hart->halt != HALT_MARKER) {
+        fprintf(stderr, "The guest is not waiting at the marker ECALL\n");
+        return -1;
+    }
+    if (len > hart->regs[A1]) {
+        len = hart->regs[A1];
+    }
+    if (memoryWrite(&hart->mem, hart->regs[A0], data, len) != 0) {
+        // A buffer outside RAM faults on the ECALL like a store there would
+        hart->halt = hart->mem.outOfMemory ? HALT_ERROR : HALT_FAULT;
+        return -1;
+    }
+    hart->regs[A0] = len;
+    if (sim->trace) {
+        traceSetLastA0(sim->trace, len);
+    }
+    hart->pc += 4; // ECALL has no compressed form
+    hart->halt = HALT_NONE;
+    return 0;
+}
+
+// Records why the hart stopped after an engine returned
+// Host memory running out is sticky and wins over whatever the guest did afterwards
+static halt_reason updateHalt(Hart *hart, int halted) {
+    if (hart->mem.outOfMemory && hart->halt == HALT_NONE) {
+        hart->halt = HALT_ERROR;
+    }
+    if (halted) {
+        if (hart->halt != HALT_NONE) {
+            return hart->halt; // Set by the op itself, the marker ECALL or an illegal one
+        }
+        if (hart->mem.fault != MEM_FAULT_NONE) {
+            hart->halt = HALT_FAULT;
+        } else {
+            hart->halt = hart->mem.halted ? HALT_DEVICE : HALT_ECALL;
+        }
+    } else if (hart->halt == HALT_NONE && !pcInRange(hart, hart->pc)) {
+        hart->halt = HALT_END;
+    }
+    return hart->halt;
+}
+
+// The analysis models drop what they cannot count without host memory, which ends the run
+// like guest memory that could not grow
+static int modelsOutOfMemory(const Sim *sim) {
+    return (sim->profile && sim->profile->outOfMemory) || (sim->cache && sim->cache->outOfMemory) ||
+           (sim->sweep && sim->sweep->outOfMemory) || (sim->branches && sim->branches->outOfMemory);
+}
+
+halt_reason sim_step(Sim *sim) {
+    Hart *hart = &sim->hart;
+
+    if (hart->halt != HALT_NONE || updateHalt(hart, 0) != HALT_NONE) {
+        return hart->halt;
+    }
+
+    fpuBegin();
+    const micro_op *op = predecodeFetch(&sim->predecode, &hart->mem, hart->pc);
+    int status = executeMicroOp(op, hart);
+    hart->retired++;
+    fpuCollect(hart);
+    consoleFlush(&hart->console);
+    return updateHalt(hart, status == 1);
+}
+
+halt_reason sim_run(Sim *sim, uint64_t maxInstrs) {
+    Hart *hart = &sim->hart;
+    uint64_t budget = maxInstrs ? maxInstrs : UINT64_MAX;
+
+    if (hart->halt != HALT_NONE || updateHalt(hart, 0) != HALT_NONE) {
+        return hart->halt;
+    }
+
+    // Profiling, tracing and the cache models swap the whole loop, so the engines themselves
+    // stay free of checks
+    // RV32F exception flags gather in the host FPU meanwhile, they reach fcsr at the end
+    engine_result res;
+    fpuBegin();
+    if (sim->trace) {
+        res = runTraced(hart, &sim->predecode, sim->trace, budget);
+    } else if (sim->profile) {
+        res = runProfiled(hart, &sim->predecode, sim->profile, budget);
+    } else if (sim->cache) {
+        res = runCached(hart, &sim->predecode, sim->cache, budget);
+    } else if (sim->sweep) {
+        res = runSweep(hart, &sim->predecode, sim->sweep, budget);
+    } else if (sim->pipeline && sim->pipelineOn) {
+        res = runPipelined(hart, &sim->predecode, sim->pipeline, budget);
+    } else if (sim->branches) {
+        res = runPredicted(hart, &sim->predecode, sim->branches, budget);
+    } else if (sim->config.coverage) {
+        res = runCovered(hart, &sim->predecode, &sim->coverage, budget);
+    } else {
+        res = runEngine(sim->config.engine, hart, &sim->predecode, &sim->blocks, budget);
+    }
+    fpuCollect(hart);
+    hart->retired += res.retired;
+    budget -= res.retired;
+    if (modelsOutOfMemory(sim) && hart->halt == HALT_NONE) {
+        hart->halt = HALT_ERROR;
+    }
+
+    // The block engine stops before a block that does not fit in the budget, finish it here
+    halt_reason reason = updateHalt(hart, res.halted);
+    while (reason == HALT_NONE && budget > 0) {
+        budget--;
+        reason = sim_step(sim);
+    }
+    consoleFlush(&hart->console); // The guest's output of the whole run in as few writes as possible
+    return reason;
+}
+
+int sim_write_profile(Sim *sim, const char *reportPath, const char *foldedPath) {
+    if (!sim->profile) {
+        fprintf(stderr, "Profiling is not enabled\n");
+        return -1;
+    }
+
+    FILE *report = fopen(reportPath, "w");
+    if (!report) {
+        perror(reportPath);
+        return -1;
+    }
+    profileWriteReport(sim->profile, &sim->predecode, &sim->hart, &sim->symbols, report);
+    fclose(report);
+
+    FILE *folded = fopen(foldedPath, "w");
+    if (!folded) {
+        perror(foldedPath);
+        return -1;
+    }
+    profileWriteFolded(sim->profile, &sim->symbols, folded);
+    fclose(folded);
+    return 0;
+}
+
+int sim_write_cache_report(Sim *sim, const char *path) {
+    if (!sim->cache) {
+        fprintf(stderr, "The cache model is not enabled\n");
+        return -1;
+    }
+
+    FILE *report = fopen(path, "w");
+    if (!report) {
+        perror(path);
+        return -1;
+    }
+    cacheWriteReport(sim->cache, &sim->predecode, &sim->hart, &sim->symbols, report);
+    fclose(report);
+    return 0;
+}
+
+void sim_set_pipeline(Sim *sim, int on) {
+    if (sim->pipeline && on && !sim->pipelineOn) {
+        pipelineRestart(sim->pipeline);
+    }
+    sim->pipelineOn = on;
+}
+
+int sim_write_pipeline_report(Sim *sim, const char *path) {
+    if (!sim->pipeline) {
+        fprintf(stderr, "The pipeline model is not enabled\n");
+        return -1;
+    }
+
+    FILE *report = fopen(path, "w");
+    if (!report) {
+        perror(path);
+        return -1;
+    }
+    pipelineWriteReport(sim->pipeline, report);
+    fclose(report);
+    return 0;
+}
+
+int sim_write_branch_report(Sim *sim, const char *path) {
+    if (!sim->branches) {
+        fprintf(stderr, "Branch prediction is not enabled\n");
+        return -1;
+    }
+
+    FILE *report = fopen(path, "w");
+    if (!report) {
+        perror(path);
+        return -1;
+    }
+    bpredWriteReport(sim->branches, &sim->symbols, report);
+    fclose(report);
+    return 0;
+}
+
+void sim_reset_coverage(Sim *sim) {
+    if (sim->config.coverage) {
+        coverageReset(&sim->coverage);
+    }
+}
+
+int sim_write_sweep_report(Sim *sim, const char *path) {
+    if (!sim->sweep) {
+        fprintf(stderr, "The cache sweep is not enabled\n");
+        return -1;
+    }
+
+    FILE *report = fopen(path, "w");
+    if (!report) {
+        perror(path);
+        return -1;
+    }
+    sweepWriteReport(sim->sweep, report);
+    fclose(report);
+    return 0;
+}
+
+void sim_print_stats(const Sim *sim, FILE *out) {
+    fprintf(out, "Guest memory: %u pages (%u KiB), %u file-mapped pages, %u predecoded pages\n",
+            sim->hart.mem.pages, sim->hart.mem.pages * (PAGE_SIZE / 1024), sim->hart.mem.mappedPages,
+            sim->predecode.pages);
+    if (sim->isElf) {
+        fprintf(out, "ELF: entry 0x%08X, %u bytes mapped, %u bytes copied, %u symbols\n", sim->elf.entry,
+                sim->elf.mappedBytes, sim->elf.copiedBytes, sim->symbols.count);
+    }
+    if (sim->useBlocks) {
+        printBlockStats(&sim->blocks, out);
+    }
+    if (sim->useJit) {
+        printJitStats(&sim->jit, out);
+    }
+}
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L // pread, fstat under -std=c99
+
+#include "../include/snapshot.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Saved in place of the contents of a page that did not exist at the snapshot
+static const uint8_t absentPage[1];
+
+Snapshot *snapshotCreate(void) {
+    Snapshot *snapshot = (Snapshot *)calloc(1, sizeof(Snapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Snapshot allocation failed\n");
+    }
+    return snapshot;
+}
+
+static void dropSaved(Snapshot *snapshot) {
+    for (uint32_t t = 0; t < PAGE_TABLE_ENTRIES; t++) {
+        if (!snapshot->saved[t]) {
+            continue;
+        }
+        for (uint32_t p = 0; p < PAGE_TABLE_ENTRIES; p++) {
+            if (snapshot->saved[t][p] != absentPage) {
+                free(snapshot->saved[t][p]);
+            }
+        }
+        free(snapshot->saved[t]);
+        snapshot->saved[t] = NULL;
+    }
+    snapshot->savedPages = 0;
+}
+
+static void clearDirty(Snapshot *snapshot) {
+    for (uint32_t i = 0; i < snapshot->dirtyCount; i++) {
+        uint32_t vpn = snapshot->dirtyList[i];
+        snapshot->dirty[vpn / 64] &= ~(1ull << (vpn % 64));
+    }
+    snapshot->dirtyCount = 0;
+}
+
+void snapshotFree(Snapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+    dropSaved(snapshot);
+    free(snapshot->dirtyList);
+    free(snapshot);
+}
+
+int snapshotTouch(Snapshot *snapshot, uint32_t vpn, const uint8_t *page) {
+    if (snapshot->dirty[vpn / 64] & (1ull << (vpn % 64))) {
+        return 0;
+    }
+
+    // Everything is allocated before the page counts as dirty, so a failure leaves no trace
+    if (snapshot->dirtyCount == snapshot->dirtyCapacity) {
+        uint32_t capacity = snapshot->dirtyCapacity ? snapshot->dirtyCapacity * 2 : 64;
+        uint32_t *grown = (uint32_t *)realloc(snapshot->dirtyList, capacity * sizeof(uint32_t));
+        if (!grown) {
+            return -1;
+        }
+        snapshot->dirtyList = grown;
+        snapshot->dirtyCapacity = capacity;
+    }
+    uint8_t ***table = &snapshot->saved[vpn >> (PAGE_TABLE_SHIFT - PAGE_SHIFT)];
+    if (!*table) {
+        *table = (uint8_t **)calloc(PAGE_TABLE_ENTRIES, sizeof(uint8_t *));
+        if (!*table) {
+            return -1;
+        }
+    }
+    uint8_t **saved = &(*table)[vpn & (PAGE_TABLE_ENTRIES - 1)];
+    if (!*saved) { // Else dirtied before an earlier restore, the copy is still the snapshot's
+        if (page) {
+            *saved = (uint8_t *)malloc(PAGE_SIZE);
+            if (!*saved) {
+                return -1;
+            }
+            memcpy(*saved, page, PAGE_SIZE);
+        } else {
+            *saved = (uint8_t *)absentPage;
+        }
+        snapshot->savedPages++;
+    }
+
+    snapshot->dirty[vpn / 64] |= 1ull << (vpn % 64);
+    snapshot->dirtyList[snapshot->dirtyCount++] = vpn;
+    return 0;
+}
+
+static void captureState(hart_state *state, const Hart *hart, const Devices *devices) {
+    memset(state, 0, sizeof(*state));
+    memcpy(state->regs, hart->regs, sizeof(state->regs));
+    memcpy(state->fregs, hart->fregs, sizeof(state->fregs));
+    state->pc = hart->pc;
+    state->fcsr = hart->fcsr;
+    state->basePC = hart->basePC;
+    state->endPC = hart->endPC;
+    state->retired = hart->retired;
+    state->halt = (uint32_t)hart->halt;
+    state->exitCode = hart->exitCode;
+    state->memHalted = (uint32_t)hart->mem.halted;
+    state->fault = (uint32_t)hart->mem.fault;
+    state->faultAddr = hart->mem.faultAddr;
+    state->ramBase = hart->mem.ramBase;
+    state->ramSize = hart->mem.ramSize;
+    if (devices) {
+        state->devices = 1;
+        state->mtime = devicesTime(devices);
+        state->mtimecmp = devices->mtimecmp;
+    }
+}
+
+static void applyState(const hart_state *state, Hart *hart, Devices *devices) {
+    memcpy(hart->regs, state->regs, sizeof(hart->regs));
+    memcpy(hart->fregs, state->fregs, sizeof(hart->fregs));
+    hart->pc = state->pc;
+    hart->fcsr = state->fcsr;
+    hart->basePC = state->basePC;
+    hart->endPC = state->endPC;
+    hart->retired = state->retired;
+    hart->halt = (halt_reason)state->halt;
+    hart->exitCode = state->exitCode;
+    hart->mem.halted = (int)state->memHalted;
+    hart->mem.fault = (mem_fault)state->fault;
+    hart->mem.faultAddr = state->faultAddr;
+    memorySetRam(&hart->mem, state->ramBase, state->ramSize);
+    if (devices && state->devices) {
+        devices->mtimecmp = state->mtimecmp;
+        devicesSetTime(devices, state->mtime);
+    }
+}
+
+void snapshotTake(Snapshot *snapshot, Hart *hart, Devices *devices) {
+    dropSaved(snapshot);
+    clearDirty(snapshot);
+    captureState(&snapshot->state, hart, devices);
+    hart->mem.snapshot = snapshot;
+    memoryFlushStores(&hart->mem); // Pages already writable must be seen again
+}
+
+void snapshotRestore(Snapshot *snapshot, Hart *hart, Devices *devices) {
+    for (uint32_t i = 0; i < snapshot->dirtyCount; i++) {
+        uint32_t vpn = snapshot->dirtyList[i];
+        const uint8_t *saved = snapshot->saved[vpn >> (PAGE_TABLE_SHIFT - PAGE_SHIFT)][vpn & (PAGE_TABLE_ENTRIES - 1)];
+        memoryRestorePage(&hart->mem, vpn, saved == absentPage ? NULL : saved);
+    }
+    clearDirty(snapshot);
+    applyState(&snapshot->state, hart, devices);
+}
+
+int isSnapshotImage(const uint8_t *data, uint32_t size) {
+    return size >= SNAPSHOT_MAGIC_LEN && memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) == 0;
+}
+
+static int isZeroPage(const uint8_t *page) {
+    for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+        if (page[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int snapshotWrite(Hart *hart, const Devices *devices, const char *path) {
+    Memory *mem = &hart->mem;
+    uint32_t *vpns = (uint32_t *)malloc(((size_t)mem->pages + mem->mappedPages + 1) * sizeof(uint32_t));
+    if (!vpns) {
+        fprintf(stderr, "Snapshot page list allocation failed\n");
+        return -1;
+    }
+
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+    header.headerSize = sizeof(header);
+    for (uint32_t vpn = 0; vpn < SNAPSHOT_VPNS; vpn++) {
+        if ((vpn & (PAGE_TABLE_ENTRIES - 1)) == 0 && !mem->tables[vpn >> (PAGE_TABLE_SHIFT - PAGE_SHIFT)]) {
+            vpn += PAGE_TABLE_ENTRIES - 1; // No table, no pages
+            continue;
+        }
+        const uint8_t *page = memoryPage(mem, vpn);
+        if (page && !isZeroPage(page)) {
+            vpns[header.pageCount++] = vpn;
+        }
+    }
+    uint32_t directory = (uint32_t)sizeof(header) + header.pageCount * (uint32_t)sizeof(uint32_t);
+    header.dataOffset = (directory + PAGE_OFFSET_MASK) & ~PAGE_OFFSET_MASK;
+    captureState(&header.state, hart, devices);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        free(vpns);
+        return -1;
+    }
+    static const uint8_t padding[PAGE_SIZE];
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(vpns, sizeof(uint32_t), header.pageCount, file) == header.pageCount &&
+             fwrite(padding, 1, header.dataOffset - directory, file) == header.dataOffset - directory;
+    for (uint32_t i = 0; ok && i < header.pageCount; i++) {
+        ok = fwrite(memoryPage(mem, vpns[i]), PAGE_SIZE, 1, file) == 1;
+    }
+    ok &= fclose(file) == 0;
+    free(vpns);
+
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Copies the pages in when they cannot be mapped
+static int readPages(Memory *mem, int fd, uint32_t offset, const uint32_t *vpns, uint32_t count) {
+    uint8_t page[PAGE_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        if (pread(fd, page, PAGE_SIZE, (off_t)offset + (off_t)i * PAGE_SIZE) != (ssize_t)PAGE_SIZE ||
+            memoryWrite(mem, vpns[i] << PAGE_SHIFT, page, PAGE_SIZE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int snapshotRead(Hart *hart, Devices *devices, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    snapshot_header header;
+    struct stat st;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        !isSnapshotImage((const uint8_t *)header.magic, SNAPSHOT_MAGIC_LEN) || header.headerSize != sizeof(header) ||
+        header.pageCount > SNAPSHOT_VPNS || (header.dataOffset & PAGE_OFFSET_MASK) ||
+        header.dataOffset < sizeof(header) + (uint64_t)header.pageCount * sizeof(uint32_t) || fstat(fd, &st) != 0 ||
+        (uint64_t)st.st_size < header.dataOffset + (uint64_t)header.pageCount * PAGE_SIZE) {
+        fprintf(stderr, "%s: not a snapshot of this build, or truncated\n", path);
+        close(fd);
+        return -1;
+    }
+
+    uint32_t *vpns = (uint32_t *)malloc(((size_t)header.pageCount + 1) * sizeof(uint32_t));
+    if (!vpns) {
+        fprintf(stderr, "Snapshot page list allocation failed\n");
+        close(fd);
+        return -1;
+    }
+    size_t directory = (size_t)header.pageCount * sizeof(uint32_t);
+    int ok = pread(fd, vpns, directory, sizeof(header)) == (ssize_t)directory;
+    for (uint32_t i = 0; ok && i < header.pageCount; i++) {
+        ok = vpns[i] < SNAPSHOT_VPNS && (i == 0 || vpns[i] > vpns[i - 1]) &&
+             memoryIsRam(&hart->mem, vpns[i] << PAGE_SHIFT, PAGE_SIZE); // Not a device's page
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: corrupt page list\n", path);
+    } else if (memoryMapPages(&hart->mem, fd, header.dataOffset, vpns, header.pageCount) != 0 &&
+               readPages(&hart->mem, fd, header.dataOffset, vpns, header.pageCount) != 0) {
+        fprintf(stderr, "%s: short read\n", path);
+        ok = 0;
+    }
+    free(vpns);
+    close(fd); // The mapping holds its own reference to the file
+    if (!ok) {
+        return -1;
+    }
+
+    applyState(&header.state, hart, devices);
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "../include/sweep.h"
+#include "../include/cache.h"
+#include "../include/execute.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY (1u << 16)
+
+static uint32_t log2u(uint32_t x) {
+    uint32_t n = 0;
+    while (x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+static size_t stackWords(uint32_t bits) {
+    return ((size_t)1 << bits) * SWEEP_MAX_WAYS;
+}
+
+int sweepInit(SweepModel *model, uint32_t lineSize) {
+    memset(model, 0, sizeof(*model));
+    if (lineSize < 4 || (lineSize & (lineSize - 1)) != 0) {
+        fprintf(stderr, "Cache sweep: the line size must be a power of two of at least 4, not %u\n", lineSize);
+        return -1;
+    }
+    model->lineSize = lineSize;
+    model->lineShift = log2u(lineSize);
+
+    int failed = 0;
+    for (uint32_t b = 0; b <= SWEEP_SET_BITS; b++) {
+        model->stacks[b] = (uint32_t *)malloc(stackWords(b) * sizeof(uint32_t));
+        failed |= !model->stacks[b];
+    }
+    model->capacity = INITIAL_CAPACITY;
+    model->slotMask = INITIAL_CAPACITY - 1;
+    model->slots = (sweep_slot *)malloc(INITIAL_CAPACITY * sizeof(sweep_slot));
+    model->tree = (uint32_t *)malloc((INITIAL_CAPACITY + 1) * sizeof(uint32_t));
+    model->timeLine = (uint32_t *)malloc((INITIAL_CAPACITY + 1) * sizeof(uint32_t));
+    if (failed || !model->slots || !model->tree || !model->timeLine) {
+        fprintf(stderr, "Cache sweep: stack allocation failed\n");
+        sweepFree(model);
+        return -1;
+    }
+    sweepReset(model);
+    return 0;
+}
+
+// Empties every stack and drops all counters, the tables keep their grown sizes
+void sweepReset(SweepModel *model) {
+    for (uint32_t b = 0; b <= SWEEP_SET_BITS; b++) {
+        memset(model->stacks[b], 0xFF, stackWords(b) * sizeof(uint32_t)); // CACHE_EMPTY
+    }
+    memset(model->hits, 0, sizeof(model->hits));
+    memset(model->slots, 0xFF, ((size_t)model->slotMask + 1) * sizeof(sweep_slot));
+    memset(model->tree, 0, ((size_t)model->capacity + 1) * sizeof(uint32_t));
+    memset(model->distances, 0, sizeof(model->distances));
+    model->lines = 0;
+    model->now = 1;
+    model->instructions = 0;
+    model->loads = 0;
+    model->stores = 0;
+    model->accesses = 0;
+    model->outOfMemory = 0;
+}
+
+void sweepFree(SweepModel *model) {
+    for (uint32_t b = 0; b <= SWEEP_SET_BITS; b++) {
+        free(model->stacks[b]);
+        model->stacks[b] = NULL;
+    }
+    free(model->slots);
+    free(model->tree);
+    free(model->timeLine);
+    model->slots = NULL;
+    model->tree = NULL;
+    model->timeLine = NULL;
+}
+
+static void outOfMemory(SweepModel *model) {
+    if (!model->outOfMemory) {
+        fprintf(stderr, "Out of host memory for the cache sweep\n");
+    }
+    model->outOfMemory = 1;
+}
+
+// Slot of line, or the free slot where it belongs
+static sweep_slot *findSlot(SweepModel *model, uint32_t line) {
+    uint32_t h = line * 0x9E3779B1u;
+    h ^= h >> 16;
+    for (uint32_t i = h & model->slotMask;; i = (i + 1) & model->slotMask) {
+        sweep_slot *slot = &model->slots[i];
+        if (slot->line == line || slot->line == CACHE_EMPTY) {
+            return slot;
+        }
+    }
+}
+
+// Doubles the hash table, keeping it at most half full
+static void growSlots(SweepModel *model) {
+    sweep_slot *old = model->slots;
+    uint32_t count = model->slotMask + 1;
+
+    sweep_slot *grown = (sweep_slot *)malloc((size_t)count * 2 * sizeof(sweep_slot));
+    if (!grown) {
+        outOfMemory(model);
+        return;
+    }
+    model->slots = grown;
+    memset(model->slots, 0xFF, (size_t)count * 2 * sizeof(sweep_slot));
+    model->slotMask = count * 2 - 1;
+    for (uint32_t i = 0; i < count; i++) {
+        if (old[i].line != CACHE_EMPTY) {
+            *findSlot(model, old[i].line) = old[i];
+        }
+    }
+    free(old);
+}
+
+static void treeAdd(SweepModel *model, uint32_t time, int32_t delta) {
+    for (; time <= model->capacity; time += time & (0u - time)) {
+        model->tree[time] += (uint32_t)delta;
+    }
+}
+
+// Times up to and including time that are still some line's last access
+static uint32_t treeCount(const SweepModel *model, uint32_t time) {
+    uint32_t count = 0;
+    for (; time; time &= time - 1) {
+        count += model->tree[time];
+    }
+    return count;
+}
+
+// Renumbers the live times 1 to lines in order when the tree runs out of times, growing it
+// when the lines fill more than half of it
+static void compact(SweepModel *model) {
+    uint32_t live = 0;
+    for (uint32_t t = 1; t < model->now; t++) {
+        sweep_slot *slot = findSlot(model, model->timeLine[t]);
+        if (slot->time == t) {
+            slot->time = ++live;
+            model->timeLine[live] = slot->line;
+        }
+    }
+
+    if (live * 2 > model->capacity) {
+        uint32_t capacity = model->capacity * 2;
+        uint32_t *tree = (uint32_t *)realloc(model->tree, ((size_t)capacity + 1) * sizeof(uint32_t));
+        if (tree) {
+            model->tree = tree;
+        }
+        uint32_t *timeLine = (uint32_t *)realloc(model->timeLine, ((size_t)capacity + 1) * sizeof(uint32_t));
+        if (timeLine) {
+            model->timeLine = timeLine;
+        }
+        if (!tree || !timeLine) {
+            outOfMemory(model);
+            return;
+        }
+        model->capacity = capacity;
+    }
+
+    // Ones at 1 to live, built bottom-up
+    memset(model->tree, 0, ((size_t)model->capacity + 1) * sizeof(uint32_t));
+    for (uint32_t t = 1; t <= model->capacity; t++) {
+        model->tree[t] += t <= live;
+        uint32_t parent = t + (t & (0u - t));
+        if (parent <= model->capacity) {
+            model->tree[parent] += model->tree[t];
+        }
+    }
+    model->now = live + 1;
+}
+
+// Distance in the fully associative stack: the lines used since line's last access
+static void fullyAssociative(SweepModel *model, uint32_t line) {
+    if (model->outOfMemory) {
+        return;
+    }
+    sweep_slot *slot = findSlot(model, line);
+
+    if (slot->line == line) {
+        uint32_t distance = model->lines - treeCount(model, slot->time);
+        model->distances[distance ? log2u(distance) + 1 : 0]++;
+        treeAdd(model, slot->time, -1);
+    } else {
+        slot->line = line;
+        model->lines++;
+    }
+    slot->time = 0; // Not live while compact renumbers the others
+
+    if (model->now > model->capacity) {
+        compact(model);
+        if (model->outOfMemory) {
+            return;
+        }
+    }
+    slot->time = model->now++;
+    model->timeLine[slot->time] = line;
+    treeAdd(model, slot->time, 1);
+
+    if (model->lines * 2 > model->slotMask) {
+        growSlots(model);
+    }
+}
+
+static void sweepLine(SweepModel *model, uint32_t line) {
+    model->accesses++;
+
+    for (uint32_t b = 0; b <= SWEEP_SET_BITS; b++) {
+        uint32_t *stack = model->stacks[b] + (size_t)(line & ((1u << b) - 1)) * SWEEP_MAX_WAYS;
+
+        // The most recent line of a set is also the most recent of every set it splits into,
+        // and with b = 0 of the whole fully associative stack
+        if (stack[0] == line) {
+            if (b == 0) {
+                model->distances[0]++;
+            }
+            for (; b <= SWEEP_SET_BITS; b++) {
+                model->hits[b][0]++;
+            }
+            break;
+        }
+        if (b == 0) {
+            fullyAssociative(model, line);
+        }
+
+        uint32_t depth = 1;
+        while (depth < SWEEP_MAX_WAYS && stack[depth] != line) {
+            depth++;
+        }
+        if (depth < SWEEP_MAX_WAYS) {
+            model->hits[b][depth]++;
+        } else {
+            depth = SWEEP_MAX_WAYS - 1; // Deeper than any way, the last line drops off
+        }
+        memmove(stack + 1, stack, depth * sizeof(uint32_t));
+        stack[0] = line;
+    }
+}
+
+engine_result runSweep(Hart *hart, PredecodeCache *cache, SweepModel *model, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    uint32_t *regs = hart->regs;
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, hart->pc);
+        uint32_t access = cacheDataAccess[op.op];
+        if (access) {
+            uint32_t addr = regs[op.rs1] + op.imm;
+            uint32_t size = access & ~CACHE_ACCESS_WRITE;
+            uint32_t first = addr >> model->lineShift;
+            uint32_t last = (addr + size - 1) >> model->lineShift;
+
+            if (access & CACHE_ACCESS_WRITE) {
+                model->stores++;
+            } else {
+                model->loads++;
+            }
+            sweepLine(model, first);
+            if (last != first && last > first) { // Straddles two lines, not wrapped around
+                sweepLine(model, last);
+            }
+        }
+
+        int status = executeMicroOp(&op, hart);
+        res.retired++;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+
+    model->instructions += res.retired;
+    return res;
+}
+
+void sweepWriteReport(const SweepModel *model, FILE *out) {
+    fprintf(out, "Cache sweep: %llu instructions, %llu loads, %llu stores, %u-byte lines\n",
+            (unsigned long long)model->instructions, (unsigned long long)model->loads,
+            (unsigned long long)model->stores, model->lineSize);
+    fprintf(out, "%llu line accesses, %u distinct lines (cold misses)\n\n", (unsigned long long)model->accesses,
+            model->lines);
+
+    fprintf(out, "Data miss rate, LRU with write-allocate\n%9s", "size");
+    for (uint32_t ways = 1; ways <= SWEEP_MAX_WAYS; ways *= 2) {
+        fprintf(out, " %5u-way", ways);
+    }
+    fprintf(out, " %9s\n", "full");
+
+    for (uint32_t size = SWEEP_MIN_SIZE; size <= SWEEP_MAX_SIZE; size *= 2) {
+        fprintf(out, "%9u", size);
+        for (uint32_t ways = 1; ways <= SWEEP_MAX_WAYS; ways *= 2) {
+            uint32_t sets = size / ways / model->lineSize;
+            if (sets == 0 || sets > (1u << SWEEP_SET_BITS)) {
+                fprintf(out, " %9s", "-");
+                continue;
+            }
+            const uint64_t *hits = model->hits[log2u(sets)];
+            uint64_t misses = model->accesses;
+            for (uint32_t d = 0; d < ways; d++) {
+                misses -= hits[d];
+            }
+            fprintf(out, " %8.2f%%", model->accesses ? 100.0 * (double)misses / (double)model->accesses : 0.0);
+        }
+
+        // A distance below the capacity in lines hits, the capacity is a power of two
+        uint32_t lines = size / model->lineSize;
+        if (lines == 0) {
+            fprintf(out, " %9s\n", "-");
+            continue;
+        }
+        uint64_t misses = model->accesses;
+        for (uint32_t b = 0; b <= log2u(lines); b++) {
+            misses -= model->distances[b];
+        }
+        fprintf(out, " %8.2f%%\n", model->accesses ? 100.0 * (double)misses / (double)model->accesses : 0.0);
+    }
+}
@@ -0,0 +1,73 @@
+#include "../include/engine.h"
+#include "../include/execute.h"
+
+#if defined(__GNUC__)
+
+// Threaded-code engine: every op_t has one final handler that does its own next-PC update
+// and then dispatches straight to the next handler through a computed goto, so each guest
+// instruction costs a single indirect branch (and each handler gets its own branch history)
+
+// v is evaluated even for x0, CSR accesses and FP compares and conversions have side effects
+#define RD(v)     do { uint32_t rdValue = (v); if (op->rd != ZERO) regs[op->rd] = rdValue; } while (0)
+#define RS1       regs[op->rs1]
+#define RS2       regs[op->rs2]
+#define IMM       op->imm
+#define LEN       op->len
+#define FRD(v)    (fregs[op->rd] = (v))
+#define FRS1      fregs[op->rs1]
+#define FRS2      fregs[op->rs2]
+#define FRS3      fregs[op->rs3]
+#define ZIMM      op->rs1
+#define DISPATCH() do {                             \
+        if (pc - basePC >= span || budget == 0)     \
+            goto out;                               \
+        op = predecodeFetch(cache, mem, pc);        \
+        budget--;                                   \
+        goto *handlers[op->op];                     \
+    } while (0)
+#define NEXT(npc) do { pc = (npc); DISPATCH(); } while (0)
+
+// Sequential PCs come from a branch on the length instead of adding it, so the next fetch
+// does not have to wait for op->len to load (the branch predicts well, code is mostly one size)
+#define NEXT_PC()        do { if (LEN == 2) NEXT(pc + 2); NEXT(pc + 4); } while (0)
+#define NEXT_SEQ()       NEXT_PC()
+#define NEXT_STORE()     NEXT_PC()
+#define NEXT_BRANCH(c)   do { if (c) NEXT(pc + IMM); NEXT_PC(); } while (0)
+#define NEXT_JUMP(t)     NEXT(t)
+#define NEXT_INDIRECT(t) NEXT(t)
+#define NEXT_ECALL()     NEXT_PC()
+#define STOP()           do { res.halted = 1; goto out; } while (0) // Budget already charged
+
+engine_result runThreaded(Hart *hart, PredecodeCache *cache, uint64_t budget) {
+    static void *const handlers[NUM_OPS] = {
+#include "optable.inc"
+    };
+
+    engine_result res = { 0, 0 };
+    const uint64_t initialBudget = budget;
+    uint32_t *const regs = hart->regs;
+    uint32_t *const fregs = hart->fregs;
+    Memory *const mem = &hart->mem;
+    const uint32_t basePC = hart->basePC;
+    const uint32_t span = hart->endPC - basePC;
+    uint32_t pc = hart->pc;
+    const micro_op *op;
+
+    DISPATCH();
+
+#include "ophandlers.inc"
+
+out:
+    hart->pc = pc;
+    res.retired = initialBudget - budget;
+    return res;
+}
+
+#else
+
+// Without labels-as-values fall back to the switch engine
+engine_result runThreaded(Hart *hart, PredecodeCache *cache, uint64_t budget) {
+    return runPredecoded(hart, cache, budget);
+}
+
+#endif
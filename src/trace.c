@@ -0,0 +1,368 @@
+#include "../include/trace.h"
+#include "../include/decode.h"
+#include "../include/execute.h"
+#include "../include/instruction.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Largest encoded record: flags, three 5-byte varints, the raw word and a store value
+#define TRACE_MAX_RECORD_BYTES (1 + 5 + 4 + 5 + 5 + 5)
+
+static void codecInit(trace_codec *codec) {
+    memset(codec, 0, sizeof(*codec));
+    for (uint32_t i = 0; i < TRACE_WORD_CACHE; i++) {
+        codec->cachePC[i] = UINT32_MAX; // Odd, so never a PC
+    }
+}
+
+static inline uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+// Word cache slot of pc, PCs that are only halfword aligned (RV32C) use the other half of
+// the cache so they do not evict their neighbours
+static inline uint32_t wordSlot(uint32_t pc) {
+    return ((pc >> 2) ^ ((pc & 2) ? TRACE_WORD_CACHE / 2 : 0)) & (TRACE_WORD_CACHE - 1);
+}
+
+// The 32-bit form of a recorded word, whose fields say what the instruction writes
+static inline uint32_t expandedWord(uint32_t word) {
+    return isCompressed(word) ? expandCompressed((uint16_t)word) : word;
+}
+
+// Instructions with an x register rd that they write. f registers are not traced, except
+// for the RV32F compares, conversions to integer and moves that write an x register
+static inline int writesRd(uint32_t word) {
+    switch (word & 0x7F) {
+        case LUI: case AUIPC: case JAL: case JALR: case NONIMM: case IMM: case LOAD:
+            break;
+        case SYSTEM: // CSR accesses
+            if (((word >> 12) & 0x7) == 0) {
+                return 0;
+            }
+            break;
+        case FARITH: // FEQ/FLT/FLE, FCVT.W[U].S, FMV.X.W and FCLASS
+            if ((word >> 25) != F7_1010000 && (word >> 25) != F7_1100000 && (word >> 25) != F7_1110000) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+    }
+    return ((word >> 7) & 0x1F) != 0;
+}
+
+uint32_t traceRd(uint32_t word) {
+    word = expandedWord(word);
+    return word == SYSTEM ? A0 : (word >> 7) & 0x1F;
+}
+
+static uint8_t *encodeRecord(trace_codec *codec, const trace_record *rec, uint8_t *p) {
+    uint8_t *flags = p++;
+    uint32_t length = instructionLength(rec->word);
+    uint32_t word = expandedWord(rec->word);
+    uint32_t opcode = word & 0x7F;
+    *flags = 0;
+
+    if (rec->pc != codec->nextPC) {
+        *flags |= TRACE_PC;
+        p = putVarint(p, zigzag(rec->pc - codec->nextPC));
+    }
+    codec->nextPC = rec->pc + length;
+
+    uint32_t slot = wordSlot(rec->pc);
+    if (codec->cachePC[slot] != rec->pc || codec->cacheWord[slot] != rec->word) {
+        *flags |= TRACE_WORD;
+        codec->cachePC[slot] = rec->pc;
+        codec->cacheWord[slot] = rec->word;
+        for (uint32_t i = 0; i < length; i++) {
+            *p++ = (uint8_t)(rec->word >> (8 * i));
+        }
+    }
+
+    // An ECALL (all fields zero) may return a value in a0, the marker ECALL does
+    if (writesRd(word) || (word == SYSTEM && rec->rdValue != codec->regs[A0])) {
+        uint32_t rd = traceRd(word);
+        *flags |= TRACE_RD;
+        p = putVarint(p, zigzag(rec->rdValue - codec->regs[rd]));
+        codec->regs[rd] = rec->rdValue;
+    }
+
+    if (opcode == LOAD || opcode == STORE || opcode == FLOAD || opcode == FSTORE) {
+        *flags |= TRACE_MEM;
+        p = putVarint(p, zigzag(rec->memAddr - codec->lastMem));
+        codec->lastMem = rec->memAddr;
+    }
+    if (opcode == STORE || opcode == FSTORE) {
+        uint32_t width = (word >> 12) & 0x7;
+        uint32_t value = width == 0 ? (rec->memValue & 0xFF) : width == 1 ? (rec->memValue & 0xFFFF) : rec->memValue;
+        *flags |= TRACE_STORE;
+        p = putVarint(p, value);
+    }
+    return p;
+}
+
+static void *writerThread(void *arg) {
+    TraceWriter *trace = (TraceWriter *)arg;
+
+    pthread_mutex_lock(&trace->lock);
+    for (;;) {
+        while (trace->pending < 0 && !trace->stop) {
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        }
+        if (trace->pending < 0) {
+            break;
+        }
+        const trace_record *chunk = trace->chunks[trace->pending];
+        uint32_t count = trace->pendingCount;
+        pthread_mutex_unlock(&trace->lock);
+
+        uint8_t *p = trace->encoded;
+        for (uint32_t i = 0; i < count; i++) {
+            p = encodeRecord(&trace->codec, &chunk[i], p);
+        }
+        size_t len = (size_t)(p - trace->encoded);
+        if (!trace->error && fwrite(trace->encoded, 1, len, trace->file) != len) {
+            trace->error = 1;
+        }
+        trace->records += count;
+        trace->bytes += len;
+
+        pthread_mutex_lock(&trace->lock);
+        trace->pending = -1;
+        pthread_cond_broadcast(&trace->cond);
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+
+TraceWriter *traceOpen(const char *path) {
+    TraceWriter *trace = (TraceWriter *)calloc(1, sizeof(TraceWriter));
+    if (!trace) {
+        fprintf(stderr, "Trace writer allocation failed\n");
+        return NULL;
+    }
+
+    trace->chunks[0] = (trace_record *)malloc(TRACE_CHUNK_RECORDS * sizeof(trace_record));
+    trace->chunks[1] = (trace_record *)malloc(TRACE_CHUNK_RECORDS * sizeof(trace_record));
+    trace->encoded = (uint8_t *)malloc(TRACE_CHUNK_RECORDS * TRACE_MAX_RECORD_BYTES);
+    if (!trace->chunks[0] || !trace->chunks[1] || !trace->encoded) {
+        fprintf(stderr, "Trace buffer allocation failed\n");
+        goto fail;
+    }
+
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        perror(path);
+        goto fail;
+    }
+    if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, trace->file) != TRACE_MAGIC_LEN) {
+        perror(path);
+        fclose(trace->file);
+        goto fail;
+    }
+
+    codecInit(&trace->codec);
+    trace->pending = -1;
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    if (pthread_create(&trace->thread, NULL, writerThread, trace) != 0) {
+        fprintf(stderr, "Failed to start the trace writer thread\n");
+        pthread_mutex_destroy(&trace->lock);
+        pthread_cond_destroy(&trace->cond);
+        fclose(trace->file);
+        goto fail;
+    }
+    return trace;
+
+fail:
+    free(trace->chunks[0]);
+    free(trace->chunks[1]);
+    free(trace->encoded);
+    free(trace);
+    return NULL;
+}
+
+// Hands the filled chunk to the writer thread and continues in the other one
+void traceSwap(TraceWriter *trace) {
+    pthread_mutex_lock(&trace->lock);
+    while (trace->pending >= 0) {
+        pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    trace->pending = trace->active;
+    trace->pendingCount = trace->fill;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+
+    trace->active ^= 1;
+    trace->fill = 0;
+}
+
+int traceClose(TraceWriter *trace) {
+    if (!trace) {
+        return 0;
+    }
+    if (trace->fill > 0) {
+        traceSwap(trace);
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    trace->stop = 1;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+
+    int error = trace->error;
+    if (fclose(trace->file) != 0) {
+        error = 1;
+    }
+    if (error) {
+        fprintf(stderr, "Writing the trace failed, it is incomplete\n");
+    }
+
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->cond);
+    free(trace->chunks[0]);
+    free(trace->chunks[1]);
+    free(trace->encoded);
+    free(trace);
+    return error ? -1 : 0;
+}
+
+engine_result runTraced(Hart *hart, PredecodeCache *cache, TraceWriter *trace, uint64_t budget) {
+    engine_result res = { 0, 0 };
+    uint32_t *regs = hart->regs;
+
+    while (pcInRange(hart, hart->pc) && res.retired < budget) {
+        // Copied, as a store may overwrite its own cached op
+        micro_op op = *predecodeFetch(cache, &hart->mem, hart->pc);
+        trace_record *rec = traceNext(trace);
+        rec->pc = hart->pc;
+        rec->word = fetchInstruction(&hart->mem, hart->pc);
+        rec->memAddr = regs[op.rs1] + op.imm;
+        rec->memValue = op.op == OP_FSW ? hart->fregs[op.rs2] : regs[op.rs2];
+
+        int status = executeMicroOp(&op, hart);
+        rec->rdValue = regs[op.op == OP_ECALL ? A0 : op.rd];
+        res.retired++;
+
+        if (status == 1) {
+            res.halted = 1;
+            break;
+        }
+    }
+    return res;
+}
+
+int traceReaderOpen(TraceReader *reader, const char *path) {
+    char magic[TRACE_MAGIC_LEN];
+
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        perror(path);
+        return -1;
+    }
+    if (fread(magic, 1, TRACE_MAGIC_LEN, reader->file) != TRACE_MAGIC_LEN ||
+        memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    codecInit(&reader->codec);
+    return 0;
+}
+
+static int getVarint(FILE *file, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = getc(file);
+        if (c == EOF) {
+            return -1;
+        }
+        result |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int traceRead(TraceReader *reader, trace_record *rec) {
+    trace_codec *codec = &reader->codec;
+    uint32_t value;
+    int flags = getc(reader->file);
+
+    if (flags == EOF) {
+        return 0;
+    }
+    memset(rec, 0, sizeof(*rec));
+    rec->flags = (uint8_t)flags;
+
+    rec->pc = codec->nextPC;
+    if (flags & TRACE_PC) {
+        if (getVarint(reader->file, &value) != 0) {
+            return -1;
+        }
+        rec->pc += unzigzag(value);
+    }
+
+    uint32_t slot = wordSlot(rec->pc);
+    if (flags & TRACE_WORD) {
+        uint8_t bytes[4] = { 0, 0, 0, 0 };
+        // The low half tells whether the other two bytes belong to this instruction
+        if (fread(bytes, 1, 2, reader->file) != 2 ||
+            (!isCompressed(bytes[0]) && fread(bytes + 2, 1, 2, reader->file) != 2)) {
+            return -1;
+        }
+        codec->cachePC[slot] = rec->pc;
+        codec->cacheWord[slot] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    } else if (codec->cachePC[slot] != rec->pc) {
+        return -1;
+    }
+    rec->word = codec->cacheWord[slot];
+    codec->nextPC = rec->pc + instructionLength(rec->word);
+
+    if (flags & TRACE_RD) {
+        uint32_t rd = traceRd(rec->word);
+        if (getVarint(reader->file, &value) != 0) {
+            return -1;
+        }
+        codec->regs[rd] += unzigzag(value);
+        rec->rdValue = codec->regs[rd];
+    }
+    if (flags & TRACE_MEM) {
+        if (getVarint(reader->file, &value) != 0) {
+            return -1;
+        }
+        codec->lastMem += unzigzag(value);
+        rec->memAddr = codec->lastMem;
+    }
+    if (flags & TRACE_STORE) {
+        if (getVarint(reader->file, &rec->memValue) != 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+void traceReaderClose(TraceReader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
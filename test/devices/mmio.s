@@ -0,0 +1,45 @@
+# Memory-mapped devices (run with --devices): prints through the UART, uses the CLINT
+# registers, then stops on a test finisher store in the middle of straight-line code
+    li s0, 0x10000000       # UART
+    la s3, message
+print:
+    lbu t0, 0(s3)
+    beqz t0, printed
+wait:
+    lbu t1, 5(s0)           # LSR, 0x20 = transmitter holding register empty
+    andi t1, t1, 0x20
+    beqz t1, wait
+    sb t0, 0(s0)
+    addi s3, s3, 1
+    j print
+printed:
+    lbu a1, 5(s0)           # 0x60
+
+    li s1, 0x02004000       # CLINT mtimecmp
+    li t2, 0x12345678
+    sw t2, 0(s1)
+    sw zero, 4(s1)
+    lw a2, 0(s1)            # 0x12345678
+    lhu a3, 2(s1)           # 0x1234
+    sb zero, 1(s1)
+    lw a5, 0(s1)            # 0x12340078
+
+    li s2, 0x0200BFF8       # CLINT mtime, never goes backwards
+    lw t5, 0(s2)
+    lw t6, 0(s2)
+    sltu a4, t6, t5
+    xori a4, a4, 1          # 1
+    li t5, 0
+    li t6, 0
+
+    li s4, 0x00100000       # Test finisher
+    li t0, 0x5555
+    li a0, 42
+    sw t0, 0(s4)            # Halts here, with a0 = 42
+    li a0, 99
+    li a6, 7
+    li a7, 10
+    ecall
+
+message:
+    .asciz "mmio ok\n"
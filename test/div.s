@@ -0,0 +1,30 @@
+# RV32M division: signed truncation toward zero, unsigned, division by zero, the
+# INT32_MIN / -1 overflow, and a digit-sum loop over divu/remu
+    li t0, -20
+    li t1, 3
+    div a0, t0, t1          # a0 = -6
+    rem a1, t0, t1          # a1 = -2, takes the dividend's sign
+    divu a2, t0, t1         # a2 = 0x5555554E
+    remu a3, t0, t1         # a3 = 2
+    div a4, t0, zero        # a4 = -1
+    divu a5, t0, zero       # a5 = 0xFFFFFFFF
+    rem a6, t0, zero        # a6 = -20, the dividend
+    remu s2, t0, zero       # s2 = 0xFFFFFFEC, the dividend
+    li t2, 0x80000000
+    li t3, -1
+    div s3, t2, t3          # s3 = 0x80000000, overflow
+    rem s4, t2, t3          # s4 = 0
+    li t4, 7
+    li t5, -2
+    div s5, t4, t5          # s5 = -3
+    rem s6, t4, t5          # s6 = 1
+    li t6, 987654321
+    li s8, 10
+    li s7, 0
+digits:
+    remu s9, t6, s8
+    add s7, s7, s9
+    divu t6, t6, s8
+    bnez t6, digits         # s7 = 45
+    li a7, 10
+    ecall
@@ -0,0 +1,22 @@
+# ELF loading (test/elfload.elf holds this as .text at 0x10000): the entry point is _start,
+# past helper. .data at 0x20000 is file-mapped for its first page and copied for its tail,
+# its BSS hides bytes the file has behind the segment, and .rodata at 0x30010 has a file
+# offset that cannot be mapped (0x3020), so it is copied
+helper:
+    add a0, a0, a0
+    ret
+_start:
+    li s0, 0x20000
+    lw a0, 0(s0)            # a0 = 0x11111111
+    call helper             # a0 = 0x22222222
+    li t0, 0x20FFC
+    lw a1, 0(t0)            # a1 = 0x33333333, last word of the mapped page
+    lw a2, 4(t0)            # a2 = 0x44444444, copied tail
+    li t1, 0x21008          # End of the file part of .data
+    lw a3, 0(t1)            # a3 = 0, BSS although the file holds 0xDEADBEEF here
+    sw a0, 0x100(t1)
+    lw a4, 0x100(t1)        # a4 = 0x22222222
+    li t2, 0x30010
+    lw a5, 0(t2)            # a5 = 0x66666666
+    li a7, 10
+    ecall
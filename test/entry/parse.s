@@ -0,0 +1,31 @@
+# Entry-PC fork server guest (make test-entry, --fork-server=0x100 --input-addr=0x2000
+# --input-size=16): startup work the server runs once, then parse(buf, len) at 0x100, where
+# the input takes the place of the empty buffer passed here. It sums the bytes (a2) and
+# counts the newlines (a3)
+    li s0, 0
+    li t0, 1000
+init:
+    add s0, s0, t0
+    addi t0, t0, -1
+    bnez t0, init           # s0 = 500500
+    li a0, 0x2000
+    li a1, 0
+    call parse
+    li a7, 10
+    ecall
+
+    .org 0x100
+# parse(a0 = buffer, a1 = length)
+parse:
+    li a2, 0
+    li a3, 0
+    add t2, a0, a1
+1:  beq a0, t2, 2f
+    lbu t3, 0(a0)
+    add a2, a2, t3
+    addi t4, t3, -10
+    seqz t4, t4
+    add a3, a3, t4
+    addi a0, a0, 1
+    j 1b
+2:  ret
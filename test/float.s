@@ -0,0 +1,73 @@
+# RV32F arithmetic: every rounding mode, fused multiply-adds, the exception flags (read and
+# cleared after each group), infinities, the canonical NaN, overflow and a subnormal result,
+# a ties-away tie, min/max with NaNs and signed zeros, compares and FCLASS
+    li t0, 0x3FC00000
+    fmv.w.x f1, t0          # f1 = 1.5
+    li t0, 0x40200000
+    fmv.w.x f2, t0          # f2 = 2.5
+    li t0, 0x3DCCCCCD
+    fmv.w.x f3, t0          # f3 = 0.1
+    li t0, 0xC0490FDB
+    fmv.w.x f4, t0          # f4 = -pi
+    fadd.s f5, f1, f2       # f5 = 4.0, exact
+    frflags a0              # a0 = 0
+    fdiv.s f6, f1, f3       # f6 = 0x41700000, 15.0
+    fdiv.s f7, f1, f3, rup  # f7 = 0x41700000
+    fdiv.s f8, f1, f3, rdn  # f8 = 0x416FFFFF
+    fmul.s f9, f3, f4, rtz  # f9 = 0xBEA0D97C
+    fsub.s f10, f3, f2, rmm # f10 = 0xC019999A
+    fsqrt.s f11, f2         # f11 = 0x3FCA62C2
+    fmadd.s f12, f3, f4, f1, rne  # f12 = 0x3F97C9A1
+    fnmsub.s f13, f3, f4, f1, rmm # f13 = 0x3FE8365F
+    fmsub.s f14, f3, f4, f1, rdn  # f14 = 0xBFE83660
+    fnmadd.s f15, f3, f4, f1, rup # f15 = 0xBF97C9A0
+    fsflags a1, zero        # a1 = 0x01 (NX), flags cleared
+    fdiv.s f16, f1, f0      # f16 = +inf
+    fsflags a2, zero        # a2 = 0x08 (DZ)
+    fdiv.s f17, f0, f0      # f17 = 0x7FC00000, the canonical NaN
+    fsflags a3, zero        # a3 = 0x10 (NV)
+    li t0, 0x7F7FFFFF
+    fmv.w.x f18, t0         # f18 = largest finite
+    fadd.s f19, f18, f18    # f19 = +inf
+    fmul.s f20, f18, f1, rtz # f20 = 0x7F7FFFFF
+    fsflags a4, zero        # a4 = 0x05 (OF, NX)
+    li t0, 0x00800000
+    fmv.w.x f21, t0
+    fmul.s f21, f21, f3     # f21 = 0x000CCCCD, subnormal
+    fsflags a5, zero        # a5 = 0x03 (UF, NX)
+    li t0, 0x3F800000
+    fmv.w.x f22, t0         # f22 = 1.0
+    li t0, 0x33800000
+    fmv.w.x f23, t0         # f23 = 2^-24, half an ulp of 1.0
+    fadd.s f24, f22, f23, rmm # f24 = 0x3F800001, tie away from zero
+    fadd.s f25, f22, f23    # f25 = 0x3F800000, tie to even
+    li t0, 0x7F800001
+    fmv.w.x f26, t0         # f26 = a signaling NaN
+    fmin.s f27, f17, f1     # f27 = 1.5, a quiet NaN loses
+    fmax.s f28, f26, f17    # f28 = 0x7FC00000
+    fsflags a6, zero        # a6 = 0x11 (NV for the signaling NaN, NX from the ties)
+    fneg.s f29, f0          # f29 = -0
+    fmin.s f30, f0, f29     # f30 = 0x80000000
+    fmax.s f31, f29, f0     # f31 = 0
+    feq.s s1, f17, f17      # s1 = 0
+    frflags s2              # s2 = 0, FEQ is quiet
+    flt.s s3, f17, f1       # s3 = 0
+    fle.s s4, f1, f2        # s4 = 1
+    fsflags s5, zero        # s5 = 0x10, FLT is not quiet
+    fclass.s s6, f29        # s6 = 0x008, -0
+    fclass.s s7, f26        # s7 = 0x100, signaling NaN
+    fclass.s s8, f21        # s8 = 0x020, positive subnormal
+    fclass.s s9, f4         # s9 = 0x002, negative normal
+    fclass.s s10, f16       # s10 = 0x080, +inf
+    fclass.s s11, f17       # s11 = 0x200, quiet NaN
+    feq.s t1, f26, f1       # t1 = 0
+    frflags t2              # t2 = 0x10, FEQ signals on a signaling NaN
+    fmadd.s f2, f16, f0, f17 # f2 = 0x7FC00000, inf * 0 is invalid with a NaN addend too
+    fsflags t3, zero        # t3 = 0x10
+    fmv.x.w t4, f10         # t4 = 0xC019999A
+    fsgnjx.s f1, f4, f4     # f1 = 0x40490FDB, |f4|
+    fsrmi t5, 3             # t5 = 0, frm = RUP
+    fadd.s f5, f5, f3       # f5 = 0x40833334, rounded up through frm
+    csrr t6, fcsr           # t6 = 0x61
+    li a7, 10
+    ecall
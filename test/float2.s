@@ -0,0 +1,69 @@
+# RV32F conversions in every rounding mode, the six CSR instruction forms on fflags, frm and
+# fcsr, rounding through frm, sign injection on NaNs and the FP loads/stores (compressed too)
+    lui sp, 8
+    addi s0, sp, 16
+    li t0, 16777217         # 2^24 + 1, a tie between two singles
+    fcvt.s.w f1, t0         # f1 = 0x4B800000, ties to even
+    fcvt.s.w f2, t0, rup    # f2 = 0x4B800001
+    fcvt.s.w f3, t0, rmm    # f3 = 0x4B800001, ties away
+    fcvt.s.w f4, t0, rdn    # f4 = 0x4B800000
+    neg t1, t0
+    fcvt.s.w f5, t1, rmm    # f5 = 0xCB800001
+    fcvt.s.w f6, t1, rtz    # f6 = 0xCB800000
+    li t2, -1
+    fcvt.s.wu f7, t2        # f7 = 0x4F800000, 2^32
+    fcvt.s.wu f8, t2, rtz   # f8 = 0x4F7FFFFF
+    fcvt.s.w f9, t2         # f9 = 0xBF800000, -1.0
+    csrrci a0, fflags, 1    # a0 = 0x01, NX cleared
+    li t3, 0x85
+    csrrw a1, fcsr, t3      # a1 = 0, frm = RMM, flags = OF, NX
+    fcvt.s.w f10, t0        # f10 = 0x4B800001, rounded through frm
+    csrrs a2, frm, zero     # a2 = 4
+    csrrsi a3, fflags, 0x10 # a3 = 0x05
+    li t4, 0x14
+    csrrc a4, fcsr, t4      # a4 = 0x95, fcsr = 0x81
+    csrrwi a5, frm, 2       # a5 = 4, frm = RDN
+    fcvt.s.w f11, t1        # f11 = 0xCB800001, rounded down through frm
+    csrrs a6, fcsr, zero    # a6 = 0x41
+    li s1, 77
+    csrrs s1, 0x800, zero   # s1 = 0, an unknown CSR reads as zero
+    li t0, 0xC0200000
+    fmv.w.x f12, t0         # f12 = -2.5
+    fcvt.w.s s2, f12        # s2 = -3, rounded down through frm
+    fcvt.w.s s3, f12, rmm   # s3 = -3
+    fcvt.w.s s4, f12, rne   # s4 = -2
+    fcvt.w.s s5, f12, rup   # s5 = -2
+    fcvt.w.s s6, f12, rtz   # s6 = -2
+    csrrw zero, fflags, zero
+    li t0, 0x4F000000
+    fmv.w.x f13, t0         # f13 = 2^31
+    fcvt.w.s s7, f13, rtz   # s7 = 0x7FFFFFFF, saturated
+    fcvt.wu.s s8, f13, rtz  # s8 = 0x80000000
+    fsflags s9, zero        # s9 = 0x10 (NV)
+    li t0, 0xCF000000
+    fmv.w.x f14, t0         # f14 = -2^31
+    fcvt.w.s s10, f14, rtz  # s10 = 0x80000000, exact
+    li t0, 0xBF000000
+    fmv.w.x f15, t0         # f15 = -0.5
+    fcvt.wu.s s11, f15, rup # s11 = 0, rounds to -0 which is in range
+    fsflags t1, zero        # t1 = 0x01 (NX only)
+    fcvt.wu.s t2, f9, rtz   # t2 = 0, -1 is out of range
+    frflags t3              # t3 = 0x10
+    li t0, 0x7F800001
+    fmv.w.x f16, t0         # f16 = a signaling NaN
+    fsgnjn.s f17, f16, f0   # f17 = 0xFF800001, sign injection keeps the payload
+    fsgnj.s f18, f1, f12    # f18 = 0xCB800000
+    fsgnjx.s f19, f12, f12  # f19 = 0x40200000
+    fsw f12, 0(s0)          # c.fsw
+    lw t4, 0(s0)            # t4 = 0xC0200000
+    flw f20, 0(s0)          # f20 = 0xC0200000
+    fsw f13, 8(sp)          # c.fswsp
+    flw f21, 8(sp)          # c.flwsp, f21 = 0x4F000000
+    flw f8, 8(sp)           # c.flwsp, f8 = 0x4F000000
+    flw f15, 0(s0)          # c.flw, f15 = 0xC0200000
+    sw t2, 12(sp)
+    flw f22, 12(sp)         # f22 = 0
+    fmv.x.w t5, f5          # t5 = 0xCB800001
+    csrr t6, fcsr           # t6 = 0x50
+    li a7, 10
+    ecall
@@ -0,0 +1,28 @@
+# Fork server guest (make test-fork): startup work the server runs once, then the marker
+# ECALL hands over the input, whose bytes are summed (a2) and newlines counted (a3)
+    li s0, 0
+    li t0, 1000
+init:
+    add s0, s0, t0
+    addi t0, t0, -1
+    bnez t0, init           # s0 = 500500
+    li a0, 0x2000           # Input buffer
+    li a1, 16               # of 16 bytes, longer inputs are cut
+    li a7, 0x100            # ECALL_MARKER
+    ecall                   # a0 = input length, 0 outside the fork server
+    li a2, 0
+    li a3, 0
+    li t1, 0x2000
+    add t2, t1, a0
+sum:
+    beq t1, t2, done
+    lbu t3, 0(t1)
+    add a2, a2, t3
+    addi t4, t3, -10
+    seqz t4, t4
+    add a3, a3, t4
+    addi t1, t1, 1
+    j sum
+done:
+    li a7, 10
+    ecall
@@ -0,0 +1,34 @@
+# Fuzzing target (make test-fuzz, run with --ram=64K): each byte of the "FUZ!" prefix is a
+# branch for the fuzzer to get past, behind it a store outside RAM faults, or with '?' next
+# an illegal instruction runs. Both are crashes
+    li a0, 0x2000           # Input buffer
+    li a1, 64
+    li a7, 0x100            # ECALL_MARKER
+    ecall                   # a0 = input length
+    li t0, 0x2000
+    li t1, 4
+    blt a0, t1, reject      # Too short
+    lbu t2, 0(t0)
+    li t3, 'F'
+    bne t2, t3, reject
+    lbu t2, 1(t0)
+    li t3, 'U'
+    bne t2, t3, reject
+    lbu t2, 2(t0)
+    li t3, 'Z'
+    bne t2, t3, reject
+    lbu t2, 3(t0)
+    li t3, '!'
+    bne t2, t3, reject
+    li a2, 1                # Past the magic
+    lbu t2, 4(t0)
+    li t3, '?'
+    beq t2, t3, illegal
+    li t4, 0x40000000
+    sw a2, 0(t4)            # Faults
+    j reject
+illegal:
+    .word 0xFFFFFFFF
+reject:
+    li a7, 10
+    ecall
@@ -0,0 +1,16 @@
+# One function called from two sites in turn: the return stack predicts every return, a BTB
+# without it (btb:512:0) remembers the other caller and misses them all
+    .text
+_start:
+    li t2, 1000
+loop:
+    call leaf
+    call leaf
+    addi t2, t2, -1
+    bnez t2, loop
+    li a7, 10
+    ecall
+
+leaf:
+    addi a0, a0, 1
+    ret
@@ -0,0 +1,14 @@
+# A branch taken three iterations in four: gshare and TAGE learn the period from the global
+# history, the bimodal counters stay taken and miss every fourth time
+    .text
+_start:
+    li t0, 0
+    li t2, 4000
+loop:
+    andi t1, t0, 3
+    bnez t1, 1f
+    addi a0, a0, 1
+1:  addi t0, t0, 1
+    blt t0, t2, loop
+    li a7, 10
+    ecall
@@ -0,0 +1,24 @@
+# Line-strided loads over 16K twice, which stays in the 32K L1 after the first pass, then over
+# 64K twice, which overflows it and only hits the first 16K once. Each load feeds the next add
+# (a load-use stall)
+    .text
+_start:
+    li s0, 0x10000
+    li a1, 0x4000
+    call walk
+    call walk
+    li a1, 0x10000
+    call walk
+    call walk
+    li a7, 10
+    ecall
+
+# walk(a1 bytes): sums one word per 64-byte line from s0
+walk:
+    mv t0, s0
+    add t1, s0, a1
+1:  lw t2, 0(t0)
+    add a0, a0, t2
+    addi t0, t0, 64
+    bltu t0, t1, 1b
+    ret
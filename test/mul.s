@@ -0,0 +1,27 @@
+# RV32M multiplication: low word, the three high-word signednesses and their corner
+# operands, a write to x0, and a 10! loop
+    li t0, -7
+    li t1, 3
+    mul a0, t0, t1          # a0 = -21
+    li t2, 0x80000000
+    mul a1, t2, t2          # a1 = 0, low word of 2^62
+    mulh a2, t2, t2         # a2 = 0x40000000
+    li t3, -1
+    mulh a3, t3, t3         # a3 = 0, (-1) * (-1) = 1
+    mulhu a4, t3, t3        # a4 = 0xFFFFFFFE
+    mulhsu a5, t3, t3       # a5 = 0xFFFFFFFF, -1 * 0xFFFFFFFF
+    mulhsu a6, t2, t3       # a6 = 0x80000000
+    li t4, 0x12345678
+    li t5, 0x9ABCDEF0
+    mulh s2, t4, t5         # s2 = 0xF8CC93D6
+    mulhu s3, t4, t5        # s3 = 0x0B00EA4E
+    mulhsu s4, t5, t4       # s4 = 0xF8CC93D6
+    mul x0, t0, t1          # x0 stays 0
+    li s5, 1
+    li s6, 10
+fact:
+    mul s5, s5, s6
+    addi s6, s6, -1
+    bnez s6, fact           # s5 = 10! = 0x00375F00
+    li a7, 10
+    ecall
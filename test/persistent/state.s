@@ -0,0 +1,37 @@
+# Persistent fork server guest (make test-persistent, run with --devices): every input runs
+# from one restored snapshot of the marker ECALL, so each run must find the state there again.
+# A run reads, then overwrites with its first input byte, a page that did not exist at the
+# snapshot (a2), the CLINT's mtimecmp (a3) and the immediate of an instruction (a5 is its
+# word before the patch). The instruction runs before the patch (a6, the original returned
+# even when the last run left it patched) and after it (a4)
+    .option norvc
+    li t0, 0x02004000       # mtimecmp
+    li t1, 7
+    sw t1, 0(t0)
+    sw zero, 4(t0)
+    li a0, 0x2000           # Input buffer, on a page that does not exist yet either
+    li a1, 16
+    li a7, 0x100            # ECALL_MARKER
+    ecall                   # a0 = input length
+    li t0, 0x2000
+    lbu s1, 0(t0)           # 0 for an empty input
+    li t0, 0x80000
+    lw a2, 0(t0)            # 0 every run
+    sw s1, 0(t0)
+    li t0, 0x02004000
+    lw a3, 0(t0)            # 7 every run
+    sw s1, 0(t0)
+    jal ra, patch
+    mv a6, a4               # 0 every run
+    la t0, patch
+    lw a5, 0(t0)            # addi a4, zero, 0 every run
+    slli t1, s1, 20
+    or t1, t1, a5
+    sw t1, 0(t0)            # addi a4, zero, s1
+    jal ra, patch
+    li a7, 10
+    ecall
+
+patch:
+    addi a4, zero, 0
+    ret
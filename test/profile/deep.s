@@ -0,0 +1,42 @@
+# Deep self recursion and mutual recursion, the profile folds both into one context per function
+    .text
+_start:
+    li sp, 0x100000
+    li a0, 20000
+    call down
+    li a0, 9
+    call ping
+    li a7, 10
+    ecall
+
+# down(n): recurses n times
+down:
+    beqz a0, 1f
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    addi a0, a0, -1
+    call down
+    lw ra, 12(sp)
+    addi sp, sp, 16
+1:  ret
+
+# ping(n) calls pong(n - 1), which calls ping(n - 2) and so on down to 0
+ping:
+    beqz a0, 1f
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    addi a0, a0, -1
+    call pong
+    lw ra, 12(sp)
+    addi sp, sp, 16
+1:  ret
+
+pong:
+    beqz a0, 1f
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    addi a0, a0, -1
+    call ping
+    lw ra, 12(sp)
+    addi sp, sp, 16
+1:  ret
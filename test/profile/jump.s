@@ -0,0 +1,20 @@
+# A jump through ra with an offset is not a return: f borrows ra for a computed jump into
+# itself, and the instructions after it stay in f's context until its real ret
+    .text
+_start:
+    li t0, 100
+1:  call f
+    addi t0, t0, -1
+    bnez t0, 1b
+    li a7, 10
+    ecall
+
+f:
+    mv s1, ra
+    auipc ra, 0
+    jalr x0, 12(ra)         # To the addi below
+    addi a0, a0, 100        # Skipped
+    addi a0, a0, 1
+    addi a0, a0, 1
+    mv ra, s1
+    ret
@@ -0,0 +1,11 @@
+# Bounded RAM (run with --ram=64K): the image fills the RAM, and the compressed instruction in
+# its last halfword runs, its fetch does not read the word past the end of RAM
+    li a0, 1
+    jal ra, last
+    li a7, 10
+    ecall
+    .org 0xFFFA
+last:
+    c.li a1, 2
+    c.nop
+    c.jr ra                 # At 0xFFFE
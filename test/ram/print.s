@@ -0,0 +1,11 @@
+# Bounded RAM (run with --ram=64K): printing a string that runs past the end of RAM faults on
+# the ECALL instead of reading zeros
+    li t0, 0xFFFC
+    li t1, 0x41414141       # "AAAA" up to the end of RAM, no NUL
+    sw t1, 0(t0)
+    mv a0, t0
+    li a7, 4
+    ecall                   # Faults at 0x10000
+    li a1, 99
+    li a7, 10
+    ecall
@@ -0,0 +1,13 @@
+# Bounded RAM (run with --ram=64K): a store straddling two pages of RAM works, a store past
+# the end of RAM faults with the PC on it
+    li t0, 0x2FFE
+    li t1, 0x12345678
+    sw t1, 0(t0)            # Straddles 0x3000
+    lw a0, 0(t0)            # 0x12345678
+    lhu a1, 2(t0)           # 0x1234, from the second page
+    li t2, 0x10000          # First byte past RAM
+    li a2, 5
+    sw a2, 0(t2)            # Faults
+    li a2, 99
+    li a7, 10
+    ecall
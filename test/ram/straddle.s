@@ -0,0 +1,11 @@
+# Bounded RAM (run with --ram=64K): a store straddling the end of RAM faults as a whole,
+# although its first half is inside
+    li t0, 0xFFFE
+    li t1, -1
+    sh t1, 0(t0)            # Last halfword of RAM
+    lhu a0, 0(t0)           # 0xFFFF
+    li a1, 7
+    sw a1, 0(t0)            # Faults
+    li a1, 99
+    li a7, 10
+    ecall
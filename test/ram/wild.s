@@ -0,0 +1,14 @@
+# Bounded RAM (run with --ram=64K): the stack at the top of RAM works, then a stray load
+# faults precisely, with the PC on it and its destination left alone
+    addi sp, sp, -16
+    li t0, 0x1234
+    sw t0, 12(sp)           # Last word of RAM
+    lw a0, 12(sp)           # 0x1234
+    li t1, 0x10000          # First byte past RAM
+    li a1, 7
+    lw a1, -4(t1)           # The same word
+    li a2, 5
+    lw a2, 0(t1)            # Faults, a2 stays 5
+    li a2, 99
+    li a7, 10
+    ecall
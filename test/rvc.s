@@ -0,0 +1,74 @@
+# RV32C: every compressed instruction, 32-bit instructions at halfword-aligned addresses,
+# and the return address of C.JAL, C.JALR and a 32-bit JAL (each left as 0 in s2, s3, s4
+# when the link points right behind the call)
+    lui sp, 8
+    addi sp, sp, -64        # c.addi16sp
+    addi s0, sp, 16         # c.addi4spn
+    li a0, 21               # c.li
+    addi a0, a0, -1         # c.addi, a0 = 20
+    nop                     # c.nop
+    sw a0, 4(s0)            # c.sw
+    lw a1, 4(s0)            # c.lw, a1 = 20
+    sw a1, 8(sp)            # c.swsp
+    lw a2, 8(sp)            # c.lwsp, a2 = 20
+    slli a2, a2, 3          # c.slli, a2 = 160
+    add a2, a2, a1          # c.add, a2 = 180
+    lui a3, 0x1f            # c.lui
+    srli a3, a3, 4          # c.srli, a3 = 0x1F00
+    li a4, -64
+    srai a4, a4, 3          # c.srai, a4 = -8
+    andi a4, a4, 0x1c       # c.andi, a4 = 0x18
+    mv a5, a0               # c.mv
+    sub a5, a5, a4          # c.sub, a5 = -4
+    xor a3, a3, a1          # c.xor, a3 = 0x1F14
+    or a3, a3, a4           # c.or, a3 = 0x1F1C
+    and a1, a1, a4          # c.and, a1 = 0x10
+    add t3, t4, t5          # 32-bit at pc % 4 == 2, t3 = 0
+    addi t3, a2, 100        # 32-bit, t3 = 280
+    li s1, 10
+    li t4, 0
+loop:
+    add t4, t4, s1          # c.add
+    addi s1, s1, -1
+    bnez s1, loop           # c.bnez, t4 = 55
+    beqz s1, skip           # c.beqz, taken
+    li t4, 99
+skip:
+    j over                  # c.j
+    li t4, 98
+over:
+    blt t4, t3, less        # 32-bit branch
+    li t4, 97
+less:
+    jal double              # c.jal
+1:  auipc s2, 0
+    sub s2, ra, s2          # s2 = 0
+    mv t0, a0               # c.mv
+    addi t0, t0, 0
+    jal t1, tail            # 32-bit jal with rd = t1
+2:  auipc s4, 0
+    sub s4, t1, s4          # s4 = 0
+    jal call                # c.jal into a function that does c.jalr
+    li a7, 10
+    ecall
+
+double:
+    add a0, a0, a0          # a0 = 40
+    ret                     # c.jr
+
+tail:
+    addi t5, t0, 5          # t5 = 45
+    jr t1                   # c.jr
+
+call:
+    mv s5, ra
+    auipc t2, 0
+    addi t2, t2, 20         # t2 = leaf
+    jalr t2                 # c.jalr
+3:  auipc s3, 0
+    sub s3, t6, s3          # s3 = 0
+    mv ra, s5
+    ret
+leaf:
+    mv t6, ra               # Return address of the c.jalr
+    ret
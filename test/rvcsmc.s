@@ -0,0 +1,26 @@
+# Self-modifying RV32C code: the loop rewrites a compressed instruction and the upper half
+# of a 32-bit instruction that starts at a halfword-aligned address (so the store only hits
+# the halfword after its start) in its own block
+    li s0, 0
+    li s1, 0
+    li a2, 0
+    li t0, 2
+1:  auipc a3, 0
+    addi a3, a3, 10         # a3 = patch1
+    mv a4, a3
+    addi a4, a4, 6          # a4 = patch2 + 2
+loop:
+patch1:
+    li a0, 1                # Rewritten to li a0, 7
+    add s0, s0, a0          # s0 = 1 + 7
+patch2:
+    addi a1, a2, 100        # Rewritten to addi a1, a2, 200
+    add s1, s1, a1          # s1 = 100 + 200
+    li t1, 0x451D           # c.li a0, 7
+    sh t1, 0(a3)
+    li t1, 0xC86            # imm = 200, rs1[4:1] of a2
+    sh t1, 0(a4)
+    addi t0, t0, -1
+    bnez t0, loop
+    li a7, 10
+    ecall
@@ -0,0 +1,15 @@
+# Self-modifying code: the first pass executes the original ADDI, then
+# overwrites it so later passes must see the new instruction
+    li a0, 0
+    li t0, 0
+    la t1, patch
+    li t2, 0x06450513       # addi a0, a0, 100
+loop:
+patch:
+    addi a0, a0, 1
+    addi t0, t0, 1
+    sw t2, 0(t1)
+    li t3, 3
+    blt t0, t3, loop
+    li a7, 10
+    ecall
@@ -0,0 +1,22 @@
+# Sparse memory: touches addresses far above the loaded image, including the top of the
+# address space, a word straddling two pages and a read of memory that was never written
+    li t0, 0x80000000
+    li t1, 0x12345678
+    sw t1, 0(t0)
+    lw a0, 0(t0)            # a0 = 0x12345678
+    li t2, 0xFFFFFFFC
+    li t3, -2
+    sw t3, 0(t2)
+    lw a1, 0(t2)            # a1 = 0xFFFFFFFE
+    li t4, 0x00401FFE
+    li t5, 0xCAFEBABE
+    sw t5, 0(t4)            # Straddles 0x00401000
+    lw a2, 0(t4)            # a2 = 0xCAFEBABE
+    lhu a3, 2(t4)           # a3 = 0x0000CAFE, from the second page
+    li t6, 0x40000000
+    lw a4, 0(t6)            # a4 = 0, never written
+    addi sp, sp, -16        # sp starts at 0, the stack wraps to the top of memory
+    sw t1, 12(sp)
+    lw a5, 12(sp)           # a5 = 0x12345678
+    li a7, 10
+    ecall
@@ -0,0 +1,534 @@
+//
+// Ahead-of-time translator: turns a flat RV32IMC binary into C (one function per basic block)
+// and compiles it with the host compiler into a standalone program that prints and dumps the
+// registers exactly like riscv_sim does. The interpreter stays the reference, the translated
+// program is meant for repeat runs of guests that do not modify their own code (a store to
+// statically reachable code makes it exit with status 2). It has no f registers either,
+// reaching an RV32F or CSR instruction exits with status 2 as well.
+//
+#define _XOPEN_SOURCE 700 // fork and waitpid under -std=c99
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../include/decode.h"
+#include "../include/memory.h"
+#include "../include/predecode.h"
+
+// Runtime shared by every translated program, mirrors memory.c, handleECALL and register.c
+static const char *runtime =
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <sys/mman.h>\n"
+    "\n"
+    "#define NUM_REGS 32\n"
+    "\n"
+    "static uint32_t regs[NUM_REGS];\n"
+    "static uint8_t *mem; // The whole 32-bit guest space, the host kernel backs pages on first touch\n"
+    "static int halted;\n"
+    "\n"
+    "static uint32_t lb(uint32_t a)  { return (uint32_t)(int32_t)(int8_t)mem[a]; }\n"
+    "static uint32_t lh(uint32_t a)  { return (uint32_t)(int32_t)(int16_t)(mem[a] | (mem[a + 1] << 8)); }\n"
+    "static uint32_t lw(uint32_t a)  { return mem[a] | (mem[a + 1] << 8) | (mem[a + 2] << 16) | ((uint32_t)mem[a + 3] << 24); }\n"
+    "static uint32_t lbu(uint32_t a) { return mem[a]; }\n"
+    "static uint32_t lhu(uint32_t a) { return mem[a] | (mem[a + 1] << 8); }\n"
+    "static uint32_t divs(uint32_t a, uint32_t b) {\n"
+    "    return b == 0 ? UINT32_MAX : (a == 0x80000000u && b == UINT32_MAX) ? a : (uint32_t)((int32_t)a / (int32_t)b);\n"
+    "}\n"
+    "static uint32_t rems(uint32_t a, uint32_t b) {\n"
+    "    return b == 0 ? a : (a == 0x80000000u && b == UINT32_MAX) ? 0 : (uint32_t)((int32_t)a % (int32_t)b);\n"
+    "}\n"
+    "static void noFloat(uint32_t pc) {\n"
+    "    fprintf(stderr, \"RV32F instruction at 0x%08X, run this guest in riscv_sim\\n\", pc);\n"
+    "    exit(2);\n"
+    "}\n"
+    "static int ecall(void) {\n"
+    "    uint32_t a0 = regs[10];\n"
+    "    float f;\n"
+    "    switch (regs[17]) {\n"
+    "        case 1: printf(\"%d\", (int32_t)a0); break;\n"
+    "        case 2: memcpy(&f, &a0, sizeof(f)); printf(\"%f\", f); break;\n"
+    "        case 4: for (uint8_t c; (c = (uint8_t)lb(a0++)) != '\\0';) printf(\"%c\", c); break;\n"
+    "        case 10: case 93: halted = 1; return 1;\n"
+    "        case 11: printf(\"%c\", (char)a0); break;\n"
+    "        case 34: printf(\"0x%X\", a0); break;\n"
+    "        case 35: for (int i = 31; i >= 0; i--) printf(\"%c\", (a0 & (1U << i)) ? '1' : '0'); break;\n"
+    "        case 36: printf(\"%u\", a0); break;\n"
+    "        case 0x100: regs[10] = 0; break;\n" // ECALL_MARKER, no input outside the fork server
+    "        default: break;\n"
+    "    }\n"
+    "    return 0;\n"
+    "}\n"
+    "\n";
+
+// Stores, emitted after the image so they can refuse to modify translated code
+static const char *storeRuntime =
+    "static void codeWrite(uint32_t a) {\n"
+    "    fprintf(stderr, \"Store to translated code at 0x%08X, run this guest in riscv_sim\\n\", a);\n"
+    "    exit(2);\n"
+    "}\n"
+    "\n"
+    "static void sb(uint32_t a, uint32_t v) {\n"
+    "    if (a < END_PC && isCode[a >> 1]) codeWrite(a);\n"
+    "    mem[a] = v & 0xFF;\n"
+    "}\n"
+    "static void sh(uint32_t a, uint32_t v) { sb(a, v); sb(a + 1, v >> 8); }\n"
+    "static void sw(uint32_t a, uint32_t v) { sh(a, v); sh(a + 2, v >> 16); }\n"
+    "\n";
+
+// Main loop and register dump, same output as riscv_sim
+static const char *driver =
+    "\n"
+    "static const char *names[NUM_REGS] = {\n"
+    "    \"ZERO\", \"RA\", \"SP\", \"GP\", \"TP\", \"T0\", \"T1\", \"T2\",\n"
+    "    \"S0/FP\", \"S1\", \"A0\", \"A1\", \"A2\", \"A3\", \"A4\", \"A5\",\n"
+    "    \"A6\", \"A7\", \"S2\", \"S3\", \"S4\", \"S5\", \"S6\", \"S7\",\n"
+    "    \"S8\", \"S9\", \"S10\", \"S11\", \"T3\", \"T4\", \"T5\", \"T6\"\n"
+    "};\n"
+    "\n"
+    "int main(int argc, char *argv[]) {\n"
+    "    const char *name = argc > 1 ? argv[1] : GUEST_NAME;\n"
+    "    uint32_t pc = 0;\n"
+    "\n"
+    "    // 4 GiB plus a page, so a word access at 0xFFFFFFFF stays inside the mapping\n"
+    "    mem = mmap(NULL, ((size_t)1 << 32) + 4096, PROT_READ | PROT_WRITE,\n"
+    "               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n"
+    "    if (mem == MAP_FAILED) {\n"
+    "        perror(\"Guest memory reservation failed\");\n"
+    "        return 1;\n"
+    "    }\n"
+    "    memcpy(mem, image, sizeof(image));\n"
+    "    printf(\"Loaded %ld bytes into memory\\n\", (long)sizeof(image));\n"
+    "\n"
+    "    while (!halted && pc < END_PC) {\n"
+    "        if ((pc & 1) || !blockOf[pc >> 1]) {\n"
+    "            fprintf(stderr, \"No translated code at PC 0x%08X\\n\", pc);\n"
+    "            return 1;\n"
+    "        }\n"
+    "        pc = blockOf[pc >> 1](pc);\n"
+    "    }\n"
+    "    if (halted) {\n"
+    "        printf(\"Program halted by ECALL\\n\");\n"
+    "    }\n"
+    "\n"
+    "    for (int i = 0; i < NUM_REGS; i++) {\n"
+    "        printf(\"x%d (%s): 0x%08X\\n\", i, names[i], regs[i]);\n"
+    "    }\n"
+    "\n"
+    "    // <basename>-answer.res, like dumpRegisterContentsFile\n"
+    "    const char *dot = strrchr(name, '.');\n"
+    "    size_t len = dot ? (size_t)(dot - name) : strlen(name);\n"
+    "    char *dump = malloc(len + sizeof(\"-answer.res\"));\n"
+    "    if (!dump) {\n"
+    "        return 1;\n"
+    "    }\n"
+    "    memcpy(dump, name, len);\n"
+    "    strcpy(dump + len, \"-answer.res\");\n"
+    "\n"
+    "    FILE *file = fopen(dump, \"wb\");\n"
+    "    if (!file || fwrite(regs, sizeof(uint32_t), NUM_REGS, file) != NUM_REGS) {\n"
+    "        perror(\"Failed to write register to a file\\n\");\n"
+    "        free(dump);\n"
+    "        return 1;\n"
+    "    }\n"
+    "    fclose(file);\n"
+    "    free(dump);\n"
+    "    return 0;\n"
+    "}\n";
+
+static int endsBlock(op_t op) {
+    switch (op) {
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+        case OP_JAL: case OP_JALR: case OP_ECALL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Emits the C for one instruction at pc, control transfers return the next PC
+static void emitInstruction(FILE *out, const micro_op *op, uint32_t pc) {
+    static const char *branchCond[] = {
+        [OP_BEQ] = "regs[%u] == regs[%u]", [OP_BNE] = "regs[%u] != regs[%u]",
+        [OP_BLT] = "(int32_t)regs[%u] < (int32_t)regs[%u]", [OP_BGE] = "(int32_t)regs[%u] >= (int32_t)regs[%u]",
+        [OP_BLTU] = "regs[%u] < regs[%u]", [OP_BGEU] = "regs[%u] >= regs[%u]"
+    };
+    static const char *loads[] = {
+        [OP_LB] = "lb", [OP_LH] = "lh", [OP_LW] = "lw", [OP_LBU] = "lbu", [OP_LHU] = "lhu"
+    };
+    static const char *stores[] = { [OP_SB] = "sb", [OP_SH] = "sh", [OP_SW] = "sw" };
+
+    unsigned rd = op->rd, rs1 = op->rs1, rs2 = op->rs2;
+    uint32_t imm = (uint32_t)op->imm;
+    char expr[96];
+
+    expr[0] = '\0';
+    switch ((op_t)op->op) {
+        case OP_ADD:   snprintf(expr, sizeof(expr), "regs[%u] + regs[%u]", rs1, rs2); break;
+        case OP_SUB:   snprintf(expr, sizeof(expr), "regs[%u] - regs[%u]", rs1, rs2); break;
+        case OP_SLL:   snprintf(expr, sizeof(expr), "regs[%u] << (regs[%u] & 0x1F)", rs1, rs2); break;
+        case OP_SLT:   snprintf(expr, sizeof(expr), "(int32_t)regs[%u] < (int32_t)regs[%u]", rs1, rs2); break;
+        case OP_SLTU:  snprintf(expr, sizeof(expr), "regs[%u] < regs[%u]", rs1, rs2); break;
+        case OP_XOR:   snprintf(expr, sizeof(expr), "regs[%u] ^ regs[%u]", rs1, rs2); break;
+        case OP_SRL:   snprintf(expr, sizeof(expr), "regs[%u] >> (regs[%u] & 0x1F)", rs1, rs2); break;
+        case OP_SRA:   snprintf(expr, sizeof(expr), "(uint32_t)((int32_t)regs[%u] >> (regs[%u] & 0x1F))", rs1, rs2); break;
+        case OP_OR:    snprintf(expr, sizeof(expr), "regs[%u] | regs[%u]", rs1, rs2); break;
+        case OP_AND:   snprintf(expr, sizeof(expr), "regs[%u] & regs[%u]", rs1, rs2); break;
+
+        case OP_MUL:    snprintf(expr, sizeof(expr), "regs[%u] * regs[%u]", rs1, rs2); break;
+        case OP_MULH:   snprintf(expr, sizeof(expr), "(uint32_t)(((int64_t)(int32_t)regs[%u] * (int32_t)regs[%u]) >> 32)", rs1, rs2); break;
+        case OP_MULHSU: snprintf(expr, sizeof(expr), "(uint32_t)(((int64_t)(int32_t)regs[%u] * (int64_t)regs[%u]) >> 32)", rs1, rs2); break;
+        case OP_MULHU:  snprintf(expr, sizeof(expr), "(uint32_t)(((uint64_t)regs[%u] * regs[%u]) >> 32)", rs1, rs2); break;
+        case OP_DIV:    snprintf(expr, sizeof(expr), "divs(regs[%u], regs[%u])", rs1, rs2); break;
+        case OP_DIVU:   snprintf(expr, sizeof(expr), "regs[%u] ? regs[%u] / regs[%u] : UINT32_MAX", rs2, rs1, rs2); break;
+        case OP_REM:    snprintf(expr, sizeof(expr), "rems(regs[%u], regs[%u])", rs1, rs2); break;
+        case OP_REMU:   snprintf(expr, sizeof(expr), "regs[%u] ? regs[%u] %% regs[%u] : regs[%u]", rs2, rs1, rs2, rs1); break;
+
+        case OP_ADDI:  snprintf(expr, sizeof(expr), "regs[%u] + 0x%08Xu", rs1, imm); break;
+        case OP_SLTI:  snprintf(expr, sizeof(expr), "(int32_t)regs[%u] < (int32_t)0x%08Xu", rs1, imm); break;
+        case OP_SLTIU: snprintf(expr, sizeof(expr), "regs[%u] < 0x%08Xu", rs1, imm); break;
+        case OP_XORI:  snprintf(expr, sizeof(expr), "regs[%u] ^ 0x%08Xu", rs1, imm); break;
+        case OP_ORI:   snprintf(expr, sizeof(expr), "regs[%u] | 0x%08Xu", rs1, imm); break;
+        case OP_ANDI:  snprintf(expr, sizeof(expr), "regs[%u] & 0x%08Xu", rs1, imm); break;
+        case OP_SLLI:  snprintf(expr, sizeof(expr), "regs[%u] << %u", rs1, imm); break;
+        case OP_SRLI:  snprintf(expr, sizeof(expr), "regs[%u] >> %u", rs1, imm); break;
+        case OP_SRAI:  snprintf(expr, sizeof(expr), "(uint32_t)((int32_t)regs[%u] >> %u)", rs1, imm); break;
+
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU:
+            snprintf(expr, sizeof(expr), "%s(regs[%u] + 0x%08Xu)", loads[op->op], rs1, imm);
+            break;
+
+        case OP_LUI:   snprintf(expr, sizeof(expr), "0x%08Xu", imm); break;
+        case OP_AUIPC: snprintf(expr, sizeof(expr), "0x%08Xu", pc + imm); break;
+
+        case OP_SB: case OP_SH: case OP_SW:
+            fprintf(out, "        %s(regs[%u] + 0x%08Xu, regs[%u]);\n", stores[op->op], rs1, imm, rs2);
+            return;
+
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+            fprintf(out, "        return (");
+            fprintf(out, branchCond[op->op], rs1, rs2);
+            fprintf(out, ") ? 0x%08Xu : 0x%08Xu;\n", pc + imm, pc + op->len);
+            return;
+
+        case OP_JAL:
+            if (rd != ZERO) {
+                fprintf(out, "        regs[%u] = 0x%08Xu;\n", rd, pc + op->len);
+            }
+            fprintf(out, "        return 0x%08Xu;\n", pc + imm);
+            return;
+
+        case OP_JALR: // Target is read before rd is written, rd may equal rs1
+            fprintf(out, "        { uint32_t t = (regs[%u] + 0x%08Xu) & ~1u;", rs1, imm);
+            if (rd != ZERO) {
+                fprintf(out, " regs[%u] = 0x%08Xu;", rd, pc + op->len);
+            }
+            fprintf(out, " return t; }\n");
+            return;
+
+        case OP_ECALL: // A halting ECALL leaves the PC on itself
+            fprintf(out, "        if (ecall()) return 0x%08Xu;\n", pc);
+            fprintf(out, "        return 0x%08Xu;\n", pc + op->len);
+            return;
+
+        default:
+            if (op->op >= OP_CSRRW && op->op <= OP_FCLASS) {
+                fprintf(out, "        noFloat(0x%08Xu);\n", pc);
+            } else {
+                fprintf(out, "        /* illegal, skipped */\n");
+            }
+            return;
+    }
+
+    // x0 stays zero, and nothing above has side effects apart from the register write
+    if (rd != ZERO) {
+        fprintf(out, "        regs[%u] = %s;\n", rd, expr);
+    }
+}
+
+// Marks the instructions reachable from the entry point through static control flow (plus
+// the return point of every call), ops and reach are indexed by halfword
+static void markReachable(const micro_op *ops, uint32_t halves, uint8_t *reach) {
+    uint32_t *work = (uint32_t *)malloc((halves + 1) * sizeof(uint32_t));
+    uint32_t top = 0;
+    if (!work) {
+        memset(reach, 1, halves); // Conservative, every halfword starts code
+        return;
+    }
+
+    if (halves) {
+        work[top++] = 0;
+        reach[0] = 1;
+    }
+    while (top) {
+        uint32_t i = work[--top];
+        op_t op = (op_t)ops[i].op;
+        uint32_t next[2];
+        int n = 0;
+
+        // Everything continues sequentially except plain jumps, a call's return point counts too
+        if (!((op == OP_JAL || op == OP_JALR) && ops[i].rd == ZERO)) {
+            next[n++] = i + ops[i].len / 2;
+        }
+        if (op == OP_JAL || (op >= OP_BEQ && op <= OP_BGEU)) {
+            uint32_t target = i * 2 + (uint32_t)ops[i].imm;
+            if ((target & 1) == 0) {
+                next[n++] = target >> 1;
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            if (next[k] < halves && !reach[next[k]]) {
+                reach[next[k]] = 1;
+                work[top++] = next[k];
+            }
+        }
+    }
+    free(work);
+}
+
+// Writes the translated program for image[0, size) as C
+static int emitProgram(FILE *out, const uint8_t *image, uint32_t size, const char *guestName) {
+    // RV32C instructions may start at any halfword, so everything is indexed by halfword
+    uint32_t halves = (size + 1) / 2;
+    micro_op *ops = (micro_op *)calloc(halves ? halves : 1, sizeof(micro_op));
+    uint8_t *start = (uint8_t *)calloc(halves + 1, 1);
+    uint8_t *leader = (uint8_t *)calloc(halves + 2, 1);
+    uint8_t *code = (uint8_t *)calloc(halves + 2, 1);
+    uint32_t *owner = (uint32_t *)calloc(halves ? halves : 1, sizeof(uint32_t));
+    if (!ops || !start || !leader || !code || !owner) {
+        free(ops);
+        free(start);
+        free(leader);
+        free(code);
+        free(owner);
+        return -1;
+    }
+
+    // Decode at every halfword with the simulator's own decoder
+    for (uint32_t i = 0; i < halves; i++) {
+        uint32_t instr = 0;
+        for (uint32_t b = 0; b < 4 && i * 2 + b < size; b++) {
+            instr |= (uint32_t)image[i * 2 + b] << (8 * b);
+        }
+        ops[i] = resolveMicroOp(decodeInstruction(instr));
+    }
+
+    // Instruction starts: a linear sweep from the entry point (every word of an RV32I image),
+    // plus whatever static control flow reaches, stores to reachable code are self-modifying
+    for (uint32_t i = 0; i < halves; i += ops[i].len / 2) {
+        start[i] = 1;
+    }
+    markReachable(ops, halves, code);
+    for (uint32_t i = halves; i-- > 0;) {
+        if (code[i]) {
+            start[i] = 1;
+            if (ops[i].len == 4) {
+                code[i + 1] = 1; // The upper half belongs to the same instruction
+            }
+        }
+    }
+
+    leader[0] = 1;
+    for (uint32_t i = 0; i < halves; i++) {
+        op_t op = (op_t)ops[i].op;
+        if (!start[i] || !endsBlock(op)) {
+            continue;
+        }
+        leader[i + ops[i].len / 2] = 1;
+        if (op != OP_JALR && op != OP_ECALL) {
+            uint32_t target = i * 2 + (uint32_t)ops[i].imm;
+            if (target < size && (target & 1) == 0 && start[target >> 1]) {
+                leader[target >> 1] = 1;
+            }
+        }
+    }
+
+    fprintf(out, "// Translated from %s by riscv_aot, do not edit\n", guestName);
+    fprintf(out, "%s", runtime);
+
+    fprintf(out, "#define END_PC 0x%08Xu\n", size);
+    fprintf(out, "#define GUEST_NAME \"");
+    for (const char *c = guestName; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*c, out);
+    }
+    fprintf(out, "\"\n\nstatic const uint8_t image[%u] = {", size ? size : 1);
+    for (uint32_t i = 0; i < size; i++) {
+        fprintf(out, "%s0x%02X,", (i % 16) ? " " : "\n    ", image[i]);
+    }
+    fprintf(out, "%s\n};\n\n", size ? "" : " 0");
+
+    fprintf(out, "static const uint8_t isCode[%u] = {", halves ? halves : 1);
+    for (uint32_t i = 0; i < halves; i++) {
+        fprintf(out, "%s%u,", (i % 32) ? "" : "\n    ", code[i]);
+    }
+    fprintf(out, "%s\n};\n\n", halves ? "" : " 0");
+    fprintf(out, "%s", storeRuntime);
+
+    // One function per basic block, entered at any of its instructions so that indirect
+    // JALR targets inside a block still work
+    for (uint32_t i = 0; i < halves; i++) {
+        if (!leader[i] || !start[i]) {
+            continue;
+        }
+        fprintf(out, "static uint32_t bb_%08X(uint32_t pc) {\n    switch (pc) {\n", i * 2);
+
+        uint32_t j = i;
+        uint32_t next;
+        for (;;) {
+            fprintf(out, "    case 0x%08Xu: // %s\n", j * 2, opName((op_t)ops[j].op));
+            emitInstruction(out, &ops[j], j * 2);
+            owner[j] = i + 1;
+            next = j * 2 + ops[j].len;
+            if (endsBlock((op_t)ops[j].op)) {
+                break; // Not reached, the terminator returned already
+            }
+            j += ops[j].len / 2;
+            if (j >= halves || leader[j] || !start[j]) {
+                break; // Fall through into the next block (or off the end of the program)
+            }
+        }
+
+        fprintf(out, "    }\n    return 0x%08Xu;\n}\n\n", next);
+    }
+
+    // Dispatch table: the block function containing each instruction, none inside one
+    fprintf(out, "static uint32_t (*const blockOf[%u])(uint32_t) = {\n", halves ? halves : 1);
+    for (uint32_t i = 0; i < halves; i++) {
+        if (owner[i]) {
+            fprintf(out, "    bb_%08X,\n", (owner[i] - 1) * 2);
+        } else {
+            fprintf(out, "    0,\n");
+        }
+    }
+    fprintf(out, "};\n");
+    fprintf(out, "%s", driver);
+
+    free(ops);
+    free(start);
+    free(leader);
+    free(code);
+    free(owner);
+    return 0;
+}
+
+
+// Runs the host compiler ($CC, a single program, or cc) on cPath without a shell, so the paths
+// reach it as they are. Returns 0 when it succeeded
+static int compileC(const char *cPath, const char *output) {
+    const char *cc = getenv("CC");
+    char *const args[] = { (char *)(cc && *cc ? cc : "cc"), "-O2", "-w", "-o", (char *)output, (char *)cPath, NULL };
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = NULL;
+    const char *output = NULL;
+    int keepC = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--keep-c") == 0) {
+            keepC = 1;
+        } else if (!input) {
+            input = argv[i];
+        } else {
+            output = argv[i];
+        }
+    }
+
+    if (!input || !output) {
+        printf("Usage: %s [--keep-c] <binary_file> <output_executable>\n", argv[0]);
+        printf("Compiles with $CC (default cc), the C source is kept as <output_executable>.c with --keep-c\n");
+        return 1;
+    }
+
+    FILE *file = fopen(input, "rb");
+    if (!file) {
+        perror("Failed to open file");
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (fsize < 0 || fsize > (long)UINT32_MAX) {
+        fprintf(stderr, "File too big\n");
+        fclose(file);
+        return 1;
+    }
+
+    uint8_t *image = (uint8_t *)malloc(fsize ? (size_t)fsize : 1);
+    if (!image || fread(image, 1, (size_t)fsize, file) != (size_t)fsize) {
+        fprintf(stderr, "Failed to read %s\n", input);
+        free(image);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    size_t pathLen = strlen(output) + 5;
+    char *cPath = (char *)malloc(pathLen);
+    if (!cPath) {
+        free(image);
+        return 1;
+    }
+    snprintf(cPath, pathLen, "%s%s.c", output[0] == '-' ? "./" : "", output); // Not an option to the compiler
+
+    FILE *out = fopen(cPath, "w");
+    if (!out) {
+        perror("Failed to create C output");
+        free(cPath);
+        free(image);
+        return 1;
+    }
+    int emitted = emitProgram(out, image, (uint32_t)fsize, input);
+    fclose(out);
+    free(image);
+
+    if (emitted != 0) {
+        fprintf(stderr, "Translation failed\n");
+        free(cPath);
+        return 1;
+    }
+
+    int status = compileC(cPath, output);
+    if (status != 0) {
+        fprintf(stderr, "Host compiler failed on %s\n", cPath);
+    }
+    if (!keepC) {
+        remove(cPath);
+    }
+
+    free(cPath);
+    return status == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+//
+// Host-throughput benchmark: runs guest kernels (bench/*.bin) on each engine and prints one
+// machine-readable row per kernel and engine with the instructions retired, the wall time of
+// the best run, MIPS and host cycles per guest instruction. Loading is not timed, guest
+// console output is formatted and sent to /dev/null. A kernel with a <name>.res next to it
+// is also checked, so a fast but wrong engine does not go unnoticed.
+//
+#define _POSIX_C_SOURCE 200809L // clock_gettime under -std=c99
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/registers.h"
+#include "../include/sim.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+typedef struct {
+    const char *kernel;
+    engine_t engine;
+    uint64_t instructions;
+    double seconds;
+    double cycles;        // Time stamp counter ticks, negative when the host has none
+    const char *status;   // "ok", "mismatch", "no-res" or "error"
+} bench_result;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t nowCycles(void) {
+#if HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Reads <kernel without extension>.res, returns 1 when it holds a full register file
+static int loadExpected(const char *path, uint32_t *regs) {
+    char *resPath = makeSiblingFilename(path, ".res");
+    FILE *file = resPath ? fopen(resPath, "rb") : NULL;
+    int ok = file && fread(regs, sizeof(uint32_t), NUM_REGS, file) == NUM_REGS;
+    if (file) {
+        fclose(file);
+    }
+    free(resPath);
+    return ok;
+}
+
+// Kernel name for the report, the file name without directory and extension
+static void kernelName(const char *path, char *name, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(name, size, "%s", base);
+    char *dot = strrchr(name, '.');
+    if (dot) {
+        *dot = '\0';
+    }
+}
+
+static void benchKernel(const char *path, engine_t engine, unsigned repeat, FILE *console, bench_result *r) {
+    sim_config config;
+    sim_default_config(&config);
+    config.engine = engine;
+    config.console = console;
+
+    r->engine = engine;
+    r->instructions = 0;
+    r->seconds = 0;
+    r->cycles = -1;
+    r->status = "error";
+
+    Sim *sim = sim_create(&config);
+    if (!sim) {
+        return;
+    }
+
+    for (unsigned i = 0; i < repeat; i++) {
+        if (sim_load(sim, path) != 0) {
+            sim_destroy(sim);
+            return;
+        }
+        uint64_t startCycles = nowCycles();
+        double start = nowSeconds();
+        halt_reason halt = sim_run(sim, 0);
+        double seconds = nowSeconds() - start;
+        uint64_t cycles = nowCycles() - startCycles;
+
+        if (halt == HALT_ERROR) {
+            sim_destroy(sim);
+            return;
+        }
+        if (i == 0 || seconds < r->seconds) {
+            r->seconds = seconds;
+            r->cycles = HAVE_CYCLES ? (double)cycles : -1;
+        }
+        r->instructions = sim->hart.retired;
+    }
+
+    uint32_t expected[NUM_REGS];
+    if (!loadExpected(path, expected)) {
+        r->status = "no-res";
+    } else if (memcmp(expected, sim->hart.regs, sizeof(expected)) == 0) {
+        r->status = "ok";
+    } else {
+        r->status = "mismatch";
+    }
+    sim_destroy(sim);
+}
+
+static void printResult(const bench_result *r, int json, FILE *out) {
+    double mips = r->seconds > 0 ? r->instructions / r->seconds / 1e6 : 0.0;
+    double cpi = r->cycles >= 0 && r->instructions ? r->cycles / (double)r->instructions : -1;
+
+    if (json) {
+        fprintf(out, "{\"kernel\":\"%s\",\"engine\":\"%s\",\"instructions\":%llu,\"seconds\":%.6f,"
+                     "\"mips\":%.2f,\"cycles_per_instr\":", r->kernel, engineName(r->engine),
+                (unsigned long long)r->instructions, r->seconds, mips);
+        if (cpi >= 0) {
+            fprintf(out, "%.2f", cpi);
+        } else {
+            fprintf(out, "null");
+        }
+        fprintf(out, ",\"status\":\"%s\"}\n", r->status);
+    } else {
+        fprintf(out, "%s,%s,%llu,%.6f,%.2f,", r->kernel, engineName(r->engine),
+                (unsigned long long)r->instructions, r->seconds, mips);
+        if (cpi >= 0) {
+            fprintf(out, "%.2f", cpi);
+        }
+        fprintf(out, ",%s\n", r->status);
+    }
+    fflush(out);
+}
+
+int main(int argc, char *argv[]) {
+    engine_t engines[] = { ENGINE_REFERENCE, ENGINE_PREDECODE, ENGINE_THREADED, ENGINE_BLOCK, ENGINE_JIT };
+    int engineCount = JIT_AVAILABLE ? 5 : 4;
+    unsigned repeat = 3;
+    int json = 0;
+    int kernels = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            if (strcmp(argv[i] + 9, "all") == 0) {
+                continue;
+            }
+            if (parseEngine(argv[i] + 9, &engines[0]) != 0) {
+                fprintf(stderr, "Unknown engine '%s'\n", argv[i] + 9);
+                return 1;
+            }
+            engineCount = 1;
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            repeat = (unsigned)strtoul(argv[i] + 9, NULL, 0);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            kernels++;
+        }
+    }
+
+    if (kernels == 0 || repeat == 0) {
+        printf("Usage: %s [--engine=NAME|all] [--repeat=N] [--json] <kernel.bin>...\n", argv[0]);
+        printf("Prints CSV (or JSON lines) with the best of N runs (default 3) per kernel and engine\n");
+        return 1;
+    }
+
+    FILE *console = fopen("/dev/null", "w");
+    if (!console) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    if (!json) {
+        printf("kernel,engine,instructions,seconds,mips,cycles_per_instr,status\n");
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            continue;
+        }
+        char name[256];
+        kernelName(argv[i], name, sizeof(name));
+        for (int e = 0; e < engineCount; e++) {
+            bench_result r;
+            r.kernel = name;
+            benchKernel(argv[i], engines[e], repeat, console, &r);
+            printResult(&r, json, stdout);
+            failed |= strcmp(r.status, "ok") != 0 && strcmp(r.status, "no-res") != 0;
+        }
+    }
+
+    fclose(console);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+//
+// Offline trace decoder: prints a trace written by `riscv_sim --trace=FILE` as one line of
+// disassembly per retired instruction, with the value written to rd and the memory access.
+// --regs=FILE writes the register file rebuilt from the trace in the .res format, which
+// matches the simulator's final registers for a complete trace.
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/decode.h"
+#include "../include/predecode.h"
+#include "../include/trace.h"
+
+static void disassemble(char *buf, size_t size, uint32_t pc, uint32_t word) {
+    micro_op op = resolveMicroOp(decodeInstruction(word));
+    const char *name = opName((op_t)op.op);
+
+    switch ((op_t)op.op) {
+        case OP_ADD: case OP_SUB: case OP_SLL: case OP_SLT: case OP_SLTU:
+        case OP_XOR: case OP_SRL: case OP_SRA: case OP_OR: case OP_AND:
+        case OP_MUL: case OP_MULH: case OP_MULHSU: case OP_MULHU:
+        case OP_DIV: case OP_DIVU: case OP_REM: case OP_REMU:
+            snprintf(buf, size, "%-6s x%u, x%u, x%u", name, op.rd, op.rs1, op.rs2);
+            break;
+        case OP_ADDI: case OP_SLTI: case OP_SLTIU: case OP_XORI: case OP_ORI: case OP_ANDI:
+        case OP_SLLI: case OP_SRLI: case OP_SRAI:
+            snprintf(buf, size, "%-6s x%u, x%u, %d", name, op.rd, op.rs1, (int)op.imm);
+            break;
+        case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: case OP_JALR:
+            snprintf(buf, size, "%-6s x%u, %d(x%u)", name, op.rd, (int)op.imm, op.rs1);
+            break;
+        case OP_SB: case OP_SH: case OP_SW:
+            snprintf(buf, size, "%-6s x%u, %d(x%u)", name, op.rs2, (int)op.imm, op.rs1);
+            break;
+        case OP_LUI: case OP_AUIPC:
+            snprintf(buf, size, "%-6s x%u, 0x%X", name, op.rd, (uint32_t)op.imm >> 12);
+            break;
+        case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGE: case OP_BLTU: case OP_BGEU:
+            snprintf(buf, size, "%-6s x%u, x%u, 0x%08X", name, op.rs1, op.rs2, pc + op.imm);
+            break;
+        case OP_JAL:
+            snprintf(buf, size, "%-6s x%u, 0x%08X", name, op.rd, pc + op.imm);
+            break;
+        case OP_CSRRW: case OP_CSRRS: case OP_CSRRC:
+            snprintf(buf, size, "%-6s x%u, 0x%03X, x%u", name, op.rd, (uint32_t)op.imm, op.rs1);
+            break;
+        case OP_CSRRWI: case OP_CSRRSI: case OP_CSRRCI:
+            snprintf(buf, size, "%-6s x%u, 0x%03X, %u", name, op.rd, (uint32_t)op.imm, op.rs1);
+            break;
+        case OP_FLW:
+            snprintf(buf, size, "%-6s f%u, %d(x%u)", name, op.rd, (int)op.imm, op.rs1);
+            break;
+        case OP_FSW:
+            snprintf(buf, size, "%-6s f%u, %d(x%u)", name, op.rs2, (int)op.imm, op.rs1);
+            break;
+        case OP_FADD: case OP_FSUB: case OP_FMUL: case OP_FDIV:
+        case OP_FSGNJ: case OP_FSGNJN: case OP_FSGNJX: case OP_FMIN: case OP_FMAX:
+            snprintf(buf, size, "%-6s f%u, f%u, f%u", name, op.rd, op.rs1, op.rs2);
+            break;
+        case OP_FMADD: case OP_FMSUB: case OP_FNMSUB: case OP_FNMADD:
+            snprintf(buf, size, "%-6s f%u, f%u, f%u, f%u", name, op.rd, op.rs1, op.rs2, op.rs3);
+            break;
+        case OP_FSQRT:
+            snprintf(buf, size, "%-6s f%u, f%u", name, op.rd, op.rs1);
+            break;
+        case OP_FCVT_W_S: case OP_FCVT_WU_S: case OP_FMV_X_W: case OP_FCLASS:
+            snprintf(buf, size, "%-6s x%u, f%u", name, op.rd, op.rs1);
+            break;
+        case OP_FCVT_S_W: case OP_FCVT_S_WU: case OP_FMV_W_X:
+            snprintf(buf, size, "%-6s f%u, x%u", name, op.rd, op.rs1);
+            break;
+        case OP_FEQ: case OP_FLT: case OP_FLE:
+            snprintf(buf, size, "%-6s x%u, f%u, f%u", name, op.rd, op.rs1, op.rs2);
+            break;
+        default:
+            snprintf(buf, size, "%s", name);
+            break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = NULL;
+    const char *regsPath = NULL;
+    uint64_t limit = 0;
+    int print = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--limit=", 8) == 0) {
+            limit = strtoull(argv[i] + 8, NULL, 0);
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            print = 0;
+        } else if (strncmp(argv[i], "--regs=", 7) == 0) {
+            regsPath = argv[i] + 7;
+        } else {
+            input = argv[i];
+        }
+    }
+
+    if (!input) {
+        printf("Usage: %s [--limit=N] [--quiet] [--regs=FILE] <trace_file>\n", argv[0]);
+        printf("Prints every record (the first N with --limit, none with --quiet)\n");
+        return 1;
+    }
+
+    TraceReader reader;
+    if (traceReaderOpen(&reader, input) != 0) {
+        return 1;
+    }
+
+    trace_record rec;
+    uint64_t count = 0;
+    char text[64];
+    int status;
+
+    while ((status = traceRead(&reader, &rec)) == 1) {
+        if (print && (limit == 0 || count < limit)) {
+            disassemble(text, sizeof(text), rec.pc, rec.word);
+            if (isCompressed(rec.word)) { // Shown as its 32-bit expansion
+                printf("%10llu  %08X:     %04X  %-28s", (unsigned long long)count, rec.pc, rec.word, text);
+            } else {
+                printf("%10llu  %08X: %08X  %-28s", (unsigned long long)count, rec.pc, rec.word, text);
+            }
+            if (rec.flags & TRACE_RD) {
+                printf("  x%u=0x%08X", traceRd(rec.word), rec.rdValue);
+            }
+            if (rec.flags & TRACE_STORE) {
+                printf("  [0x%08X]<-0x%X", rec.memAddr, rec.memValue);
+            } else if (rec.flags & TRACE_MEM) {
+                printf("  [0x%08X]", rec.memAddr);
+            }
+            printf("\n");
+        }
+        count++;
+    }
+    if (status < 0) {
+        fprintf(stderr, "%s: corrupt record %llu\n", input, (unsigned long long)count);
+    }
+    fprintf(stderr, "%llu instructions\n", (unsigned long long)count);
+
+    if (regsPath) {
+        FILE *file = fopen(regsPath, "wb");
+        if (!file || fwrite(reader.codec.regs, sizeof(uint32_t), 32, file) != 32) {
+            perror(regsPath);
+            status = -1;
+        }
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    traceReaderClose(&reader);
+    return status < 0 ? 1 : 0;
+}